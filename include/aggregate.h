@@ -0,0 +1,119 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#ifndef _AGGREGATE_H
+#define _AGGREGATE_H
+
+#include "default.h"
+#include "cbxpkt.h"
+#include "macset.h"
+#include "presence.h"
+
+/*******************************
+ * Types
+ ******************************/
+
+typedef struct {
+  uint8_t mac[6];               /* The sender address of the transmitter */
+  char api_key[CBX_PKT_LEGACY_API_KEY_SIZE]; /* The API key of the transmitter */
+  int64_t last_frame;           /* When the last frame arrived, in microseconds */
+  uint8_t chain_no;             /* The chain number of the last frame */
+} aggregate_node_t;
+
+/* Gateway side table keyed on the MAC, which merges the measurements of all
+ * the transmitters and chained packets within one upload window. Works like
+ * the mac_set, open addressing with an epoch so clearing is O(1), the other
+ * arrays hold the per MAC data of the occupied slots. The uploaded entries
+ * are removed by shifting the ones after them back, there are no tombstones */
+typedef struct {
+  uint64_t keys[GLOBAL_AGGREGATE_CAPACITY];
+  uint16_t epochs[GLOBAL_AGGREGATE_CAPACITY];
+  uint32_t first_seen[GLOBAL_AGGREGATE_CAPACITY]; /* Unix time in seconds */
+  uint32_t last_seen[GLOBAL_AGGREGATE_CAPACITY];  /* Unix time in seconds */
+  uint16_t seen_by[GLOBAL_AGGREGATE_CAPACITY];    /* Bitmap of node indices */
+  uint32_t frames[GLOBAL_AGGREGATE_CAPACITY];     /* Frames seen, 0 from legacy payloads */
+  int32_t rssi_sum[GLOBAL_AGGREGATE_CAPACITY];    /* The average RSSI times the frames */
+  int8_t rssi_max[GLOBAL_AGGREGATE_CAPACITY];
+  uint16_t channels[GLOBAL_AGGREGATE_CAPACITY];   /* Bit (channel - 1) per channel */
+  uint16_t epoch;
+  size_t size;
+  aggregate_node_t nodes[GLOBAL_AGGREGATE_MAX_NODES];
+  size_t node_count;
+  uint32_t dropped;             /* Measurements dropped, table full */
+  uint32_t lost_parts;          /* Chained packets which never arrived */
+} aggregate_t;
+
+/*******************************
+ * Function prototypes
+ ******************************/
+
+/**
+ * Initializes an aggregation table, must be called before first use
+ * 
+ * @param agg the table to be initialized
+ */
+void aggregate_init(aggregate_t *agg);
+
+/**
+ * Registers an received packet, looks up (or adds) the node which sent it
+ *  and keeps track of the chain, so missing chained packets are counted
+ * 
+ * @param agg the table
+ * @param pkt the parsed packet
+ * @param now the current time in microseconds
+ * @return the node index, or -1 if there is no room for another node
+ */
+int32_t aggregate_frame(aggregate_t *agg, const cbx_pkt_t *pkt, int64_t now);
+
+/**
+ * Merges an measurement into the table
+ * 
+ * @param agg the table
+ * @param node the node index returned by aggregate_frame
+ * @param mac the mac address (6 bytes)
+ * @param record the presence record, with the times in unix seconds
+ * @return false if the table is full
+ */
+bool aggregate_insert(aggregate_t *agg, int32_t node, const uint8_t *mac, const presence_record_t *record);
+
+/**
+ * Checks if an transmitter sent an frame recently, meaning an chain may
+ *  still be in progress and the window should not be cut yet
+ * 
+ * @param agg the table
+ * @param now the current time in microseconds
+ */
+bool aggregate_busy(const aggregate_t *agg, int64_t now);
+
+/**
+ * Releases the measurements of the transmitters whose upload succeeded, the
+ *  others are kept to be uploaded again, once none are left the table is
+ *  cleared
+ * 
+ * @param agg the table
+ * @param node_mask the bitmap of the transmitters whose upload succeeded
+ * @param now the current time in microseconds
+ */
+void aggregate_release(aggregate_t *agg, uint16_t node_mask, int64_t now);
+
+/**
+ * Removes all the measurements from the table, the nodes which have not
+ *  sent an frame within the node timeout are forgotten
+ * 
+ * @param agg the table to be cleared
+ * @param now the current time in microseconds
+ */
+void aggregate_clear(aggregate_t *agg, int64_t now);
+
+/**
+ * Checks if an slot of the table holds an measurement
+ * 
+ * @param agg the table
+ * @param slot the slot index
+ */
+static inline bool aggregate_used(const aggregate_t *agg, size_t slot) {
+  return agg->epochs[slot] == agg->epoch;
+}
+
+#endif
@@ -0,0 +1,126 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#ifndef _BINLOG_H
+#define _BINLOG_H
+
+#include "default.h"
+
+#include <atomic>
+
+/*******************************
+ * Definitions
+ ******************************/
+
+/* An log record is stored as an format ID plus up to eight integer
+ * arguments, and written to the serial console as: '#L' followed by the
+ * hex of [id] [argc] [time_us (u32)] [args (u32) ...], all integers are
+ * little endian, the time wraps around every 71 minutes */
+#define BINLOG_MAX_ARGS 8
+#define BINLOG_RECORD_MAX_SIZE (6 + BINLOG_MAX_ARGS * 4)
+
+/* Turns an MAC address into the two arguments printed by '%M' */
+#define BINLOG_MAC(MAC) \
+  (static_cast<uint32_t>((MAC)[0]) << 16 | static_cast<uint32_t>((MAC)[1]) << 8 | (MAC)[2]), \
+  (static_cast<uint32_t>((MAC)[3]) << 16 | static_cast<uint32_t>((MAC)[4]) << 8 | (MAC)[5])
+
+/* Writes an log record, when the format is filtered out by its level or
+ * module the call, including the evaluation of the arguments, is compiled
+ * away. Never blocks, the record is dropped when the ring is full */
+#define BINLOG(NAME, ...) do { \
+  if (BINLOG_ENABLED_##NAME) binlog_write(BINLOG_##NAME, ##__VA_ARGS__); \
+} while (0)
+
+/*******************************
+ * Types
+ ******************************/
+
+typedef enum {
+  BINLOG_LEVEL_DEBUG,
+  BINLOG_LEVEL_INFO,
+  BINLOG_LEVEL_WARN,
+  BINLOG_LEVEL_ERROR
+} binlog_level_t;
+
+typedef enum {
+  BINLOG_MODULE_SYSTEM,         /* The logger itself */
+  BINLOG_MODULE_CAPTURE,        /* Sniffing and deduplication */
+  BINLOG_MODULE_LORA,           /* Transmitting and receiving packets */
+  BINLOG_MODULE_PKT,            /* The packet contents */
+  BINLOG_MODULE_SERVER,         /* The server connection */
+  BINLOG_MODULE_HTTP            /* The API uploads */
+} binlog_module_t;
+
+#define BINLOG_MODULE_ALL 0xFF
+
+/* The format IDs, and whether each of them passes the compile-time filter */
+#define BINLOG_FORMAT(NAME, MODULE, LEVEL, FORMAT) BINLOG_##NAME,
+typedef enum {
+  #include "binlog_formats.h"
+  BINLOG_FORMAT_COUNT
+} binlog_format_t;
+#undef BINLOG_FORMAT
+
+#define BINLOG_FORMAT(NAME, MODULE, LEVEL, FORMAT) \
+  BINLOG_ENABLED_##NAME = BINLOG_LEVEL_##LEVEL >= GLOBAL_LOG_LEVEL \
+    && ((GLOBAL_LOG_MODULES >> BINLOG_MODULE_##MODULE) & 1),
+enum {
+  #include "binlog_formats.h"
+};
+#undef BINLOG_FORMAT
+
+/* An slot of the log ring, the sequence tells whether the slot is free or
+ * holds an record for the current lap of the ring */
+typedef struct {
+  std::atomic<uint32_t> seq;
+  uint32_t time;
+  uint8_t id;
+  uint8_t argc;
+  uint32_t args[BINLOG_MAX_ARGS];
+} binlog_slot_t;
+
+/*******************************
+ * Function prototypes
+ ******************************/
+
+/**
+ * Initializes the log ring, and starts the task which drains it to the
+ *  serial console
+ */
+void binlog_begin();
+
+/**
+ * Pushes an record into the log ring, safe to call from any task or core,
+ *  use the BINLOG() macro instead so filtered records are compiled away
+ *
+ * @param id the format ID
+ * @param argc the number of arguments
+ * @param args the arguments
+ */
+void binlog_push(uint8_t id, uint8_t argc, const uint32_t *args);
+
+/**
+ * Writes the records in the log ring to the serial console
+ */
+void binlog_drain();
+
+/**
+ * Gets the number of records dropped since the ring was full
+ */
+uint32_t binlog_get_dropped();
+
+/**
+ * Pushes an record with its arguments converted to 32 bit integers
+ *
+ * @param id the format ID
+ * @param args the arguments
+ */
+template<typename... A>
+static inline void binlog_write(binlog_format_t id, A... args) {
+  static_assert(sizeof... (A) <= BINLOG_MAX_ARGS, "too many log arguments");
+  const uint32_t values[] = { 0, static_cast<uint32_t>(args)... };
+  binlog_push(id, sizeof... (A), &values[1]);
+}
+
+#endif
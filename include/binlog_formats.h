@@ -0,0 +1,39 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+/* The log formats, as BINLOG_FORMAT(name, module, level, format), this file
+ * is included by binlog.h which turns it into the format IDs, the format
+ * strings themselves only end up in the host decoder. Only the integer
+ * conversions are supported, '%M' prints an MAC address from the two
+ * arguments produced by BINLOG_MAC(). Formats are only appended, so the
+ * decoder of an newer build still understands the logs of older ones */
+
+BINLOG_FORMAT(DROPPED, SYSTEM, WARN, "Log ring full, %u records dropped")
+BINLOG_FORMAT(PKT_HEADER, PKT, DEBUG, "cbx_pkt_t { Version: %u, Sender: %M, Receiver: %M, Chain no: %u, Flags: %02X }")
+BINLOG_FORMAT(PKT_BODY, PKT, DEBUG, "cbx_pkt_t { Size: %u, KeyID: %u }")
+BINLOG_FORMAT(TX_PACKET, LORA, DEBUG, "Writing packet, chain no: %u, chained: %u, payload size: %u")
+BINLOG_FORMAT(TX_DUTY_CYCLE_WAIT, LORA, INFO, "Duty cycle exhausted, waiting %ums")
+BINLOG_FORMAT(TX_UNIQUE_MAC, CAPTURE, DEBUG, "Unique mac: %M")
+BINLOG_FORMAT(TX_STATS, LORA, INFO, "TX stats { Received: %u, Dropped: %u, Duplicates: %u, Batches: %u, "
+  "In flight: %uus, Max in flight: %uus, Airtime: %ums, Duty cycle waits: %u }")
+BINLOG_FORMAT(RX_PACKET, LORA, DEBUG, "Received packet { RSSI: %d, SNR: %d, Size: %u }")
+BINLOG_FORMAT(RX_MALFORMED, LORA, WARN, "Ignoring packet, malformed or not from Cybox ..")
+BINLOG_FORMAT(RX_MALFORMED_PAYLOAD, LORA, WARN, "Ignoring packet, malformed compressed payload ..")
+BINLOG_FORMAT(RX_MAC, LORA, DEBUG, "MAC Received: %M")
+BINLOG_FORMAT(RX_TOO_MANY_NODES, LORA, WARN, "Ignoring measurements, too many transmitters ..")
+BINLOG_FORMAT(AGGREGATE_UPLOADED, HTTP, INFO, "Aggregation uploaded { MACs: %u, Nodes: %u, Dropped: %u, "
+  "Lost parts: %u, Ok: %u }")
+BINLOG_FORMAT(HTTP_PERFORMED, HTTP, DEBUG, "API Performed { Status: %d, Length: %d }")
+BINLOG_FORMAT(SERVER_CONNECTED, SERVER, INFO, "Connected to server, %u bytes waiting")
+BINLOG_FORMAT(SERVER_DISCONNECTED, SERVER, INFO, "Disconnected from server, retrying in %ums")
+BINLOG_FORMAT(SERVER_FULL, SERVER, WARN, "Server buffer full, %u packets dropped")
+BINLOG_FORMAT(HOP_CHANNEL, CAPTURE, INFO, "Channel %u { Frames: %u, New MACs: %u, New MACs/s: %u, "
+  "Dwell: %ums, Total dwell: %ums }")
+BINLOG_FORMAT(SKETCH_WINDOW, LORA, INFO, "Sketch window { Distinct MACs: ~%u, Randomized frames: ~%u, Window: %us }")
+BINLOG_FORMAT(SKETCH_MALFORMED, LORA, WARN, "Ignoring sketch part, malformed ..")
+BINLOG_FORMAT(TX_REPORTED, LORA, INFO, "Reported filter { Suppressed: %u, False positive rate: %uppm, Airtime saved: ~%ums }")
+BINLOG_FORMAT(TX_FINGERPRINTS, LORA, INFO, "Fingerprints { Devices: %u, Collapsed MACs: %u }")
+BINLOG_FORMAT(HTTP_SENDING, HTTP, DEBUG, "Sending data { Length: %d }")
+BINLOG_FORMAT(TX_SET_FULL, LORA, WARN, "Deduplication set full, flushing early, %u times")
+BINLOG_FORMAT(HOP_FAILED, CAPTURE, WARN, "Switching to channel %u failed { Error: %d, Failures: %u }")
@@ -0,0 +1,105 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#ifndef _BLOOM_H
+#define _BLOOM_H
+
+#include "default.h"
+
+/*******************************
+ * Types
+ ******************************/
+
+/* Fixed size Bloom filter of MAC addresses, an MAC which was inserted is
+ * always found, one which was not is found with an small probability which
+ * grows as the filter fills up */
+typedef struct {
+  uint32_t bits[GLOBAL_BLOOM_BITS / 32];
+  uint32_t set_bits;            /* The number of bits set, for the false positive rate */
+} bloom_t;
+
+/* An pair of Bloom filters which ages out its entries, the MACs are inserted
+ * into the current filter, and found in both, each rotation clears the older
+ * one and makes it the current one, so an entry lives for one to two
+ * rotation intervals */
+typedef struct {
+  bloom_t filters[2];
+  uint8_t current;              /* The filter new MACs are inserted into */
+  int64_t interval;             /* The rotation interval in microseconds */
+  int64_t rotated_at;           /* When the filters were last rotated */
+} bloom_pair_t;
+
+/*******************************
+ * Function prototypes
+ ******************************/
+
+/**
+ * Removes all the entries from an Bloom filter
+ *
+ * @param bloom the filter to be cleared
+ */
+void bloom_clear(bloom_t *bloom);
+
+/**
+ * Inserts an MAC address into an Bloom filter
+ *
+ * @param bloom the filter to insert into
+ * @param mac the mac address (6 bytes)
+ */
+void bloom_insert(bloom_t *bloom, const uint8_t *mac);
+
+/**
+ * Checks if an MAC address might be present in an Bloom filter
+ *
+ * @param bloom the filter to search in
+ * @param mac the mac address (6 bytes)
+ */
+bool bloom_contains(const bloom_t *bloom, const uint8_t *mac);
+
+/**
+ * Estimates the false positive rate of an Bloom filter from the bits set
+ *
+ * @param bloom the filter
+ * @return the false positive rate in parts per million
+ */
+uint32_t bloom_fp_rate(const bloom_t *bloom);
+
+/**
+ * Initializes an pair of Bloom filters, must be called before first use
+ *
+ * @param pair the pair to be initialized
+ * @param interval the rotation interval in milliseconds
+ * @param now the current time in microseconds
+ */
+void bloom_pair_init(bloom_pair_t *pair, int64_t interval, int64_t now);
+
+/**
+ * Rotates the filters of an pair once the rotation interval is over
+ *
+ * @param pair the pair
+ * @param now the current time in microseconds
+ * @return true if the filters were rotated
+ */
+bool bloom_pair_rotate(bloom_pair_t *pair, int64_t now);
+
+/**
+ * Inserts an MAC address into an pair, unless one of the filters already
+ *  contains it
+ *
+ * @param pair the pair to insert into
+ * @param mac the mac address (6 bytes)
+ * @return true if inserted, false if (probably) already present
+ */
+bool bloom_pair_insert(bloom_pair_t *pair, const uint8_t *mac);
+
+/**
+ * Estimates the false positive rate of an pair, an MAC is falsely found
+ *  when either of the filters falsely contains it
+ *
+ * @param pair the pair
+ * @return the false positive rate in parts per million
+ */
+uint32_t bloom_pair_fp_rate(const bloom_pair_t *pair);
+
+#endif
@@ -7,42 +7,119 @@
 
 #include "default.h"
 #include "ieee80211.h"
+#include "stats.h"
+#include "binlog.h"
+
+/*******************************
+ * Definitions
+ ******************************/
+
+#define CBX_PKT_MAX_SIZE 255    /* The max size of an LoRa frame */
+
+/* The wire format starts with the magic 'CBX' followed by the version byte,
+ * the legacy format used the label 'CBXL' so its version byte is 'L' */
+#define CBX_PKT_VERSION_LEGACY 'L'
+#define CBX_PKT_VERSION 2
+
+/* Wire layout of version 2, all integers are little endian:
+ *   [0]  magic 'CBX'       [3]  version       [4]  sender[6]
+ *   [10] receiver[6]       [16] chain_no      [17] flags
+ *   [18] unique_id (u32)   [22] key_id (u16)  [24] size
+ *   [25] payload[size] */
+#define CBX_PKT_HEADER_SIZE 25
+
+/* Wire layout of the legacy version, all integers are little endian:
+ *   [0]  label 'CBXL'      [4]  sender[6]     [10] receiver[6]
+ *   [16] chain_no          [17] flags         [18] unique_id (u32)
+ *   [22] api_key[18]       [40] size          [41] payload[size] */
+#define CBX_PKT_LEGACY_HEADER_SIZE 41
+#define CBX_PKT_LEGACY_API_KEY_SIZE 18
 
 /*******************************
  * Types
  ******************************/
 
-typedef struct __attribute__ (( packed )) {
+typedef struct {
   unsigned encrypted : 1;       /* If the packet has been encrypted */
   unsigned relayed : 1;         /* If the packet has been relayed */
   unsigned chained : 1;         /* If the packet is chained */
-  unsigned reserved : 5;
+  unsigned compressed : 1;      /* If the payload is encoded with mac_codec */
+  unsigned sketch : 1;          /* If the payload is an part of an sketch */
+  unsigned presence : 1;        /* If the payload holds presence records */
+  unsigned reserved : 2;
 } cbx_pkt_flags_t;
 
-typedef struct __attribute__ (( packed )) {
-  char label[4];                /* The packet label, mostly 'CBXL' */
+typedef struct {
+  uint8_t version;              /* The wire format version */
   uint8_t sender[6];            /* The sender address */
   uint8_t receiver[6];          /* The receiver address */
   uint8_t chain_no;             /* The number of the current chain */
   cbx_pkt_flags_t flags;        /* The packet flags */
 } cbx_pkt_hdr_t;
 
-typedef struct __attribute__ (( packed )) {
+typedef struct {
   uint32_t unique_id;           /* The unique identifier of the packet */
-  char api_key[18];             /* The API key */
+  uint16_t key_id;              /* The identifier of the transmitters API key */
+  const char *api_key;          /* The API key, resolved by the gateway */
   uint8_t size;                 /* The size of the payload */
-  uint8_t *payload;             /* The body of the packet */
+  const uint8_t *payload;       /* The body of the packet */
 } cbx_pkt_body_t;
 
-typedef struct __attribute__ (( packed )) {
+typedef struct {
   cbx_pkt_hdr_t hdr;            /* The header of the packet */
   cbx_pkt_body_t body;          /* The body of the packet */
 } cbx_pkt_t;
 
+typedef struct {
+  uint16_t key_id;              /* The identifier sent over the air */
+  const char *api_key;          /* The API key it belongs to */
+} cbx_pkt_key_t;
+
 /*******************************
  * Function prototypes
  ******************************/
 
+/**
+ * Serializes an packet into the version 2 wire format
+ * 
+ * @param pkt the packet to be serialized
+ * @param out the output buffer
+ * @param out_size the size of the output buffer
+ * @return the number of bytes written, or 0 if the buffer is too small
+ */
+size_t cbx_pkt_serialize(const cbx_pkt_t *pkt, uint8_t *out, size_t out_size);
+
+/**
+ * Serializes an packet into the legacy wire format, which still carries
+ *  the API key, this is what the server understands
+ * 
+ * @param pkt the packet to be serialized, body.api_key must be set
+ * @param out the output buffer
+ * @param out_size the size of the output buffer
+ * @return the number of bytes written, or 0 if the buffer is too small
+ */
+size_t cbx_pkt_serialize_legacy(const cbx_pkt_t *pkt, uint8_t *out, size_t out_size);
+
+/**
+ * Parses an packet in either wire format, the payload points into the
+ *  input buffer, the API key is resolved with cbx_pkt_lookup_key for
+ *  version 2 packets
+ * 
+ * @param in the input buffer
+ * @param in_size the size of the input buffer
+ * @param pkt the output packet
+ * @return 0 on success, -1 if the packet is malformed or not ours
+ */
+int32_t cbx_pkt_parse(const uint8_t *in, size_t in_size, cbx_pkt_t *pkt);
+
+/**
+ * Looks up the API key of an key identifier in GLOBAL_API_KEYS
+ * 
+ * @param key_id the key identifier
+ * @return the API key, or nullptr if unknown
+ */
+const char *cbx_pkt_lookup_key(uint16_t key_id);
+
 /**
  * Transmits an packet over the LoRa antenna
  * 
@@ -51,7 +128,7 @@ typedef struct __attribute__ (( packed )) {
 void cbx_pkt_transmit(const cbx_pkt_t *pkt);
 
 /**
- * Logs packet details over the USART line
+ * Logs packet details to the log ring
  * 
  * @param pkt the packet to be logged
  */
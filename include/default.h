@@ -5,8 +5,12 @@
 #ifndef _INCLUDE_DEFAULT_H
 #define _INCLUDE_DEFAULT_H
 
+#ifndef COMPILE_AS_TRANSMITTER
 #define COMPILE_AS_RECEIVER
+#endif
 #define GLOBAL_DEBUG
+#define GLOBAL_STATS
+// #define GLOBAL_SKETCH_MODE
 
 #include <Arduino.h>
 #include <lib/LoRa.h>
@@ -22,7 +26,6 @@
 #include <esp_event_loop.h>
 #include <esp_event.h>
 #include <esp_timer.h>
-#include <cJSON.h>
 
 #include "soc/timer_group_struct.h"
 #include "soc/timer_group_reg.h"
@@ -42,9 +45,58 @@
  * Pre-compile config
  ******************************/
 
-#define GLOBAL_MEASUREMENT_BUFFER_SIZE 32
-#define GLOBAL_CHANNEL_SWITCH_DELAY 10      /* In milliseconds */
-#define GLOBAL_RECEIVER_BUFFER_SIZE 2048    /* Bytes */
+#define GLOBAL_MEASUREMENT_BUFFER_SIZE 128
+#define GLOBAL_MAC_SET_CAPACITY 512         /* Power of two, >= 2x buffer size, the rest remembers suppressed MACs */
+#define GLOBAL_BLOOM_BITS 16384             /* Per filter, power of two */
+#define GLOBAL_BLOOM_HASHES 4
+#define GLOBAL_BLOOM_ROTATE_INTERVAL 300000 /* In milliseconds */
+#define GLOBAL_REFRESH_INTERVAL 30000       /* In milliseconds, at most half the aggregation window */
+#define GLOBAL_REFRESH_BUFFER_SIZE 256      /* MACs refreshed per batch */
+#define GLOBAL_FP_CLUSTERS 64               /* Randomizing devices tracked */
+#define GLOBAL_FP_WINDOW 600000             /* In milliseconds */
+#define GLOBAL_FP_SEQ_GAP 64                /* Sequence numbers */
+#define GLOBAL_LORA_PAYLOAD_SIZE 128        /* Bytes */
+#define GLOBAL_DUTY_CYCLE 10                /* In permille, 1% for EU868 g1 */
+#define GLOBAL_DUTY_CYCLE_WINDOW 3600000000LL /* In microseconds */
+#define GLOBAL_DUTY_CYCLE_HISTORY 256       /* Transmissions per window */
+#define GLOBAL_RING_SIZE 256                /* Power of two */
+#define GLOBAL_TRANSMISSION_INTERVAL 60000000 /* In microseconds */
+#define GLOBAL_SKETCH_WINDOW 60000          /* In milliseconds */
+#define GLOBAL_TX_TASK_CORE 1
+#define GLOBAL_TX_TASK_PRIORITY 5
+#define GLOBAL_TX_TASK_STACK_SIZE 4096      /* Bytes */
+#define GLOBAL_TX_TASK_POLL_DELAY 10        /* In milliseconds */
+#define GLOBAL_HOP_CHANNEL_COUNT 12         /* Channels 1 to 12 */
+#define GLOBAL_HOP_MIN_DWELL 20             /* In milliseconds */
+#define GLOBAL_HOP_ROUND_TIME 1000          /* In milliseconds */
+#define GLOBAL_HOP_SEEN_BITS 8192           /* Power of two */
+#define GLOBAL_HOP_SEEN_RESET 60000         /* In milliseconds */
+#define GLOBAL_RX_QUEUE_SIZE 16             /* Frames, power of two */
+#define GLOBAL_RX_TASK_CORE 1
+#define GLOBAL_RX_TASK_PRIORITY 10
+#define GLOBAL_RX_TASK_STACK_SIZE 4096      /* Bytes */
+#define GLOBAL_SERVER_FRAMING SERVER_FRAMING_HEX
+#define GLOBAL_SERVER_BUFFER_SIZE 16384     /* Bytes */
+#define GLOBAL_SERVER_FLUSH_SIZE 1400       /* Bytes, about one TCP segment */
+#define GLOBAL_SERVER_FLUSH_LATENCY 200     /* In milliseconds */
+#define GLOBAL_SERVER_REPLAY_SIZE 5744     /* Bytes, the lwIP TCP send buffer */
+#define GLOBAL_SERVER_CONNECT_TIMEOUT 5000  /* In milliseconds */
+#define GLOBAL_SERVER_RECONNECT_MIN 500     /* In milliseconds */
+#define GLOBAL_SERVER_RECONNECT_MAX 60000   /* In milliseconds */
+#define GLOBAL_AGGREGATE_CAPACITY 1024     /* Slots, power of two, holds half as many MACs */
+#define GLOBAL_AGGREGATE_MAX_NODES 16       /* Transmitters, at most 16 */
+#define GLOBAL_AGGREGATE_WINDOW 60000       /* In milliseconds */
+#define GLOBAL_AGGREGATE_CHAIN_TIMEOUT 2000 /* In milliseconds */
+#define GLOBAL_AGGREGATE_NODE_TIMEOUT 300000 /* In milliseconds, five windows */
+#define GLOBAL_HTTP_BODY_SIZE 12288        /* Bytes, about 40 per MAC */
+#define GLOBAL_HTTP_TIMEOUT 5000            /* In milliseconds */
+#define GLOBAL_STATS_INTERVAL 10000        /* In milliseconds */
+#define GLOBAL_LOG_MODULES BINLOG_MODULE_ALL /* Bitmask of BINLOG_MODULE_* bits */
+#define GLOBAL_LOG_RING_SIZE 64             /* Records, power of two */
+#define GLOBAL_LOG_DRAIN_DELAY 50           /* In milliseconds */
+#define GLOBAL_LOG_TASK_CORE 0
+#define GLOBAL_LOG_TASK_PRIORITY 1
+#define GLOBAL_LOG_TASK_STACK_SIZE 2048     /* Bytes */
 #define GLOBAL_USART_BAUD 230400
 #define BAND    868E6
 
@@ -57,9 +109,11 @@
 #define GATEWAY_MAC { 0x12, 0x4, 0x2, 0x8, 0x7, 0x5 }
 #define GLOBAL_WIFI_SSID "VRV951769FD81"
 #define GLOBAL_WIFI_PASS "3mPohmrJ5GY@"
-#define GLOBAL_API_KEY "8a3d6b-efcdc1-6de"
+#define GLOBAL_KEY_ID 1
+#define GLOBAL_API_KEYS { { 1, "8a3d6b-efcdc1-6de" } }
 #define GLOBAL_SERVER_IP "192.168.2.11"
 #define GLOBAL_SERVER_PORT 8801
+#define GLOBAL_API_URL "https://drukteradar.cybox.nl/api/"
 #endif
 
 /*******************************
@@ -68,8 +122,16 @@
 
 #ifdef GLOBAL_DEBUG
 #define DEBUG_ONLY(A) A
+#define GLOBAL_LOG_LEVEL BINLOG_LEVEL_DEBUG
 #else
 #define DEBUG_ONLY(A)
+#define GLOBAL_LOG_LEVEL BINLOG_LEVEL_INFO
+#endif
+
+#ifdef GLOBAL_STATS
+#define STATS_ONLY(A) A
+#else
+#define STATS_ONLY(A)
 #endif
 
 /*******************************
@@ -80,4 +142,12 @@ typedef struct __attribute__ (( packed )) {
   uint8_t mac[6];
 } measurement_t;
 
+typedef struct {
+  uint8_t mac[6];
+  int8_t rssi;                  /* The signal strength of the frame, in dBm */
+  uint8_t channel;              /* The channel the frame was sniffed on */
+  uint16_t seq;                 /* The sequence number, only set with an fingerprint */
+  uint32_t fingerprint;         /* Of the probe request of an randomized MAC, or 0 */
+} sighting_t;
+
 #endif
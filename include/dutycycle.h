@@ -0,0 +1,66 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#ifndef _DUTYCYCLE_H
+#define _DUTYCYCLE_H
+
+#include "default.h"
+
+/*******************************
+ * Types
+ ******************************/
+
+typedef struct {
+  int64_t at;                   /* When the transmission started */
+  uint32_t airtime;             /* The time on air in microseconds */
+} duty_cycle_entry_t;
+
+/* Rolling duty cycle budget, keeps the transmissions of the last window so
+ * the used airtime is exact instead of approximated with an token bucket */
+typedef struct {
+  duty_cycle_entry_t entries[GLOBAL_DUTY_CYCLE_HISTORY];
+  size_t head;                  /* The oldest entry */
+  size_t count;                 /* The number of entries */
+  int64_t used;                 /* The airtime used in the window */
+} duty_cycle_t;
+
+/*******************************
+ * Function prototypes
+ ******************************/
+
+/**
+ * Initializes an duty cycle budget
+ * 
+ * @param dc the budget to be initialized
+ */
+void duty_cycle_init(duty_cycle_t *dc);
+
+/**
+ * Gets the airtime in microseconds which may still be used right now
+ * 
+ * @param dc the budget
+ * @param now the current time in microseconds
+ */
+int64_t duty_cycle_available(duty_cycle_t *dc, int64_t now);
+
+/**
+ * Gets how long to wait until an transmission fits in the budget
+ * 
+ * @param dc the budget
+ * @param now the current time in microseconds
+ * @param airtime the time on air of the transmission in microseconds
+ * @return the time to wait in microseconds, 0 if it can be sent now
+ */
+int64_t duty_cycle_wait_time(duty_cycle_t *dc, int64_t now, uint32_t airtime);
+
+/**
+ * Records an transmission in the budget
+ * 
+ * @param dc the budget
+ * @param now the time the transmission started
+ * @param airtime the time on air of the transmission in microseconds
+ */
+void duty_cycle_record(duty_cycle_t *dc, int64_t now, uint32_t airtime);
+
+#endif
@@ -0,0 +1,76 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#ifndef _FINGERPRINT_H
+#define _FINGERPRINT_H
+
+#include "default.h"
+
+/*******************************
+ * Definitions
+ ******************************/
+
+#define FINGERPRINT_NONE 0            /* The frame has nothing to fingerprint */
+#define FINGERPRINT_SEQ_MASK 0xFFF    /* The sequence numbers are 12 bits */
+
+/*******************************
+ * Types
+ ******************************/
+
+typedef struct {
+  uint32_t fingerprint;         /* FINGERPRINT_NONE if the slot is free */
+  uint8_t mac[6];               /* The MAC the cluster is reported as, its first one */
+  uint64_t last_key;            /* The packed MAC the cluster was seen with last */
+  uint16_t seq;                 /* The sequence number it was seen with last */
+  int64_t last_seen;            /* When it was seen last, in microseconds */
+} fingerprint_cluster_t;
+
+/* The devices which randomize their MAC, each cluster is one device, found
+ * by the fingerprint of its probe requests. An new MAC joins an cluster with
+ * the same fingerprint, seen within the window, if its sequence numbers go
+ * on from where the cluster left off, so two devices of the same model are
+ * only merged when their counters happen to be close */
+typedef struct {
+  fingerprint_cluster_t clusters[GLOBAL_FP_CLUSTERS];
+  uint32_t created;             /* The clusters created */
+  uint32_t collapsed;           /* The MAC changes merged into an existing cluster */
+} fingerprint_table_t;
+
+/*******************************
+ * Function prototypes
+ ******************************/
+
+/**
+ * Fingerprints the body of an probe request, by hashing the order of its
+ *  information elements and the contents of those describing the hardware,
+ *  the elements which depend on the network or channel are left out
+ *
+ * @param body the frame body, starting at the first element
+ * @param size the size of the body
+ * @return the fingerprint, or FINGERPRINT_NONE if the body has no elements
+ */
+uint32_t fingerprint_probe(const uint8_t *body, size_t size);
+
+/**
+ * Initializes an cluster table, must be called before first use
+ *
+ * @param table the table to be initialized
+ */
+void fingerprint_init(fingerprint_table_t *table);
+
+/**
+ * Finds the cluster of an randomized MAC, or creates one, the oldest
+ *  cluster makes room when the table is full
+ *
+ * @param table the table
+ * @param mac the mac address (6 bytes)
+ * @param fingerprint the fingerprint of the probe request
+ * @param seq the sequence number of the probe request
+ * @param now the current time in microseconds
+ * @return the MAC the cluster is reported as
+ */
+const uint8_t *fingerprint_cluster(fingerprint_table_t *table, const uint8_t *mac,
+  uint32_t fingerprint, uint16_t seq, int64_t now);
+
+#endif
@@ -0,0 +1,93 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#ifndef _HOPPER_H
+#define _HOPPER_H
+
+#include "default.h"
+
+#include <atomic>
+
+/*******************************
+ * Definitions
+ ******************************/
+
+#define HOPPER_SCORE_SHIFT 8          /* The scores are fixed point, 8 fraction bits */
+#define HOPPER_SCORE_SMOOTHING 2      /* Each dwell moves the score 1/4 towards its yield */
+
+/*******************************
+ * Types
+ ******************************/
+
+typedef struct {
+  std::atomic<uint32_t> frames;       /* The frames sniffed on the channel */
+  std::atomic<uint32_t> new_macs;     /* The transmitters not seen before on any channel */
+  uint32_t new_macs_at_start;         /* The new transmitters when the dwell started */
+  uint32_t score;                     /* The new transmitters per second, smoothed */
+  uint32_t dwell;                     /* The dwell time in this round, in ms */
+  uint32_t dwell_total;               /* The time spent on the channel, in ms */
+} hopper_channel_t;
+
+/* Adaptive channel hopping, every round visits all channels, each for at
+ * least the minimum dwell so quiet channels are still explored, the rest of
+ * the round is divided by the rate at which new transmitters show up */
+typedef struct {
+  hopper_channel_t channels[GLOBAL_HOP_CHANNEL_COUNT];
+  std::atomic<uint32_t> seen[GLOBAL_HOP_SEEN_BITS / 32];
+  int64_t seen_cleared_at;            /* When the seen bitmap was cleared */
+  int64_t dwell_started_at;           /* When the current dwell started */
+  uint8_t current;                    /* The index of the current channel */
+} hopper_t;
+
+typedef struct {
+  uint32_t frames;
+  uint32_t new_macs;
+  uint32_t score;
+  uint32_t dwell;
+  uint32_t dwell_total;
+} hopper_channel_stats_t;
+
+/*******************************
+ * Function prototypes
+ ******************************/
+
+/**
+ * Initializes an hopper, all channels start with an equal dwell time
+ *
+ * @param hopper the hopper
+ * @param now the current time in microseconds
+ */
+void hopper_init(hopper_t *hopper, int64_t now);
+
+/**
+ * Records an sniffed frame, safe to call from the promiscuous callback
+ *  while the other task hops
+ *
+ * @param hopper the hopper
+ * @param channel the channel the frame was sniffed on
+ * @param mac the transmitter of the frame
+ */
+void hopper_observe(hopper_t *hopper, uint8_t channel, const uint8_t *mac);
+
+/**
+ * Ends the dwell on the current channel, and moves to the next one, the
+ *  dwell times are divided again at the start of every round
+ *
+ * @param hopper the hopper
+ * @param now the current time in microseconds
+ * @param dwell the output dwell time on the next channel in ms
+ * @return the next channel
+ */
+uint8_t hopper_next(hopper_t *hopper, int64_t now, uint32_t *dwell);
+
+/**
+ * Gets the statistics of an channel
+ *
+ * @param hopper the hopper
+ * @param channel the channel, starting at 1
+ * @param stats the output statistics
+ */
+void hopper_get_stats(const hopper_t *hopper, uint8_t channel, hopper_channel_stats_t *stats);
+
+#endif
@@ -7,6 +7,36 @@
 
 #include "default.h"
 
+/*******************************
+ * Definitions
+ ******************************/
+
+#define IEEE80211_FCS_SIZE 4          /* The checksum after the frame */
+#define IEEE80211_MIN_FRAME_SIZE 10   /* The size of an ACK or CTS */
+
+/* The address offsets in the MAC header */
+#define IEEE80211_ADDRESS1 4
+#define IEEE80211_ADDRESS2 10
+#define IEEE80211_ADDRESS3 16
+#define IEEE80211_ADDRESS4 24
+
+/* The flags of an frame class */
+#define IEEE80211_CLASS_QOS 0x1       /* Followed by the QoS control field */
+#define IEEE80211_CLASS_HTC 0x2       /* Followed by HT control, if the order bit is set */
+#define IEEE80211_NO_ELEMENTS 0xFF    /* The fixed fields of an frame without elements */
+
+/* The IDs of the information elements */
+#define IEEE80211_IE_SSID 0
+#define IEEE80211_IE_RATES 1
+#define IEEE80211_IE_DS_PARAMS 3
+#define IEEE80211_IE_HT_CAPABILITIES 45
+#define IEEE80211_IE_RSN 48
+#define IEEE80211_IE_EXT_RATES 50
+#define IEEE80211_IE_EXT_CAPABILITIES 127
+#define IEEE80211_IE_VHT_CAPABILITIES 191
+#define IEEE80211_IE_VENDOR 221
+#define IEEE80211_IE_EXTENSION 255
+
 /*******************************
  * Types
  ******************************/
@@ -40,6 +70,7 @@ typedef enum {
   __WIFI_RESERVED2,
   __WIFI_RESERVED3,
   WIFI_TRIGGER,
+  WIFI_TACK,
   WIFI_REPORT_POLL,
   WIFI_NDP_ANNOUNCE,
   WIFI_CONTROL_FRAME_EXTENSION,
@@ -113,6 +144,64 @@ typedef struct __attribute__ ((packed)) {
   uint8_t transmitter[6];
 } ieee80211_control_mac_header_t;
 
+/* The layout of the MAC header for an (type, subtype, DS bits) combination,
+ * the addresses are offsets into the frame, zero if it's not there */
+typedef struct {
+  uint8_t header_size;          /* Without QoS and HT control, zero if invalid */
+  uint8_t receiver;             /* The offset of the receiver address */
+  uint8_t transmitter;          /* The offset of the transmitter address */
+  uint8_t bssid;                /* The offset of the BSSID */
+  uint8_t flags;                /* The IEEE80211_CLASS_* flags */
+  uint8_t fixed_size;           /* The fixed fields before the elements, or IEEE80211_NO_ELEMENTS */
+} ieee80211_class_t;
+
+typedef struct {
+  uint8_t type;                 /* The frame type, an ieee80211_control_frame_type_t */
+  uint8_t subtype;              /* The frame subtype */
+  bool protected_frame;         /* If the body is encrypted */
+  const uint8_t *receiver;      /* The receiver address */
+  const uint8_t *transmitter;   /* The transmitter address, nullptr for CTS and ACK */
+  const uint8_t *bssid;         /* The BSSID, nullptr if the frame does not carry it */
+  uint16_t payload_offset;      /* The offset of the frame body */
+  uint16_t elements_offset;     /* The offset of the information elements, zero if none */
+} ieee80211_frame_info_t;
+
+/* The information elements which are dispatched on, the others are
+ * IEEE80211_IE_KIND_OTHER. An known element with an impossible length is
+ * IEEE80211_IE_KIND_MALFORMED, so the fixed parts of the others can be read
+ * without checking the length again */
+typedef enum {
+  IEEE80211_IE_KIND_OTHER,
+  IEEE80211_IE_KIND_MALFORMED,
+  IEEE80211_IE_KIND_SSID,         /* 0 to 32 bytes */
+  IEEE80211_IE_KIND_CHANNEL,      /* The DS parameter set, 1 byte */
+  IEEE80211_IE_KIND_RSN,          /* At least the 2 byte version */
+  IEEE80211_IE_KIND_HT_CAPABILITIES,  /* 26 bytes */
+  IEEE80211_IE_KIND_VHT_CAPABILITIES, /* 12 bytes */
+  IEEE80211_IE_KIND_VENDOR        /* At least the 3 byte OUI */
+} ieee80211_ie_kind_t;
+
+/* The kind of an element ID and the lengths it may have */
+typedef struct {
+  uint8_t kind;                 /* An ieee80211_ie_kind_t */
+  uint8_t min_length;
+  uint8_t max_length;
+} ieee80211_ie_class_t;
+
+typedef struct {
+  uint8_t id;
+  uint8_t length;
+  uint8_t kind;                 /* An ieee80211_ie_kind_t */
+  const uint8_t *data;          /* Points into the frame, length bytes */
+} ieee80211_ie_t;
+
+/* Walks the elements without copying them, an element is only returned when
+ * it's completely within the frame, so the walk stops at an truncated one */
+typedef struct {
+  const uint8_t *pos;
+  const uint8_t *end;
+} ieee80211_ie_iter_t;
+
 /*******************************
  * Function prototypes
  ******************************/
@@ -146,6 +235,28 @@ const char *ieee80211_get_mgmt_subtype_string(ieee80211_control_mgmt_subtype_t t
  */
 const char *ieee80211_get_ctrl_subtype_string(ieee80211_control_ctr_subtype_t type);
 
+/**
+ * Classifies an frame through an lookup table keyed by the type, subtype
+ *  and DS bits, which gives the addresses and the size of the MAC header
+ *  in one pass, the frame is never read beyond its size
+ * 
+ * @param frame the frame, starting at the frame control field
+ * @param size the size of the frame, without the FCS
+ * @param info the output info, only valid on success
+ * @return 0 on success, -1 if the frame is truncated or the type is reserved
+ */
+int32_t ieee80211_classify(const uint8_t *frame, size_t size, ieee80211_frame_info_t *info);
+
+/**
+ * Gets the next information element, and its kind from an lookup table
+ *  keyed by the element ID
+ * 
+ * @param iter the iterator, advanced past the element
+ * @param ie the output element, only valid on success
+ * @return false at the end of the elements, or at an truncated element
+ */
+bool ieee80211_ie_next(ieee80211_ie_iter_t *iter, ieee80211_ie_t *ie);
+
 /**
  * Logs an IEEE80211 frame to the USART line, this is used directly
  *  in the callback of an promiscous wifi mode
@@ -155,4 +266,51 @@ const char *ieee80211_get_ctrl_subtype_string(ieee80211_control_ctr_subtype_t ty
  */
 void ieee80211_log_packet(void *buffer, wifi_promiscuous_pkt_type_t type);
 
-#endif
\ No newline at end of file
+/**
+ * Starts an walk over the information elements of an buffer
+ * 
+ * @param iter the iterator to be initialized
+ * @param elements the first element
+ * @param size the size of the elements
+ */
+static inline void ieee80211_ie_init(ieee80211_ie_iter_t *iter, const uint8_t *elements, size_t size) {
+  iter->pos = elements;
+  iter->end = elements + size;
+}
+
+/**
+ * Starts an walk over the information elements of an classified frame
+ * 
+ * @param iter the iterator to be initialized
+ * @param frame the frame
+ * @param size the size of the frame, without the FCS
+ * @param info the info of the frame
+ * @return false if the frame has no elements
+ */
+static inline bool ieee80211_ie_begin(ieee80211_ie_iter_t *iter, const uint8_t *frame, size_t size,
+  const ieee80211_frame_info_t *info) {
+  if (info->elements_offset == 0) return false;
+  ieee80211_ie_init(iter, &frame[info->elements_offset], size - info->elements_offset);
+  return true;
+}
+
+/**
+ * Checks if an walk ended at the end of the elements, instead of at an
+ *  truncated element
+ * 
+ * @param iter the iterator
+ */
+static inline bool ieee80211_ie_complete(const ieee80211_ie_iter_t *iter) {
+  return iter->pos == iter->end;
+}
+
+/**
+ * Gets the OUI of an vendor specific element
+ * 
+ * @param ie the element, of kind IEEE80211_IE_KIND_VENDOR
+ */
+static inline uint32_t ieee80211_ie_vendor_oui(const ieee80211_ie_t *ie) {
+  return (ie->data[0] << 16) | (ie->data[1] << 8) | ie->data[2];
+}
+
+#endif
@@ -0,0 +1,70 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#ifndef _JSONWRITER_H
+#define _JSONWRITER_H
+
+#include "default.h"
+
+/*******************************
+ * Types
+ ******************************/
+
+/* Streaming JSON writer which appends into an caller owned buffer, nothing
+ * is allocated, when the buffer runs out the writer is marked as overflowed
+ * and all further writes are ignored */
+typedef struct {
+  char *buf;
+  size_t size;
+  size_t len;
+  bool overflow;
+} json_writer_t;
+
+/*******************************
+ * Function prototypes
+ ******************************/
+
+/**
+ * Initializes an JSON writer on top of an buffer
+ * 
+ * @param writer the writer to be initialized
+ * @param buf the output buffer
+ * @param size the size of the output buffer
+ */
+void json_writer_init(json_writer_t *writer, char *buf, size_t size);
+
+/**
+ * Appends an raw (already valid JSON) string, used for the punctuation
+ *  and the object keys
+ * 
+ * @param writer the writer
+ * @param str the null terminated string
+ */
+void json_writer_raw(json_writer_t *writer, const char *str);
+
+/**
+ * Appends an unsigned integer as JSON number
+ * 
+ * @param writer the writer
+ * @param value the value
+ */
+void json_writer_u64(json_writer_t *writer, uint64_t value);
+
+/**
+ * Appends an signed integer as JSON number
+ * 
+ * @param writer the writer
+ * @param value the value
+ */
+void json_writer_i64(json_writer_t *writer, int64_t value);
+
+/**
+ * Null terminates the output
+ * 
+ * @param writer the writer
+ * @return the length of the output, or -1 if the buffer overflowed
+ */
+int32_t json_writer_finish(json_writer_t *writer);
+
+#endif
@@ -45,6 +45,8 @@ public:
   float packetSnr();
   long packetFrequencyError();
 
+  size_t readPacket(uint8_t *buffer, size_t size);
+
   // from Print
   virtual size_t write(uint8_t byte);
   virtual size_t write(const uint8_t *buffer, size_t size);
@@ -59,6 +61,11 @@ public:
   void onReceive(void(*callback)(int));
   void onTxDone(void(*callback)());
 
+  // raw DIO0 interrupt, the handler must not touch SPI, call
+  // receivedPacket() from task context instead
+  void onDio0(void(*isr)());
+  int receivedPacket();
+
   void receive(int size = 0);
 #endif
   void idle();
@@ -71,6 +78,21 @@ public:
   void setCodingRate4(int denominator);
   void setPreambleLength(long length);
   void setSyncWord(int sw);
+
+  int getSpreadingFactor();
+  long getSignalBandwidth();
+  int getCodingRate4();
+  long getPreambleLength();
+  int getTxPower();
+
+  // time on air in microseconds of an packet with the given payload size,
+  // using the active modem configuration
+  uint32_t timeOnAir(size_t size);
+  uint32_t symbolTime();
+
+  // link budget, using the active modem configuration and TX power
+  float sensitivity();
+  float linkBudget();
   void enableCrc();
   void disableCrc();
   void enableInvertIQ();
@@ -97,13 +119,12 @@ private:
   void handleDio0Rise();
   bool isTransmitting();
 
-  int getSpreadingFactor();
-  long getSignalBandwidth();
-
   void setLdoFlag();
 
   uint8_t readRegister(uint8_t address);
   void writeRegister(uint8_t address, uint8_t value);
+  void writeFifo(const uint8_t *buffer, size_t size);
+  void readFifo(uint8_t *buffer, size_t size);
   uint8_t singleTransfer(uint8_t address, uint8_t value);
 
   static void onDio0Rise();
@@ -115,7 +136,9 @@ private:
   int _reset;
   int _dio0;
   long _frequency;
+  int _txPower;
   int _packetIndex;
+  int _packetLength;
   int _implicitHeaderMode;
   void (*_onReceive)(int);
   void (*_onTxDone)();
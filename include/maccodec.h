@@ -0,0 +1,114 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#ifndef _MACCODEC_H
+#define _MACCODEC_H
+
+#include "default.h"
+
+/*******************************
+ * Definitions
+ ******************************/
+
+/* The compressed payload looks like: [count][headers][suffixes], the header
+ * holds one nibble per MAC. Up to 5 it's the number of leading bytes shared
+ * with the previous MAC, and the suffix holds the remaining (6 - shared)
+ * bytes. From 6 the MAC is in the same OUI run as the previous one, and the
+ * suffix holds the difference of their lower three bytes, big endian, in
+ * (header - 5) bytes. The MACs have to be sorted, so the vendor OUI prefixes
+ * end up next to each other and the differences stay small */
+#define MAC_CODEC_MAX_COUNT 255
+#define MAC_CODEC_MAX_SHARED 5
+#define MAC_CODEC_OUI_SIZE 3
+
+/*******************************
+ * Function prototypes
+ ******************************/
+
+/**
+ * Sorts the measurements, so the shared prefixes are adjacent
+ * 
+ * @param macs the measurements to be sorted
+ * @param count the number of measurements
+ */
+void mac_codec_sort(measurement_t *macs, size_t count);
+
+/**
+ * Encodes as many sorted measurements as fit into the output buffer
+ * 
+ * @param out the output buffer
+ * @param out_size the size of the output buffer
+ * @param macs the sorted measurements
+ * @param count the number of measurements
+ * @param consumed the number of measurements which were encoded
+ * @return the number of bytes written
+ */
+size_t mac_codec_encode(uint8_t *out, size_t out_size, const measurement_t *macs,
+  size_t count, size_t *consumed);
+
+/**
+ * Decodes an compressed payload
+ * 
+ * @param in the compressed payload
+ * @param in_size the size of the payload
+ * @param macs the output measurements
+ * @param max_count the max number of output measurements
+ * @param used the output number of bytes the encoded measurements took
+ * @return the number of decoded measurements, or -1 if malformed
+ */
+int32_t mac_codec_decode(const uint8_t *in, size_t in_size, measurement_t *macs,
+  size_t max_count, size_t *used);
+
+/**
+ * Gets the number of leading bytes two MACs share, at most 5
+ * 
+ * @param a the first mac
+ * @param b the second mac
+ */
+static inline uint8_t mac_codec_shared(const uint8_t *a, const uint8_t *b) {
+  uint8_t shared = 0;
+  while (shared < MAC_CODEC_MAX_SHARED && a[shared] == b[shared]) ++shared;
+  return shared;
+}
+
+/**
+ * Gets the difference of the lower three bytes of two MACs
+ * 
+ * @param prev the previous mac
+ * @param mac the mac
+ */
+static inline uint32_t mac_codec_delta(const uint8_t *prev, const uint8_t *mac) {
+  uint32_t a = (prev[3] << 16) | (prev[4] << 8) | prev[5];
+  uint32_t b = (mac[3] << 16) | (mac[4] << 8) | mac[5];
+  return (b - a) & 0xFFFFFF;
+}
+
+/**
+ * Picks the header of an MAC, the difference is used when it's shorter
+ *  than the suffix after the shared prefix
+ * 
+ * @param prev the previous mac, or nullptr for the first one
+ * @param mac the mac
+ */
+static inline uint8_t mac_codec_header(const uint8_t *prev, const uint8_t *mac) {
+  if (prev == nullptr) return 0;
+
+  uint8_t shared = mac_codec_shared(prev, mac);
+  if (shared < MAC_CODEC_OUI_SIZE) return shared;
+
+  uint32_t delta = mac_codec_delta(prev, mac);
+  uint8_t delta_size = delta < 0x100 ? 1 : delta < 0x10000 ? 2 : 3;
+  return delta_size < 6 - shared ? MAC_CODEC_MAX_SHARED + delta_size : shared;
+}
+
+/**
+ * Gets the size of the suffix which follows an header
+ * 
+ * @param header the header
+ */
+static inline uint8_t mac_codec_suffix_size(uint8_t header) {
+  return header <= MAC_CODEC_MAX_SHARED ? 6 - header : header - MAC_CODEC_MAX_SHARED;
+}
+
+#endif
@@ -0,0 +1,90 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#ifndef _MACSET_H
+#define _MACSET_H
+
+#include "default.h"
+
+/*******************************
+ * Types
+ ******************************/
+
+/* Fixed capacity open-addressing hash set keyed on the 48 bit MAC, the
+ * epoch array allows the whole set to be cleared in O(1) by bumping the
+ * current epoch instead of wiping the keys */
+typedef struct {
+  uint64_t keys[GLOBAL_MAC_SET_CAPACITY];
+  uint16_t epochs[GLOBAL_MAC_SET_CAPACITY];
+  uint16_t values[GLOBAL_MAC_SET_CAPACITY];     /* An value stored with the MAC */
+  uint16_t epoch;
+  size_t size;
+} mac_set_t;
+
+/*******************************
+ * Function prototypes
+ ******************************/
+
+/**
+ * Initializes an MAC set, must be called before first use
+ * 
+ * @param set the set to be initialized
+ */
+void mac_set_init(mac_set_t *set);
+
+/**
+ * Finds the value stored with an MAC address, the MAC is inserted when it
+ *  is not present yet, after which the caller sets its value
+ * 
+ * @param set the set
+ * @param mac the mac address (6 bytes)
+ * @param inserted the output, true if the MAC was inserted
+ * @return the value of the MAC, or nullptr if not present and the set is full
+ */
+uint16_t *mac_set_emplace(mac_set_t *set, const uint8_t *mac, bool *inserted);
+
+/**
+ * Finds the value stored with an MAC address
+ * 
+ * @param set the set to search in
+ * @param mac the mac address (6 bytes)
+ * @return the value of the MAC, or nullptr if not present
+ */
+uint16_t *mac_set_find(mac_set_t *set, const uint8_t *mac);
+
+/**
+ * Removes all the entries from the set
+ * 
+ * @param set the set to be cleared
+ */
+void mac_set_clear(mac_set_t *set);
+
+/**
+ * Packs an MAC address into the lower 48 bits of an integer
+ * 
+ * @param mac the mac address (6 bytes)
+ */
+static inline uint64_t mac_set_key(const uint8_t *mac) {
+  return static_cast<uint64_t>(mac[0])
+    | (static_cast<uint64_t>(mac[1]) << 8)
+    | (static_cast<uint64_t>(mac[2]) << 16)
+    | (static_cast<uint64_t>(mac[3]) << 24)
+    | (static_cast<uint64_t>(mac[4]) << 32)
+    | (static_cast<uint64_t>(mac[5]) << 40);
+}
+
+/**
+ * Hashes an packed MAC address, the two halves are folded and mixed so the
+ *  (often shared) vendor prefix does not dominate, the lower bits of the
+ *  result index the hash tables
+ * 
+ * @param key the packed mac address
+ */
+static inline uint32_t mac_set_hash(uint64_t key) {
+  uint32_t h = static_cast<uint32_t>(key) ^ static_cast<uint32_t>(key >> 24);
+  h *= 0x9E3779B1;
+  return h ^ (h >> 16);
+}
+
+#endif
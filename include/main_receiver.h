@@ -8,6 +8,12 @@
 #include "default.h"
 #include "cbxpkt.h"
 #include "server_connection.h"
+#include "rx_queue.h"
+#include "maccodec.h"
+#include "presence.h"
+#include "aggregate.h"
+#include "sketch.h"
+#include "jsonwriter.h"
 
 #ifdef COMPILE_AS_RECEIVER
 
@@ -23,6 +29,19 @@
  */
 esp_err_t event_handler(void *ctx, system_event_t *event);
 
+/**
+ * The DIO0 interrupt handler, only wakes up the receive task
+ */
+void lora_dio0_isr();
+
+/**
+ * The task which drains the LoRa FIFO after an DIO0 interrupt, and
+ *  queues the frame for the gateway loop
+ * 
+ * @param arg unused
+ */
+void lora_rx_task(void *arg);
+
 /**
   * Performs all the initialization code
  */
@@ -8,17 +8,129 @@
 #include "default.h"
 #include "ieee80211.h"
 #include "cbxpkt.h"
+#include "macset.h"
+#include "bloom.h"
+#include "fingerprint.h"
+#include "ring.h"
+#include "maccodec.h"
+#include "presence.h"
+#include "dutycycle.h"
+#include "hopper.h"
+#include "sketch.h"
 
 #ifndef COMPILE_AS_RECEIVER
 
+/*******************************
+ * Definitions
+ ******************************/
+
+/* The value the deduplication set holds for an MAC which is suppressed, since
+ * it was reported recently, instead of the index of its record */
+#define LORA_SUPPRESSED 0xFFFF
+
+/*******************************
+ * Types
+ ******************************/
+
+/* What became of an sighting in the collector */
+typedef enum {
+  LORA_COLLECT_NEW,             /* Its MAC got an new record in the batch */
+  LORA_COLLECT_DUPLICATE,       /* Merged into the record of its MAC, or its MAC is suppressed */
+  LORA_COLLECT_SUPPRESSED,      /* Its MAC was reported recently, and is remembered as suppressed */
+  LORA_COLLECT_UNTRACKED,       /* Its MAC was reported recently, but the set has no room to remember it */
+  LORA_COLLECT_FULL             /* The set has no room for its MAC, the batch has to be flushed first */
+} lora_collect_t;
+
+typedef struct {
+  presence_table_t records;     /* The record of every MAC seen within the batch */
+  measurement_t refreshed[GLOBAL_REFRESH_BUFFER_SIZE]; /* The suppressed MACs which are still around */
+  size_t refreshed_count;
+  int64_t swapped_at;           /* When the batch was handed to the transmitter */
+} measurement_batch_t;
+
+typedef struct {
+  uint32_t received;            /* Frames accepted by the promiscous callback */
+  uint32_t dropped;             /* Frames dropped since the ring was full */
+  uint32_t duplicates;          /* Frames merged into the record of an buffered MAC */
+  uint32_t overflows;           /* Frames which found the deduplication set full, each forces an flush */
+  uint32_t suppressed;          /* MACs not sent since they were reported recently, once per batch */
+  uint32_t untracked;           /* Frames of suppressed MACs the set had no room for, checked against the filters again */
+  uint32_t refreshed;           /* Suppressed MACs sent again as MAC only, since their refresh interval was over */
+  uint32_t reported_fp_ppm;     /* The estimated false positive rate of the reported filters */
+  uint64_t airtime_saved_us;    /* The estimated airtime the suppressed MACs would have taken */
+  uint32_t fp_clusters;         /* The devices with an randomized MAC found by fingerprint */
+  uint32_t fp_collapsed;        /* The randomized MACs merged into an known device */
+  uint32_t batches;             /* Number of transmitted batches */
+  int64_t last_in_flight_us;    /* How long the last batch was in flight */
+  int64_t max_in_flight_us;     /* The longest time an batch was in flight */
+  uint64_t airtime_us;          /* The total time on air */
+  uint32_t duty_cycle_waits;    /* Packets delayed to respect the duty cycle */
+} lora_tx_stats_t;
+
 /*******************************
  * Function prototypes
  ******************************/
 
 /**
- * Transmits the measurements currently buffered
+ * Transmits the measurements of an batch, the batch will be sorted
+ * 
+ * @param batch the batch to be transmitted
+ */
+void lora_transmit_measurements(measurement_batch_t *batch);
+
+/**
+ * Adds an sighting to the batch being filled, unless its MAC is in it
+ *  already or was reported recently, the set maps the MACs in the batch to
+ *  their record, and remembers the suppressed MACs while it has room beyond
+ *  what the batch may still need, an suppressed MAC which was not refreshed
+ *  recently is added to the refreshes of the batch
+ * 
+ * @param batch the batch being filled, which is not full
+ * @param set the MACs of the batch
+ * @param reported the MACs reported recently
+ * @param refreshed the MACs reported or refreshed recently
+ * @param m the sighting
+ * @param now the current time in microseconds
+ */
+lora_collect_t lora_collect(measurement_batch_t *batch, mac_set_t *set, bloom_pair_t *reported,
+  bloom_pair_t *refreshed, const sighting_t *m, int64_t now);
+
+/**
+ * Transmits an sketch, as an chain of one packet per part
+ * 
+ * @param sketch the sketch to be transmitted
+ */
+void lora_transmit_sketch(const sketch_t *sketch);
+
+/**
+ * The task which drains the ring, deduplicates the MACs and fills the
+ *  current batch
+ * 
+ * @param arg unused
+ */
+void lora_collect_task(void *arg);
+
+/**
+ * The task which transmits the batches handed over by the collection task
+ * 
+ * @param arg unused
+ */
+void lora_tx_task(void *arg);
+
+/**
+ * Gets a snapshot of the transmission statistics
+ * 
+ * @param stats the output statistics
+ */
+void lora_get_stats(lora_tx_stats_t *stats);
+
+/**
+ * Gets the capture statistics of an channel
+ * 
+ * @param channel the channel, starting at 1
+ * @param stats the output statistics
  */
-void lora_transmit_measurements();
+void channel_get_stats(uint8_t channel, hopper_channel_stats_t *stats);
 
 /**
  * The callback for incomming promiscous packets
@@ -34,7 +146,8 @@ void promisc_packet_cb(void *buffer, wifi_promiscuous_pkt_type_t type);
 void setup();
 
 /**
- * Switches the channels
+ * Switches the channels, the dwell time on each channel is adapted to
+ *  the number of new transmitters it yields
  */
 void loop();
 
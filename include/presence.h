@@ -0,0 +1,136 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#ifndef _PRESENCE_H
+#define _PRESENCE_H
+
+#include "default.h"
+
+/*******************************
+ * Definitions
+ ******************************/
+
+/* The presence payload looks like: [age (u16)] [macs] [records], the age is
+ * the number of seconds between the start of the batch and the transmission,
+ * the MACs are encoded with mac_codec, followed by an record per MAC in the
+ * same order: [first_seen] [dwell] [frames - 1] [rssi_max (i8)] [rssi_spread
+ * << 4 | channel] ([channels]), the first three and the channel bitmap are
+ * LEB128 varints, the times are in seconds since the start of the batch. The
+ * spread is the distance from the max to the average RSSI, clamped to 15 dB,
+ * the channel is the only channel the MAC was seen on, or 0 when it was seen
+ * on multiple, in which case the bitmap follows */
+#define PRESENCE_AGE_SIZE 2
+#define PRESENCE_PACKET_OVERHEAD (PRESENCE_AGE_SIZE + 1)  /* The age and the MAC count */
+#define PRESENCE_RECORD_MAX_SIZE (3 + 3 + 5 + 1 + 1 + 3)
+#define PRESENCE_SPREAD_MAX 15
+#define PRESENCE_CHANNEL_MAX 15          /* The channels which fit in the nibble */
+
+/*******************************
+ * Types
+ ******************************/
+
+/* The records of the MACs seen within one batch, as an struct of arrays so
+ * the lookups and updates of the collector only touch the columns they use */
+typedef struct {
+  measurement_t macs[GLOBAL_MEASUREMENT_BUFFER_SIZE];
+  uint16_t first_seen[GLOBAL_MEASUREMENT_BUFFER_SIZE];  /* Seconds since the start */
+  uint16_t last_seen[GLOBAL_MEASUREMENT_BUFFER_SIZE];   /* Seconds since the start */
+  uint32_t frames[GLOBAL_MEASUREMENT_BUFFER_SIZE];      /* The number of frames seen */
+  int32_t rssi_sum[GLOBAL_MEASUREMENT_BUFFER_SIZE];     /* The sum of the RSSI of all frames */
+  int8_t rssi_max[GLOBAL_MEASUREMENT_BUFFER_SIZE];
+  uint16_t channels[GLOBAL_MEASUREMENT_BUFFER_SIZE];    /* Bit (channel - 1) per channel, up to 15 */
+  size_t count;
+  int64_t started_at;           /* When the batch started, in microseconds */
+} presence_table_t;
+
+/* An single decoded record, the times are relative to the start of the batch
+ * when decoded, the gateway makes them absolute. An record without frames
+ * comes from an legacy payload, which only holds the MAC */
+typedef struct {
+  uint32_t first_seen;
+  uint32_t last_seen;
+  uint32_t frames;
+  int8_t rssi_max;
+  int8_t rssi_avg;
+  uint16_t channels;
+} presence_record_t;
+
+/*******************************
+ * Function prototypes
+ ******************************/
+
+/**
+ * Removes all the records from an table, and starts an new batch
+ *
+ * @param table the table to be cleared
+ * @param now the current time in microseconds
+ */
+void presence_clear(presence_table_t *table, int64_t now);
+
+/**
+ * Adds an new record to an table, for an MAC which is not in it yet
+ *
+ * @param table the table
+ * @param sighting the sighting of the MAC
+ * @param now the current time in microseconds
+ * @return the index of the record, or -1 if the table is full
+ */
+int32_t presence_add(presence_table_t *table, const sighting_t *sighting, int64_t now);
+
+/**
+ * Updates the record of an MAC with another sighting
+ *
+ * @param table the table
+ * @param index the index of the record
+ * @param sighting the sighting of the MAC
+ * @param now the current time in microseconds
+ */
+void presence_update(presence_table_t *table, size_t index, const sighting_t *sighting, int64_t now);
+
+/**
+ * Sorts the records of an table by MAC, so the shared prefixes are adjacent
+ *
+ * @param table the table to be sorted
+ */
+void presence_sort(presence_table_t *table);
+
+/**
+ * Gets an upper bound of the encoded size of all records of an table, the
+ *  MACs are counted whole since their shared prefixes are only known once
+ *  the table is sorted, the overhead of each packet is left out
+ *
+ * @param table the table
+ * @return the size in bytes
+ */
+size_t presence_size_bound(const presence_table_t *table);
+
+/**
+ * Encodes as many sorted records as fit into the output buffer
+ *
+ * @param out the output buffer
+ * @param out_size the size of the output buffer
+ * @param table the sorted table
+ * @param start the index of the first record to encode
+ * @param now the current time in microseconds
+ * @param consumed the number of records which were encoded
+ * @return the number of bytes written
+ */
+size_t presence_encode(uint8_t *out, size_t out_size, const presence_table_t *table,
+  size_t start, int64_t now, size_t *consumed);
+
+/**
+ * Decodes an presence payload
+ *
+ * @param in the payload
+ * @param in_size the size of the payload
+ * @param age the output age of the batch in seconds
+ * @param macs the output measurements
+ * @param records the output records
+ * @param max_count the max number of output records
+ * @return the number of decoded records, or -1 if malformed
+ */
+int32_t presence_decode(const uint8_t *in, size_t in_size, uint16_t *age,
+  measurement_t *macs, presence_record_t *records, size_t max_count);
+
+#endif
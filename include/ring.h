@@ -0,0 +1,61 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#ifndef _RING_H
+#define _RING_H
+
+#include "default.h"
+
+#include <atomic>
+
+/*******************************
+ * Types
+ ******************************/
+
+/* Lock-free single producer / single consumer ring of sightings, the
+ * head is only written by the producer and the tail only by the consumer */
+typedef struct {
+  sighting_t items[GLOBAL_RING_SIZE];
+  std::atomic<uint32_t> head;         /* Next slot to be written */
+  std::atomic<uint32_t> tail;         /* Next slot to be read */
+  std::atomic<uint32_t> dropped;      /* Pushes refused since the ring was full */
+} measurement_ring_t;
+
+/*******************************
+ * Function prototypes
+ ******************************/
+
+/**
+ * Initializes an measurement ring
+ * 
+ * @param ring the ring to be initialized
+ */
+void ring_init(measurement_ring_t *ring);
+
+/**
+ * Pushes an sighting into the ring, may only be called by the producer
+ * 
+ * @param ring the ring to push into
+ * @param m the sighting to be pushed
+ * @return false if the ring was full and the sighting has been dropped
+ */
+bool ring_push(measurement_ring_t *ring, const sighting_t *m);
+
+/**
+ * Pops an sighting from the ring, may only be called by the consumer
+ * 
+ * @param ring the ring to pop from
+ * @param m the output sighting
+ * @return false if the ring was empty
+ */
+bool ring_pop(measurement_ring_t *ring, sighting_t *m);
+
+/**
+ * Gets the number of sightings currently in the ring
+ * 
+ * @param ring the ring
+ */
+uint32_t ring_size(const measurement_ring_t *ring);
+
+#endif
@@ -0,0 +1,74 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#ifndef _RX_QUEUE_H
+#define _RX_QUEUE_H
+
+#include "default.h"
+
+#include <atomic>
+
+/*******************************
+ * Types
+ ******************************/
+
+typedef struct {
+  uint8_t data[255];            /* The raw LoRa frame */
+  uint8_t size;                 /* The size of the frame */
+  int16_t rssi;                 /* The packet RSSI in dBm */
+  float snr;                    /* The packet SNR in dB */
+  int64_t received_at;          /* The esp_timer time of reception */
+} rx_frame_t;
+
+/* Lock-free single producer / single consumer queue of received frames, the
+ * frames are written and read in place so they are never copied */
+typedef struct {
+  rx_frame_t frames[GLOBAL_RX_QUEUE_SIZE];
+  std::atomic<uint32_t> head;         /* Next slot to be written */
+  std::atomic<uint32_t> tail;         /* Next slot to be read */
+  std::atomic<uint32_t> dropped;      /* Frames refused since the queue was full */
+} rx_queue_t;
+
+/*******************************
+ * Function prototypes
+ ******************************/
+
+/**
+ * Initializes an receive queue
+ * 
+ * @param queue the queue to be initialized
+ */
+void rx_queue_init(rx_queue_t *queue);
+
+/**
+ * Reserves the next free frame, may only be called by the producer
+ * 
+ * @param queue the queue
+ * @return the frame to be filled, or nullptr if the queue is full
+ */
+rx_frame_t *rx_queue_reserve(rx_queue_t *queue);
+
+/**
+ * Publishes the frame returned by rx_queue_reserve to the consumer
+ * 
+ * @param queue the queue
+ */
+void rx_queue_commit(rx_queue_t *queue);
+
+/**
+ * Gets the oldest published frame, may only be called by the consumer
+ * 
+ * @param queue the queue
+ * @return the frame, or nullptr if the queue is empty
+ */
+rx_frame_t *rx_queue_front(rx_queue_t *queue);
+
+/**
+ * Returns the frame returned by rx_queue_front to the producer
+ * 
+ * @param queue the queue
+ */
+void rx_queue_release(rx_queue_t *queue);
+
+#endif
@@ -7,22 +7,80 @@
 
 #include "default.h"
 #include "cbxpkt.h"
+#include "stats.h"
 
+#include <atomic>
+
+typedef enum {
+  SERVER_FRAMING_HEX,           /* One hex encoded packet per line */
+  SERVER_FRAMING_BINARY         /* Length prefixed binary records */
+} server_framing_t;
+
+typedef enum {
+  SERVER_STATE_DISCONNECTED,
+  SERVER_STATE_CONNECTING,
+  SERVER_STATE_CONNECTED
+} server_state_t;
+
+/* Binary record layout, all integers are little endian:
+ *   [0] length (u16, of the rest)  [2] received at (u64, unix ms)
+ *   [10] rssi (i16, dBm)           [12] snr (i8, quarter dB)
+ *   [13] packet[length - 11] */
+#define SERVER_RECORD_HEADER_SIZE 13
+
+/* Non-blocking connection to the packet parsing server, the packets are
+ * encoded into an bounded ring which is drained in order while connected,
+ * so an server outage only costs the packets which don't fit in the ring.
+ * The last sent records are replayed after an reconnect, so delivery is
+ * at-least-once. Everything except initConn and closeConn must be called
+ * from one task */
 class ServerConnection {
 public:
-  ServerConnection(const char *addr, uint32_t port);
+  ServerConnection(const char *addr, uint32_t port, server_framing_t framing = SERVER_FRAMING_HEX);
 
-  int32_t writePacket(const uint8_t *buffer, int32_t size);
+  int32_t writePacket(const uint8_t *buffer, int32_t size, int16_t rssi = 0,
+    float snr = 0, uint64_t received_at = 0);
+  int32_t poll();
+  int32_t flush();
   int32_t initConn();
 
   void closeConn();
+
+  server_state_t getState() const { return m_State; }
+  uint32_t getDropped() const { return m_Dropped; }
+  uint32_t getReconnects() const { return m_Reconnects; }
+  size_t getBuffered() const { return m_Size; }
 private:
+  int32_t startConnect();
+  int32_t finishConnect();
+  void disconnect();
+  void release(size_t max_size);
+  void append(const uint8_t *data, size_t size);
+  size_t recordSize(size_t pos) const;
+  uint8_t at(size_t pos) const { return m_Buffer[pos % GLOBAL_SERVER_BUFFER_SIZE]; }
+
   const char *m_Address;
   uint32_t m_Port;
+  server_framing_t m_Framing;
 
   int32_t m_FD;
   struct sockaddr_in m_SocketAddr;
-  bool m_Connected;
+  std::atomic<bool> m_Wanted;
+  server_state_t m_State;
+  int64_t m_RetryAt;
+  uint32_t m_Backoff;
+  uint32_t m_Reconnects;
+  uint32_t m_Dropped;
+
+  /* The ring holds whole records, head is where the next one is written,
+   * tail is the start of the oldest record and sent the number of bytes
+   * from the tail on which already went out on the current connection */
+  uint8_t m_Buffer[GLOBAL_SERVER_BUFFER_SIZE];
+  size_t m_Head;
+  size_t m_Tail;
+  size_t m_Size;
+  size_t m_Sent;
+  int64_t m_OldestAt;
 };
 
-#endif
\ No newline at end of file
+#endif
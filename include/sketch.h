@@ -0,0 +1,129 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#ifndef _SKETCH_H
+#define _SKETCH_H
+
+#include "default.h"
+
+/*******************************
+ * Definitions
+ ******************************/
+
+/* An HyperLogLog of 2^7 registers estimates the number of distinct MACs
+ * with an standard error of about 9%, the Count-Min sketch counts the
+ * frames per OUI, an count is never underestimated and overestimated by
+ * at most e/width of all frames with an probability of 1 - e^-depth */
+#define SKETCH_HLL_BITS 7
+#define SKETCH_HLL_REGISTERS (1 << SKETCH_HLL_BITS)
+#define SKETCH_CMS_DEPTH 4
+#define SKETCH_CMS_WIDTH 48
+
+/* The randomized (locally administered) MACs have an random OUI, so they
+ * are all counted under this key instead */
+#define SKETCH_OUI_RANDOMIZED 0x1000000
+
+/* An sketch is sent in parts, one for the HyperLogLog and one for each
+ * row of the Count-Min sketch, each part looks like: [kind] [index]
+ * [window (u16, seconds)] [data], the HyperLogLog data are the registers
+ * packed in 6 bits each, the Count-Min data the counters of the row (u16) */
+#define SKETCH_PART_HLL 1
+#define SKETCH_PART_CMS 2
+#define SKETCH_PART_COUNT (1 + SKETCH_CMS_DEPTH)
+#define SKETCH_PART_HEADER_SIZE 4
+#define SKETCH_PART_MAX_SIZE (SKETCH_PART_HEADER_SIZE + SKETCH_CMS_WIDTH * 2)
+
+/* The merged sketch sent to the server looks like: "CBXK" [version]
+ * [hll_bits] [cms_depth] [cms_width] [window (u16, seconds)] [registers]
+ * [counters (u16)], all integers are little endian */
+#define SKETCH_FRAME_VERSION 1
+#define SKETCH_FRAME_SIZE (10 + SKETCH_HLL_REGISTERS + SKETCH_CMS_DEPTH * SKETCH_CMS_WIDTH * 2)
+
+/*******************************
+ * Types
+ ******************************/
+
+typedef struct {
+  uint8_t hll[SKETCH_HLL_REGISTERS];
+  uint16_t cms[SKETCH_CMS_DEPTH][SKETCH_CMS_WIDTH];
+  uint16_t window;              /* The longest window merged in, in seconds */
+} sketch_t;
+
+/*******************************
+ * Function prototypes
+ ******************************/
+
+/**
+ * Clears an sketch
+ *
+ * @param sketch the sketch to be cleared
+ */
+void sketch_clear(sketch_t *sketch);
+
+/**
+ * Adds an sighting of an MAC to the sketch
+ *
+ * @param sketch the sketch
+ * @param mac the mac address (6 bytes)
+ */
+void sketch_add(sketch_t *sketch, const uint8_t *mac);
+
+/**
+ * Checks if nothing was added to the sketch
+ *
+ * @param sketch the sketch
+ */
+bool sketch_empty(const sketch_t *sketch);
+
+/**
+ * Estimates the number of distinct MACs in the sketch
+ *
+ * @param sketch the sketch
+ */
+uint32_t sketch_estimate(const sketch_t *sketch);
+
+/**
+ * Estimates the number of frames sent by MACs with an OUI
+ *
+ * @param sketch the sketch
+ * @param oui the OUI (first three bytes, big endian) or SKETCH_OUI_RANDOMIZED
+ */
+uint32_t sketch_oui_count(const sketch_t *sketch, uint32_t oui);
+
+/**
+ * Encodes an part of the sketch
+ *
+ * @param sketch the sketch
+ * @param part the part, 0 for the HyperLogLog, 1 and up for the Count-Min rows
+ * @param window the window the sketch covers in seconds
+ * @param out the output buffer
+ * @param out_size the size of the output buffer
+ * @return the number of bytes written, or 0 if the buffer is too small
+ */
+size_t sketch_encode_part(const sketch_t *sketch, uint8_t part, uint16_t window,
+  uint8_t *out, size_t out_size);
+
+/**
+ * Merges an received part into an sketch, the registers are merged by
+ *  their maximum and the counters are added, so the result is the sketch
+ *  of everything the transmitters saw together
+ *
+ * @param sketch the sketch to merge into
+ * @param in the encoded part
+ * @param in_size the size of the encoded part
+ * @return 0 on success, -1 if the part is malformed
+ */
+int32_t sketch_merge_part(sketch_t *sketch, const uint8_t *in, size_t in_size);
+
+/**
+ * Serializes an sketch into the frame sent to the server
+ *
+ * @param sketch the sketch
+ * @param out the output buffer
+ * @param out_size the size of the output buffer
+ * @return the number of bytes written, or 0 if the buffer is too small
+ */
+size_t sketch_serialize(const sketch_t *sketch, uint8_t *out, size_t out_size);
+
+#endif
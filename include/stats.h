@@ -0,0 +1,119 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#ifndef _STATS_H
+#define _STATS_H
+
+#include "default.h"
+
+#include <atomic>
+#include <soc/cpu.h>
+
+/*******************************
+ * Definitions
+ ******************************/
+
+/* The stats frame looks like: "CBXS" [version] [tick_hz (u32)] [uptime_ms (u32)]
+ * [stage_count] [bucket_count] followed by each stage: [count] [sum] [max]
+ * [buckets ...], all stage fields are LEB128 varints so empty buckets only
+ * take a single byte. Bucket i counts the samples of [2^(i-1), 2^i) ticks,
+ * bucket 0 those of zero ticks */
+#define STATS_FRAME_VERSION 1
+#define STATS_BUCKET_COUNT 32
+#define STATS_FRAME_MAX_SIZE (15 + STATS_COUNT * (5 + 10 + 5 + STATS_BUCKET_COUNT * 5))
+
+/*******************************
+ * Types
+ ******************************/
+
+typedef enum {
+  STATS_PROMISC_CB,             /* The promiscuous callback */
+  STATS_DEDUP,                  /* Deduplication of an measurement */
+  STATS_ENCODE,                 /* Encoding of an packet payload */
+  STATS_TRANSMIT,               /* Serializing and writing an packet to the FIFO */
+  STATS_TX_DONE,                /* Waiting for the radio to finish transmitting */
+  STATS_RX_DRAIN,               /* Reading an received packet from the FIFO */
+  STATS_SERVER_WRITE,           /* Encoding an packet into the server buffer */
+  STATS_SERVER_FLUSH,           /* Sending the server buffer */
+  STATS_COUNT
+} stats_stage_t;
+
+/* The counters of an stage on one core, only that core writes them, so the
+ * atomics never bounce between the cores and relaxed ordering is enough. The
+ * Xtensa cores only have 32 bit atomics, so the sum is split in two halves,
+ * the high half counts the times the low half wrapped around */
+typedef struct {
+  std::atomic<uint32_t> count;
+  std::atomic<uint32_t> max;
+  std::atomic<uint32_t> sum_low;
+  std::atomic<uint32_t> sum_high;
+  std::atomic<uint32_t> buckets[STATS_BUCKET_COUNT];
+} stats_counters_t;
+
+typedef struct {
+  uint32_t count;
+  uint32_t max;
+  uint64_t sum;
+  uint32_t buckets[STATS_BUCKET_COUNT];
+} stats_stage_snapshot_t;
+
+/*******************************
+ * Function prototypes
+ ******************************/
+
+/**
+ * Records an sample of an stage on the current core
+ * 
+ * @param stage the stage
+ * @param ticks the duration in ticks
+ */
+void stats_record(stats_stage_t stage, uint32_t ticks);
+
+/**
+ * Gets the counters of an stage, summed over the cores
+ * 
+ * @param stage the stage
+ * @param out the output snapshot
+ */
+void stats_snapshot(stats_stage_t stage, stats_stage_snapshot_t *out);
+
+/**
+ * Gets the number of ticks per second
+ */
+uint32_t stats_tick_hz();
+
+/**
+ * Serializes the counters of all stages into an stats frame
+ * 
+ * @param out the output buffer
+ * @param out_size the size of the output buffer
+ * @return the number of bytes written, or 0 if the buffer is too small
+ */
+size_t stats_serialize(uint8_t *out, size_t out_size);
+
+/**
+ * Writes an stats frame to the serial console, as an single line of hex
+ *  prefixed with '#S' so it can be picked out of the other output
+ */
+void stats_print();
+
+/**
+ * Gets the current time in ticks, the CPU cycle counter, which wraps
+ *  around so only the difference of two calls is meaningful
+ */
+static inline uint32_t stats_now() {
+  return esp_cpu_get_ccount();
+}
+
+/**
+ * Records the time since an stats_now() call
+ * 
+ * @param stage the stage
+ * @param started the result of stats_now() when the stage started
+ */
+static inline void stats_end(stats_stage_t stage, uint32_t started) {
+  stats_record(stage, stats_now() - started);
+}
+
+#endif
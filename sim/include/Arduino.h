@@ -0,0 +1,111 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#ifndef _SIM_ARDUINO_H
+#define _SIM_ARDUINO_H
+
+/* Host shim of the parts of the Arduino core which the firmware uses, the
+ * ESP32 core pulls in FreeRTOS and the C library, so this one does too */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/*******************************
+ * Definitions
+ ******************************/
+
+#define IRAM_ATTR
+#define ICACHE_RAM_ATTR
+
+#define HIGH 0x1
+#define LOW 0x0
+#define INPUT 0x01
+#define OUTPUT 0x02
+#define RISING 0x01
+
+#define DEC 10
+#define HEX 16
+
+#define B111 7
+#define B1000 8
+
+#define bitWrite(value, bit, bitvalue) ((bitvalue) ? ((value) |= (1UL << (bit))) : ((value) &= ~(1UL << (bit))))
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+/*******************************
+ * Classes
+ ******************************/
+
+class Print {
+public:
+  virtual ~Print() {}
+
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size);
+
+  size_t print(const char *str);
+  size_t print(char c);
+  size_t print(long n, int base = DEC);
+  size_t println(const char *str = "");
+  size_t println(long n, int base = DEC);
+  size_t printf(const char *format, ...) __attribute__ ((format (printf, 2, 3)));
+};
+
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+  virtual void flush() {}
+
+  void setTimeout(unsigned long timeout) { _timeout = timeout; }
+
+protected:
+  unsigned long _timeout = 1000;
+};
+
+class HardwareSerial : public Stream {
+public:
+  void begin(unsigned long baud) {}
+
+  size_t write(uint8_t c);
+  size_t write(const uint8_t *buffer, size_t size);
+  int available() { return 0; }
+  int read() { return -1; }
+  int peek() { return -1; }
+  void flush();
+};
+
+extern HardwareSerial Serial;
+
+/*******************************
+ * Function prototypes
+ ******************************/
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalPinToInterrupt(uint8_t pin);
+void attachInterrupt(uint8_t pin, void (*isr)(), int mode);
+void detachInterrupt(uint8_t pin);
+
+uint32_t getCpuFrequencyMhz();
+
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void yield();
+
+void configTime(long gmt_offset, int daylight_offset, const char *server1,
+  const char *server2 = nullptr, const char *server3 = nullptr);
+
+#endif
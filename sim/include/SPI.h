@@ -0,0 +1,36 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#ifndef _SIM_SPI_H
+#define _SIM_SPI_H
+
+#include <Arduino.h>
+
+/* Host shim of the SPI bus, the only device on it is the simulated SX1276,
+ * an transaction starts with the address byte like on the real chip */
+
+#define MSBFIRST 1
+#define SPI_MODE0 0
+
+class SPISettings {
+public:
+  SPISettings(uint32_t clock = 1000000, uint8_t bit_order = MSBFIRST, uint8_t data_mode = SPI_MODE0) {}
+};
+
+class SPIClass {
+public:
+  void begin(int8_t sck = -1, int8_t miso = -1, int8_t mosi = -1, int8_t ss = -1) {}
+  void end() {}
+
+  void beginTransaction(SPISettings settings);
+  void endTransaction();
+
+  uint8_t transfer(uint8_t data);
+  void writeBytes(const uint8_t *data, uint32_t size);
+  void transferBytes(const uint8_t *data, uint8_t *out, uint32_t size);
+};
+
+extern SPIClass SPI;
+
+#endif
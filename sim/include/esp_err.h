@@ -0,0 +1,21 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#ifndef _SIM_ESP_ERR_H
+#define _SIM_ESP_ERR_H
+
+#include <stdint.h>
+
+typedef int32_t esp_err_t;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_NO_MEM 0x101
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_NVS_NO_FREE_PAGES (0x1100 + 0x0d)
+#define ESP_ERR_NVS_NEW_VERSION_FOUND (0x1100 + 0x10)
+
+const char *esp_err_to_name(esp_err_t code);
+
+#endif
@@ -0,0 +1,47 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#ifndef _SIM_ESP_EVENT_H
+#define _SIM_ESP_EVENT_H
+
+#include "esp_err.h"
+
+/* The legacy system events, the simulated station connects right away
+ * so the handler sees STA_START followed by STA_GOT_IP */
+typedef enum {
+  SYSTEM_EVENT_STA_START = 2,
+  SYSTEM_EVENT_STA_DISCONNECTED = 5,
+  SYSTEM_EVENT_STA_GOT_IP = 7
+} system_event_id_t;
+
+typedef struct {
+  uint32_t addr;
+} ip4_addr_t;
+
+typedef struct {
+  ip4_addr_t ip;
+  ip4_addr_t netmask;
+  ip4_addr_t gw;
+} tcpip_adapter_ip_info_t;
+
+typedef struct {
+  tcpip_adapter_ip_info_t ip_info;
+} system_event_sta_got_ip_t;
+
+typedef union {
+  system_event_sta_got_ip_t got_ip;
+} system_event_info_t;
+
+typedef struct {
+  system_event_id_t event_id;
+  system_event_info_t event_info;
+} system_event_t;
+
+typedef esp_err_t (*system_event_cb_t)(void *ctx, system_event_t *event);
+
+esp_err_t esp_event_loop_create_default();
+void tcpip_adapter_init();
+char *ip4addr_ntoa(const ip4_addr_t *addr);
+
+#endif
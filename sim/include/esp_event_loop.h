@@ -0,0 +1,12 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#ifndef _SIM_ESP_EVENT_LOOP_H
+#define _SIM_ESP_EVENT_LOOP_H
+
+#include "esp_event.h"
+
+esp_err_t esp_event_loop_init(system_event_cb_t cb, void *ctx);
+
+#endif
@@ -0,0 +1,47 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#ifndef _SIM_ESP_HTTP_CLIENT_H
+#define _SIM_ESP_HTTP_CLIENT_H
+
+/* Host shim of the HTTP client, there is no TLS on the host so the requests
+ * are only counted, and answered with 200 */
+
+#include "esp_err.h"
+
+typedef struct sim_http_client *esp_http_client_handle_t;
+
+typedef enum {
+  HTTP_METHOD_GET,
+  HTTP_METHOD_POST,
+  HTTP_METHOD_PUT
+} esp_http_client_method_t;
+
+typedef struct {
+  const char *url;
+  const char *host;
+  int port;
+  const char *username;
+  const char *password;
+  int auth_type;
+  const char *path;
+  const char *query;
+  const char *cert_pem;
+  const char *client_cert_pem;
+  const char *client_key_pem;
+  esp_http_client_method_t method;
+  int timeout_ms;
+} esp_http_client_config_t;
+
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t *config);
+esp_err_t esp_http_client_set_method(esp_http_client_handle_t client, esp_http_client_method_t method);
+esp_err_t esp_http_client_set_header(esp_http_client_handle_t client, const char *key, const char *value);
+esp_err_t esp_http_client_set_post_field(esp_http_client_handle_t client, const char *data, int len);
+esp_err_t esp_http_client_perform(esp_http_client_handle_t client);
+int esp_http_client_get_status_code(esp_http_client_handle_t client);
+int esp_http_client_get_content_length(esp_http_client_handle_t client);
+esp_err_t esp_http_client_close(esp_http_client_handle_t client);
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client);
+
+#endif
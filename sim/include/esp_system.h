@@ -0,0 +1,13 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#ifndef _SIM_ESP_SYSTEM_H
+#define _SIM_ESP_SYSTEM_H
+
+#include <stdint.h>
+
+uint32_t esp_random();
+void esp_restart();
+
+#endif
@@ -0,0 +1,10 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#ifndef _SIM_ESP_TASK_WDT_H
+#define _SIM_ESP_TASK_WDT_H
+
+#include "esp_err.h"
+
+#endif
@@ -0,0 +1,13 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#ifndef _SIM_ESP_TIMER_H
+#define _SIM_ESP_TIMER_H
+
+#include <stdint.h>
+
+/* Microseconds since the simulation started, from the monotonic clock */
+int64_t esp_timer_get_time();
+
+#endif
@@ -0,0 +1,20 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#ifndef _SIM_ESP_TLS_H
+#define _SIM_ESP_TLS_H
+
+/* On the ESP32 this pulls in the lwIP sockets, which on the host are
+ * simply the POSIX ones */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#endif
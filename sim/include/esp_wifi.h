@@ -0,0 +1,133 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#ifndef _SIM_ESP_WIFI_H
+#define _SIM_ESP_WIFI_H
+
+/* Host shim of the WiFi driver, in promiscuous mode the frames come from
+ * sim_wifi_deliver instead of the radio */
+
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_event.h"
+#include "esp_system.h"
+
+/*******************************
+ * Types
+ ******************************/
+
+typedef enum {
+  WIFI_PKT_MGMT,
+  WIFI_PKT_CTRL,
+  WIFI_PKT_DATA,
+  WIFI_PKT_MISC
+} wifi_promiscuous_pkt_type_t;
+
+typedef struct {
+  signed rssi : 8;
+  unsigned rate : 5;
+  unsigned : 1;
+  unsigned sig_mode : 2;
+  unsigned : 16;
+  unsigned mcs : 7;
+  unsigned cwb : 1;
+  unsigned : 16;
+  unsigned smoothing : 1;
+  unsigned not_sounding : 1;
+  unsigned : 1;
+  unsigned aggregation : 1;
+  unsigned stbc : 2;
+  unsigned fec_coding : 1;
+  unsigned sgi : 1;
+  signed noise_floor : 8;
+  unsigned ampdu_cnt : 8;
+  unsigned channel : 4;
+  unsigned secondary_channel : 4;
+  unsigned : 8;
+  unsigned timestamp : 32;
+  unsigned : 32;
+  unsigned : 31;
+  unsigned ant : 1;
+  unsigned sig_len : 12;
+  unsigned : 12;
+  unsigned rx_state : 8;
+} wifi_pkt_rx_ctrl_t;
+
+typedef struct {
+  wifi_pkt_rx_ctrl_t rx_ctrl;
+  uint8_t payload[0];
+} wifi_promiscuous_pkt_t;
+
+typedef struct {
+  uint32_t filter_mask;
+} wifi_promiscuous_filter_t;
+
+typedef void (*wifi_promiscuous_cb_t)(void *buf, wifi_promiscuous_pkt_type_t type);
+
+typedef struct {
+  int magic;
+} wifi_init_config_t;
+
+typedef struct {
+  uint8_t ssid[32];
+  uint8_t password[64];
+} wifi_sta_config_t;
+
+typedef union {
+  wifi_sta_config_t sta;
+} wifi_config_t;
+
+typedef enum {
+  WIFI_MODE_NULL,
+  WIFI_MODE_STA,
+  WIFI_MODE_AP,
+  WIFI_MODE_APSTA
+} wifi_mode_t;
+
+typedef enum {
+  WIFI_STORAGE_FLASH,
+  WIFI_STORAGE_RAM
+} wifi_storage_t;
+
+typedef enum {
+  ESP_IF_WIFI_STA,
+  ESP_IF_WIFI_AP
+} esp_interface_t;
+
+typedef enum {
+  WIFI_SECOND_CHAN_NONE,
+  WIFI_SECOND_CHAN_ABOVE,
+  WIFI_SECOND_CHAN_BELOW
+} wifi_second_chan_t;
+
+/*******************************
+ * Definitions
+ ******************************/
+
+#define WIFI_INIT_CONFIG_DEFAULT() { 0x1F2F3F4F }
+
+#define WIFI_PROMIS_FILTER_MASK_ALL 0xFFFFFFFF
+#define WIFI_PROMIS_FILTER_MASK_MGMT (1 << 0)
+#define WIFI_PROMIS_FILTER_MASK_CTRL (1 << 1)
+#define WIFI_PROMIS_FILTER_MASK_DATA (1 << 2)
+#define WIFI_PROMIS_FILTER_MASK_MISC (1 << 3)
+
+/*******************************
+ * Function prototypes
+ ******************************/
+
+esp_err_t esp_wifi_init(const wifi_init_config_t *config);
+esp_err_t esp_wifi_set_storage(wifi_storage_t storage);
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode);
+esp_err_t esp_wifi_set_config(esp_interface_t interface, wifi_config_t *config);
+esp_err_t esp_wifi_start();
+esp_err_t esp_wifi_connect();
+
+esp_err_t esp_wifi_set_promiscuous(bool enable);
+esp_err_t esp_wifi_set_promiscuous_filter(const wifi_promiscuous_filter_t *filter);
+esp_err_t esp_wifi_set_promiscuous_rx_cb(wifi_promiscuous_cb_t cb);
+esp_err_t esp_wifi_set_channel(uint8_t primary, wifi_second_chan_t second);
+
+#endif
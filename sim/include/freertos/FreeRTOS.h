@@ -0,0 +1,30 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#ifndef _SIM_FREERTOS_H
+#define _SIM_FREERTOS_H
+
+/* Host shim of FreeRTOS, the tasks run as threads and the tick is
+ * one millisecond */
+
+#include <stdint.h>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS 1
+#define pdFAIL 0
+
+#define portMAX_DELAY 0xffffffffUL
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) (static_cast<TickType_t>(ms))
+#define portYIELD_FROM_ISR()
+
+#define configMAX_PRIORITIES 25
+#define portNUM_PROCESSORS 1
+
+#endif
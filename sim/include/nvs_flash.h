@@ -0,0 +1,13 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#ifndef _SIM_NVS_FLASH_H
+#define _SIM_NVS_FLASH_H
+
+#include "esp_err.h"
+
+esp_err_t nvs_flash_init();
+esp_err_t nvs_flash_erase();
+
+#endif
@@ -0,0 +1,96 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#ifndef _SIM_H
+#define _SIM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*******************************
+ * Definitions
+ ******************************/
+
+/* The simulated LoRa channel is an file (or named pipe) of frames, each
+ * stored as [size][payload], the transmitter appends to it and the receiver
+ * reads from it, so both sides can run as separate processes */
+#define SIM_LORA_DEFAULT_RSSI -80   /* dBm */
+#define SIM_LORA_DEFAULT_SNR 9.5f   /* dB */
+
+/*******************************
+ * Function prototypes
+ ******************************/
+
+/**
+ * Opens the simulated LoRa channel, frames transmitted by the radio are
+ *  appended to the output file
+ * 
+ * @param path the channel file, or nullptr to discard the frames
+ */
+void sim_lora_open_output(const char *path);
+
+/**
+ * Delivers an frame to the simulated radio, blocks until the radio is
+ *  in receive mode and the previous frame has been read, so no frames
+ *  are lost in the simulation
+ * 
+ * @param data the frame
+ * @param size the size of the frame
+ * @param rssi the rssi in dBm
+ * @param snr the snr in dB
+ */
+void sim_lora_deliver(const uint8_t *data, size_t size, int rssi, float snr);
+
+/**
+ * Gets the number of frames which went over the simulated channel
+ * 
+ * @param transmitted the number of frames transmitted by the radio
+ * @param received the number of frames received by the radio
+ */
+void sim_lora_counters(uint32_t *transmitted, uint32_t *received);
+
+/**
+ * Gets the traffic on the simulated SPI bus
+ * 
+ * @param transactions the number of transactions, each is one CS assertion
+ * @param bytes the number of bytes clocked, address bytes included
+ */
+void sim_spi_counters(uint32_t *transactions, uint32_t *bytes);
+
+/**
+ * Moves the clock of esp_timer_get_time forward, so timeouts and backoffs
+ *  can be tested without waiting for them
+ * 
+ * @param us the time to skip in microseconds
+ */
+void sim_advance_time(int64_t us);
+
+/**
+ * Raises an interrupt on an pin, calls the attached handler
+ * 
+ * @param pin the pin
+ */
+void sim_raise_interrupt(int pin);
+
+/**
+ * Hands an sniffed 802.11 frame to the promiscuous callback, if promiscuous
+ *  mode is enabled, the filter allows it and the radio is on its channel
+ * 
+ * @param frame the 802.11 frame, starting with the frame control
+ * @param size the size of the frame
+ * @param rssi the rssi in dBm
+ * @param channel the channel the frame was sent on, 0 for any channel
+ * @return false if the frame was filtered
+ */
+bool sim_wifi_deliver(const uint8_t *frame, size_t size, int rssi, uint8_t channel);
+
+/**
+ * Gets the number of requests made with the HTTP client
+ * 
+ * @param requests the number of requests
+ * @param bytes the number of body bytes
+ */
+void sim_http_counters(uint32_t *requests, uint64_t *bytes);
+
+#endif
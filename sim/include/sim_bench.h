@@ -0,0 +1,21 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#ifndef _SIM_BENCH_H
+#define _SIM_BENCH_H
+
+#include <stdint.h>
+
+/**
+ * Benchmarks the capture path of the transmitter, the frames of an pcap
+ *  are handed to the promiscuous callbacks at max rate, and the rate, the
+ *  time per frame and the drops are reported to stderr
+ * 
+ * @param path the pcap file
+ * @param labels the device of each randomized MAC in the pcap, or nullptr
+ * @return 0 on success, -1 if the pcap can't be read
+ */
+int32_t sim_bench_run(const char *path, const char *labels);
+
+#endif
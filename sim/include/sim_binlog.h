@@ -0,0 +1,19 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#ifndef _SIM_BINLOG_H
+#define _SIM_BINLOG_H
+
+#include <stdio.h>
+
+/**
+ * Decodes the '#L' log lines of an serial console capture into text, the
+ *  other lines are copied as is
+ * 
+ * @param in the serial console capture
+ * @param out the output
+ */
+void sim_binlog_decode(FILE *in, FILE *out);
+
+#endif
@@ -0,0 +1,74 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#ifndef _SIM_PCAP_H
+#define _SIM_PCAP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/*******************************
+ * Definitions
+ ******************************/
+
+#define SIM_PCAP_MAGIC_US 0xa1b2c3d4
+#define SIM_PCAP_MAGIC_NS 0xa1b23c4d
+#define SIM_LINKTYPE_IEEE802_11 105
+#define SIM_LINKTYPE_RADIOTAP 127
+
+#define SIM_RADIOTAP_FLAGS_FCS 0x10
+#define SIM_PCAP_DEFAULT_RSSI -60   /* dBm, when the capture has none */
+
+/*******************************
+ * Types
+ ******************************/
+
+typedef struct {
+  FILE *file;
+  bool swapped;                 /* If the file is in the other byte order */
+  bool nanoseconds;             /* If the timestamps are in nanoseconds */
+  uint32_t linktype;
+  uint8_t buffer[65536];
+} sim_pcap_t;
+
+typedef struct {
+  const uint8_t *data;          /* The 802.11 frame, without radiotap and FCS */
+  size_t size;
+  int rssi;                     /* The signal strength in dBm */
+  uint8_t channel;              /* The 2.4GHz channel, 0 if unknown */
+  int64_t ts;                   /* The capture time in microseconds */
+} sim_pcap_frame_t;
+
+/*******************************
+ * Function prototypes
+ ******************************/
+
+/**
+ * Opens an pcap file with raw 802.11 or radiotap frames
+ * 
+ * @param pcap the reader
+ * @param path the pcap file
+ * @return 0 on success, -1 if the file can't be used
+ */
+int32_t sim_pcap_open(sim_pcap_t *pcap, const char *path);
+
+/**
+ * Reads the next frame, frames with an malformed radiotap header are
+ *  skipped, the data stays valid until the next call
+ * 
+ * @param pcap the reader
+ * @param frame the output frame
+ * @return false at the end of the file
+ */
+bool sim_pcap_next(sim_pcap_t *pcap, sim_pcap_frame_t *frame);
+
+/**
+ * Closes an pcap file
+ * 
+ * @param pcap the reader
+ */
+void sim_pcap_close(sim_pcap_t *pcap);
+
+#endif
@@ -0,0 +1,15 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#ifndef _SIM_CPU_H
+#define _SIM_CPU_H
+
+#include <stdint.h>
+
+/* The host has no cycle counter that is stable across cores, so the
+ * monotonic clock in nanoseconds is used instead, which is why the
+ * simulated CPU runs at 1000 MHz */
+uint32_t esp_cpu_get_ccount();
+
+#endif
@@ -0,0 +1,10 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#ifndef _SIM_TIMER_GROUP_STRUCT_H
+#define _SIM_TIMER_GROUP_STRUCT_H
+
+/* Not used by the firmware, only included */
+
+#endif
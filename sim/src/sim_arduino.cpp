@@ -0,0 +1,138 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <stdarg.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "sim.h"
+
+/* The interrupt handlers, indexed by pin */
+#define SIM_PIN_COUNT 40
+static std::atomic<void (*)()> g_Interrupts[SIM_PIN_COUNT];
+
+HardwareSerial Serial;
+
+/*******************************
+ * Print
+ ******************************/
+
+size_t Print::write(const uint8_t *buffer, size_t size) {
+  for (size_t i = 0; i < size; ++i) write(buffer[i]);
+  return size;
+}
+
+size_t Print::print(const char *str) {
+  return write(reinterpret_cast<const uint8_t *>(str), strlen(str));
+}
+
+size_t Print::print(char c) {
+  return write(static_cast<uint8_t>(c));
+}
+
+size_t Print::print(long n, int base) {
+  char buffer[24];
+  snprintf(buffer, sizeof (buffer), base == HEX ? "%lx" : "%ld", n);
+  return print(buffer);
+}
+
+size_t Print::println(const char *str) {
+  return print(str) + print("\r\n");
+}
+
+size_t Print::println(long n, int base) {
+  return print(n, base) + print("\r\n");
+}
+
+size_t Print::printf(const char *format, ...) {
+  char buffer[256];
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf(buffer, sizeof (buffer), format, args);
+  va_end(args);
+
+  if (len < 0) return 0;
+  else if (static_cast<size_t>(len) >= sizeof (buffer)) len = sizeof (buffer) - 1;
+  return write(reinterpret_cast<const uint8_t *>(buffer), len);
+}
+
+/*******************************
+ * HardwareSerial
+ ******************************/
+
+size_t HardwareSerial::write(uint8_t c) {
+  return fwrite(&c, 1, 1, stdout);
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size) {
+  return fwrite(buffer, 1, size, stdout);
+}
+
+void HardwareSerial::flush() {
+  fflush(stdout);
+}
+
+/*******************************
+ * GPIO
+ ******************************/
+
+void pinMode(uint8_t pin, uint8_t mode) {}
+void digitalWrite(uint8_t pin, uint8_t value) {}
+
+int digitalPinToInterrupt(uint8_t pin) {
+  return pin < SIM_PIN_COUNT ? pin : -1;
+}
+
+void attachInterrupt(uint8_t pin, void (*isr)(), int mode) {
+  if (pin < SIM_PIN_COUNT) g_Interrupts[pin].store(isr);
+}
+
+void detachInterrupt(uint8_t pin) {
+  if (pin < SIM_PIN_COUNT) g_Interrupts[pin].store(nullptr);
+}
+
+/**
+ * Raises an interrupt on an pin, calls the attached handler
+ * 
+ * @param pin the pin
+ */
+void sim_raise_interrupt(int pin) {
+  if (pin < 0 || pin >= SIM_PIN_COUNT) return;
+
+  void (*isr)() = g_Interrupts[pin].load();
+  if (isr != nullptr) isr();
+}
+
+/*******************************
+ * Time
+ ******************************/
+
+/* Matches the nanosecond clock behind esp_cpu_get_ccount */
+uint32_t getCpuFrequencyMhz() {
+  return 1000;
+}
+
+unsigned long millis() {
+  return static_cast<unsigned long>(esp_timer_get_time() / 1000);
+}
+
+unsigned long micros() {
+  return static_cast<unsigned long>(esp_timer_get_time());
+}
+
+void delay(uint32_t ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void yield() {
+  std::this_thread::yield();
+}
+
+/* The host clock is already synchronized */
+void configTime(long gmt_offset, int daylight_offset, const char *server1,
+  const char *server2, const char *server3) {}
@@ -0,0 +1,369 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#include "default.h"
+
+#ifndef COMPILE_AS_RECEIVER
+
+#include "main_transmitter.h"
+#include "sim.h"
+#include "sim_pcap.h"
+#include "sim_bench.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+typedef struct {
+  std::vector<uint8_t> data;
+  int rssi;
+  int64_t ts;                   /* The capture time, in microseconds */
+} sim_bench_frame_t;
+
+/**
+ * Does nothing, used to measure the cost of the shim itself
+ */
+static void sim_bench_noop_cb(void *buffer, wifi_promiscuous_pkt_type_t type) {}
+
+/* Where the address extraction passes leave the transmitter, so the
+ * compiler can't drop the work */
+static volatile uint8_t g_BenchSink;
+
+/**
+ * Gets the transmitter like the callback did before ieee80211_classify(),
+ *  by casting the frame to the header struct of its type
+ */
+static void sim_bench_cast_cb(void *buffer, wifi_promiscuous_pkt_type_t type) {
+  wifi_promiscuous_pkt_t *promisc_pkt = (wifi_promiscuous_pkt_t *) buffer;
+  const uint8_t *transmitter;
+  switch (type) {
+    case WIFI_CF_MGMT:
+      transmitter = ((ieee80211_management_packet_t *) promisc_pkt->payload)->hdr.transmitter;
+      break;
+    case WIFI_CF_CONTROL:
+      transmitter = ((ieee80211_control_mac_header_t *) promisc_pkt->payload)->transmitter;
+      break;
+    case WIFI_CF_DATA:
+      transmitter = ((ieee80211_data_packet_t *) promisc_pkt->payload)->hdr.address2;
+      break;
+    default: return;
+  }
+
+  g_BenchSink = transmitter[5];
+}
+
+/**
+ * Gets the transmitter with ieee80211_classify()
+ */
+static void sim_bench_classify_cb(void *buffer, wifi_promiscuous_pkt_type_t type) {
+  wifi_promiscuous_pkt_t *promisc_pkt = (wifi_promiscuous_pkt_t *) buffer;
+  ieee80211_frame_info_t info;
+  if (ieee80211_classify(promisc_pkt->payload, promisc_pkt->rx_ctrl.sig_len - IEEE80211_FCS_SIZE, &info) == 0
+    && info.transmitter != nullptr) g_BenchSink = info.transmitter[5];
+}
+
+/**
+ * Walks the information elements of an frame, picking out the channel
+ */
+static void sim_bench_elements_cb(void *buffer, wifi_promiscuous_pkt_type_t type) {
+  wifi_promiscuous_pkt_t *promisc_pkt = (wifi_promiscuous_pkt_t *) buffer;
+  size_t size = promisc_pkt->rx_ctrl.sig_len - IEEE80211_FCS_SIZE;
+  ieee80211_frame_info_t info;
+  ieee80211_ie_iter_t iter;
+  ieee80211_ie_t ie;
+  if (ieee80211_classify(promisc_pkt->payload, size, &info) != 0
+    || !ieee80211_ie_begin(&iter, promisc_pkt->payload, size, &info)) return;
+
+  while (ieee80211_ie_next(&iter, &ie))
+    if (ie.kind == IEEE80211_IE_KIND_CHANNEL) g_BenchSink = ie.data[0];
+}
+
+/**
+ * Gets the fingerprint of an frame like the callback does, 0 if it's not
+ *  an probe request of an randomized MAC
+ * 
+ * @param frame the frame
+ * @param size the size of the frame
+ * @param info the output frame info
+ * @param seq the output sequence number
+ */
+static uint32_t sim_bench_fingerprint(const uint8_t *frame, size_t size, ieee80211_frame_info_t *info,
+  uint16_t *seq) {
+  if (ieee80211_classify(frame, size, info) != 0 || info->transmitter == nullptr
+    || info->type != WIFI_CF_MGMT || info->subtype != WIFI_PROBE_REQ
+    || (info->transmitter[0] & 0x02) == 0) return FINGERPRINT_NONE;
+
+  *seq = reinterpret_cast<const ieee80211_management_mac_header_t *>(frame)->seq_ctl >> 4;
+  return fingerprint_probe(&frame[info->elements_offset], size - info->elements_offset);
+}
+
+/**
+ * Fingerprints the probe requests of randomized MACs
+ */
+static void sim_bench_fingerprint_cb(void *buffer, wifi_promiscuous_pkt_type_t type) {
+  wifi_promiscuous_pkt_t *promisc_pkt = (wifi_promiscuous_pkt_t *) buffer;
+  ieee80211_frame_info_t info;
+  uint16_t seq;
+  g_BenchSink = sim_bench_fingerprint(promisc_pkt->payload,
+    promisc_pkt->rx_ctrl.sig_len - IEEE80211_FCS_SIZE, &info, &seq);
+}
+
+/**
+ * Gets the monotonic time in nanoseconds
+ */
+static inline int64_t sim_bench_now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Hands all the frames to an callback, and reports the rate and the
+ *  distribution of the time spent per frame
+ * 
+ * @param name the name of the callback
+ * @param cb the callback
+ * @param frames the frames
+ */
+static void sim_bench_pass(const char *name, wifi_promiscuous_cb_t cb,
+  const std::vector<sim_bench_frame_t> &frames) {
+  std::vector<int64_t> times;
+  times.reserve(frames.size());
+
+  esp_wifi_set_promiscuous_rx_cb(cb);
+  int64_t started = sim_bench_now();
+  for (const sim_bench_frame_t &frame : frames) {
+    int64_t t = sim_bench_now();
+    sim_wifi_deliver(frame.data.data(), frame.data.size(), frame.rssi, 0);
+    times.push_back(sim_bench_now() - t);
+  }
+
+  int64_t elapsed = sim_bench_now() - started;
+  if (times.empty()) return;
+
+  std::sort(times.begin(), times.end());
+  auto percentile = [&times](double p) {
+    return times[static_cast<size_t>(p * (times.size() - 1))];
+  };
+
+  fprintf(stderr, "bench %s { Frames: %zu, Frames/s: %.0f, p50: %lldns, p90: %lldns, "
+    "p99: %lldns, p99.9: %lldns, Max: %lldns }\n", name, times.size(),
+    times.size() * 1E9 / elapsed, static_cast<long long>(percentile(0.5)),
+    static_cast<long long>(percentile(0.9)), static_cast<long long>(percentile(0.99)),
+    static_cast<long long>(percentile(0.999)), static_cast<long long>(times.back()));
+}
+
+/**
+ * Reads the labels of an capture, an line per MAC: 'aa:bb:cc:dd:ee:ff device',
+ *  lines starting with '#' are skipped
+ * 
+ * @param path the labels file
+ * @param labels the output device per packed MAC
+ * @return 0 on success, -1 if the file can't be read
+ */
+static int32_t sim_bench_read_labels(const char *path, std::unordered_map<uint64_t, std::string> &labels) {
+  std::ifstream in(path);
+  if (!in) return -1;
+
+  std::string line;
+  while (std::getline(in, line)) {
+    unsigned int b[6];
+    char device[64];
+    if (line.empty() || line[0] == '#') continue;
+    if (sscanf(line.c_str(), "%x:%x:%x:%x:%x:%x%*[ ,\t]%63s", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5],
+      device) != 7) continue;
+
+    uint8_t mac[6];
+    for (size_t i = 0; i < 6; ++i) mac[i] = b[i];
+    labels[mac_set_key(mac)] = device;
+  }
+
+  return 0;
+}
+
+/**
+ * Clusters the randomized MACs of the capture by their fingerprint, on the
+ *  capture timestamps, and reports how many were collapsed, with labels the
+ *  pairwise precision and recall: of the MAC pairs put in the same cluster
+ *  the share which belongs to the same device, and the other way around
+ * 
+ * @param frames the frames
+ * @param path the labels file, or nullptr
+ */
+static void sim_bench_fingerprints(const std::vector<sim_bench_frame_t> &frames, const char *path) {
+  static fingerprint_table_t table;
+  fingerprint_init(&table);
+
+  /* The cluster every randomized MAC was put in first */
+  std::unordered_map<uint64_t, uint64_t> clusters;
+  uint32_t probes = 0;
+  for (const sim_bench_frame_t &frame : frames) {
+    ieee80211_frame_info_t info;
+    uint16_t seq;
+    uint32_t fingerprint = sim_bench_fingerprint(frame.data.data(), frame.data.size(), &info, &seq);
+    if (fingerprint == FINGERPRINT_NONE) continue;
+
+    ++probes;
+    const uint8_t *device = fingerprint_cluster(&table, info.transmitter, fingerprint, seq, frame.ts);
+    clusters.emplace(mac_set_key(info.transmitter), mac_set_key(device));
+  }
+
+  fprintf(stderr, "bench fingerprints { Probe requests: %u, Randomized MACs: %zu, Devices: %u, "
+    "Collapsed MACs: %u }\n", probes, clusters.size(), table.created, table.collapsed);
+
+  std::unordered_map<uint64_t, std::string> labels;
+  if (path == nullptr) return;
+  else if (sim_bench_read_labels(path, labels) != 0) {
+    fprintf(stderr, "Failed to read labels: %s\n", path);
+    return;
+  }
+
+  /* Counts the labeled MACs per cluster, per device and per both, the pairs
+   * within each group follow from those */
+  std::map<uint64_t, uint64_t> per_cluster;
+  std::map<std::string, uint64_t> per_device;
+  std::map<std::pair<uint64_t, std::string>, uint64_t> per_both;
+  size_t labeled = 0;
+  for (const auto &entry : clusters) {
+    auto label = labels.find(entry.first);
+    if (label == labels.end()) continue;
+
+    ++labeled;
+    ++per_cluster[entry.second];
+    ++per_device[label->second];
+    ++per_both[std::make_pair(entry.second, label->second)];
+  }
+
+  auto pairs = [](uint64_t n) { return n * (n - 1) / 2; };
+  uint64_t cluster_pairs = 0, device_pairs = 0, true_pairs = 0;
+  for (const auto &entry : per_cluster) cluster_pairs += pairs(entry.second);
+  for (const auto &entry : per_device) device_pairs += pairs(entry.second);
+  for (const auto &entry : per_both) true_pairs += pairs(entry.second);
+
+  fprintf(stderr, "bench fingerprint accuracy { Labeled MACs: %zu, Devices: %zu, Clusters: %zu, "
+    "Precision: %.3f, Recall: %.3f }\n", labeled, per_device.size(), per_cluster.size(),
+    cluster_pairs == 0 ? 1.0 : static_cast<double>(true_pairs) / cluster_pairs,
+    device_pairs == 0 ? 1.0 : static_cast<double>(true_pairs) / device_pairs);
+}
+
+/**
+ * Encodes the transmitters of the capture like the transmitter does, in
+ *  batches of the buffer size in the order they were first seen, and reports
+ *  the bytes per MAC of the raw, the prefix only and the encoded MACs
+ * 
+ * @param transmitters the transmitters, in the order they were first seen
+ */
+static void sim_bench_mac_codec(const std::vector<measurement_t> &transmitters) {
+  uint8_t out[1 + GLOBAL_MEASUREMENT_BUFFER_SIZE / 2 + GLOBAL_MEASUREMENT_BUFFER_SIZE * 6];
+  size_t encoded_size = 0, prefix_size = 0;
+  for (size_t i = 0; i < transmitters.size(); i += GLOBAL_MEASUREMENT_BUFFER_SIZE) {
+    size_t count = std::min(transmitters.size() - i, static_cast<size_t>(GLOBAL_MEASUREMENT_BUFFER_SIZE));
+    std::vector<measurement_t> batch(transmitters.begin() + i, transmitters.begin() + i + count);
+    mac_codec_sort(batch.data(), batch.size());
+
+    size_t consumed;
+    encoded_size += mac_codec_encode(out, sizeof (out), batch.data(), batch.size(), &consumed);
+    prefix_size += 1 + (count + 1) / 2 + 6;
+    for (size_t j = 1; j < count; ++j) prefix_size += 6 - mac_codec_shared(batch[j - 1].mac, batch[j].mac);
+  }
+
+  double macs = transmitters.empty() ? 1.0 : static_cast<double>(transmitters.size());
+  fprintf(stderr, "bench mac_codec { MACs: %zu, Raw: 6.00, Prefix only: %.2f, Encoded: %.2f bytes/MAC }\n",
+    transmitters.size(), prefix_size / macs, encoded_size / macs);
+}
+
+/**
+ * Benchmarks the capture path of the transmitter, the frames of an pcap
+ *  are handed to the promiscuous callbacks at max rate, and the rate, the
+ *  time per frame and the drops are reported to stderr
+ * 
+ * @param path the pcap file
+ * @param labels the device of each randomized MAC in the pcap, or nullptr
+ * @return 0 on success, -1 if the pcap can't be read
+ */
+int32_t sim_bench_run(const char *path, const char *labels) {
+  /* Loads the whole capture first, so the file reads are not measured */
+  static sim_pcap_t pcap;
+  if (sim_pcap_open(&pcap, path) != 0) return -1;
+
+  std::vector<sim_bench_frame_t> frames;
+  std::unordered_set<uint64_t> transmitters;
+  std::vector<measurement_t> first_seen;
+  uint32_t rejected = 0, misattributed = 0, with_elements = 0, elements = 0, malformed = 0, truncated = 0;
+  sim_pcap_frame_t frame;
+  while (sim_pcap_next(&pcap, &frame)) {
+    frames.push_back({ std::vector<uint8_t>(frame.data, frame.data + frame.size), frame.rssi, frame.ts });
+
+    /* Counts the distinct transmitters in the capture, which is what the
+     * callback should find, and the frames the old cast took address 2 of
+     * while they have no transmitter, or are too short to have one */
+    ieee80211_frame_info_t info;
+    bool classified = ieee80211_classify(frame.data, frame.size, &info) == 0;
+    if (!classified) ++rejected;
+    else if (info.transmitter != nullptr && transmitters.insert(mac_set_key(info.transmitter)).second) {
+      first_seen.emplace_back();
+      memcpy(first_seen.back().mac, info.transmitter, 6);
+    }
+
+    if ((!classified || info.transmitter == nullptr) && frame.size >= 2
+      && ((frame.data[0] >> 2) & 0x3) != WIFI_CF_EXT) ++misattributed;
+
+    /* Counts the elements, those with an impossible length, and the walks
+     * which ended at an truncated element */
+    ieee80211_ie_iter_t iter;
+    ieee80211_ie_t ie;
+    if (classified && ieee80211_ie_begin(&iter, frame.data, frame.size, &info)) {
+      ++with_elements;
+      while (ieee80211_ie_next(&iter, &ie)) {
+        ++elements;
+        if (ie.kind == IEEE80211_IE_KIND_MALFORMED) ++malformed;
+      }
+
+      if (!ieee80211_ie_complete(&iter)) ++truncated;
+    }
+  }
+
+  sim_pcap_close(&pcap);
+  fprintf(stderr, "bench capture { Frames: %zu, Transmitters: %zu, Rejected: %u, "
+    "Misattributed by the cast: %u }\n", frames.size(), transmitters.size(), rejected, misattributed);
+  fprintf(stderr, "bench elements { Frames: %u, Elements: %u, Malformed: %u, Truncated: %u }\n",
+    with_elements, elements, malformed, truncated);
+  sim_bench_mac_codec(first_seen);
+
+  /* The shim pass is the baseline, which has to be subtracted from the
+   * others. The collection tasks keep running during the capture pass,
+   * like on the device, so the ring drops are real */
+  sim_bench_pass("shim", &sim_bench_noop_cb, frames);
+  sim_bench_pass("header cast", &sim_bench_cast_cb, frames);
+  sim_bench_pass("ieee80211_classify", &sim_bench_classify_cb, frames);
+  sim_bench_pass("ieee80211_ie_next", &sim_bench_elements_cb, frames);
+  sim_bench_pass("fingerprint_probe", &sim_bench_fingerprint_cb, frames);
+  sim_bench_fingerprints(frames, labels);
+
+  lora_tx_stats_t before, after;
+  lora_get_stats(&before);
+  sim_bench_pass("promisc_packet_cb", &promisc_packet_cb, frames);
+  std::this_thread::sleep_for(std::chrono::milliseconds(GLOBAL_TX_TASK_POLL_DELAY * 10));
+  lora_get_stats(&after);
+
+  uint32_t received = after.received - before.received;
+  uint32_t dropped = after.dropped - before.dropped;
+  uint32_t duplicates = after.duplicates - before.duplicates;
+  uint32_t suppressed = after.suppressed - before.suppressed;
+  fprintf(stderr, "bench promisc_packet_cb { Received: %u, Dropped: %u, Duplicates: %u, "
+    "Suppressed: %u, Unique per batch: %u }\n", received, dropped, duplicates, suppressed,
+    received - dropped - duplicates - suppressed);
+
+  sim_bench_pass("ieee80211_log_packet", &ieee80211_log_packet, frames);
+
+  esp_wifi_set_promiscuous_rx_cb(&promisc_packet_cb);
+  return 0;
+}
+
+#endif
@@ -0,0 +1,123 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#include "binlog.h"
+#include "sim_binlog.h"
+
+#include <ctype.h>
+
+typedef struct {
+  const char *name;
+  const char *format;
+} sim_binlog_format_t;
+
+/* The format strings, which only exist on the host */
+#define BINLOG_FORMAT(NAME, MODULE, LEVEL, FORMAT) { #NAME, FORMAT },
+static const sim_binlog_format_t g_Formats[] = {
+  #include "binlog_formats.h"
+};
+#undef BINLOG_FORMAT
+
+/**
+ * Parses an hex string into bytes
+ * 
+ * @param hex the hex string, ends at the first non hex character
+ * @param out the output buffer
+ * @param out_size the size of the output buffer
+ * @return the number of bytes, or -1 if it's malformed or too long
+ */
+static int32_t sim_binlog_parse_hex(const char *hex, uint8_t *out, size_t out_size) {
+  size_t n = 0;
+  for (; isxdigit(hex[0]); hex += 2) {
+    if (!isxdigit(hex[1]) || n >= out_size) return -1;
+    char byte[3] = { hex[0], hex[1], '\0' };
+    out[n++] = static_cast<uint8_t>(strtoul(byte, nullptr, 16));
+  }
+
+  return static_cast<int32_t>(n);
+}
+
+/**
+ * Prints an log format with its arguments, the conversions are handed to
+ *  printf one by one, except '%M' which prints an MAC from two arguments
+ * 
+ * @param out the output
+ * @param format the format string
+ * @param argc the number of arguments
+ * @param args the arguments
+ */
+static void sim_binlog_print(FILE *out, const char *format, uint8_t argc, const uint32_t *args) {
+  uint8_t arg = 0;
+
+  while (*format != '\0') {
+    if (*format != '%') {
+      fputc(*format++, out);
+      continue;
+    }
+
+    /* Collects the flags and width of the conversion */
+    char spec[16];
+    size_t n = 0;
+    spec[n++] = *format++;
+    while (*format != '\0' && strchr("-+ #0123456789", *format) && n < sizeof (spec) - 3)
+      spec[n++] = *format++;
+
+    char conversion = *format != '\0' ? *format++ : '%';
+    if (conversion == '%') {
+      fputc('%', out);
+    } else if (conversion == 'M') {
+      uint32_t hi = arg < argc ? args[arg] : 0, lo = arg + 1 < argc ? args[arg + 1] : 0;
+      arg += 2;
+      fprintf(out, "%02x:%02x:%02x:%02x:%02x:%02x", (hi >> 16) & 0xff, (hi >> 8) & 0xff,
+        hi & 0xff, (lo >> 16) & 0xff, (lo >> 8) & 0xff, lo & 0xff);
+    } else {
+      spec[n++] = conversion;
+      spec[n] = '\0';
+      uint32_t value = arg < argc ? args[arg] : 0;
+      ++arg;
+      if (conversion == 'd' || conversion == 'i') fprintf(out, spec, static_cast<int32_t>(value));
+      else fprintf(out, spec, value);
+    }
+  }
+}
+
+/**
+ * Decodes the '#L' log lines of an serial console capture into text, the
+ *  other lines are copied as is
+ * 
+ * @param in the serial console capture
+ * @param out the output
+ */
+void sim_binlog_decode(FILE *in, FILE *out) {
+  char line[1024];
+
+  while (fgets(line, sizeof (line), in) != nullptr) {
+    uint8_t record[BINLOG_RECORD_MAX_SIZE];
+    int32_t size;
+    if (strncmp(line, "#L", 2) != 0
+      || (size = sim_binlog_parse_hex(&line[2], record, sizeof (record))) < 6
+      || size != 6 + record[1] * 4) {
+      fputs(line, out);
+      continue;
+    }
+
+    uint8_t id = record[0], argc = record[1];
+    uint32_t time = 0, args[BINLOG_MAX_ARGS];
+    for (size_t i = 0; i < 4; ++i) time |= static_cast<uint32_t>(record[2 + i]) << (i * 8);
+    for (uint8_t a = 0; a < argc; ++a) {
+      args[a] = 0;
+      for (size_t i = 0; i < 4; ++i) args[a] |= static_cast<uint32_t>(record[6 + a * 4 + i]) << (i * 8);
+    }
+
+    fprintf(out, "[%10.6f] ", time / 1e6);
+    if (id >= BINLOG_FORMAT_COUNT) {
+      fprintf(out, "Unknown log format %u\n", id);
+      continue;
+    }
+
+    fprintf(out, "%s: ", g_Formats[id].name);
+    sim_binlog_print(out, g_Formats[id].format, argc, args);
+    fputc('\n', out);
+  }
+}
@@ -0,0 +1,251 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#include <esp_timer.h>
+#include <esp_wifi.h>
+#include <esp_event_loop.h>
+#include <esp_http_client.h>
+#include <nvs_flash.h>
+#include <soc/cpu.h>
+#include <arpa/inet.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <chrono>
+#include <random>
+
+#include "sim.h"
+
+/* The largest 802.11 frame the driver hands to the callback */
+#define SIM_WIFI_MAX_FRAME 2500
+
+static const std::chrono::steady_clock::time_point g_Started = std::chrono::steady_clock::now();
+static std::atomic<int64_t> g_Skipped(0);
+
+static system_event_cb_t g_EventHandler = nullptr;
+static void *g_EventContext = nullptr;
+static wifi_mode_t g_WifiMode = WIFI_MODE_NULL;
+static bool g_WifiConnect = false;
+
+static std::atomic<bool> g_Promiscuous(false);
+static std::atomic<uint32_t> g_PromiscuousFilter(WIFI_PROMIS_FILTER_MASK_ALL);
+static std::atomic<wifi_promiscuous_cb_t> g_PromiscuousCallback(nullptr);
+static std::atomic<uint8_t> g_Channel(1);
+
+struct sim_http_client {
+  int body_len;
+};
+
+static std::atomic<uint32_t> g_HttpRequests(0);
+static std::atomic<uint64_t> g_HttpBytes(0);
+
+/*******************************
+ * System
+ ******************************/
+
+int64_t esp_timer_get_time() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now() - g_Started).count() + g_Skipped.load();
+}
+
+void sim_advance_time(int64_t us) {
+  g_Skipped += us;
+}
+
+uint32_t esp_cpu_get_ccount() {
+  return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now() - g_Started).count());
+}
+
+const char *esp_err_to_name(esp_err_t code) {
+  switch (code) {
+    case ESP_OK: return "ESP_OK";
+    case ESP_FAIL: return "ESP_FAIL";
+    case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+    default: return "UNKNOWN ERROR";
+  }
+}
+
+uint32_t esp_random() {
+  static std::mt19937 generator(std::random_device{}());
+  return generator();
+}
+
+void esp_restart() {
+  fprintf(stderr, "esp_restart() called, exiting the simulation\n");
+  exit(1);
+}
+
+esp_err_t nvs_flash_init() { return ESP_OK; }
+esp_err_t nvs_flash_erase() { return ESP_OK; }
+
+/*******************************
+ * Events
+ ******************************/
+
+esp_err_t esp_event_loop_create_default() { return ESP_OK; }
+void tcpip_adapter_init() {}
+
+esp_err_t esp_event_loop_init(system_event_cb_t cb, void *ctx) {
+  g_EventHandler = cb;
+  g_EventContext = ctx;
+  return ESP_OK;
+}
+
+char *ip4addr_ntoa(const ip4_addr_t *addr) {
+  static char buffer[16];
+  struct in_addr in;
+  in.s_addr = addr->addr;
+  snprintf(buffer, sizeof (buffer), "%s", inet_ntoa(in));
+  return buffer;
+}
+
+/**
+ * Sends an system event to the handler
+ * 
+ * @param id the event
+ */
+static void sim_send_event(system_event_id_t id) {
+  if (g_EventHandler == nullptr) return;
+
+  system_event_t event;
+  memset(&event, 0, sizeof (event));
+  event.event_id = id;
+  if (id == SYSTEM_EVENT_STA_GOT_IP) event.event_info.got_ip.ip_info.ip.addr = htonl(INADDR_LOOPBACK);
+  g_EventHandler(g_EventContext, &event);
+}
+
+/*******************************
+ * WiFi
+ ******************************/
+
+esp_err_t esp_wifi_init(const wifi_init_config_t *config) { return ESP_OK; }
+esp_err_t esp_wifi_set_storage(wifi_storage_t storage) { return ESP_OK; }
+esp_err_t esp_wifi_set_config(esp_interface_t interface, wifi_config_t *config) { return ESP_OK; }
+
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode) {
+  g_WifiMode = mode;
+  return ESP_OK;
+}
+
+/* The station connects as soon as it's asked to, the events are sent after
+ * each other instead of from the handler, like the event task would */
+esp_err_t esp_wifi_start() {
+  if (g_WifiMode != WIFI_MODE_STA) return ESP_OK;
+
+  sim_send_event(SYSTEM_EVENT_STA_START);
+  if (g_WifiConnect) sim_send_event(SYSTEM_EVENT_STA_GOT_IP);
+  return ESP_OK;
+}
+
+esp_err_t esp_wifi_connect() {
+  g_WifiConnect = true;
+  return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_promiscuous(bool enable) {
+  g_Promiscuous.store(enable);
+  return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_promiscuous_filter(const wifi_promiscuous_filter_t *filter) {
+  g_PromiscuousFilter.store(filter->filter_mask);
+  return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_promiscuous_rx_cb(wifi_promiscuous_cb_t cb) {
+  g_PromiscuousCallback.store(cb);
+  return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_channel(uint8_t primary, wifi_second_chan_t second) {
+  if (primary < 1 || primary > 14) return ESP_ERR_INVALID_ARG;
+
+  g_Channel.store(primary);
+  return ESP_OK;
+}
+
+/**
+ * Hands an sniffed 802.11 frame to the promiscuous callback, if promiscuous
+ *  mode is enabled, the filter allows it and the radio is on its channel
+ * 
+ * @param frame the 802.11 frame, starting with the frame control
+ * @param size the size of the frame
+ * @param rssi the rssi in dBm
+ * @param channel the channel the frame was sent on, 0 for any channel
+ * @return false if the frame was filtered
+ */
+bool sim_wifi_deliver(const uint8_t *frame, size_t size, int rssi, uint8_t channel) {
+  wifi_promiscuous_cb_t cb = g_PromiscuousCallback.load();
+  if (!g_Promiscuous.load() || cb == nullptr || size < 2 || size > SIM_WIFI_MAX_FRAME) return false;
+  if (channel != 0 && channel != g_Channel.load()) return false;
+
+  /* The type comes from the frame control, the extension frames end
+   * up as misc like they do in the driver */
+  wifi_promiscuous_pkt_type_t type = static_cast<wifi_promiscuous_pkt_type_t>((frame[0] >> 2) & 0x3);
+  if ((g_PromiscuousFilter.load() & (1 << type)) == 0) return false;
+
+  /* Builds the driver buffer, the signal length includes the FCS */
+  static thread_local uint8_t buffer[sizeof (wifi_promiscuous_pkt_t) + SIM_WIFI_MAX_FRAME];
+  wifi_promiscuous_pkt_t *pkt = reinterpret_cast<wifi_promiscuous_pkt_t *>(buffer);
+  memset(&pkt->rx_ctrl, 0, sizeof (pkt->rx_ctrl));
+  pkt->rx_ctrl.rssi = rssi;
+  pkt->rx_ctrl.channel = g_Channel.load();
+  pkt->rx_ctrl.sig_len = size + 4;
+  pkt->rx_ctrl.timestamp = static_cast<uint32_t>(esp_timer_get_time());
+  memcpy(pkt->payload, frame, size);
+
+  cb(pkt, type);
+  return true;
+}
+
+/*******************************
+ * HTTP client
+ ******************************/
+
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t *config) {
+  return new sim_http_client { 0 };
+}
+
+esp_err_t esp_http_client_set_method(esp_http_client_handle_t client, esp_http_client_method_t method) {
+  return ESP_OK;
+}
+
+esp_err_t esp_http_client_set_header(esp_http_client_handle_t client, const char *key, const char *value) {
+  return ESP_OK;
+}
+
+esp_err_t esp_http_client_set_post_field(esp_http_client_handle_t client, const char *data, int len) {
+  client->body_len = len;
+  return ESP_OK;
+}
+
+esp_err_t esp_http_client_perform(esp_http_client_handle_t client) {
+  g_HttpRequests.fetch_add(1);
+  g_HttpBytes.fetch_add(client->body_len);
+  return ESP_OK;
+}
+
+int esp_http_client_get_status_code(esp_http_client_handle_t client) { return 200; }
+int esp_http_client_get_content_length(esp_http_client_handle_t client) { return 0; }
+esp_err_t esp_http_client_close(esp_http_client_handle_t client) { return ESP_OK; }
+
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client) {
+  delete client;
+  return ESP_OK;
+}
+
+/**
+ * Gets the number of requests made with the HTTP client
+ * 
+ * @param requests the number of requests
+ * @param bytes the number of body bytes
+ */
+void sim_http_counters(uint32_t *requests, uint64_t *bytes) {
+  *requests = g_HttpRequests.load();
+  *bytes = g_HttpBytes.load();
+}
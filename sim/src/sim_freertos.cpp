@@ -0,0 +1,80 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+/* An task, the notification value works like the FreeRTOS one when used
+ * as counting semaphore with ulTaskNotifyTake and xTaskNotifyGive */
+struct sim_task {
+  std::mutex mutex;
+  std::condition_variable cv;
+  uint32_t notifications = 0;
+};
+
+/* The task of the current thread, created on first use for the threads
+ * which were not started with xTaskCreatePinnedToCore (like main) */
+static thread_local sim_task *t_CurrentTask = nullptr;
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char *name, uint32_t stack_size,
+  void *arg, UBaseType_t priority, TaskHandle_t *handle, BaseType_t core) {
+  /* The handle is stored before the thread starts, since the tasks often
+   * use their own handle right away */
+  sim_task *t = new sim_task;
+  if (handle != nullptr) *handle = t;
+
+  std::thread([t, task, arg]() {
+    t_CurrentTask = t;
+    task(arg);
+  }).detach();
+
+  return pdPASS;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+  if (t_CurrentTask == nullptr) t_CurrentTask = new sim_task;
+  return t_CurrentTask;
+}
+
+BaseType_t xPortGetCoreID() {
+  return 0;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks) {
+  sim_task *t = xTaskGetCurrentTaskHandle();
+  std::unique_lock<std::mutex> lock(t->mutex);
+
+  auto notified = [t]() { return t->notifications > 0; };
+  if (ticks == portMAX_DELAY) t->cv.wait(lock, notified);
+  else t->cv.wait_for(lock, std::chrono::milliseconds(ticks * portTICK_PERIOD_MS), notified);
+
+  uint32_t value = t->notifications;
+  if (clear_on_exit) t->notifications = 0;
+  else if (value > 0) --t->notifications;
+  return value;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+  {
+    std::lock_guard<std::mutex> lock(task->mutex);
+    ++task->notifications;
+  }
+
+  task->cv.notify_one();
+  return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken) {
+  xTaskNotifyGive(task);
+  if (woken != nullptr) *woken = pdFALSE;
+}
+
+void vTaskDelay(TickType_t ticks) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ticks * portTICK_PERIOD_MS));
+}
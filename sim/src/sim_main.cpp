@@ -0,0 +1,225 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#include "default.h"
+
+/* The unit tests bring their own entry point */
+#ifndef PIO_UNIT_TESTING
+
+#ifdef COMPILE_AS_RECEIVER
+#include "main_receiver.h"
+#else
+#include "main_transmitter.h"
+#endif
+
+#include "sim.h"
+#include "sim_pcap.h"
+#include "sim_bench.h"
+#include "sim_binlog.h"
+
+#include <getopt.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+/* Host entry point, runs setup() and loop() like the Arduino core does, while
+ * an input thread feeds the firmware. The transmitter is fed the 802.11
+ * frames of an pcap file, the receiver the frames of the simulated LoRa
+ * channel the transmitter wrote */
+
+typedef struct {
+  const char *input;            /* The pcap file, or the LoRa channel */
+  const char *output;           /* The LoRa channel written by the transmitter */
+  double speed;                 /* Replay speed of the pcap, 0 is unpaced */
+  int64_t drain;                /* Time to keep running after the input, in ms */
+  bool bench;                   /* Benchmark the capture path instead */
+  const char *labels;           /* The devices of the randomized MACs, for the benchmark */
+} sim_options_t;
+
+static std::atomic<bool> g_InputDone(false);
+static std::atomic<uint32_t> g_InputFrames(0);
+static std::atomic<uint32_t> g_InputFiltered(0);
+
+#ifndef COMPILE_AS_RECEIVER
+
+/**
+ * Replays an pcap file into the promiscuous callback, paced by the
+ *  capture timestamps
+ * 
+ * @param options the simulation options
+ */
+static void sim_pcap_replay(const sim_options_t *options) {
+  static sim_pcap_t pcap;
+  if (sim_pcap_open(&pcap, options->input) != 0) return;
+
+  sim_pcap_frame_t frame;
+  int64_t first_ts = -1, started = esp_timer_get_time();
+  while (sim_pcap_next(&pcap, &frame)) {
+    /* Waits until the frame is due, relative to the first frame */
+    if (first_ts < 0) first_ts = frame.ts;
+    if (options->speed > 0) {
+      int64_t due = started + static_cast<int64_t>((frame.ts - first_ts) / options->speed);
+      int64_t wait = due - esp_timer_get_time();
+      if (wait > 0) std::this_thread::sleep_for(std::chrono::microseconds(wait));
+    }
+
+    g_InputFrames.fetch_add(1);
+    if (!sim_wifi_deliver(frame.data, frame.size, frame.rssi, frame.channel)) g_InputFiltered.fetch_add(1);
+  }
+
+  sim_pcap_close(&pcap);
+}
+
+#else
+
+/**
+ * Reads the frames of the simulated LoRa channel into the radio
+ * 
+ * @param options the simulation options
+ */
+static void sim_channel_replay(const sim_options_t *options) {
+  FILE *file = fopen(options->input, "rb");
+  if (file == nullptr) {
+    perror("sim_channel_replay()");
+    return;
+  }
+
+  uint8_t frame[256];
+  for (;;) {
+    int size = fgetc(file);
+    if (size == EOF || fread(frame, 1, size, file) != static_cast<size_t>(size)) break;
+
+    g_InputFrames.fetch_add(1);
+    sim_lora_deliver(frame, size, SIM_LORA_DEFAULT_RSSI, SIM_LORA_DEFAULT_SNR);
+  }
+
+  fclose(file);
+}
+
+#endif
+
+/**
+ * Prints the counters of the simulation to stderr
+ */
+static void sim_report() {
+  uint32_t lora_tx, lora_rx, http_requests;
+  uint64_t http_bytes;
+  sim_lora_counters(&lora_tx, &lora_rx);
+  sim_http_counters(&http_requests, &http_bytes);
+
+  fprintf(stderr, "sim { Input frames: %u, Filtered: %u, LoRa TX: %u, LoRa RX: %u, "
+    "HTTP requests: %u, HTTP bytes: %llu }\n", g_InputFrames.load(), g_InputFiltered.load(),
+    lora_tx, lora_rx, http_requests, static_cast<unsigned long long>(http_bytes));
+
+#ifndef COMPILE_AS_RECEIVER
+  lora_tx_stats_t stats;
+  lora_get_stats(&stats);
+  fprintf(stderr, "tx { Received: %u, Dropped: %u, Duplicates: %u, Set overflows: %u, Batches: %u, "
+    "Max in flight: %lldus, Airtime: %lluus, Duty cycle waits: %u }\n",
+    stats.received, stats.dropped, stats.duplicates, stats.overflows, stats.batches,
+    static_cast<long long>(stats.max_in_flight_us),
+    static_cast<unsigned long long>(stats.airtime_us), stats.duty_cycle_waits);
+  fprintf(stderr, "tx reported { Suppressed: %u, Untracked: %u, Refreshed: %u, False positive rate: %uppm, Airtime saved: %lluus }\n",
+    stats.suppressed, stats.untracked, stats.refreshed, stats.reported_fp_ppm, static_cast<unsigned long long>(stats.airtime_saved_us));
+  fprintf(stderr, "tx fingerprints { Devices: %u, Collapsed MACs: %u }\n", stats.fp_clusters,
+    stats.fp_collapsed);
+
+  for (uint8_t channel = 1; channel <= GLOBAL_HOP_CHANNEL_COUNT; ++channel) {
+    hopper_channel_stats_t hop;
+    channel_get_stats(channel, &hop);
+    fprintf(stderr, "channel %2u { Frames: %u, New MACs: %u, New MACs/s: %u, Dwell: %ums, "
+      "Total dwell: %ums }\n", channel, hop.frames, hop.new_macs, hop.score >> HOPPER_SCORE_SHIFT,
+      hop.dwell, hop.dwell_total);
+  }
+#endif
+}
+
+static void sim_usage(const char *program) {
+  fprintf(stderr, "usage: %s -i input [-o channel] [-s speed] [-d drain_ms] [-b [-g labels]]\n"
+    "       %s -l < console.txt\n"
+    "  -i  transmitter: the pcap to replay, receiver: the LoRa channel to read\n"
+    "  -o  transmitter: the LoRa channel to write\n"
+    "  -s  pcap replay speed, 1 is real time, 0 is as fast as possible\n"
+    "  -d  how long to keep running after the input ran out\n"
+    "  -b  transmitter: benchmark the capture path with the pcap, at max rate\n"
+    "  -g  the device of each randomized MAC in the pcap, to score the fingerprints\n"
+    "  -l  decode the binary log lines of an serial console capture\n", program, program);
+}
+
+int main(int argc, char **argv) {
+  sim_options_t options = { nullptr, nullptr, 1.0, 0, false, nullptr };
+
+  /* The transmitter needs an full transmission interval to flush the
+   * last batch, the receiver only an upload window */
+#ifdef COMPILE_AS_RECEIVER
+  options.drain = GLOBAL_AGGREGATE_WINDOW + 1000;
+#else
+  options.drain = GLOBAL_TRANSMISSION_INTERVAL / 1000 + 1000;
+#endif
+
+  int opt;
+  while ((opt = getopt(argc, argv, "i:o:s:d:g:blh")) != -1) {
+    switch (opt) {
+      case 'i': options.input = optarg; break;
+      case 'o': options.output = optarg; break;
+      case 's': options.speed = atof(optarg); break;
+      case 'd': options.drain = atoll(optarg); break;
+      case 'b': options.bench = true; break;
+      case 'g': options.labels = optarg; break;
+      case 'l':
+        sim_binlog_decode(stdin, stdout);
+        return 0;
+      default:
+        sim_usage(argv[0]);
+        return 1;
+    }
+  }
+
+  if (options.input == nullptr) {
+    sim_usage(argv[0]);
+    return 1;
+  }
+
+  sim_lora_open_output(options.output);
+  setup();
+
+#ifndef COMPILE_AS_RECEIVER
+  if (options.bench) {
+    int32_t err = sim_bench_run(options.input, options.labels);
+    fflush(stdout);
+    _exit(err == 0 ? 0 : 1);
+  }
+#endif
+
+  std::thread input([&options]() {
+#ifdef COMPILE_AS_RECEIVER
+    sim_channel_replay(&options);
+#else
+    sim_pcap_replay(&options);
+#endif
+    g_InputDone.store(true);
+  });
+
+  /* Runs the loop until the input ran out, and the firmware had the
+   * time to flush what it still had buffered */
+  int64_t done_at = 0;
+  for (;;) {
+    loop();
+
+    if (!g_InputDone.load()) continue;
+    else if (done_at == 0) done_at = esp_timer_get_time();
+    else if (esp_timer_get_time() - done_at >= options.drain * 1000) break;
+  }
+
+  input.join();
+  fflush(stdout);
+  sim_report();
+
+  /* The tasks never return, so the process is ended without
+   * waiting for them */
+  _exit(0);
+}
+
+#endif
@@ -0,0 +1,149 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#include "sim_pcap.h"
+
+/**
+ * Reads an little or big endian integer from the pcap headers
+ */
+static uint32_t sim_pcap_u32(const uint8_t *p, bool swapped) {
+  return swapped ? (static_cast<uint32_t>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3]
+    : (static_cast<uint32_t>(p[3]) << 24) | (p[2] << 16) | (p[1] << 8) | p[0];
+}
+
+/**
+ * Turns an 2.4GHz frequency into its channel
+ * 
+ * @param mhz the frequency in MHz
+ * @return the channel, or 0 if it's not an 2.4GHz channel
+ */
+static uint8_t sim_radiotap_channel(uint16_t mhz) {
+  if (mhz == 2484) return 14;
+  if (mhz < 2412 || mhz > 2472 || (mhz - 2412) % 5 != 0) return 0;
+  return static_cast<uint8_t>((mhz - 2412) / 5 + 1);
+}
+
+/**
+ * Strips the radiotap header of an captured frame, and takes the signal
+ *  strength and the channel from it when present
+ * 
+ * @param frame the frame, updated to the 802.11 frame
+ * @return false if the header is malformed
+ */
+static bool sim_radiotap_strip(sim_pcap_frame_t *frame) {
+  const uint8_t *p = frame->data;
+  if (frame->size < 8) return false;
+
+  size_t header_size = p[2] | (p[3] << 8);
+  if (header_size > frame->size) return false;
+
+  /* Walks the present bitmaps, only the first one is interpreted */
+  uint32_t present = p[4] | (p[5] << 8) | (p[6] << 16) | (static_cast<uint32_t>(p[7]) << 24);
+  size_t offset = 8;
+  for (uint32_t word = present; word & 0x80000000; offset += 4) {
+    if (offset + 4 > header_size) return false;
+    word = p[offset] | (p[offset + 1] << 8) | (p[offset + 2] << 16) | (static_cast<uint32_t>(p[offset + 3]) << 24);
+  }
+
+  /* The fields up to the antenna signal: TSFT, flags, rate, channel, FHSS
+   * and the signal, each aligned to its own size */
+  static const uint8_t field_size[] = { 8, 1, 1, 4, 2, 1 };
+  static const uint8_t field_align[] = { 8, 1, 1, 2, 1, 1 };
+  uint8_t flags = 0;
+  for (uint8_t field = 0; field < sizeof (field_size); ++field) {
+    if ((present & (1 << field)) == 0) continue;
+
+    offset = (offset + field_align[field] - 1) & ~static_cast<size_t>(field_align[field] - 1);
+    if (offset + field_size[field] > header_size) return false;
+
+    if (field == 1) flags = p[offset];
+    else if (field == 3) frame->channel = sim_radiotap_channel(p[offset] | (p[offset + 1] << 8));
+    else if (field == 5) frame->rssi = static_cast<int8_t>(p[offset]);
+    offset += field_size[field];
+  }
+
+  frame->data += header_size;
+  frame->size -= header_size;
+  if ((flags & SIM_RADIOTAP_FLAGS_FCS) && frame->size >= 4) frame->size -= 4;
+  return true;
+}
+
+/**
+ * Opens an pcap file with raw 802.11 or radiotap frames
+ * 
+ * @param pcap the reader
+ * @param path the pcap file
+ * @return 0 on success, -1 if the file can't be used
+ */
+int32_t sim_pcap_open(sim_pcap_t *pcap, const char *path) {
+  pcap->file = fopen(path, "rb");
+  if (pcap->file == nullptr) {
+    perror("sim_pcap_open()");
+    return -1;
+  }
+
+  uint8_t header[24];
+  if (fread(header, 1, sizeof (header), pcap->file) != sizeof (header)) {
+    fprintf(stderr, "sim_pcap_open(): truncated pcap header\n");
+    sim_pcap_close(pcap);
+    return -1;
+  }
+
+  /* The magic tells the byte order and the timestamp resolution */
+  uint32_t magic = sim_pcap_u32(header, false);
+  pcap->swapped = magic == 0xd4c3b2a1 || magic == 0x4d3cb2a1;
+  pcap->nanoseconds = magic == SIM_PCAP_MAGIC_NS || magic == 0x4d3cb2a1;
+  if (!pcap->swapped && magic != SIM_PCAP_MAGIC_US && magic != SIM_PCAP_MAGIC_NS) {
+    fprintf(stderr, "sim_pcap_open(): not an pcap file\n");
+    sim_pcap_close(pcap);
+    return -1;
+  }
+
+  pcap->linktype = sim_pcap_u32(&header[20], pcap->swapped);
+  if (pcap->linktype != SIM_LINKTYPE_IEEE802_11 && pcap->linktype != SIM_LINKTYPE_RADIOTAP) {
+    fprintf(stderr, "sim_pcap_open(): unsupported link type %u\n", pcap->linktype);
+    sim_pcap_close(pcap);
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * Reads the next frame, frames with an malformed radiotap header are
+ *  skipped, the data stays valid until the next call
+ * 
+ * @param pcap the reader
+ * @param frame the output frame
+ * @return false at the end of the file
+ */
+bool sim_pcap_next(sim_pcap_t *pcap, sim_pcap_frame_t *frame) {
+  for (;;) {
+    uint8_t record[16];
+    if (fread(record, 1, sizeof (record), pcap->file) != sizeof (record)) return false;
+
+    uint32_t captured = sim_pcap_u32(&record[8], pcap->swapped);
+    if (captured > sizeof (pcap->buffer)
+      || fread(pcap->buffer, 1, captured, pcap->file) != captured) return false;
+
+    frame->data = pcap->buffer;
+    frame->size = captured;
+    frame->rssi = SIM_PCAP_DEFAULT_RSSI;
+    frame->channel = 0;
+    frame->ts = static_cast<int64_t>(sim_pcap_u32(record, pcap->swapped)) * 1000000
+      + sim_pcap_u32(&record[4], pcap->swapped) / (pcap->nanoseconds ? 1000 : 1);
+
+    if (pcap->linktype != SIM_LINKTYPE_RADIOTAP || sim_radiotap_strip(frame)) return true;
+  }
+}
+
+/**
+ * Closes an pcap file
+ * 
+ * @param pcap the reader
+ */
+void sim_pcap_close(sim_pcap_t *pcap) {
+  if (pcap->file != nullptr) fclose(pcap->file);
+  pcap->file = nullptr;
+}
@@ -0,0 +1,303 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#include "default.h"
+#include "sim.h"
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+/* Register level model of the SX1276 in LoRa mode behind the SPI shim, so
+ * the real driver in lib/LoRa.cpp runs unmodified. Only the registers the
+ * driver depends on have behavior, the others just store their value */
+
+#define SX1276_REG_FIFO                 0x00
+#define SX1276_REG_OP_MODE              0x01
+#define SX1276_REG_FRF_MSB              0x06
+#define SX1276_REG_LNA                  0x0c
+#define SX1276_REG_FIFO_ADDR_PTR        0x0d
+#define SX1276_REG_FIFO_TX_BASE_ADDR    0x0e
+#define SX1276_REG_FIFO_RX_BASE_ADDR    0x0f
+#define SX1276_REG_FIFO_RX_CURRENT_ADDR 0x10
+#define SX1276_REG_IRQ_FLAGS            0x12
+#define SX1276_REG_RX_NB_BYTES          0x13
+#define SX1276_REG_PKT_SNR_VALUE        0x19
+#define SX1276_REG_PKT_RSSI_VALUE       0x1a
+#define SX1276_REG_MODEM_CONFIG_1       0x1d
+#define SX1276_REG_MODEM_CONFIG_2       0x1e
+#define SX1276_REG_PREAMBLE_LSB         0x21
+#define SX1276_REG_PAYLOAD_LENGTH       0x22
+#define SX1276_REG_RSSI_WIDEBAND        0x2c
+#define SX1276_REG_DIO_MAPPING_1        0x40
+#define SX1276_REG_VERSION              0x42
+
+#define SX1276_MODE_MASK                0x07
+#define SX1276_MODE_STDBY               0x01
+#define SX1276_MODE_TX                  0x03
+#define SX1276_MODE_RX_CONTINUOUS       0x05
+
+#define SX1276_IRQ_TX_DONE              0x08
+#define SX1276_IRQ_RX_DONE              0x40
+
+#define SX1276_DIO0_MASK                0xc0
+#define SX1276_DIO0_RX_DONE             0x00
+#define SX1276_DIO0_TX_DONE             0x40
+
+typedef struct {
+  uint8_t regs[0x80];
+  uint8_t fifo[256];
+  uint8_t address;              /* The register of the current transaction */
+  bool has_address;             /* If the address byte has been received */
+  bool write;                   /* If the current transaction is an write */
+} sx1276_t;
+
+/* The bus lock is held during each SPI transaction, and while an frame is
+ * delivered, so the radio state never changes in the middle of an burst */
+static std::mutex g_Bus;
+static sx1276_t g_Radio;
+static bool g_RadioReset = false;
+
+static FILE *g_Channel = nullptr;
+static std::atomic<uint32_t> g_Transmitted(0);
+static std::atomic<uint32_t> g_Received(0);
+
+/* The SPI traffic, so the cost of the driver can be measured */
+static std::atomic<uint32_t> g_SpiTransactions(0);
+static std::atomic<uint32_t> g_SpiBytes(0);
+
+SPIClass SPI;
+
+/**
+ * Puts the radio in its power on state
+ */
+static void sx1276_reset() {
+  memset(&g_Radio, 0, sizeof (g_Radio));
+  g_Radio.regs[SX1276_REG_OP_MODE] = SX1276_MODE_STDBY;
+  g_Radio.regs[SX1276_REG_FRF_MSB] = 0x6c;
+  g_Radio.regs[SX1276_REG_FRF_MSB + 1] = 0x80;
+  g_Radio.regs[SX1276_REG_LNA] = 0x20;
+  g_Radio.regs[SX1276_REG_FIFO_RX_BASE_ADDR] = 0x00;
+  g_Radio.regs[SX1276_REG_FIFO_TX_BASE_ADDR] = 0x80;
+  g_Radio.regs[SX1276_REG_MODEM_CONFIG_1] = 0x72;
+  g_Radio.regs[SX1276_REG_MODEM_CONFIG_2] = 0x70;
+  g_Radio.regs[SX1276_REG_PREAMBLE_LSB] = 0x08;
+  g_Radio.regs[SX1276_REG_PAYLOAD_LENGTH] = 0x01;
+  g_Radio.regs[SX1276_REG_VERSION] = 0x12;
+  g_RadioReset = true;
+}
+
+/**
+ * Gets the carrier frequency in Hz from the FRF registers
+ */
+static double sx1276_frequency() {
+  uint32_t frf = (static_cast<uint32_t>(g_Radio.regs[SX1276_REG_FRF_MSB]) << 16)
+    | (static_cast<uint32_t>(g_Radio.regs[SX1276_REG_FRF_MSB + 1]) << 8)
+    | g_Radio.regs[SX1276_REG_FRF_MSB + 2];
+  return frf * 32E6 / (1 << 19);
+}
+
+/**
+ * Transmits the payload in the FIFO over the simulated channel
+ * 
+ * @return true if DIO0 has to be raised
+ */
+static bool sx1276_transmit() {
+  uint8_t size = g_Radio.regs[SX1276_REG_PAYLOAD_LENGTH];
+  uint8_t base = g_Radio.regs[SX1276_REG_FIFO_TX_BASE_ADDR];
+
+  uint8_t frame[256];
+  frame[0] = size;
+  for (uint8_t i = 0; i < size; ++i) frame[i + 1] = g_Radio.fifo[static_cast<uint8_t>(base + i)];
+
+  if (g_Channel != nullptr) {
+    fwrite(frame, 1, size + 1, g_Channel);
+    fflush(g_Channel);
+  }
+
+  g_Transmitted.fetch_add(1);
+
+  /* The transmission is done right away, after which the radio goes
+   * back to standby like the real one */
+  g_Radio.regs[SX1276_REG_IRQ_FLAGS] |= SX1276_IRQ_TX_DONE;
+  g_Radio.regs[SX1276_REG_OP_MODE] = (g_Radio.regs[SX1276_REG_OP_MODE] & ~SX1276_MODE_MASK) | SX1276_MODE_STDBY;
+  return (g_Radio.regs[SX1276_REG_DIO_MAPPING_1] & SX1276_DIO0_MASK) == SX1276_DIO0_TX_DONE;
+}
+
+/**
+ * Writes an register
+ * 
+ * @param address the register address
+ * @param value the value
+ * @return true if DIO0 has to be raised
+ */
+static bool sx1276_write(uint8_t address, uint8_t value) {
+  switch (address) {
+    case SX1276_REG_FIFO:
+      g_Radio.fifo[g_Radio.regs[SX1276_REG_FIFO_ADDR_PTR]++] = value;
+      return false;
+    case SX1276_REG_IRQ_FLAGS:
+      g_Radio.regs[SX1276_REG_IRQ_FLAGS] &= ~value;
+      return false;
+    case SX1276_REG_VERSION:
+      return false;
+    case SX1276_REG_OP_MODE:
+      g_Radio.regs[address] = value;
+      if ((value & SX1276_MODE_MASK) == SX1276_MODE_TX) return sx1276_transmit();
+      return false;
+    default:
+      g_Radio.regs[address] = value;
+      return false;
+  }
+}
+
+/**
+ * Reads an register
+ * 
+ * @param address the register address
+ */
+static uint8_t sx1276_read(uint8_t address) {
+  switch (address) {
+    case SX1276_REG_FIFO: return g_Radio.fifo[g_Radio.regs[SX1276_REG_FIFO_ADDR_PTR]++];
+    case SX1276_REG_RSSI_WIDEBAND: return static_cast<uint8_t>(esp_random());
+    default: return g_Radio.regs[address];
+  }
+}
+
+/*******************************
+ * SPIClass
+ ******************************/
+
+void SPIClass::beginTransaction(SPISettings settings) {
+  g_Bus.lock();
+  if (!g_RadioReset) sx1276_reset();
+  g_Radio.has_address = false;
+  g_SpiTransactions.fetch_add(1, std::memory_order_relaxed);
+}
+
+void SPIClass::endTransaction() {
+  g_Bus.unlock();
+}
+
+uint8_t SPIClass::transfer(uint8_t data) {
+  g_SpiBytes.fetch_add(1, std::memory_order_relaxed);
+
+  /* The first byte is the address, with the MSB set for an write */
+  if (!g_Radio.has_address) {
+    g_Radio.has_address = true;
+    g_Radio.write = (data & 0x80) != 0;
+    g_Radio.address = data & 0x7f;
+    return 0x00;
+  }
+
+  /* In burst mode the address increments, except for the FIFO */
+  uint8_t address = g_Radio.address, value = 0x00;
+  if (address != SX1276_REG_FIFO) g_Radio.address = (address + 1) & 0x7f;
+
+  if (!g_Radio.write) value = sx1276_read(address);
+  else if (sx1276_write(address, data)) {
+    /* The interrupt is raised outside of the transaction, like the real
+     * one which can only be handled once the bus is released */
+    g_Bus.unlock();
+    sim_raise_interrupt(DI0);
+    g_Bus.lock();
+  }
+
+  return value;
+}
+
+void SPIClass::writeBytes(const uint8_t *data, uint32_t size) {
+  for (uint32_t i = 0; i < size; ++i) transfer(data[i]);
+}
+
+void SPIClass::transferBytes(const uint8_t *data, uint8_t *out, uint32_t size) {
+  for (uint32_t i = 0; i < size; ++i) {
+    uint8_t value = transfer(data != nullptr ? data[i] : 0x00);
+    if (out != nullptr) out[i] = value;
+  }
+}
+
+/*******************************
+ * Simulated channel
+ ******************************/
+
+/**
+ * Opens the simulated LoRa channel, frames transmitted by the radio are
+ *  appended to the output file
+ * 
+ * @param path the channel file, or nullptr to discard the frames
+ */
+void sim_lora_open_output(const char *path) {
+  std::lock_guard<std::mutex> lock(g_Bus);
+  if (path == nullptr) return;
+
+  g_Channel = fopen(path, "ab");
+  if (g_Channel == nullptr) perror("sim_lora_open_output()");
+}
+
+/**
+ * Delivers an frame to the simulated radio, blocks until the radio is
+ *  in receive mode and the previous frame has been read, so no frames
+ *  are lost in the simulation
+ * 
+ * @param data the frame
+ * @param size the size of the frame
+ * @param rssi the rssi in dBm
+ * @param snr the snr in dB
+ */
+void sim_lora_deliver(const uint8_t *data, size_t size, int rssi, float snr) {
+  if (size > 255) return;
+
+  for (;;) {
+    std::unique_lock<std::mutex> lock(g_Bus);
+    if (!g_RadioReset) sx1276_reset();
+
+    if ((g_Radio.regs[SX1276_REG_OP_MODE] & SX1276_MODE_MASK) != SX1276_MODE_RX_CONTINUOUS
+      || (g_Radio.regs[SX1276_REG_IRQ_FLAGS] & SX1276_IRQ_RX_DONE) != 0) {
+      lock.unlock();
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      continue;
+    }
+
+    /* Stores the frame at the RX base address, with the signal
+     * information encoded like the radio does */
+    uint8_t base = g_Radio.regs[SX1276_REG_FIFO_RX_BASE_ADDR];
+    for (size_t i = 0; i < size; ++i) g_Radio.fifo[static_cast<uint8_t>(base + i)] = data[i];
+
+    g_Radio.regs[SX1276_REG_FIFO_RX_CURRENT_ADDR] = base;
+    g_Radio.regs[SX1276_REG_RX_NB_BYTES] = static_cast<uint8_t>(size);
+    g_Radio.regs[SX1276_REG_PKT_SNR_VALUE] = static_cast<uint8_t>(static_cast<int8_t>(snr * 4));
+    g_Radio.regs[SX1276_REG_PKT_RSSI_VALUE] = static_cast<uint8_t>(rssi + (sx1276_frequency() < 868E6 ? 164 : 157));
+    g_Radio.regs[SX1276_REG_IRQ_FLAGS] |= SX1276_IRQ_RX_DONE;
+    g_Received.fetch_add(1);
+
+    bool raise = (g_Radio.regs[SX1276_REG_DIO_MAPPING_1] & SX1276_DIO0_MASK) == SX1276_DIO0_RX_DONE;
+    lock.unlock();
+
+    if (raise) sim_raise_interrupt(DI0);
+    return;
+  }
+}
+
+/**
+ * Gets the number of frames which went over the simulated channel
+ * 
+ * @param transmitted the number of frames transmitted by the radio
+ * @param received the number of frames received by the radio
+ */
+void sim_lora_counters(uint32_t *transmitted, uint32_t *received) {
+  *transmitted = g_Transmitted.load();
+  *received = g_Received.load();
+}
+
+/**
+ * Gets the traffic on the simulated SPI bus
+ * 
+ * @param transactions the number of transactions, each is one CS assertion
+ * @param bytes the number of bytes clocked, address bytes included
+ */
+void sim_spi_counters(uint32_t *transactions, uint32_t *bytes) {
+  *transactions = g_SpiTransactions.load();
+  *bytes = g_SpiBytes.load();
+}
@@ -0,0 +1,233 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#include "aggregate.h"
+
+static_assert((GLOBAL_AGGREGATE_CAPACITY & (GLOBAL_AGGREGATE_CAPACITY - 1)) == 0,
+  "GLOBAL_AGGREGATE_CAPACITY must be a power of two");
+static_assert(GLOBAL_AGGREGATE_MAX_NODES <= 16,
+  "GLOBAL_AGGREGATE_MAX_NODES must fit in the seen_by bitmap");
+
+/**
+ * Hashes the packed MAC into an slot index
+ * 
+ * @param key the packed mac address
+ */
+static inline size_t aggregate_slot(uint64_t key) {
+  return mac_set_hash(key) & (GLOBAL_AGGREGATE_CAPACITY - 1);
+}
+
+/**
+ * Initializes an aggregation table, must be called before first use
+ * 
+ * @param agg the table to be initialized
+ */
+void aggregate_init(aggregate_t *agg) {
+  memset(agg->epochs, 0, sizeof (agg->epochs));
+  agg->epoch = 1;
+  agg->size = 0;
+  agg->node_count = 0;
+  agg->dropped = 0;
+  agg->lost_parts = 0;
+}
+
+/**
+ * Registers an received packet, looks up (or adds) the node which sent it
+ *  and keeps track of the chain, so missing chained packets are counted
+ * 
+ * @param agg the table
+ * @param pkt the parsed packet
+ * @param now the current time in microseconds
+ * @return the node index, or -1 if there is no room for another node
+ */
+int32_t aggregate_frame(aggregate_t *agg, const cbx_pkt_t *pkt, int64_t now) {
+  /* Finds the node, there are only a handful so an linear search will do */
+  size_t i;
+  for (i = 0; i < agg->node_count; ++i) {
+    if (memcmp(agg->nodes[i].mac, pkt->hdr.sender, 6) == 0) break;
+  }
+
+  aggregate_node_t *node = &agg->nodes[i];
+  if (i == agg->node_count) {
+    if (agg->node_count >= GLOBAL_AGGREGATE_MAX_NODES) return -1;
+
+    memcpy(node->mac, pkt->hdr.sender, 6);
+    node->last_frame = 0;
+    node->chain_no = 0;
+    ++agg->node_count;
+  }
+
+  /* The key is copied, since legacy packets point into the frame buffer */
+  memset(node->api_key, 0, sizeof (node->api_key));
+  if (pkt->body.api_key != nullptr)
+    strncpy(node->api_key, pkt->body.api_key, sizeof (node->api_key) - 1);
+
+  /* The first packet of an batch is not chained and has chain number 0, the
+   * next ones are chained with an incrementing number, so any gap in the
+   * numbers means the packets in between were lost, and an number which
+   * did not go up means the start of the new batch was lost */
+  if (pkt->hdr.flags.chained) {
+    if (pkt->hdr.chain_no > node->chain_no) agg->lost_parts += pkt->hdr.chain_no - node->chain_no - 1;
+    else agg->lost_parts += pkt->hdr.chain_no;
+  }
+
+  node->chain_no = pkt->hdr.chain_no;
+  node->last_frame = now;
+  return static_cast<int32_t>(i);
+}
+
+/**
+ * Merges an measurement into the table
+ * 
+ * @param agg the table
+ * @param node the node index returned by aggregate_frame
+ * @param mac the mac address (6 bytes)
+ * @param record the presence record, with the times in unix seconds
+ * @return false if the table is full
+ */
+bool aggregate_insert(aggregate_t *agg, int32_t node, const uint8_t *mac, const presence_record_t *record) {
+  uint64_t key = mac_set_key(mac);
+  uint16_t bit = static_cast<uint16_t>(1) << node;
+
+  /* Probes until either the MAC or an free slot is found */
+  size_t slot = aggregate_slot(key);
+  while (aggregate_used(agg, slot)) {
+    if (agg->keys[slot] == key) {
+      if (record->first_seen < agg->first_seen[slot]) agg->first_seen[slot] = record->first_seen;
+      if (record->last_seen > agg->last_seen[slot]) agg->last_seen[slot] = record->last_seen;
+      agg->seen_by[slot] |= bit;
+
+      /* The transmitters which saw the MAC are merged as if it was one */
+      if (record->frames > 0) {
+        if (agg->frames[slot] == 0 || record->rssi_max > agg->rssi_max[slot])
+          agg->rssi_max[slot] = record->rssi_max;
+        agg->frames[slot] += record->frames;
+        agg->rssi_sum[slot] += record->rssi_avg * static_cast<int32_t>(record->frames);
+        agg->channels[slot] |= record->channels;
+      }
+
+      return true;
+    }
+
+    slot = (slot + 1) & (GLOBAL_AGGREGATE_CAPACITY - 1);
+  }
+
+  /* Keeps the load factor at or below one half, so the probes stay short */
+  if (agg->size >= GLOBAL_AGGREGATE_CAPACITY / 2) {
+    ++agg->dropped;
+    return false;
+  }
+
+  agg->keys[slot] = key;
+  agg->epochs[slot] = agg->epoch;
+  agg->first_seen[slot] = record->first_seen;
+  agg->last_seen[slot] = record->last_seen;
+  agg->seen_by[slot] = bit;
+  agg->frames[slot] = record->frames;
+  agg->rssi_sum[slot] = record->rssi_avg * static_cast<int32_t>(record->frames);
+  agg->rssi_max[slot] = record->rssi_max;
+  agg->channels[slot] = record->channels;
+  ++agg->size;
+  return true;
+}
+
+/**
+ * Checks if an transmitter sent an frame recently, meaning an chain may
+ *  still be in progress and the window should not be cut yet
+ * 
+ * @param agg the table
+ * @param now the current time in microseconds
+ */
+bool aggregate_busy(const aggregate_t *agg, int64_t now) {
+  for (size_t i = 0; i < agg->node_count; ++i) {
+    if (now - agg->nodes[i].last_frame < GLOBAL_AGGREGATE_CHAIN_TIMEOUT * 1000LL) return true;
+  }
+
+  return false;
+}
+
+/**
+ * Removes the measurement in an slot, the ones further along its probe
+ *  sequence are shifted back into the hole, so no lookup stops short
+ * 
+ * @param agg the table
+ * @param slot the slot index
+ */
+static void aggregate_remove(aggregate_t *agg, size_t slot) {
+  size_t hole = slot;
+  for (size_t next = (slot + 1) & (GLOBAL_AGGREGATE_CAPACITY - 1); aggregate_used(agg, next);
+    next = (next + 1) & (GLOBAL_AGGREGATE_CAPACITY - 1)) {
+    /* An entry may only move back if its home slot is not between the
+     * hole and where it is now */
+    size_t home = aggregate_slot(agg->keys[next]);
+    if (((next - home) & (GLOBAL_AGGREGATE_CAPACITY - 1)) < ((next - hole) & (GLOBAL_AGGREGATE_CAPACITY - 1)))
+      continue;
+
+    agg->keys[hole] = agg->keys[next];
+    agg->first_seen[hole] = agg->first_seen[next];
+    agg->last_seen[hole] = agg->last_seen[next];
+    agg->seen_by[hole] = agg->seen_by[next];
+    agg->frames[hole] = agg->frames[next];
+    agg->rssi_sum[hole] = agg->rssi_sum[next];
+    agg->rssi_max[hole] = agg->rssi_max[next];
+    agg->channels[hole] = agg->channels[next];
+    hole = next;
+  }
+
+  agg->epochs[hole] = 0;
+  --agg->size;
+}
+
+/**
+ * Releases the measurements of the transmitters whose upload succeeded, the
+ *  others are kept to be uploaded again, once none are left the table is
+ *  cleared
+ * 
+ * @param agg the table
+ * @param node_mask the bitmap of the transmitters whose upload succeeded
+ * @param now the current time in microseconds
+ */
+void aggregate_release(aggregate_t *agg, uint16_t node_mask, int64_t now) {
+  for (size_t slot = 0; slot < GLOBAL_AGGREGATE_CAPACITY; ++slot) {
+    if (aggregate_used(agg, slot)) agg->seen_by[slot] &= ~node_mask;
+  }
+
+  /* An entry shifted into the slot which was just emptied is checked too,
+   * the ones shifted into the slots before it were checked already */
+  for (size_t slot = 0; slot < GLOBAL_AGGREGATE_CAPACITY && agg->size > 0;) {
+    if (aggregate_used(agg, slot) && agg->seen_by[slot] == 0) aggregate_remove(agg, slot);
+    else ++slot;
+  }
+
+  if (agg->size == 0) aggregate_clear(agg, now);
+}
+
+/**
+ * Removes all the measurements from the table, the nodes which have not
+ *  sent an frame within the node timeout are forgotten
+ * 
+ * @param agg the table to be cleared
+ * @param now the current time in microseconds
+ */
+void aggregate_clear(aggregate_t *agg, int64_t now) {
+  agg->size = 0;
+
+  /* The table is empty, so no seen_by bit refers to an node anymore, and
+   * the nodes which are left can be moved down to fill the gaps */
+  size_t count = 0;
+  for (size_t i = 0; i < agg->node_count; ++i) {
+    if (now - agg->nodes[i].last_frame >= GLOBAL_AGGREGATE_NODE_TIMEOUT * 1000LL) continue;
+    if (count != i) agg->nodes[count] = agg->nodes[i];
+    ++count;
+  }
+
+  agg->node_count = count;
+
+  /* Bumps the epoch so every slot becomes stale at once, only when the
+   * epoch wraps around we have to wipe the epoch array */
+  if (++agg->epoch == 0) {
+    memset(agg->epochs, 0, sizeof (agg->epochs));
+    agg->epoch = 1;
+  }
+}
@@ -0,0 +1,159 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#include "binlog.h"
+
+static_assert((GLOBAL_LOG_RING_SIZE & (GLOBAL_LOG_RING_SIZE - 1)) == 0,
+  "GLOBAL_LOG_RING_SIZE must be a power of two");
+static_assert(BINLOG_FORMAT_COUNT <= 256, "too many log formats");
+
+/* Bounded multi producer / single consumer ring, the producers claim an
+ * slot by advancing the head, and publish it through the sequence of the
+ * slot, so an producer never waits for another one */
+static binlog_slot_t g_Slots[GLOBAL_LOG_RING_SIZE];
+static std::atomic<uint32_t> g_Head(0);
+static uint32_t g_Tail = 0;
+static std::atomic<uint32_t> g_Dropped(0);
+static uint32_t g_DroppedReported = 0;
+
+/**
+ * The task which drains the log ring, at an low priority so writing to
+ *  the serial console only uses the time left over
+ *
+ * @param arg unused
+ */
+static void binlog_task(void *arg) {
+  for (;;) {
+    binlog_drain();
+    vTaskDelay(pdMS_TO_TICKS(GLOBAL_LOG_DRAIN_DELAY));
+  }
+}
+
+/**
+ * Initializes the log ring, and starts the task which drains it to the
+ *  serial console
+ */
+void binlog_begin() {
+  for (uint32_t i = 0; i < GLOBAL_LOG_RING_SIZE; ++i)
+    g_Slots[i].seq.store(i, std::memory_order_relaxed);
+  g_Head.store(0, std::memory_order_relaxed);
+  g_Tail = 0;
+
+  xTaskCreatePinnedToCore(&binlog_task, "binlog", GLOBAL_LOG_TASK_STACK_SIZE,
+    nullptr, GLOBAL_LOG_TASK_PRIORITY, nullptr, GLOBAL_LOG_TASK_CORE);
+}
+
+/**
+ * Pushes an record into the log ring, safe to call from any task or core,
+ *  use the BINLOG() macro instead so filtered records are compiled away
+ *
+ * @param id the format ID
+ * @param argc the number of arguments
+ * @param args the arguments
+ */
+void IRAM_ATTR binlog_push(uint8_t id, uint8_t argc, const uint32_t *args) {
+  uint32_t pos = g_Head.load(std::memory_order_relaxed);
+  binlog_slot_t *slot;
+
+  /* Claims the slot at the head, the slot is free for this lap once its
+   * sequence equals the position, when it's still one lap behind the ring
+   * is full. Before binlog_begin() all sequences are zero, so those records
+   * are dropped, except the first one which is discarded by binlog_begin() */
+  for (;;) {
+    slot = &g_Slots[pos & (GLOBAL_LOG_RING_SIZE - 1)];
+    int32_t diff = static_cast<int32_t>(slot->seq.load(std::memory_order_acquire) - pos);
+    if (diff == 0) {
+      if (g_Head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+    } else if (diff < 0) {
+      g_Dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    } else {
+      pos = g_Head.load(std::memory_order_relaxed);
+    }
+  }
+
+  slot->time = static_cast<uint32_t>(esp_timer_get_time());
+  slot->id = id;
+  slot->argc = argc;
+  for (uint8_t i = 0; i < argc; ++i) slot->args[i] = args[i];
+  slot->seq.store(pos + 1, std::memory_order_release);
+}
+
+/**
+ * Appends an record as an hex line to an buffer
+ *
+ * @param out the output buffer
+ * @param time the time of the record
+ * @param id the format ID
+ * @param argc the number of arguments
+ * @param args the arguments
+ * @return the number of characters written
+ */
+static size_t binlog_format_line(char *out, uint32_t time, uint8_t id, uint8_t argc,
+  const uint32_t *args) {
+  static const char digits[] = "0123456789abcdef";
+  uint8_t record[BINLOG_RECORD_MAX_SIZE];
+  size_t size = 0, n = 0;
+
+  record[size++] = id;
+  record[size++] = argc;
+  for (size_t i = 0; i < 4; ++i) record[size++] = (time >> (i * 8)) & 0xff;
+  for (uint8_t a = 0; a < argc; ++a)
+    for (size_t i = 0; i < 4; ++i) record[size++] = (args[a] >> (i * 8)) & 0xff;
+
+  out[n++] = '#';
+  out[n++] = 'L';
+  for (size_t i = 0; i < size; ++i) {
+    out[n++] = digits[record[i] >> 4];
+    out[n++] = digits[record[i] & 0xf];
+  }
+
+  out[n++] = '\r';
+  out[n++] = '\n';
+  return n;
+}
+
+/**
+ * Writes the records in the log ring to the serial console
+ */
+void binlog_drain() {
+  static char lines[8 * (2 * BINLOG_RECORD_MAX_SIZE + 4)];
+  const size_t max_line_size = 2 * BINLOG_RECORD_MAX_SIZE + 4;
+  size_t n = 0;
+
+  /* Copies the published records out of the ring, and writes them in
+   * batches so the serial driver is called as little as possible */
+  for (;;) {
+    binlog_slot_t *slot = &g_Slots[g_Tail & (GLOBAL_LOG_RING_SIZE - 1)];
+    if (slot->seq.load(std::memory_order_acquire) != g_Tail + 1) break;
+
+    n += binlog_format_line(&lines[n], slot->time, slot->id, slot->argc, slot->args);
+    slot->seq.store(g_Tail + GLOBAL_LOG_RING_SIZE, std::memory_order_release);
+    ++g_Tail;
+
+    if (n + max_line_size > sizeof (lines)) {
+      Serial.write(reinterpret_cast<const uint8_t *>(lines), n);
+      n = 0;
+    }
+  }
+
+  /* Reports the records which were dropped since the last drain, after
+   * the records which were kept since those came before them */
+  uint32_t dropped = g_Dropped.load(std::memory_order_relaxed);
+  if (dropped != g_DroppedReported) {
+    uint32_t count = dropped - g_DroppedReported;
+    n += binlog_format_line(&lines[n], static_cast<uint32_t>(esp_timer_get_time()),
+      BINLOG_DROPPED, 1, &count);
+    g_DroppedReported = dropped;
+  }
+
+  if (n > 0) Serial.write(reinterpret_cast<const uint8_t *>(lines), n);
+}
+
+/**
+ * Gets the number of records dropped since the ring was full
+ */
+uint32_t binlog_get_dropped() {
+  return g_Dropped.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,151 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#include "bloom.h"
+#include "macset.h"
+
+#include <math.h>
+
+static_assert((GLOBAL_BLOOM_BITS & (GLOBAL_BLOOM_BITS - 1)) == 0 && GLOBAL_BLOOM_BITS >= 32,
+  "GLOBAL_BLOOM_BITS must be a power of two");
+
+/**
+ * Hashes the packed MAC into the two hashes the bit indices are derived
+ *  from, so only one hash is computed for all of them
+ *
+ * @param key the packed mac address
+ * @param h1 the output first hash
+ * @param h2 the output second hash, always odd
+ */
+static inline void bloom_hash(uint64_t key, uint32_t *h1, uint32_t *h2) {
+  key ^= key >> 33;
+  key *= 0xFF51AFD7ED558CCDULL;
+  key ^= key >> 33;
+  key *= 0xC4CEB9FE1A85EC53ULL;
+  key ^= key >> 33;
+  *h1 = static_cast<uint32_t>(key);
+  *h2 = static_cast<uint32_t>(key >> 32) | 1;
+}
+
+/**
+ * Removes all the entries from an Bloom filter
+ *
+ * @param bloom the filter to be cleared
+ */
+void bloom_clear(bloom_t *bloom) {
+  memset(bloom->bits, 0, sizeof (bloom->bits));
+  bloom->set_bits = 0;
+}
+
+/**
+ * Inserts an MAC address into an Bloom filter
+ *
+ * @param bloom the filter to insert into
+ * @param mac the mac address (6 bytes)
+ */
+void bloom_insert(bloom_t *bloom, const uint8_t *mac) {
+  uint32_t h1, h2;
+  bloom_hash(mac_set_key(mac), &h1, &h2);
+
+  for (uint32_t i = 0; i < GLOBAL_BLOOM_HASHES; ++i) {
+    uint32_t bit = (h1 + i * h2) & (GLOBAL_BLOOM_BITS - 1);
+    uint32_t mask = 1UL << (bit & 31);
+    if ((bloom->bits[bit >> 5] & mask) == 0) {
+      bloom->bits[bit >> 5] |= mask;
+      ++bloom->set_bits;
+    }
+  }
+}
+
+/**
+ * Checks if an MAC address might be present in an Bloom filter
+ *
+ * @param bloom the filter to search in
+ * @param mac the mac address (6 bytes)
+ */
+bool bloom_contains(const bloom_t *bloom, const uint8_t *mac) {
+  uint32_t h1, h2;
+  bloom_hash(mac_set_key(mac), &h1, &h2);
+
+  for (uint32_t i = 0; i < GLOBAL_BLOOM_HASHES; ++i) {
+    uint32_t bit = (h1 + i * h2) & (GLOBAL_BLOOM_BITS - 1);
+    if ((bloom->bits[bit >> 5] & (1UL << (bit & 31))) == 0) return false;
+  }
+
+  return true;
+}
+
+/**
+ * Estimates the false positive rate of an Bloom filter from the bits set
+ *
+ * @param bloom the filter
+ * @return the false positive rate in parts per million
+ */
+uint32_t bloom_fp_rate(const bloom_t *bloom) {
+  /* An absent MAC is found when all of its bits happen to be set */
+  double fill = static_cast<double>(bloom->set_bits) / GLOBAL_BLOOM_BITS;
+  return static_cast<uint32_t>(pow(fill, GLOBAL_BLOOM_HASHES) * 1000000.0 + 0.5);
+}
+
+/**
+ * Initializes an pair of Bloom filters, must be called before first use
+ *
+ * @param pair the pair to be initialized
+ * @param interval the rotation interval in milliseconds
+ * @param now the current time in microseconds
+ */
+void bloom_pair_init(bloom_pair_t *pair, int64_t interval, int64_t now) {
+  bloom_clear(&pair->filters[0]);
+  bloom_clear(&pair->filters[1]);
+  pair->current = 0;
+  pair->interval = interval * 1000LL;
+  pair->rotated_at = now;
+}
+
+/**
+ * Rotates the filters of an pair once the rotation interval is over
+ *
+ * @param pair the pair
+ * @param now the current time in microseconds
+ * @return true if the filters were rotated
+ */
+bool bloom_pair_rotate(bloom_pair_t *pair, int64_t now) {
+  if (now - pair->rotated_at < pair->interval) return false;
+
+  pair->current ^= 1;
+  bloom_clear(&pair->filters[pair->current]);
+  pair->rotated_at = now;
+  return true;
+}
+
+/**
+ * Inserts an MAC address into an pair, unless one of the filters already
+ *  contains it
+ *
+ * @param pair the pair to insert into
+ * @param mac the mac address (6 bytes)
+ * @return true if inserted, false if (probably) already present
+ */
+bool bloom_pair_insert(bloom_pair_t *pair, const uint8_t *mac) {
+  /* An MAC found in the older filter is not inserted again, so it's only
+   * forgotten, and inserted anew, once that filter rotates out */
+  if (bloom_contains(&pair->filters[0], mac) || bloom_contains(&pair->filters[1], mac))
+    return false;
+
+  bloom_insert(&pair->filters[pair->current], mac);
+  return true;
+}
+
+/**
+ * Estimates the false positive rate of an pair, an MAC is falsely found
+ *  when either of the filters falsely contains it
+ *
+ * @param pair the pair
+ * @return the false positive rate in parts per million
+ */
+uint32_t bloom_pair_fp_rate(const bloom_pair_t *pair) {
+  uint64_t pass0 = 1000000 - bloom_fp_rate(&pair->filters[0]);
+  uint64_t pass1 = 1000000 - bloom_fp_rate(&pair->filters[1]);
+  return static_cast<uint32_t>(1000000 - pass0 * pass1 / 1000000);
+}
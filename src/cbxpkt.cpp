@@ -4,45 +4,194 @@
 
 #include "cbxpkt.h"
 
+/* The table which maps the key identifiers sent over the air to the API
+ * keys, only required on the gateway */
+static const cbx_pkt_key_t g_Keys[] = GLOBAL_API_KEYS;
+
+/*******************************
+ * Helpers
+ ******************************/
+
+static inline void cbx_pkt_put_u16(uint8_t *out, uint16_t v) {
+  out[0] = static_cast<uint8_t>(v);
+  out[1] = static_cast<uint8_t>(v >> 8);
+}
+
+static inline void cbx_pkt_put_u32(uint8_t *out, uint32_t v) {
+  out[0] = static_cast<uint8_t>(v);
+  out[1] = static_cast<uint8_t>(v >> 8);
+  out[2] = static_cast<uint8_t>(v >> 16);
+  out[3] = static_cast<uint8_t>(v >> 24);
+}
+
+static inline uint16_t cbx_pkt_get_u16(const uint8_t *in) {
+  return static_cast<uint16_t>(in[0]) | (static_cast<uint16_t>(in[1]) << 8);
+}
+
+static inline uint32_t cbx_pkt_get_u32(const uint8_t *in) {
+  return static_cast<uint32_t>(in[0]) | (static_cast<uint32_t>(in[1]) << 8)
+    | (static_cast<uint32_t>(in[2]) << 16) | (static_cast<uint32_t>(in[3]) << 24);
+}
+
+static inline uint8_t cbx_pkt_flags_to_byte(const cbx_pkt_flags_t *flags) {
+  return (flags->encrypted << 0) | (flags->relayed << 1) | (flags->chained << 2)
+    | (flags->compressed << 3) | (flags->sketch << 4) | (flags->presence << 5)
+    | (flags->reserved << 6);
+}
+
+static inline void cbx_pkt_flags_from_byte(cbx_pkt_flags_t *flags, uint8_t b) {
+  flags->encrypted = (b >> 0) & 0x1;
+  flags->relayed = (b >> 1) & 0x1;
+  flags->chained = (b >> 2) & 0x1;
+  flags->compressed = (b >> 3) & 0x1;
+  flags->sketch = (b >> 4) & 0x1;
+  flags->presence = (b >> 5) & 0x1;
+  flags->reserved = (b >> 6) & 0x3;
+}
+
+/**
+ * Writes the fields both wire formats have in common, these are the
+ *  first 22 bytes
+ * 
+ * @param pkt the packet
+ * @param out the output buffer
+ */
+static void cbx_pkt_serialize_common(const cbx_pkt_t *pkt, uint8_t *out) {
+  memcpy(&out[4], pkt->hdr.sender, 6);
+  memcpy(&out[10], pkt->hdr.receiver, 6);
+  out[16] = pkt->hdr.chain_no;
+  out[17] = cbx_pkt_flags_to_byte(&pkt->hdr.flags);
+  cbx_pkt_put_u32(&out[18], pkt->body.unique_id);
+}
+
+/*******************************
+ * Functions
+ ******************************/
+
+/**
+ * Serializes an packet into the version 2 wire format
+ * 
+ * @param pkt the packet to be serialized
+ * @param out the output buffer
+ * @param out_size the size of the output buffer
+ * @return the number of bytes written, or 0 if the buffer is too small
+ */
+size_t cbx_pkt_serialize(const cbx_pkt_t *pkt, uint8_t *out, size_t out_size) {
+  size_t size = CBX_PKT_HEADER_SIZE + pkt->body.size;
+  if (size > out_size) return 0;
+
+  out[0] = 'C'; out[1] = 'B'; out[2] = 'X';
+  out[3] = CBX_PKT_VERSION;
+  cbx_pkt_serialize_common(pkt, out);
+  cbx_pkt_put_u16(&out[22], pkt->body.key_id);
+  out[24] = pkt->body.size;
+  memcpy(&out[CBX_PKT_HEADER_SIZE], pkt->body.payload, pkt->body.size);
+
+  return size;
+}
+
+/**
+ * Serializes an packet into the legacy wire format, which still carries
+ *  the API key, this is what the server understands
+ * 
+ * @param pkt the packet to be serialized, body.api_key must be set
+ * @param out the output buffer
+ * @param out_size the size of the output buffer
+ * @return the number of bytes written, or 0 if the buffer is too small
+ */
+size_t cbx_pkt_serialize_legacy(const cbx_pkt_t *pkt, uint8_t *out, size_t out_size) {
+  size_t size = CBX_PKT_LEGACY_HEADER_SIZE + pkt->body.size;
+  if (size > out_size) return 0;
+
+  out[0] = 'C'; out[1] = 'B'; out[2] = 'X';
+  out[3] = CBX_PKT_VERSION_LEGACY;
+  cbx_pkt_serialize_common(pkt, out);
+  memset(&out[22], 0, CBX_PKT_LEGACY_API_KEY_SIZE);
+  if (pkt->body.api_key != nullptr)
+    strncpy(reinterpret_cast<char *>(&out[22]), pkt->body.api_key, CBX_PKT_LEGACY_API_KEY_SIZE - 1);
+  out[40] = pkt->body.size;
+  memcpy(&out[CBX_PKT_LEGACY_HEADER_SIZE], pkt->body.payload, pkt->body.size);
+
+  return size;
+}
+
+/**
+ * Parses an packet in either wire format, the payload points into the
+ *  input buffer, the API key is resolved with cbx_pkt_lookup_key for
+ *  version 2 packets
+ * 
+ * @param in the input buffer
+ * @param in_size the size of the input buffer
+ * @param pkt the output packet
+ * @return 0 on success, -1 if the packet is malformed or not ours
+ */
+int32_t cbx_pkt_parse(const uint8_t *in, size_t in_size, cbx_pkt_t *pkt) {
+  if (in_size < CBX_PKT_HEADER_SIZE) return -1;
+  else if (in[0] != 'C' || in[1] != 'B' || in[2] != 'X') return -1;
+
+  /* Parses the fields both wire formats have in common */
+  pkt->hdr.version = in[3];
+  memcpy(pkt->hdr.sender, &in[4], 6);
+  memcpy(pkt->hdr.receiver, &in[10], 6);
+  pkt->hdr.chain_no = in[16];
+  cbx_pkt_flags_from_byte(&pkt->hdr.flags, in[17]);
+  pkt->body.unique_id = cbx_pkt_get_u32(&in[18]);
+
+  /* Parses the version specific fields */
+  size_t header_size;
+  switch (pkt->hdr.version) {
+    case CBX_PKT_VERSION: {
+      header_size = CBX_PKT_HEADER_SIZE;
+      pkt->body.key_id = cbx_pkt_get_u16(&in[22]);
+      pkt->body.api_key = cbx_pkt_lookup_key(pkt->body.key_id);
+      pkt->body.size = in[24];
+      if (pkt->body.api_key == nullptr) return -1;
+      break;
+    }
+    case CBX_PKT_VERSION_LEGACY: {
+      header_size = CBX_PKT_LEGACY_HEADER_SIZE;
+      if (in_size < header_size) return -1;
+
+      /* The key must be terminated inside its field */
+      const char *api_key = reinterpret_cast<const char *>(&in[22]);
+      if (memchr(api_key, '\0', CBX_PKT_LEGACY_API_KEY_SIZE) == nullptr) return -1;
+
+      pkt->body.key_id = 0;
+      pkt->body.api_key = api_key;
+      pkt->body.size = in[40];
+      break;
+    }
+    default: return -1;
+  }
+
+  /* Checks if the whole payload has been received */
+  if (in_size < header_size + pkt->body.size) return -1;
+  pkt->body.payload = &in[header_size];
+
+  return 0;
+}
+
 /**
- * Logs packet details over the USART line
+ * Looks up the API key of an key identifier in GLOBAL_API_KEYS
+ * 
+ * @param key_id the key identifier
+ * @return the API key, or nullptr if unknown
+ */
+const char *cbx_pkt_lookup_key(uint16_t key_id) {
+  for (size_t i = 0; i < sizeof (g_Keys) / sizeof (cbx_pkt_key_t); ++i)
+    if (g_Keys[i].key_id == key_id) return g_Keys[i].api_key;
+  return nullptr;
+}
+
+/**
+ * Logs packet details to the log ring
  * 
  * @param pkt the packet to be logged
  */
 void cbx_pkt_log(const cbx_pkt_t *pkt) {
-  char sender[] = {"00:00:00:00:00:00\0"};
-  char receiver[] = {"00:00:00:00:00:00\0"};
-
-  /* Convers the addresses to strings */
-  ieee80211_mac_to_string(receiver, pkt->hdr.receiver);
-  ieee80211_mac_to_string(sender, pkt->hdr.sender);
-
-  /* Prints the basic packet information */
-  uint32_t flags = 0x0;
-  memcpy(&flags, &pkt->hdr.flags, 1);
-  Serial.printf(
-    "cbx_pkt_t {\r\n"
-    "\tHeader {\r\n"
-    "\t\tLabel: %c%c%c%c\r\n"
-    "\t\tSender: %s\r\n"
-    "\t\tReceiver: %s\r\n"
-    "\t\tChain no: %d\r\n"
-    "\t\tFlags: %02X\r\n"
-    "\t}\r\n"
-    "\tBody {\r\n"
-    "\t\tSize: %d\r\n"
-    "\t\tAPIKey: %s\r\n"
-    "\t}\r\n"
-    "}\r\n"
-    , // ==========================================
-    pkt->hdr.label[0], pkt->hdr.label[1], pkt->hdr.label[2], pkt->hdr.label[3],
-    sender,
-    receiver,
-    pkt->hdr.chain_no,
-    flags,
-    pkt->body.size,
-    pkt->body.api_key
-  );
+  BINLOG(PKT_HEADER, pkt->hdr.version, BINLOG_MAC(pkt->hdr.sender), BINLOG_MAC(pkt->hdr.receiver),
+    pkt->hdr.chain_no, cbx_pkt_flags_to_byte(&pkt->hdr.flags));
+  BINLOG(PKT_BODY, pkt->body.size, pkt->body.key_id);
 }
 
 /**
@@ -51,37 +200,20 @@ void cbx_pkt_log(const cbx_pkt_t *pkt) {
  * @param pkt the packet to be transmitted
  */
 void cbx_pkt_transmit(const cbx_pkt_t *pkt) {
-  const uint8_t *bin = nullptr;
-  uint8_t write_size = 0, packet_size = 0;
+  uint8_t frame[CBX_PKT_MAX_SIZE];
+  STATS_ONLY(uint32_t started = stats_now());
+
+  /* Serializes the whole frame, so it is written into the FIFO in
+   * a single SPI burst */
+  size_t frame_size = cbx_pkt_serialize(pkt, frame, sizeof (frame));
+  if (frame_size == 0) return;
 
-  /* Begins the transmission of the packet */
   LoRa.beginPacket();
+  LoRa.write(frame, frame_size);
+  STATS_ONLY(stats_end(STATS_TRANSMIT, started));
 
-  /* Defines the anonymous function which will send some
-   * bytes over lora */
-  auto transmit = [&]() {
-    packet_size += write_size;
-    for (uint8_t i = 0; i < write_size; ++i) LoRa.write(bin[i]);
-  };
-
-  /* Sends the packet header, which will contain the flags etcetera
-   * all of the size will be known at runtime */
-  bin = reinterpret_cast<const uint8_t *>(&pkt->hdr);
-  write_size = sizeof (cbx_pkt_hdr_t);
-  transmit();
-
-  /* Sends the packet body without the payload, since the
-   * size is not know at compilation time, we will do this separately */
-  bin = reinterpret_cast<const uint8_t *>(&pkt->body);
-  write_size = sizeof (cbx_pkt_body_t) - sizeof (uint8_t *);
-  transmit();
-
-  /* Sends the payload, the size will not be known by default, the size is
-   * defined in the body size attribute */
-  write_size = pkt->body.size;
-  bin = pkt->body.payload;
-  transmit();
-
-  /* Ends the packet */
+  /* Blocks until the radio is done, which is the time on air */
+  STATS_ONLY(started = stats_now());
   LoRa.endPacket();
-}
\ No newline at end of file
+  STATS_ONLY(stats_end(STATS_TX_DONE, started));
+}
@@ -0,0 +1,107 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#include "dutycycle.h"
+
+/* The airtime allowed within one window */
+static const int64_t g_DutyCycleBudget = 
+  static_cast<int64_t>(GLOBAL_DUTY_CYCLE_WINDOW) * GLOBAL_DUTY_CYCLE / 1000;
+
+/**
+ * Removes the transmissions which left the window
+ * 
+ * @param dc the budget
+ * @param now the current time in microseconds
+ */
+static void duty_cycle_expire(duty_cycle_t *dc, int64_t now) {
+  while (dc->count > 0) {
+    const duty_cycle_entry_t *e = &dc->entries[dc->head];
+    if (e->at + GLOBAL_DUTY_CYCLE_WINDOW > now) break;
+
+    dc->used -= e->airtime;
+    dc->head = (dc->head + 1) % GLOBAL_DUTY_CYCLE_HISTORY;
+    --dc->count;
+  }
+}
+
+/**
+ * Initializes an duty cycle budget
+ * 
+ * @param dc the budget to be initialized
+ */
+void duty_cycle_init(duty_cycle_t *dc) {
+  dc->head = 0;
+  dc->count = 0;
+  dc->used = 0;
+}
+
+/**
+ * Gets the airtime in microseconds which may still be used right now
+ * 
+ * @param dc the budget
+ * @param now the current time in microseconds
+ */
+int64_t duty_cycle_available(duty_cycle_t *dc, int64_t now) {
+  duty_cycle_expire(dc, now);
+
+  /* When the history is full we can't keep track of another transmission */
+  if (dc->count >= GLOBAL_DUTY_CYCLE_HISTORY) return 0;
+  return g_DutyCycleBudget - dc->used;
+}
+
+/**
+ * Gets how long to wait until an transmission fits in the budget
+ * 
+ * @param dc the budget
+ * @param now the current time in microseconds
+ * @param airtime the time on air of the transmission in microseconds
+ * @return the time to wait in microseconds, 0 if it can be sent now
+ */
+int64_t duty_cycle_wait_time(duty_cycle_t *dc, int64_t now, uint32_t airtime) {
+  duty_cycle_expire(dc, now);
+  if (airtime > g_DutyCycleBudget) return GLOBAL_DUTY_CYCLE_WINDOW;
+
+  /* Walks from the oldest transmission on, until enough of them have left
+   * the window for the new one to fit, and a history slot is free */
+  int64_t used = dc->used;
+  size_t count = dc->count;
+  for (size_t i = 0; i < dc->count; ++i) {
+    if (used + airtime <= g_DutyCycleBudget && count < GLOBAL_DUTY_CYCLE_HISTORY) break;
+
+    const duty_cycle_entry_t *e = &dc->entries[(dc->head + i) % GLOBAL_DUTY_CYCLE_HISTORY];
+    used -= e->airtime;
+    --count;
+    if (used + airtime <= g_DutyCycleBudget && count < GLOBAL_DUTY_CYCLE_HISTORY)
+      return e->at + GLOBAL_DUTY_CYCLE_WINDOW - now;
+  }
+
+  return 0;
+}
+
+/**
+ * Records an transmission in the budget
+ * 
+ * @param dc the budget
+ * @param now the time the transmission started
+ * @param airtime the time on air of the transmission in microseconds
+ */
+void duty_cycle_record(duty_cycle_t *dc, int64_t now, uint32_t airtime) {
+  duty_cycle_expire(dc, now);
+
+  /* If the caller ignored the wait time and the history is full, the oldest
+   * entry is merged into the next one, which expires later, so the budget
+   * stays pessimistic instead of forgetting airtime */
+  if (dc->count >= GLOBAL_DUTY_CYCLE_HISTORY) {
+    size_t next = (dc->head + 1) % GLOBAL_DUTY_CYCLE_HISTORY;
+    dc->entries[next].airtime += dc->entries[dc->head].airtime;
+    dc->head = next;
+    --dc->count;
+  }
+
+  duty_cycle_entry_t *e = &dc->entries[(dc->head + dc->count) % GLOBAL_DUTY_CYCLE_HISTORY];
+  e->at = now;
+  e->airtime = airtime;
+  dc->used += airtime;
+  ++dc->count;
+}
@@ -0,0 +1,130 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#include "fingerprint.h"
+#include "ieee80211.h"
+#include "macset.h"
+
+/**
+ * Mixes an byte into an FNV-1a hash
+ *
+ * @param hash the hash
+ * @param b the byte
+ */
+static inline uint32_t fingerprint_mix(uint32_t hash, uint8_t b) {
+  return (hash ^ b) * 0x01000193;
+}
+
+/**
+ * Fingerprints the body of an probe request, by hashing the order of its
+ *  information elements and the contents of those describing the hardware,
+ *  the elements which depend on the network or channel are left out
+ *
+ * @param body the frame body, starting at the first element
+ * @param size the size of the body
+ * @return the fingerprint, or FINGERPRINT_NONE if the body has no elements
+ */
+uint32_t IRAM_ATTR fingerprint_probe(const uint8_t *body, size_t size) {
+  uint32_t hash = 0x811C9DC5;
+  size_t elements = 0;
+
+  /* An truncated element ends the walk, the ones before it still count. The
+   * elements which take part with their contents are picked by ID, so the
+   * malformed ones still differ by their contents */
+  ieee80211_ie_iter_t iter;
+  ieee80211_ie_t ie;
+  ieee80211_ie_init(&iter, body, size);
+  while (ieee80211_ie_next(&iter, &ie)) {
+    hash = fingerprint_mix(hash, ie.id);
+
+    size_t hashed = 0;
+    switch (ie.id) {
+      case IEEE80211_IE_RATES:
+      case IEEE80211_IE_HT_CAPABILITIES:
+      case IEEE80211_IE_EXT_RATES:
+      case IEEE80211_IE_EXT_CAPABILITIES:
+      case IEEE80211_IE_VHT_CAPABILITIES:
+        hashed = ie.length;
+        break;
+      case IEEE80211_IE_VENDOR:
+        /* The OUI and the type, the rest may hold counters */
+        hashed = ie.length < 4 ? ie.length : 4;
+        break;
+      case IEEE80211_IE_EXTENSION:
+        hashed = ie.length < 1 ? ie.length : 1;
+        break;
+      default:
+        break;
+    }
+
+    for (size_t j = 0; j < hashed; ++j) hash = fingerprint_mix(hash, ie.data[j]);
+    ++elements;
+  }
+
+  if (elements == 0) return FINGERPRINT_NONE;
+  return hash != FINGERPRINT_NONE ? hash : 1;
+}
+
+/**
+ * Initializes an cluster table, must be called before first use
+ *
+ * @param table the table to be initialized
+ */
+void fingerprint_init(fingerprint_table_t *table) {
+  for (size_t i = 0; i < GLOBAL_FP_CLUSTERS; ++i) {
+    table->clusters[i].fingerprint = FINGERPRINT_NONE;
+    table->clusters[i].last_seen = INT64_MIN;
+  }
+
+  table->created = 0;
+  table->collapsed = 0;
+}
+
+/**
+ * Finds the cluster of an randomized MAC, or creates one, the oldest
+ *  cluster makes room when the table is full
+ *
+ * @param table the table
+ * @param mac the mac address (6 bytes)
+ * @param fingerprint the fingerprint of the probe request
+ * @param seq the sequence number of the probe request
+ * @param now the current time in microseconds
+ * @return the MAC the cluster is reported as
+ */
+const uint8_t *fingerprint_cluster(fingerprint_table_t *table, const uint8_t *mac,
+  uint32_t fingerprint, uint16_t seq, int64_t now) {
+  uint64_t key = mac_set_key(mac);
+
+  /* Picks the matching cluster whose sequence numbers are the closest, the
+   * MAC it was seen with last always matches, and the oldest cluster is
+   * remembered in case there is none. The table is small and only searched
+   * for probe requests of randomized MACs, so an linear scan will do */
+  fingerprint_cluster_t *best = nullptr, *oldest = &table->clusters[0];
+  uint16_t best_gap = GLOBAL_FP_SEQ_GAP + 1;
+  for (size_t i = 0; i < GLOBAL_FP_CLUSTERS; ++i) {
+    fingerprint_cluster_t *c = &table->clusters[i];
+    if (c->last_seen < oldest->last_seen) oldest = c;
+    if (c->fingerprint != fingerprint || now - c->last_seen >= GLOBAL_FP_WINDOW * 1000LL) continue;
+
+    uint16_t gap = c->last_key == key ? 0 : (seq - c->seq) & FINGERPRINT_SEQ_MASK;
+    if (gap < best_gap) {
+      best = c;
+      best_gap = gap;
+    }
+  }
+
+  if (best == nullptr) {
+    best = oldest;
+    best->fingerprint = fingerprint;
+    memcpy(best->mac, mac, 6);
+    ++table->created;
+  } else if (best->last_key != key) {
+    ++table->collapsed;
+  }
+
+  best->last_key = key;
+  best->seq = seq;
+  best->last_seen = now;
+  return best->mac;
+}
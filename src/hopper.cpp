@@ -0,0 +1,143 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#include "hopper.h"
+#include "macset.h"
+
+static_assert((GLOBAL_HOP_SEEN_BITS & (GLOBAL_HOP_SEEN_BITS - 1)) == 0 && GLOBAL_HOP_SEEN_BITS >= 32,
+  "GLOBAL_HOP_SEEN_BITS must be a power of two");
+static_assert(GLOBAL_HOP_ROUND_TIME >= GLOBAL_HOP_CHANNEL_COUNT * GLOBAL_HOP_MIN_DWELL,
+  "GLOBAL_HOP_ROUND_TIME must fit the minimum dwell of every channel");
+
+/**
+ * Hashes the packed MAC into an bit of the seen bitmap
+ *
+ * @param key the packed mac address
+ */
+static inline uint32_t hopper_seen_bit(uint64_t key) {
+  return mac_set_hash(key) & (GLOBAL_HOP_SEEN_BITS - 1);
+}
+
+/**
+ * Divides the round over the channels, each gets the minimum dwell, and
+ *  the rest is divided by the scores, or equally if nothing was found yet
+ *
+ * @param hopper the hopper
+ */
+static void hopper_divide(hopper_t *hopper) {
+  const uint32_t spare = GLOBAL_HOP_ROUND_TIME - GLOBAL_HOP_CHANNEL_COUNT * GLOBAL_HOP_MIN_DWELL;
+
+  uint64_t total = 0;
+  for (size_t i = 0; i < GLOBAL_HOP_CHANNEL_COUNT; ++i) total += hopper->channels[i].score;
+
+  for (size_t i = 0; i < GLOBAL_HOP_CHANNEL_COUNT; ++i) {
+    hopper_channel_t *c = &hopper->channels[i];
+    c->dwell = GLOBAL_HOP_MIN_DWELL + (total == 0 ? spare / GLOBAL_HOP_CHANNEL_COUNT
+      : static_cast<uint32_t>(spare * static_cast<uint64_t>(c->score) / total));
+  }
+}
+
+/**
+ * Initializes an hopper, all channels start with an equal dwell time
+ *
+ * @param hopper the hopper
+ * @param now the current time in microseconds
+ */
+void hopper_init(hopper_t *hopper, int64_t now) {
+  for (size_t i = 0; i < GLOBAL_HOP_CHANNEL_COUNT; ++i) {
+    hopper_channel_t *c = &hopper->channels[i];
+    c->frames.store(0, std::memory_order_relaxed);
+    c->new_macs.store(0, std::memory_order_relaxed);
+    c->new_macs_at_start = 0;
+    c->score = 0;
+    c->dwell_total = 0;
+  }
+
+  for (size_t i = 0; i < GLOBAL_HOP_SEEN_BITS / 32; ++i)
+    hopper->seen[i].store(0, std::memory_order_relaxed);
+
+  /* The first hopper_next() starts the first round on the first channel,
+   * without an dwell to be scored */
+  hopper->seen_cleared_at = now;
+  hopper->dwell_started_at = -1;
+  hopper->current = GLOBAL_HOP_CHANNEL_COUNT - 1;
+  hopper_divide(hopper);
+}
+
+/**
+ * Records an sniffed frame, safe to call from the promiscuous callback
+ *  while the other task hops
+ *
+ * @param hopper the hopper
+ * @param channel the channel the frame was sniffed on
+ * @param mac the transmitter of the frame
+ */
+void IRAM_ATTR hopper_observe(hopper_t *hopper, uint8_t channel, const uint8_t *mac) {
+  if (channel < 1 || channel > GLOBAL_HOP_CHANNEL_COUNT) return;
+  hopper_channel_t *c = &hopper->channels[channel - 1];
+  c->frames.fetch_add(1, std::memory_order_relaxed);
+
+  /* An transmitter is new when its bit was not set yet, collisions only
+   * make the yield look a bit lower on busy channels */
+  uint32_t bit = hopper_seen_bit(mac_set_key(mac));
+  uint32_t mask = 1UL << (bit & 31);
+  if ((hopper->seen[bit >> 5].fetch_or(mask, std::memory_order_relaxed) & mask) == 0)
+    c->new_macs.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * Ends the dwell on the current channel, and moves to the next one, the
+ *  dwell times are divided again at the start of every round
+ *
+ * @param hopper the hopper
+ * @param now the current time in microseconds
+ * @param dwell the output dwell time on the next channel in ms
+ * @return the next channel
+ */
+uint8_t hopper_next(hopper_t *hopper, int64_t now, uint32_t *dwell) {
+  hopper_channel_t *c = &hopper->channels[hopper->current];
+
+  /* Scores the dwell by the new transmitters per second it found */
+  uint32_t elapsed = hopper->dwell_started_at < 0 ? 0
+    : static_cast<uint32_t>((now - hopper->dwell_started_at) / 1000);
+  if (elapsed > 0) {
+    uint32_t found = c->new_macs.load(std::memory_order_relaxed) - c->new_macs_at_start;
+    uint32_t yield = static_cast<uint32_t>((static_cast<uint64_t>(found) * 1000 << HOPPER_SCORE_SHIFT) / elapsed);
+    c->score = c->score - (c->score >> HOPPER_SCORE_SMOOTHING) + (yield >> HOPPER_SCORE_SMOOTHING);
+    c->dwell_total += elapsed;
+  }
+
+  /* Forgets the transmitters once in a while, so the ones which return
+   * later on count as new again */
+  if (now - hopper->seen_cleared_at >= GLOBAL_HOP_SEEN_RESET * 1000LL) {
+    for (size_t i = 0; i < GLOBAL_HOP_SEEN_BITS / 32; ++i)
+      hopper->seen[i].store(0, std::memory_order_relaxed);
+    hopper->seen_cleared_at = now;
+  }
+
+  hopper->current = (hopper->current + 1) % GLOBAL_HOP_CHANNEL_COUNT;
+  if (hopper->current == 0) hopper_divide(hopper);
+
+  c = &hopper->channels[hopper->current];
+  c->new_macs_at_start = c->new_macs.load(std::memory_order_relaxed);
+  hopper->dwell_started_at = now;
+  *dwell = c->dwell;
+  return hopper->current + 1;
+}
+
+/**
+ * Gets the statistics of an channel
+ *
+ * @param hopper the hopper
+ * @param channel the channel, starting at 1
+ * @param stats the output statistics
+ */
+void hopper_get_stats(const hopper_t *hopper, uint8_t channel, hopper_channel_stats_t *stats) {
+  const hopper_channel_t *c = &hopper->channels[channel - 1];
+  stats->frames = c->frames.load(std::memory_order_relaxed);
+  stats->new_macs = c->new_macs.load(std::memory_order_relaxed);
+  stats->score = c->score;
+  stats->dwell = c->dwell;
+  stats->dwell_total = c->dwell_total;
+}
@@ -4,6 +4,213 @@
 
 #include "ieee80211.h"
 
+/*******************************
+ * Frame classes
+ ******************************/
+
+static constexpr ieee80211_class_t ieee80211_make_class(uint8_t header_size, uint8_t receiver,
+  uint8_t transmitter, uint8_t bssid, uint8_t flags, uint8_t fixed_size = IEEE80211_NO_ELEMENTS) {
+  return ieee80211_class_t { header_size, receiver, transmitter, bssid, flags, fixed_size };
+}
+
+static constexpr ieee80211_class_t ieee80211_invalid_class() {
+  return ieee80211_make_class(0, 0, 0, 0, 0);
+}
+
+/**
+ * Gets the size of the fixed fields of an management frame, which come
+ *  before its information elements
+ * 
+ * @param subtype the subtype
+ */
+static constexpr uint8_t ieee80211_mgmt_fixed_size(uint8_t subtype) {
+  return subtype == WIFI_ASSOC_REQ ? 4          /* Capabilities, listen interval */
+    : subtype == WIFI_ASSOC_RES || subtype == WIFI_REASSOC_RES ? 6 /* Capabilities, status, AID */
+    : subtype == WIFI_REASSOC_REQ ? 10          /* Capabilities, listen interval, current AP */
+    : subtype == WIFI_PROBE_REQ ? 0
+    : subtype == WIFI_PROBE_RES || subtype == WIFI_BEACON ? 12 /* Timestamp, interval, capabilities */
+    : IEEE80211_NO_ELEMENTS;
+}
+
+/**
+ * Gets the class of an management frame, they always use the
+ *  DA, SA, BSSID layout and the DS bits are reserved
+ * 
+ * @param subtype the subtype
+ * @param ds the DS bits
+ */
+static constexpr ieee80211_class_t ieee80211_mgmt_class(uint8_t subtype, uint8_t ds) {
+  return ds != 0 || subtype == 7 || subtype == 15 ? ieee80211_invalid_class()
+    : ieee80211_make_class(24, IEEE80211_ADDRESS1, IEEE80211_ADDRESS2, IEEE80211_ADDRESS3,
+      IEEE80211_CLASS_HTC, ieee80211_mgmt_fixed_size(subtype));
+}
+
+/**
+ * Gets the class of an control frame, CTS and ACK only have an receiver,
+ *  PS-Poll and CF-End carry the BSSID as one of their addresses. The control
+ *  wrapper only has an receiver, followed by the wrapped frame control and
+ *  the HT control
+ * 
+ * @param subtype the subtype
+ * @param ds the DS bits
+ */
+static constexpr ieee80211_class_t ieee80211_ctrl_class(uint8_t subtype, uint8_t ds) {
+  return ds != 0 ? ieee80211_invalid_class()
+    : subtype == WIFI_CTS || subtype == WIFI_ACK
+      ? ieee80211_make_class(10, IEEE80211_ADDRESS1, 0, 0, 0)
+    : subtype == WIFI_CONTROL_WRAPPER
+      ? ieee80211_make_class(16, IEEE80211_ADDRESS1, 0, 0, 0)
+    : subtype == WIFI_PS_POLL
+      ? ieee80211_make_class(16, IEEE80211_ADDRESS1, IEEE80211_ADDRESS2, IEEE80211_ADDRESS1, 0)
+    : subtype == WIFI_CF_END || subtype == WIFI_CF_END__CF_ACK
+      ? ieee80211_make_class(16, IEEE80211_ADDRESS1, IEEE80211_ADDRESS2, IEEE80211_ADDRESS2, 0)
+    : subtype == WIFI_TRIGGER || subtype == WIFI_TACK || subtype == WIFI_REPORT_POLL || subtype == WIFI_NDP_ANNOUNCE
+      || subtype == WIFI_BLOCK_ACK_REQUEST || subtype == WIFI_BLOCK_ACK || subtype == WIFI_RTS
+      ? ieee80211_make_class(16, IEEE80211_ADDRESS1, IEEE80211_ADDRESS2, 0, 0)
+    : ieee80211_invalid_class();
+}
+
+/**
+ * Gets the class of an data frame, the transmitter is always address 2,
+ *  the place of the BSSID depends on the DS bits: none (address 3), to
+ *  the AP (address 1), from the AP (address 2) or between two APs, which
+ *  adds address 4 and leaves out the BSSID
+ * 
+ * @param subtype the subtype
+ * @param ds the DS bits
+ */
+static constexpr ieee80211_class_t ieee80211_data_class(uint8_t subtype, uint8_t ds) {
+  return subtype == 13 ? ieee80211_invalid_class()
+    : ieee80211_make_class(ds == 3 ? 30 : 24, IEEE80211_ADDRESS1, IEEE80211_ADDRESS2,
+      ds == 0 ? IEEE80211_ADDRESS3 : ds == 1 ? IEEE80211_ADDRESS1 : ds == 2 ? IEEE80211_ADDRESS2 : 0,
+      (subtype & 0x8) ? IEEE80211_CLASS_QOS | IEEE80211_CLASS_HTC : 0);
+}
+
+/**
+ * Gets the class of an key, which is built from the first two bytes of
+ *  the frame: [type (2 bits)] [subtype (4 bits)] [DS bits (2 bits)]
+ * 
+ * @param key the key
+ */
+static constexpr ieee80211_class_t ieee80211_class_of(uint8_t key) {
+  return (key & 0x3) == WIFI_CF_MGMT ? ieee80211_mgmt_class((key >> 2) & 0xf, key >> 6)
+    : (key & 0x3) == WIFI_CF_CONTROL ? ieee80211_ctrl_class((key >> 2) & 0xf, key >> 6)
+    : (key & 0x3) == WIFI_CF_DATA ? ieee80211_data_class((key >> 2) & 0xf, key >> 6)
+    : ieee80211_invalid_class();
+}
+
+#define IEEE80211_TABLE_4(F, K) F(K), F(K + 1), F(K + 2), F(K + 3)
+#define IEEE80211_TABLE_16(F, K) IEEE80211_TABLE_4(F, K), IEEE80211_TABLE_4(F, K + 4), \
+  IEEE80211_TABLE_4(F, K + 8), IEEE80211_TABLE_4(F, K + 12)
+#define IEEE80211_TABLE_64(F, K) IEEE80211_TABLE_16(F, K), IEEE80211_TABLE_16(F, K + 16), \
+  IEEE80211_TABLE_16(F, K + 32), IEEE80211_TABLE_16(F, K + 48)
+#define IEEE80211_TABLE_256(F) IEEE80211_TABLE_64(F, 0), IEEE80211_TABLE_64(F, 64), \
+  IEEE80211_TABLE_64(F, 128), IEEE80211_TABLE_64(F, 192)
+
+/* The classes of all keys, computed at compile time so it ends up in flash */
+static constexpr ieee80211_class_t g_Classes[256] = { IEEE80211_TABLE_256(ieee80211_class_of) };
+
+static_assert(g_Classes[WIFI_CF_MGMT | WIFI_PROBE_REQ << 2].transmitter == IEEE80211_ADDRESS2,
+  "probe requests are sent by address 2");
+static_assert(WIFI_ACK == 13 && g_Classes[WIFI_CF_CONTROL | WIFI_ACK << 2].transmitter == 0,
+  "ACKs have no transmitter");
+static_assert(g_Classes[WIFI_CF_DATA | 8 << 2 | 3 << 6].header_size == 30,
+  "WDS frames carry address 4");
+static_assert(g_Classes[WIFI_CF_MGMT | WIFI_BEACON << 2].fixed_size == 12
+  && g_Classes[WIFI_CF_MGMT | WIFI_ACTION << 2].fixed_size == IEEE80211_NO_ELEMENTS,
+  "beacons carry elements after 12 bytes, action frames none");
+
+/*******************************
+ * Information element classes
+ ******************************/
+
+static constexpr ieee80211_ie_class_t ieee80211_make_ie_class(uint8_t kind, uint8_t min_length,
+  uint8_t max_length) {
+  return ieee80211_ie_class_t { kind, min_length, max_length };
+}
+
+/**
+ * Gets the class of an element ID, the lengths are the ones the standard
+ *  allows, or at least the fixed part the users read
+ * 
+ * @param id the element ID
+ */
+static constexpr ieee80211_ie_class_t ieee80211_ie_class_of(uint8_t id) {
+  return id == IEEE80211_IE_SSID ? ieee80211_make_ie_class(IEEE80211_IE_KIND_SSID, 0, 32)
+    : id == IEEE80211_IE_DS_PARAMS ? ieee80211_make_ie_class(IEEE80211_IE_KIND_CHANNEL, 1, 1)
+    : id == IEEE80211_IE_RSN ? ieee80211_make_ie_class(IEEE80211_IE_KIND_RSN, 2, 255)
+    : id == IEEE80211_IE_HT_CAPABILITIES ? ieee80211_make_ie_class(IEEE80211_IE_KIND_HT_CAPABILITIES, 26, 26)
+    : id == IEEE80211_IE_VHT_CAPABILITIES ? ieee80211_make_ie_class(IEEE80211_IE_KIND_VHT_CAPABILITIES, 12, 12)
+    : id == IEEE80211_IE_VENDOR ? ieee80211_make_ie_class(IEEE80211_IE_KIND_VENDOR, 3, 255)
+    : ieee80211_make_ie_class(IEEE80211_IE_KIND_OTHER, 0, 255);
+}
+
+/* The classes of all element IDs, computed at compile time like the frame classes */
+static constexpr ieee80211_ie_class_t g_IeClasses[256] = { IEEE80211_TABLE_256(ieee80211_ie_class_of) };
+
+static_assert(g_IeClasses[IEEE80211_IE_VENDOR].kind == IEEE80211_IE_KIND_VENDOR
+  && g_IeClasses[IEEE80211_IE_RATES].kind == IEEE80211_IE_KIND_OTHER,
+  "the vendor element is dispatched on, the rates are not");
+
+/*******************************
+ * Functions
+ ******************************/
+
+/**
+ * Classifies an frame through an lookup table keyed by the type, subtype
+ *  and DS bits, which gives the addresses and the size of the MAC header
+ *  in one pass, the frame is never read beyond its size
+ * 
+ * @param frame the frame, starting at the frame control field
+ * @param size the size of the frame, without the FCS
+ * @param info the output info, only valid on success
+ * @return 0 on success, -1 if the frame is truncated or the type is reserved
+ */
+int32_t IRAM_ATTR ieee80211_classify(const uint8_t *frame, size_t size, ieee80211_frame_info_t *info) {
+  if (size < IEEE80211_MIN_FRAME_SIZE || (frame[0] & 0x3) != 0) return -1;
+
+  /* The QoS control follows the addresses, and HT control follows that
+   * when the order bit is set on an frame which may carry it */
+  const ieee80211_class_t *c = &g_Classes[(frame[0] >> 2) | (frame[1] & 0x3) << 6];
+  size_t header_size = c->header_size
+    + ((c->flags & IEEE80211_CLASS_QOS) ? 2 : 0)
+    + ((c->flags & IEEE80211_CLASS_HTC) && (frame[1] & 0x80) ? 4 : 0);
+  if (c->header_size == 0 || header_size > size) return -1;
+
+  info->type = (frame[0] >> 2) & 0x3;
+  info->subtype = frame[0] >> 4;
+  info->protected_frame = (frame[1] & 0x40) != 0;
+  info->receiver = &frame[c->receiver];
+  info->transmitter = c->transmitter != 0 ? &frame[c->transmitter] : nullptr;
+  info->bssid = c->bssid != 0 ? &frame[c->bssid] : nullptr;
+  info->payload_offset = static_cast<uint16_t>(header_size);
+  info->elements_offset = c->fixed_size != IEEE80211_NO_ELEMENTS && header_size + c->fixed_size <= size
+    ? static_cast<uint16_t>(header_size + c->fixed_size) : 0;
+  return 0;
+}
+
+/**
+ * Gets the next information element, and its kind from an lookup table
+ *  keyed by the element ID
+ * 
+ * @param iter the iterator, advanced past the element
+ * @param ie the output element, only valid on success
+ * @return false at the end of the elements, or at an truncated element
+ */
+bool IRAM_ATTR ieee80211_ie_next(ieee80211_ie_iter_t *iter, ieee80211_ie_t *ie) {
+  size_t left = iter->end - iter->pos;
+  if (left < 2 || left - 2 < iter->pos[1]) return false;
+
+  const ieee80211_ie_class_t *c = &g_IeClasses[iter->pos[0]];
+  ie->id = iter->pos[0];
+  ie->length = iter->pos[1];
+  ie->kind = ie->length >= c->min_length && ie->length <= c->max_length
+    ? c->kind : static_cast<uint8_t>(IEEE80211_IE_KIND_MALFORMED);
+  ie->data = &iter->pos[2];
+  iter->pos += 2 + ie->length;
+  return true;
+}
+
 /**
  * Turns an mac address into it's string representation
  * 
@@ -60,6 +267,7 @@ const char *ieee80211_get_mgmt_subtype_string(ieee80211_control_mgmt_subtype_t t
 const char *ieee80211_get_ctrl_subtype_string(ieee80211_control_ctr_subtype_t type) {
   switch (type) {
     case WIFI_TRIGGER: return "CTRL: Trigger";
+    case WIFI_TACK: return "CTRL: TACK";
     case WIFI_REPORT_POLL: return "CTRL: ReportPoll";
     case WIFI_NDP_ANNOUNCE: return "CTRL: Announce";
     case WIFI_CONTROL_FRAME_EXTENSION: return "CTRL: CTRLExt";
@@ -83,64 +291,52 @@ const char *ieee80211_get_ctrl_subtype_string(ieee80211_control_ctr_subtype_t ty
  * @param buffer the input data buffer of frame
  * @param type the type of the frame
  */
-void ieee80211_log_packet(void *buffer, wifi_promiscuous_pkt_type_t type);
 void ieee80211_log_packet(void *buffer, wifi_promiscuous_pkt_type_t type) {
   wifi_promiscuous_pkt_t *promisc_pkt = (wifi_promiscuous_pkt_t *) buffer;
-  ieee80211_control_frame_t *cf = (ieee80211_control_frame_t *) promisc_pkt->payload;
+  size_t size = promisc_pkt->rx_ctrl.sig_len > IEEE80211_FCS_SIZE
+    ? promisc_pkt->rx_ctrl.sig_len - IEEE80211_FCS_SIZE : 0;
 
   char pkt_destination_mac[] = {"00:00:00:00:00:00\0"};
   char pkt_transmitter_mac[] = {"00:00:00:00:00:00\0"};
   char pkt_data[32] = {'\0'};
   const char *label = ieee80211_get_type_string(type);
 
-  // Switches the type, so we can parse the packet with the correct stucture
-  //  and read the required data from it
-  switch (type) {
-    // ======================
-    case WIFI_CF_MGMT: {
-      ieee80211_management_packet_t *pkt = (ieee80211_management_packet_t *) promisc_pkt->payload;
-      label = ieee80211_get_mgmt_subtype_string(static_cast<ieee80211_control_mgmt_subtype_t>(cf->subtype));
-
-      // Turns the mac addresses in the management frame to strings,
-      //  so we can log them to the console later on
-      ieee80211_mac_to_string(pkt_transmitter_mac, pkt->hdr.transmitter);
-      ieee80211_mac_to_string(pkt_destination_mac, pkt->hdr.destination);
-
-      // Switches the subtype, to check if we can get any data from the packet
-      //  since not all contain data
-      switch (cf->subtype) {
-        case WIFI_BEACON: case WIFI_PROBE_RES: {
-          ieee80211_management_beacon_var_t *var = (ieee80211_management_beacon_var_t *) pkt->payload;
-
-          if (var->tag_length > 31) strncpy(pkt_data, var->ssid, 31);
-          else strncpy(pkt_data, var->ssid, var->tag_length);
-          break;
+  // Classifies the frame, which gives us the addresses no matter the type
+  //  and the DS bits, and where the body starts
+  ieee80211_frame_info_t info;
+  if (ieee80211_classify(promisc_pkt->payload, size, &info) == 0) {
+    if (info.transmitter != nullptr) ieee80211_mac_to_string(pkt_transmitter_mac, info.transmitter);
+    ieee80211_mac_to_string(pkt_destination_mac, info.receiver);
+
+    switch (info.type) {
+      // ======================
+      case WIFI_CF_MGMT: {
+        label = ieee80211_get_mgmt_subtype_string(static_cast<ieee80211_control_mgmt_subtype_t>(info.subtype));
+
+        // Looks for the SSID among the elements, wherever it is, the
+        //  iterator only returns the ones which are completely within the frame
+        ieee80211_ie_iter_t iter;
+        ieee80211_ie_t ie;
+        if (ieee80211_ie_begin(&iter, promisc_pkt->payload, size, &info)) {
+          while (ieee80211_ie_next(&iter, &ie)) {
+            if (ie.kind != IEEE80211_IE_KIND_SSID) continue;
+
+            size_t length = ie.length > 31 ? 31 : ie.length;
+            memcpy(pkt_data, ie.data, length);
+            pkt_data[length] = '\0';
+            break;
+          }
         }
-        default: break;
+        break;
       }
-      break;
-    }
-    // ======================
-    case WIFI_CF_CONTROL: {
-      ieee80211_control_mac_header_t *hdr = (ieee80211_control_mac_header_t *) promisc_pkt->payload;
-      label = ieee80211_get_ctrl_subtype_string(static_cast<ieee80211_control_ctr_subtype_t>(cf->subtype));
-      ieee80211_mac_to_string(pkt_transmitter_mac, hdr->destination);
-      ieee80211_mac_to_string(pkt_destination_mac, hdr->transmitter);
-      break;
-    }
-    // ======================
-    case WIFI_CF_DATA: {
-      ieee80211_data_packet_t *pkt = (ieee80211_data_packet_t *) promisc_pkt->payload;
-      ieee80211_mac_to_string(pkt_transmitter_mac, pkt->hdr.address2);
-      ieee80211_mac_to_string(pkt_destination_mac, pkt->hdr.address1);
-      break;
-    }
-    // ======================
-    case WIFI_CF_EXT: {
-      break;
+      // ======================
+      case WIFI_CF_CONTROL: {
+        label = ieee80211_get_ctrl_subtype_string(static_cast<ieee80211_control_ctr_subtype_t>(info.subtype));
+        break;
+      }
+      // ======================
+      default: break;
     }
-    // ======================
-    default: break;
   }
 
   // Prints the packet to the serial console, of course this happens in a decently
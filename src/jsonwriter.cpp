@@ -0,0 +1,92 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#include "jsonwriter.h"
+
+/**
+ * Initializes an JSON writer on top of an buffer
+ * 
+ * @param writer the writer to be initialized
+ * @param buf the output buffer
+ * @param size the size of the output buffer
+ */
+void json_writer_init(json_writer_t *writer, char *buf, size_t size) {
+  writer->buf = buf;
+  writer->size = size;
+  writer->len = 0;
+  writer->overflow = false;
+}
+
+/**
+ * Appends an raw (already valid JSON) string, used for the punctuation
+ *  and the object keys
+ * 
+ * @param writer the writer
+ * @param str the null terminated string
+ */
+void json_writer_raw(json_writer_t *writer, const char *str) {
+  if (writer->overflow) return;
+
+  /* One byte is always kept free for the null termination */
+  size_t len = strlen(str);
+  if (len >= writer->size - writer->len) {
+    writer->overflow = true;
+    return;
+  }
+
+  memcpy(&writer->buf[writer->len], str, len);
+  writer->len += len;
+}
+
+/**
+ * Appends an unsigned integer as JSON number
+ * 
+ * @param writer the writer
+ * @param value the value
+ */
+void json_writer_u64(json_writer_t *writer, uint64_t value) {
+  if (writer->overflow) return;
+
+  /* Writes the digits backwards into an scratch buffer, 20 digits
+   * is enough for the largest 64 bit value */
+  char digits[20];
+  size_t n = 0;
+  do {
+    digits[n++] = '0' + static_cast<char>(value % 10);
+    value /= 10;
+  } while (value != 0);
+
+  if (n >= writer->size - writer->len) {
+    writer->overflow = true;
+    return;
+  }
+
+  while (n > 0) writer->buf[writer->len++] = digits[--n];
+}
+
+/**
+ * Appends an signed integer as JSON number
+ * 
+ * @param writer the writer
+ * @param value the value
+ */
+void json_writer_i64(json_writer_t *writer, int64_t value) {
+  if (value < 0) {
+    json_writer_raw(writer, "-");
+    json_writer_u64(writer, -static_cast<uint64_t>(value));
+  } else json_writer_u64(writer, value);
+}
+
+/**
+ * Null terminates the output
+ * 
+ * @param writer the writer
+ * @return the length of the output, or -1 if the buffer overflowed
+ */
+int32_t json_writer_finish(json_writer_t *writer) {
+  if (writer->overflow || writer->size == 0) return -1;
+
+  writer->buf[writer->len] = '\0';
+  return static_cast<int32_t>(writer->len);
+}
@@ -68,7 +68,9 @@ LoRaClass::LoRaClass() :
   _spi(&LORA_DEFAULT_SPI),
   _ss(LORA_DEFAULT_SS_PIN), _reset(LORA_DEFAULT_RESET_PIN), _dio0(LORA_DEFAULT_DIO0_PIN),
   _frequency(0),
+  _txPower(17),
   _packetIndex(0),
+  _packetLength(0),
   _implicitHeaderMode(0),
   _onReceive(NULL),
   _onTxDone(NULL)
@@ -237,6 +239,7 @@ int LoRaClass::parsePacket(int size)
     } else {
       packetLength = readRegister(REG_RX_NB_BYTES);
     }
+    _packetLength = packetLength;
 
     // set FIFO address to current RX address
     writeRegister(REG_FIFO_ADDR_PTR, readRegister(REG_FIFO_RX_CURRENT_ADDR));
@@ -299,10 +302,8 @@ size_t LoRaClass::write(const uint8_t *buffer, size_t size)
     size = MAX_PKT_LENGTH - currentLength;
   }
 
-  // write data
-  for (size_t i = 0; i < size; i++) {
-    writeRegister(REG_FIFO, buffer[i]);
-  }
+  // write data, in a single burst
+  writeFifo(buffer, size);
 
   // update length
   writeRegister(REG_PAYLOAD_LENGTH, currentLength + size);
@@ -326,6 +327,25 @@ int LoRaClass::read()
   return readRegister(REG_FIFO);
 }
 
+size_t LoRaClass::readPacket(uint8_t *buffer, size_t size)
+{
+  // the length is known since parsePacket, so no need to ask the radio
+  int remaining = _packetLength - _packetIndex;
+  if (remaining <= 0) {
+    return 0;
+  }
+
+  if (size > (size_t) remaining) {
+    size = remaining;
+  }
+
+  // read data, in a single burst
+  readFifo(buffer, size);
+  _packetIndex += size;
+
+  return size;
+}
+
 int LoRaClass::peek()
 {
   if (!available()) {
@@ -385,6 +405,45 @@ void LoRaClass::onTxDone(void(*callback)())
   }
 }
 
+void LoRaClass::onDio0(void(*isr)())
+{
+  if (isr) {
+    pinMode(_dio0, INPUT);
+#ifdef SPI_HAS_NOTUSINGINTERRUPT
+    SPI.usingInterrupt(digitalPinToInterrupt(_dio0));
+#endif
+    attachInterrupt(digitalPinToInterrupt(_dio0), isr, RISING);
+  } else {
+    detachInterrupt(digitalPinToInterrupt(_dio0));
+#ifdef SPI_HAS_NOTUSINGINTERRUPT
+    SPI.notUsingInterrupt(digitalPinToInterrupt(_dio0));
+#endif
+  }
+}
+
+int LoRaClass::receivedPacket()
+{
+  int irqFlags = readRegister(REG_IRQ_FLAGS);
+
+  // clear IRQ's
+  writeRegister(REG_IRQ_FLAGS, irqFlags);
+
+  if ((irqFlags & IRQ_RX_DONE_MASK) == 0 || (irqFlags & IRQ_PAYLOAD_CRC_ERROR_MASK) != 0) {
+    return 0;
+  }
+
+  // received a packet
+  _packetIndex = 0;
+
+  // read packet length
+  _packetLength = _implicitHeaderMode ? readRegister(REG_PAYLOAD_LENGTH) : readRegister(REG_RX_NB_BYTES);
+
+  // set FIFO address to current RX address
+  writeRegister(REG_FIFO_ADDR_PTR, readRegister(REG_FIFO_RX_CURRENT_ADDR));
+
+  return _packetLength;
+}
+
 void LoRaClass::receive(int size)
 {
 
@@ -415,6 +474,8 @@ void LoRaClass::sleep()
 void LoRaClass::setTxPower(int level, int outputPin)
 {
   if (PA_OUTPUT_RFO_PIN == outputPin) {
+    _txPower = level < 0 ? 0 : (level > 14 ? 14 : level);
+
     // RFO
     if (level < 0) {
       level = 0;
@@ -425,6 +486,8 @@ void LoRaClass::setTxPower(int level, int outputPin)
     writeRegister(REG_PA_CONFIG, 0x70 | level);
   } else {
     // PA BOOST
+    _txPower = level < 2 ? 2 : (level > 20 ? 20 : level);
+
     if (level > 17) {
       if (level > 20) {
         level = 20;
@@ -537,17 +600,83 @@ void LoRaClass::setSignalBandwidth(long sbw)
 
 void LoRaClass::setLdoFlag()
 {
-  // Section 4.1.1.5
-  long symbolDuration = 1000 / ( getSignalBandwidth() / (1L << getSpreadingFactor()) ) ;
-
-  // Section 4.1.1.6
-  boolean ldoOn = symbolDuration > 16;
+  // Section 4.1.1.6, the symbol time is kept in microseconds, in whole
+  // milliseconds the 16.384ms symbols of SF11 at 125kHz would not count
+  boolean ldoOn = symbolTime() > 16000;
 
   uint8_t config3 = readRegister(REG_MODEM_CONFIG_3);
   bitWrite(config3, 3, ldoOn);
   writeRegister(REG_MODEM_CONFIG_3, config3);
 }
 
+int LoRaClass::getCodingRate4()
+{
+  return ((readRegister(REG_MODEM_CONFIG_1) >> 1) & 0x07) + 4;
+}
+
+long LoRaClass::getPreambleLength()
+{
+  return ((long)readRegister(REG_PREAMBLE_MSB) << 8) | readRegister(REG_PREAMBLE_LSB);
+}
+
+int LoRaClass::getTxPower()
+{
+  return _txPower;
+}
+
+uint32_t LoRaClass::symbolTime()
+{
+  // Section 4.1.1.6
+  return (uint32_t)((1L << getSpreadingFactor()) * 1000000LL / getSignalBandwidth());
+}
+
+uint32_t LoRaClass::timeOnAir(size_t size)
+{
+  uint8_t config1 = readRegister(REG_MODEM_CONFIG_1);
+  uint8_t config2 = readRegister(REG_MODEM_CONFIG_2);
+  uint8_t config3 = readRegister(REG_MODEM_CONFIG_3);
+
+  int sf = config2 >> 4;
+  int cr = (config1 >> 1) & 0x07;
+  bool implicitHeader = config1 & 0x01;
+  bool crc = config2 & 0x04;
+  bool ldro = config3 & 0x08;
+
+  // Section 4.1.1.6, symbol and preamble duration
+  float symbolTime = (float)(1L << sf) * 1E6 / getSignalBandwidth();
+  float preambleTime = (getPreambleLength() + 4.25f) * symbolTime;
+
+  // Section 4.1.1.7, number of payload symbols
+  long numerator = 8L * size - 4 * sf + 28 + (crc ? 16 : 0) - (implicitHeader ? 20 : 0);
+  long denominator = 4 * (sf - (ldro ? 2 : 0));
+  long payloadSymbols = 8;
+  if (numerator > 0) {
+    payloadSymbols += ((numerator + denominator - 1) / denominator) * (cr + 4);
+  }
+
+  return (uint32_t)(preambleTime + payloadSymbols * symbolTime);
+}
+
+float LoRaClass::sensitivity()
+{
+  // Section 4.1.1.3, demodulator SNR limit per spreading factor
+  static const float snrLimit[] = { -5.0f, -7.5f, -10.0f, -12.5f, -15.0f, -17.5f, -20.0f };
+  int sf = getSpreadingFactor();
+  if (sf < 6) {
+    sf = 6;
+  } else if (sf > 12) {
+    sf = 12;
+  }
+
+  // thermal noise floor + receiver noise figure (6 dB) + SNR limit
+  return -174.0f + 10.0f * log10f((float)getSignalBandwidth()) + 6.0f + snrLimit[sf - 6];
+}
+
+float LoRaClass::linkBudget()
+{
+  return _txPower - sensitivity();
+}
+
 void LoRaClass::setCodingRate4(int denominator)
 {
   if (denominator < 5) {
@@ -668,6 +797,7 @@ void LoRaClass::handleDio0Rise()
 
       // read packet length
       int packetLength = _implicitHeaderMode ? readRegister(REG_PAYLOAD_LENGTH) : readRegister(REG_RX_NB_BYTES);
+      _packetLength = packetLength;
 
       // set FIFO address to current RX address
       writeRegister(REG_FIFO_ADDR_PTR, readRegister(REG_FIFO_RX_CURRENT_ADDR));
@@ -694,6 +824,55 @@ void LoRaClass::writeRegister(uint8_t address, uint8_t value)
   singleTransfer(address | 0x80, value);
 }
 
+void LoRaClass::writeFifo(const uint8_t *buffer, size_t size)
+{
+  if (size == 0) {
+    return;
+  }
+
+  // burst mode: the FIFO address auto increments, so a single CS assertion
+  // with the address byte followed by all the data bytes is enough
+  digitalWrite(_ss, LOW);
+
+  _spi->beginTransaction(_spiSettings);
+  _spi->transfer(REG_FIFO | 0x80);
+#if defined(ESP32)
+  _spi->writeBytes(buffer, size);
+#else
+  for (size_t i = 0; i < size; i++) {
+    _spi->transfer(buffer[i]);
+  }
+#endif
+  _spi->endTransaction();
+
+  digitalWrite(_ss, HIGH);
+}
+
+void LoRaClass::readFifo(uint8_t *buffer, size_t size)
+{
+  if (size == 0) {
+    return;
+  }
+
+  // burst mode: the FIFO address auto increments, so a single CS assertion
+  // with the address byte is followed by clocking out all the data bytes
+  digitalWrite(_ss, LOW);
+
+  _spi->beginTransaction(_spiSettings);
+  _spi->transfer(REG_FIFO & 0x7f);
+#if defined(ESP32)
+  memset(buffer, 0x00, size);
+  _spi->transferBytes(buffer, buffer, size);
+#else
+  for (size_t i = 0; i < size; i++) {
+    buffer[i] = _spi->transfer(0x00);
+  }
+#endif
+  _spi->endTransaction();
+
+  digitalWrite(_ss, HIGH);
+}
+
 uint8_t LoRaClass::singleTransfer(uint8_t address, uint8_t value)
 {
   uint8_t response;
@@ -0,0 +1,120 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#include "maccodec.h"
+
+/**
+ * Compares two measurements in big endian order
+ * 
+ * @param a the first measurement
+ * @param b the second measurement
+ */
+static int mac_codec_compare(const void *a, const void *b) {
+  return memcmp(a, b, sizeof (measurement_t));
+}
+
+/**
+ * Sorts the measurements, so the shared prefixes are adjacent
+ * 
+ * @param macs the measurements to be sorted
+ * @param count the number of measurements
+ */
+void mac_codec_sort(measurement_t *macs, size_t count) {
+  qsort(macs, count, sizeof (measurement_t), &mac_codec_compare);
+}
+
+/**
+ * Encodes as many sorted measurements as fit into the output buffer
+ * 
+ * @param out the output buffer
+ * @param out_size the size of the output buffer
+ * @param macs the sorted measurements
+ * @param count the number of measurements
+ * @param consumed the number of measurements which were encoded
+ * @return the number of bytes written
+ */
+size_t mac_codec_encode(uint8_t *out, size_t out_size, const measurement_t *macs,
+  size_t count, size_t *consumed) {
+  *consumed = 0;
+  if (out_size < 1) return 0;
+  if (count > MAC_CODEC_MAX_COUNT) count = MAC_CODEC_MAX_COUNT;
+
+  /* Finds out how many measurements fit, since the header size depends
+   * on the count we have to know it before writing */
+  size_t n = 0, suffix_size = 0;
+  for (; n < count; ++n) {
+    uint8_t header = mac_codec_header(n == 0 ? nullptr : macs[n - 1].mac, macs[n].mac);
+    size_t next_suffix_size = suffix_size + mac_codec_suffix_size(header);
+    if (1 + (n + 2) / 2 + next_suffix_size > out_size) break;
+    suffix_size = next_suffix_size;
+  }
+
+  /* Writes the count, the nibble headers and the suffixes */
+  uint8_t *headers = &out[1], *suffix = &out[1 + (n + 1) / 2];
+  out[0] = static_cast<uint8_t>(n);
+  memset(headers, 0, (n + 1) / 2);
+  for (size_t i = 0; i < n; ++i) {
+    uint8_t header = mac_codec_header(i == 0 ? nullptr : macs[i - 1].mac, macs[i].mac);
+    headers[i / 2] |= header << ((i & 1) ? 0 : 4);
+
+    uint8_t size = mac_codec_suffix_size(header);
+    if (header <= MAC_CODEC_MAX_SHARED) memcpy(suffix, &macs[i].mac[header], size);
+    else {
+      uint32_t delta = mac_codec_delta(macs[i - 1].mac, macs[i].mac);
+      for (uint8_t j = 0; j < size; ++j) suffix[j] = delta >> (8 * (size - 1 - j));
+    }
+    suffix += size;
+  }
+
+  *consumed = n;
+  return suffix - out;
+}
+
+/**
+ * Decodes an compressed payload
+ * 
+ * @param in the compressed payload
+ * @param in_size the size of the payload
+ * @param macs the output measurements
+ * @param max_count the max number of output measurements
+ * @param used the output number of bytes the encoded measurements took
+ * @return the number of decoded measurements, or -1 if malformed
+ */
+int32_t mac_codec_decode(const uint8_t *in, size_t in_size, measurement_t *macs,
+  size_t max_count, size_t *used) {
+  if (in_size < 1) return -1;
+
+  size_t n = in[0];
+  if (n > max_count || 1 + (n + 1) / 2 > in_size) return -1;
+
+  const uint8_t *headers = &in[1], *suffix = &in[1 + (n + 1) / 2], *end = &in[in_size];
+  for (size_t i = 0; i < n; ++i) {
+    uint8_t header = (headers[i / 2] >> ((i & 1) ? 0 : 4)) & 0x0F;
+    if (header > MAC_CODEC_MAX_SHARED + 3 || (i == 0 && header != 0)) return -1;
+
+    uint8_t size = mac_codec_suffix_size(header);
+    if (suffix + size > end) return -1;
+
+    if (header <= MAC_CODEC_MAX_SHARED) {
+      /* Copies the prefix from the previous MAC, and the suffix from the payload */
+      if (header > 0) memcpy(macs[i].mac, macs[i - 1].mac, header);
+      memcpy(&macs[i].mac[header], suffix, size);
+    } else {
+      /* Adds the difference to the lower bytes of the previous MAC */
+      uint32_t delta = 0;
+      for (uint8_t j = 0; j < size; ++j) delta = (delta << 8) | suffix[j];
+
+      const uint8_t *prev = macs[i - 1].mac;
+      uint32_t lower = (((prev[3] << 16) | (prev[4] << 8) | prev[5]) + delta) & 0xFFFFFF;
+      memcpy(macs[i].mac, prev, MAC_CODEC_OUI_SIZE);
+      macs[i].mac[3] = lower >> 16;
+      macs[i].mac[4] = lower >> 8;
+      macs[i].mac[5] = lower;
+    }
+    suffix += size;
+  }
+
+  *used = suffix - in;
+  return static_cast<int32_t>(n);
+}
@@ -0,0 +1,100 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#include "macset.h"
+
+static_assert((GLOBAL_MAC_SET_CAPACITY & (GLOBAL_MAC_SET_CAPACITY - 1)) == 0,
+  "GLOBAL_MAC_SET_CAPACITY must be a power of two");
+static_assert(GLOBAL_MAC_SET_CAPACITY >= 2 * GLOBAL_MEASUREMENT_BUFFER_SIZE,
+  "GLOBAL_MAC_SET_CAPACITY must be at least twice the measurement buffer");
+
+/**
+ * Hashes the packed MAC into an slot index
+ * 
+ * @param key the packed mac address
+ */
+static inline size_t mac_set_slot(uint64_t key) {
+  return mac_set_hash(key) & (GLOBAL_MAC_SET_CAPACITY - 1);
+}
+
+/**
+ * Initializes an MAC set, must be called before first use
+ * 
+ * @param set the set to be initialized
+ */
+void mac_set_init(mac_set_t *set) {
+  memset(set->epochs, 0, sizeof (set->epochs));
+  set->epoch = 1;
+  set->size = 0;
+}
+
+/**
+ * Finds the value stored with an MAC address, the MAC is inserted when it
+ *  is not present yet, after which the caller sets its value
+ * 
+ * @param set the set
+ * @param mac the mac address (6 bytes)
+ * @param inserted the output, true if the MAC was inserted
+ * @return the value of the MAC, or nullptr if not present and the set is full
+ */
+uint16_t *mac_set_emplace(mac_set_t *set, const uint8_t *mac, bool *inserted) {
+  uint64_t key = mac_set_key(mac);
+  *inserted = false;
+
+  /* Linear probing, an slot with an old epoch is considered empty */
+  size_t i = mac_set_slot(key);
+  for (size_t n = 0; n < GLOBAL_MAC_SET_CAPACITY; ++n) {
+    if (set->epochs[i] != set->epoch) {
+      /* Keeps the load factor at or below one half, so probes stay short */
+      if (set->size >= GLOBAL_MAC_SET_CAPACITY / 2) return nullptr;
+
+      set->epochs[i] = set->epoch;
+      set->keys[i] = key;
+      ++set->size;
+      *inserted = true;
+      return &set->values[i];
+    } else if (set->keys[i] == key) return &set->values[i];
+
+    i = (i + 1) & (GLOBAL_MAC_SET_CAPACITY - 1);
+  }
+
+  return nullptr;
+}
+
+/**
+ * Finds the value stored with an MAC address
+ * 
+ * @param set the set to search in
+ * @param mac the mac address (6 bytes)
+ * @return the value of the MAC, or nullptr if not present
+ */
+uint16_t *mac_set_find(mac_set_t *set, const uint8_t *mac) {
+  uint64_t key = mac_set_key(mac);
+
+  size_t i = mac_set_slot(key);
+  for (size_t n = 0; n < GLOBAL_MAC_SET_CAPACITY; ++n) {
+    if (set->epochs[i] != set->epoch) return nullptr;
+    else if (set->keys[i] == key) return &set->values[i];
+
+    i = (i + 1) & (GLOBAL_MAC_SET_CAPACITY - 1);
+  }
+
+  return nullptr;
+}
+
+/**
+ * Removes all the entries from the set
+ * 
+ * @param set the set to be cleared
+ */
+void mac_set_clear(mac_set_t *set) {
+  /* Bumps the epoch so every slot becomes stale at once, only when the
+   * epoch wraps around we have to wipe the epoch array */
+  if (++set->epoch == 0) {
+    memset(set->epochs, 0, sizeof (set->epochs));
+    set->epoch = 1;
+  }
+
+  set->size = 0;
+}
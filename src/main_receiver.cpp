@@ -7,85 +7,214 @@
 #ifdef COMPILE_AS_RECEIVER
 
 static bool g_Connected = false;
-static ServerConnection g_ServerConnection(GLOBAL_SERVER_IP, GLOBAL_SERVER_PORT);
+static ServerConnection g_ServerConnection(GLOBAL_SERVER_IP, GLOBAL_SERVER_PORT, GLOBAL_SERVER_FRAMING);
 
-void http_write_macs(uint8_t *mac_addrs, uint8_t addr_count, const char *api_key) {
-  if (!g_Connected) {
-    Serial.println("Refusing packet transmission: no WiFi connection");
-    return;
-  }
+/* The queue which carries the received frames from the receive task to the
+ * gateway loop, and the tasks which are woken up on new data */
+static rx_queue_t g_RxQueue;
+static TaskHandle_t g_RxTask = nullptr;
+static TaskHandle_t g_LoopTask = nullptr;
+
+/* The measurements of the frame currently being handled */
+static measurement_t g_Measurements[MAC_CODEC_MAX_COUNT];
+static presence_record_t g_Records[MAC_CODEC_MAX_COUNT];
+
+/* The measurements of all transmitters within the current upload window */
+static aggregate_t g_Aggregate;
+static int64_t g_WindowStarted = 0;
+static bool g_UploadOk = true;
+
+/* The sketches of all transmitters in sketch mode, merged over the window */
+static sketch_t g_Sketch;
+
+STATS_ONLY(static int64_t g_LastStatsTime = 0);
+
+/* The long-lived API client, kept open between the uploads so the TLS
+ * session and the connection are reused, and the reusable request body */
+static esp_http_client_handle_t g_HttpClient = nullptr;
+static char g_HttpBody[GLOBAL_HTTP_BODY_SIZE];
+
+/**
+ * Gets the API client, and creates it on first use
+ */
+static esp_http_client_handle_t http_get_client() {
+  if (g_HttpClient != nullptr) return g_HttpClient;
 
-  uint64_t now = std::chrono::duration_cast<std::chrono::seconds>(
-    std::chrono::system_clock::now().time_since_epoch()
-  ).count(), last_seen = now, first_seen = last_seen - 60;
-
-  /* Prepares the body for the HTTP message */
-  cJSON *body = cJSON_CreateObject(),
-    *body_d = cJSON_CreateArray();
-
-  /* Adds the timestamp */
-  cJSON_AddNumberToObject(body, "ts", now);
-
-  /* Loops over the mac addresses, while we turn them into numbers 
-   * and add them to the body data array */
-  uint8_t *mac_ptr = mac_addrs;
-  for (uint8_t i = 0; i < addr_count; ++i) {
-    /* Converts the MAC address to an 64 bit unsigned integer, so it
-     * can be sent to the api (kinda retarded this way, just do it binary) */
-    uint64_t number = static_cast<uint64_t>(mac_ptr[0]);
-    number |= (static_cast<uint64_t>(mac_ptr[1]) << 8);
-    number |= (static_cast<uint64_t>(mac_ptr[2]) << 16);
-    number |= (static_cast<uint64_t>(mac_ptr[3]) << 24);
-    number |= (static_cast<uint64_t>(mac_ptr[4]) << 32);
-    number |= (static_cast<uint64_t>(mac_ptr[5]) << 40);
-
-    /* Creates the data array [mac, first_seen, last_seen] */
-    cJSON *element = cJSON_CreateArray(),
-      *mac = cJSON_CreateNumber(number),
-      *first = cJSON_CreateNumber(first_seen),
-      *last = cJSON_CreateNumber(last_seen);
-    cJSON_AddItemToArray(element, mac);
-    cJSON_AddItemToArray(element, first);
-    cJSON_AddItemToArray(element, last);
-
-    /* Inserts the data to the final array of data */
-    cJSON_AddItemToArray(body_d, element);
-
-    /* Goes to the next address in the list */
-    mac_ptr += sizeof (uint8_t) * 6;
-  }
-
-  // /* Adds the data array to the body, and generates the JSON string */
-  cJSON_AddItemToObject(body, "d", body_d);
-  char *http_body = cJSON_Print(body);
-  DEBUG_ONLY(Serial.printf("Sending data: '%s'\r\n", http_body));
-  size_t http_body_len = strlen(http_body);
-  if (http_body == NULL) Serial.println("cJSON_Print() failed !\r\n");
-
-  /* Configures the HTTP Request, and initializes the client */
   esp_http_client_config_t config {
-    .url = "https://drukteradar.cybox.nl/api/"
+    .url = GLOBAL_API_URL
   };
-  esp_http_client_handle_t handle = esp_http_client_init(&config);
+  config.timeout_ms = GLOBAL_HTTP_TIMEOUT;
+  g_HttpClient = esp_http_client_init(&config);
 
-  /* Initializes the HTTP Request, and sends the headers */
-  esp_http_client_set_method(handle, HTTP_METHOD_PUT);
+  /* The method and the content type never change, so are only set once */
+  if (g_HttpClient != nullptr) {
+    esp_http_client_set_method(g_HttpClient, HTTP_METHOD_PUT);
+    esp_http_client_set_header(g_HttpClient, "Content-Type", "application/json");
+  }
+
+  return g_HttpClient;
+}
+
+/**
+ * Sends an request body to the API over the kept-alive connection
+ * 
+ * @param body the JSON body
+ * @param body_len the length of the body
+ * @param api_key the API key of the transmitters the body belongs to
+ * @return false if the request failed
+ */
+static bool http_put(const char *body, int32_t body_len, const char *api_key) {
+  BINLOG(HTTP_SENDING, body_len);
+
+  esp_http_client_handle_t handle = http_get_client();
+  if (handle == nullptr) {
+    Serial.println("esp_http_client_init() failed !");
+    return false;
+  }
+
+  /* Performs the request over the kept-alive connection, the client
+   * reconnects by itself when the server closed it in the mean time */
   esp_http_client_set_header(handle, "Authorization", api_key);
-  esp_http_client_set_header(handle, "Content-Type", "application/json");
-  esp_http_client_set_post_field(handle, http_body, http_body_len);
+  esp_http_client_set_post_field(handle, body, body_len);
   esp_err_t err = esp_http_client_perform(handle);
   if (err != ESP_OK) {
     Serial.printf("esp_http_client_perform() failed: %d->%s\r\n", err, 
       esp_err_to_name(err));
-  } else {
-    DEBUG_ONLY(Serial.printf("API Performed { Status: %d, Length: %d }\r\n",
-      esp_http_client_get_status_code(handle), 
-      esp_http_client_get_content_length(handle)));
+
+    /* Drops the (possibly half open) connection, so the next upload
+     * starts with an fresh one */
+    esp_http_client_close(handle);
+    return false;
   }
 
-  // /* Free's the memory */
-  cJSON_Delete(body);
-  esp_http_client_cleanup(handle);
+  BINLOG(HTTP_PERFORMED, esp_http_client_get_status_code(handle),
+    esp_http_client_get_content_length(handle));
+  return true;
+}
+
+/**
+ * Uploads the aggregated measurements seen by a set of transmitters, split
+ *  over multiple requests when they do not fit in one body
+ * 
+ * @param agg the aggregation table
+ * @param node_mask the bitmap of the transmitters
+ * @param api_key the API key of the transmitters
+ * @return false if one of the requests failed
+ */
+static bool http_write_macs(const aggregate_t *agg, uint16_t node_mask, const char *api_key) {
+  if (!g_Connected) {
+    Serial.println("Refusing packet transmission: no WiFi connection");
+    return false;
+  }
+
+  /* The largest entry ',[mac,first_seen,last_seen,frames,rssi_max,rssi_avg,
+   * channels]' with the closing brackets and the null termination */
+  const size_t max_entry_size = 80;
+
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+
+  /* Streams the bodies into the reusable buffer, the layout is
+   * {"ts":now,"d":[[mac,first_seen,last_seen,frames,rssi_max,rssi_avg,channels],...]}
+   * where the MAC address is sent as an 48 bit little endian number, the frames
+   * are 0 for the MACs of legacy transmitters, which do not send the rest */
+  json_writer_t writer;
+  size_t entries = 0;
+  bool ok = true;
+  for (size_t slot = 0; slot <= GLOBAL_AGGREGATE_CAPACITY; ++slot) {
+    bool last = slot == GLOBAL_AGGREGATE_CAPACITY;
+    if (!last && (!aggregate_used(agg, slot) || !(agg->seen_by[slot] & node_mask))) continue;
+
+    /* Sends the body once it is full, or when all the entries are written */
+    if (entries > 0 && (last || writer.size - writer.len < max_entry_size)) {
+      json_writer_raw(&writer, "]}");
+      int32_t http_body_len = json_writer_finish(&writer);
+      if (http_body_len < 0 || !http_put(g_HttpBody, http_body_len, api_key)) ok = false;
+      entries = 0;
+    }
+
+    if (last) break;
+    else if (entries == 0) {
+      json_writer_init(&writer, g_HttpBody, sizeof (g_HttpBody));
+      json_writer_raw(&writer, "{\"ts\":");
+      json_writer_u64(&writer, tv.tv_sec);
+      json_writer_raw(&writer, ",\"d\":[");
+    }
+
+    json_writer_raw(&writer, entries == 0 ? "[" : ",[");
+    json_writer_u64(&writer, agg->keys[slot]);
+    json_writer_raw(&writer, ",");
+    json_writer_u64(&writer, agg->first_seen[slot]);
+    json_writer_raw(&writer, ",");
+    json_writer_u64(&writer, agg->last_seen[slot]);
+    json_writer_raw(&writer, ",");
+    json_writer_u64(&writer, agg->frames[slot]);
+    json_writer_raw(&writer, ",");
+    json_writer_i64(&writer, agg->frames[slot] == 0 ? 0 : agg->rssi_max[slot]);
+    json_writer_raw(&writer, ",");
+    json_writer_i64(&writer, agg->frames[slot] == 0 ? 0
+      : agg->rssi_sum[slot] / static_cast<int32_t>(agg->frames[slot]));
+    json_writer_raw(&writer, ",");
+    json_writer_u64(&writer, agg->channels[slot]);
+    json_writer_raw(&writer, "]");
+    ++entries;
+  }
+
+  return ok;
+}
+
+/**
+ * Uploads the aggregation table, with one upload per API key, so the
+ *  transmitters sharing an key end up in the same requests
+ * 
+ * @return false if one of the uploads failed
+ */
+static bool aggregate_upload() {
+  uint16_t uploaded = 0;
+  bool ok = true;
+  for (size_t i = 0; i < g_Aggregate.node_count; ++i) {
+    const char *api_key = g_Aggregate.nodes[i].api_key;
+
+    /* Skips the keys which were already uploaded with an earlier node,
+     * and collects the nodes sharing the key */
+    size_t j;
+    for (j = 0; j < i; ++j) {
+      if (strcmp(g_Aggregate.nodes[j].api_key, api_key) == 0) break;
+    }
+
+    if (j < i) continue;
+
+    uint16_t node_mask = 0;
+    for (j = i; j < g_Aggregate.node_count; ++j) {
+      if (strcmp(g_Aggregate.nodes[j].api_key, api_key) == 0) node_mask |= 1 << j;
+    }
+
+    if (http_write_macs(&g_Aggregate, node_mask, api_key)) uploaded |= node_mask;
+    else ok = false;
+  }
+
+  /* When an upload failed the measurements of its key are kept, and only
+   * that key is retried in the next window, so no key gets an entry twice */
+  BINLOG(AGGREGATE_UPLOADED, g_Aggregate.size, g_Aggregate.node_count,
+    g_Aggregate.dropped, g_Aggregate.lost_parts, ok);
+  aggregate_release(&g_Aggregate, uploaded, esp_timer_get_time());
+  return ok;
+}
+
+/**
+ * Sends the merged sketch of the window to the server, and starts an new one
+ */
+static void sketch_upload() {
+  static uint8_t sketch_frame[SKETCH_FRAME_SIZE];
+
+  BINLOG(SKETCH_WINDOW, sketch_estimate(&g_Sketch),
+    sketch_oui_count(&g_Sketch, SKETCH_OUI_RANDOMIZED), g_Sketch.window);
+
+  size_t sketch_size = sketch_serialize(&g_Sketch, sketch_frame, sizeof (sketch_frame));
+  if (g_ServerConnection.writePacket(sketch_frame, sketch_size) < 0)
+    BINLOG(SERVER_FULL, g_ServerConnection.getDropped());
+
+  sketch_clear(&g_Sketch);
 }
 
 /**
@@ -120,20 +249,62 @@ esp_err_t event_handler(void *ctx, system_event_t *event) {
   return ESP_OK;
 }
 
+/**
+ * The DIO0 interrupt handler, only wakes up the receive task
+ */
+void IRAM_ATTR lora_dio0_isr() {
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(g_RxTask, &woken);
+  if (woken == pdTRUE) {
+    portYIELD_FROM_ISR();
+  }
+}
+
+/**
+ * The task which drains the LoRa FIFO after an DIO0 interrupt, and
+ *  queues the frame for the gateway loop
+ * 
+ * @param arg unused
+ */
+void lora_rx_task(void *arg) {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    /* Checks which interrupt fired, and gets the size of the packet */
+    STATS_ONLY(uint32_t started = stats_now());
+    int32_t packet_size = LoRa.receivedPacket();
+    if (packet_size <= 0) continue;
+
+    /* Reserves an frame in the queue, if the gateway loop can't keep up
+     * the packet is dropped, and counted by the queue */
+    rx_frame_t *frame = rx_queue_reserve(&g_RxQueue);
+    if (frame == nullptr) continue;
+
+    /* Reads the packet in a single burst, together with the signal information */
+    frame->size = LoRa.readPacket(frame->data, packet_size);
+    frame->rssi = LoRa.packetRssi();
+    frame->snr = LoRa.packetSnr();
+    frame->received_at = esp_timer_get_time();
+
+    rx_queue_commit(&g_RxQueue);
+    STATS_ONLY(stats_end(STATS_RX_DRAIN, started));
+    xTaskNotifyGive(g_LoopTask);
+  }
+}
+
 /**
   * Performs all the initialization code
  */
 void setup() {
   wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
-  wifi_config_t wifi_cfg = {
-    .sta = {
-      { .ssid = GLOBAL_WIFI_SSID },
-      { .password = GLOBAL_WIFI_PASS },
-    },
-  };
+  wifi_config_t wifi_cfg;
+  memset(&wifi_cfg, 0, sizeof (wifi_cfg));
+  strncpy(reinterpret_cast<char *>(wifi_cfg.sta.ssid), GLOBAL_WIFI_SSID, sizeof (wifi_cfg.sta.ssid));
+  strncpy(reinterpret_cast<char *>(wifi_cfg.sta.password), GLOBAL_WIFI_PASS, sizeof (wifi_cfg.sta.password));
 
-  /* Inits serial */
+  /* Inits serial, and the log which is drained to it */
   Serial.begin(GLOBAL_USART_BAUD);
+  binlog_begin();
 
   /* Inits NVS */
   esp_err_t err = nvs_flash_init();
@@ -162,81 +333,173 @@ void setup() {
   }
 
   Serial.println("LoRa.begin() succeeded");
+
+  /* Starts the receive task, and puts the radio in continuous receive mode
+   * with DIO0 signaling RX done */
+  rx_queue_init(&g_RxQueue);
+  aggregate_init(&g_Aggregate);
+  g_WindowStarted = esp_timer_get_time();
+  g_LoopTask = xTaskGetCurrentTaskHandle();
+  xTaskCreatePinnedToCore(&lora_rx_task, "lora_rx", GLOBAL_RX_TASK_STACK_SIZE,
+    nullptr, GLOBAL_RX_TASK_PRIORITY, &g_RxTask, GLOBAL_RX_TASK_CORE);
+  LoRa.onDio0(&lora_dio0_isr);
+  LoRa.receive();
 }
 
 /**
- * Performs the receiving
+ * Parses an received frame and forwards it to the server
+ * 
+ * @param frame the received frame
  */
-static uint8_t packet_buffer[GLOBAL_RECEIVER_BUFFER_SIZE];
-void loop() {
-  /* Gets the size of the possible packet, after which we check
-   * if the size is larger than zero, indicating an packet */
-  int32_t packet_size = LoRa.parsePacket();
-  if (packet_size <= 0) return;
-
-  DEBUG_ONLY(Serial.printf("Received packet { RSSI: "
-   "%d, SNR: %d, Size: %d } \r\n", LoRa.packetRssi(), 
-   static_cast<int32_t>(LoRa.packetSnr() * 100), packet_size));
-
-  /* Checks if the packet is too large for the current buffer */
-  if (packet_size > GLOBAL_RECEIVER_BUFFER_SIZE) {
-    DEBUG_ONLY(Serial.printf("Ignoring packet, due to extreme"
-      "size of %d bytes\r\n", packet_size));
+static void handle_frame(const rx_frame_t *frame) {
+  const uint8_t *packet_buffer = frame->data;
+  int32_t packet_size = frame->size;
+
+  BINLOG(RX_PACKET, frame->rssi, static_cast<int32_t>(frame->snr * 100), packet_size);
+
+  /* Parses the packet, and logs it, packets which are not
+   * from cybox or from an unknown key are ignored */
+  cbx_pkt_t pkt;
+  if (cbx_pkt_parse(packet_buffer, packet_size, &pkt) != 0) {
+    BINLOG(RX_MALFORMED);
     return;
   }
 
-  /* Reads the packet after which we start parsing the packet
-   * into usefull data */
-  for (int32_t i = 0; i < packet_size; ++i)
-    packet_buffer[i] = LoRa.read();
+  cbx_pkt_log(&pkt);
 
-  /* Parses the packet, and logs it to the console */
-  const cbx_pkt_t *pkt = reinterpret_cast<cbx_pkt_t *>(packet_buffer);
-  cbx_pkt_log(pkt);
+  /* Sketch parts are merged into the sketch of the window, they still go
+   * through the aggregation table so an chain postpones the upload */
+  if (pkt.hdr.flags.sketch) {
+    if (aggregate_frame(&g_Aggregate, &pkt, frame->received_at) < 0) BINLOG(RX_TOO_MANY_NODES);
+    if (sketch_merge_part(&g_Sketch, pkt.body.payload, pkt.body.size) != 0) BINLOG(SKETCH_MALFORMED);
+    return;
+  }
 
-  /* Checks if the packet is from cybox, if not ignore */
-  if (
-    pkt->hdr.label[0] != 'C' || pkt->hdr.label[1] != 'B' || 
-    pkt->hdr.label[2] != 'X' || pkt->hdr.label[3] != 'L'
-  ) {
-    DEBUG_ONLY(Serial.println("Ignoring packet, not from Cybox .."));
+  /* Parses the measurements, the presence records and the compressed
+   * payloads are decoded while the raw ones are just copied */
+  int32_t measurement_count;
+  uint16_t age = 0;
+  size_t used;
+  if (pkt.hdr.flags.presence) {
+    measurement_count = presence_decode(pkt.body.payload, pkt.body.size, &age, g_Measurements,
+      g_Records, MAC_CODEC_MAX_COUNT);
+  } else if (pkt.hdr.flags.compressed) {
+    measurement_count = mac_codec_decode(pkt.body.payload, pkt.body.size, g_Measurements,
+      MAC_CODEC_MAX_COUNT, &used);
+  } else {
+    measurement_count = pkt.body.size / sizeof (measurement_t);
+    memcpy(g_Measurements, pkt.body.payload, measurement_count * sizeof (measurement_t));
+  }
+
+  if (measurement_count < 0) {
+    BINLOG(RX_MALFORMED_PAYLOAD);
     return;
   }
 
-  /* Parses the measurements and logs them */
-  uint8_t measurement_count = pkt->body.size / sizeof (measurement_t);
-  uint8_t *measurement_pointer = (reinterpret_cast<uint8_t *>(packet_buffer) + sizeof (cbx_pkt_t)) - sizeof (uint8_t *);
-  uint8_t *measurement_base_pointer = measurement_pointer;
-  for (uint8_t i = 0; i < measurement_count; ++i) {
-    const measurement_t *m = reinterpret_cast<measurement_t *>(measurement_base_pointer);  
-    measurement_base_pointer += sizeof (measurement_t);
-
-    /* Prints the mac address to the serial console, only if
-     * debug is enabled tho */
-    DEBUG_ONLY({
-      char mac_buffer[] = {"00:00:00:00:00:00\0"};
-      ieee80211_mac_to_string(mac_buffer, m->mac);
-      Serial.printf("MAC Received: %s\r\n", mac_buffer);
-    });    
-  }
-
-  /* Writes the measurements to the API */
-  #ifdef GLOBAL_DEBUG
-  int64_t start = std::chrono::duration_cast<std::chrono::milliseconds>(
-    std::chrono::high_resolution_clock::now().time_since_epoch()).count();
-  Serial.println("Writing packet to server ..");
-  #endif
-  
-  if (g_ServerConnection.writePacket(packet_buffer, packet_size) < 0) esp_restart();
+  /* Logs the mac addresses, only if debug is enabled tho */
+  if (BINLOG_ENABLED_RX_MAC) {
+    for (int32_t i = 0; i < measurement_count; ++i)
+      BINLOG(RX_MAC, BINLOG_MAC(g_Measurements[i].mac));
+  }
 
-  #ifdef GLOBAL_DEBUG
-  int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
-    std::chrono::high_resolution_clock::now().time_since_epoch()).count();
-  Serial.printf("Packet writting in %dms\r\n", now - start);
-  #endif
-  
+  /* Calculates when the frame was received in unix time, the frame may
+   * have waited in the queue for some time */
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+  uint64_t received_at = static_cast<uint64_t>(tv.tv_sec) * 1000 + tv.tv_usec / 1000
+    - (esp_timer_get_time() - frame->received_at) / 1000;
+
+  /* Makes the times of the records absolute, they are relative to the start
+   * of the batch, which started age seconds before it was sent. The legacy
+   * payloads only hold the MACs, so they are seen at the moment they arrived */
+  uint32_t batch_started = received_at / 1000 - age;
+  for (int32_t i = 0; i < measurement_count; ++i) {
+    presence_record_t *r = &g_Records[i];
+    if (pkt.hdr.flags.presence) {
+      r->first_seen += batch_started;
+      r->last_seen += batch_started;
+    } else {
+      *r = { };
+      r->first_seen = r->last_seen = received_at / 1000;
+    }
+  }
+
+  /* Merges the measurements into the aggregation table, which is uploaded
+   * to the API once per window */
+  int32_t node = aggregate_frame(&g_Aggregate, &pkt, frame->received_at);
+  if (node < 0) {
+    BINLOG(RX_TOO_MANY_NODES);
+  } else {
+    for (int32_t i = 0; i < measurement_count; ++i)
+      aggregate_insert(&g_Aggregate, node, g_Measurements[i].mac, &g_Records[i]);
+  }
+
+  /* The server only understands the legacy format with raw payloads, so the
+   * packets are converted, split up so the payload size still fits in the body */
+  static uint8_t forward_buffer[CBX_PKT_LEGACY_HEADER_SIZE + 255];
+
+  const int32_t max_chunk = 255 / sizeof (measurement_t);
+  cbx_pkt_t forward = pkt;
+  forward.hdr.flags.compressed = 0x0;
+  forward.hdr.flags.presence = 0x0;
+
+  for (int32_t i = 0; i < measurement_count; i += max_chunk) {
+    int32_t chunk = measurement_count - i < max_chunk ? measurement_count - i : max_chunk;
+    forward.body.size = chunk * sizeof (measurement_t);
+    forward.body.payload = reinterpret_cast<const uint8_t *>(&g_Measurements[i]);
+
+    STATS_ONLY(uint32_t started = stats_now());
+    size_t forward_size = cbx_pkt_serialize_legacy(&forward, forward_buffer, sizeof (forward_buffer));
+    int32_t rc = g_ServerConnection.writePacket(forward_buffer, forward_size, frame->rssi,
+      frame->snr, received_at);
+    STATS_ONLY(stats_end(STATS_SERVER_WRITE, started));
+
+    if (rc < 0) BINLOG(SERVER_FULL, g_ServerConnection.getDropped());
+  }
+}
+
+/**
+ * Performs the receiving
+ */
+void loop() {
+  /* Handles the oldest received frame */
+  rx_frame_t *frame = rx_queue_front(&g_RxQueue);
+  if (frame != nullptr) {
+    handle_frame(frame);
+    rx_queue_release(&g_RxQueue);
+  }
+
+  /* Drives the server connection, which (re)connects and flushes, if there
+   * was no frame we sleep until the receive task wakes us up, or the server
+   * buffer has to be flushed */
+  g_ServerConnection.poll();
+
+  /* Uploads the aggregation table once the window is over, unless an
+   * transmitter is still sending an chain, which may postpone the upload
+   * by at most one window. When the table fills up it's uploaded early,
+   * unless the previous upload failed, then we wait for the next window */
+  int64_t now = esp_timer_get_time(), elapsed = now - g_WindowStarted;
+  if ((elapsed >= GLOBAL_AGGREGATE_WINDOW * 1000LL && !aggregate_busy(&g_Aggregate, now))
+    || elapsed >= 2 * GLOBAL_AGGREGATE_WINDOW * 1000LL
+    || (g_UploadOk && g_Aggregate.size >= GLOBAL_AGGREGATE_CAPACITY / 2)) {
+    if (g_Aggregate.size > 0) g_UploadOk = aggregate_upload();
+    if (!sketch_empty(&g_Sketch)) sketch_upload();
+    g_WindowStarted = now;
+  }
 
-  delay(10);
+  /* Prints the stats frame, and sends it to the server as well so the
+   * histograms of the gateway end up next to the measurements */
+  STATS_ONLY({
+    if (now - g_LastStatsTime >= GLOBAL_STATS_INTERVAL * 1000LL) {
+      static uint8_t stats_frame[STATS_FRAME_MAX_SIZE];
+      g_LastStatsTime = now;
+      stats_print();
+      size_t stats_size = stats_serialize(stats_frame, sizeof (stats_frame));
+      if (stats_size > 0) g_ServerConnection.writePacket(stats_frame, stats_size);
+    }
+  });
+
+  if (frame == nullptr) ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(GLOBAL_SERVER_FLUSH_LATENCY));
 }
 
 #endif
\ No newline at end of file
@@ -10,11 +10,76 @@
  * Global variables
  ******************************/
 
-/* Will be used to keep track of the measurements inside the program
- * the size is used to detect overflow and trigger transmission */
-static measurement_t g_Measurements[GLOBAL_MEASUREMENT_BUFFER_SIZE];
-static size_t g_MeasurementCounter = 0;
-static int64_t g_LastTransmissionTime = 0;
+/* The ping-pong pair of measurement batches, the collection task fills the
+ * batch at g_FillIndex while the transmission task drains the other one, the
+ * in flight flag tells who owns the other batch */
+static measurement_batch_t g_Batches[2];
+static std::atomic<uint8_t> g_FillIndex(0);
+static std::atomic<bool> g_BatchInFlight(false);
+static int64_t g_LastSwapTime = 0;
+
+#ifdef GLOBAL_SKETCH_MODE
+/* In the sketch mode the MACs are sketched instead of sent one by one, the
+ * sketches are handed over the same way as the batches, per window */
+static sketch_t g_Sketches[2];
+
+static_assert(SKETCH_PART_MAX_SIZE <= GLOBAL_LORA_PAYLOAD_SIZE,
+  "an sketch part must fit in a single packet");
+static_assert(GLOBAL_SKETCH_WINDOW / 1000 <= UINT16_MAX,
+  "GLOBAL_SKETCH_WINDOW must fit the window field of an sketch part");
+#endif
+
+/* The set of MAC addresses currently in the measurement buffer, used to
+ * deduplicate incomming frames without scanning the whole buffer */
+static mac_set_t g_MeasurementSet;
+
+/* The MAC addresses reported in the last one or two rotation intervals,
+ * which are not sent again until they age out. The filters are owned by the
+ * collector, which publishes their false positive rate for the stats */
+static bloom_pair_t g_Reported;
+static std::atomic<uint32_t> g_ReportedFpRate(0);
+static std::atomic<uint32_t> g_MacsSuppressed(0);
+static std::atomic<uint32_t> g_FramesUntracked(0);
+
+/* The MACs reported or refreshed in the last one or two refresh intervals,
+ * an suppressed MAC which is not in it is sent again as MAC only */
+static bloom_pair_t g_Refreshed;
+static uint32_t g_MacsRefreshed = 0;
+
+static_assert(GLOBAL_REFRESH_INTERVAL < GLOBAL_BLOOM_ROTATE_INTERVAL,
+  "GLOBAL_REFRESH_INTERVAL must be shorter than the reported filters live");
+static_assert(2 * GLOBAL_REFRESH_INTERVAL <= GLOBAL_AGGREGATE_WINDOW,
+  "an suppressed MAC must be refreshed within every aggregation window");
+
+/* The devices which randomize their MAC, owned by the collector, which
+ * reports each of them as the first MAC it was seen with, and publishes the
+ * counters of the table */
+static fingerprint_table_t g_Fingerprints;
+static std::atomic<uint32_t> g_FpClusters(0);
+static std::atomic<uint32_t> g_FpCollapsed(0);
+
+/* The ring which carries the sniffed MACs from the WiFi callback to the
+ * transmission task, and the statistics about them */
+static measurement_ring_t g_MeasurementRing;
+static std::atomic<uint32_t> g_FramesReceived(0);
+static std::atomic<uint32_t> g_FramesDuplicate(0);
+static std::atomic<uint32_t> g_SetOverflows(0);
+static uint32_t g_BatchesTransmitted = 0;
+static int64_t g_LastInFlightTime = 0;
+static int64_t g_MaxInFlightTime = 0;
+STATS_ONLY(static int64_t g_LastStatsTime = 0);
+static uint64_t g_AirtimeUsed = 0;
+static uint64_t g_PresenceBytes = 0;
+static uint64_t g_PresenceRecords = 0;
+static uint32_t g_DutyCycleWaits = 0;
+static TaskHandle_t g_CollectTask = nullptr;
+static TaskHandle_t g_TxTask = nullptr;
+
+/* The duty cycle budget, owned by the transmission task, which publishes the
+ * available airtime and the airtime of an full packet for the collector */
+static duty_cycle_t g_DutyCycle;
+static std::atomic<uint32_t> g_AirtimeAvailable(0);
+static std::atomic<uint32_t> g_FullPacketAirtime(0);
 
 /* The filter which will be applied to the promiscous wifi mode
  * this will only allow management frames */
@@ -22,152 +87,570 @@ static wifi_promiscuous_filter_t g_PromiscFilter = {
   .filter_mask = WIFI_PROMIS_FILTER_MASK_MGMT
 };
 
-/* The channel is used for channel switching, while the transmitting boolean
- * indicates if we should ignore packets at that moment  */
-static uint8_t channel = 1;
-static bool transmitting = false;
+/* The channel hopping scheduler, when its stats were last logged, and how
+ * often switching the channel failed */
+static hopper_t g_Hopper;
+static int64_t g_LastHopStatsTime = 0;
+static uint32_t g_HopFailures = 0;
 
 /*******************************
  * Functions
  ******************************/
 
 /**
- * Transmits the measurements currently buffered
+ * Creates an packet for the gateway with the default values
+ * 
+ * @param payload the payload buffer of the packet
  */
-void lora_transmit_measurements() {
-  transmitting = true;
-
-  /* Defines the paykoad buffer, and the packet with the default
-   * packet values .. */
-  uint8_t payload_buffer[128];
-  cbx_pkt_t packet = {
+static cbx_pkt_t lora_make_packet(uint8_t *payload) {
+  return {
     .hdr = {
-      .label = { 'C', 'B', 'X', 'L' },
+      .version = CBX_PKT_VERSION,
       .sender = DEVICE_MAC,
       .receiver = GATEWAY_MAC,
       .chain_no = 0,
       .flags = {
         .encrypted = 0x1,
         .relayed = 0x0,
-        .chained = 0x0
+        .chained = 0x0,
+        .compressed = 0x0,
+        .sketch = 0x0,
+        .presence = 0x0,
+        .reserved = 0x0
       },
     },
     .body = {
       .unique_id = 0x00000000,
-      { .api_key = GLOBAL_API_KEY },
+      .key_id = GLOBAL_KEY_ID,
+      .api_key = nullptr,
       .size = 0,
-      .payload = payload_buffer
+      .payload = payload
     }
   };
+}
 
-  /* Defines the anonymous function which will transfer the current
-   * packet over LoRa */
-  bool first_packet = true; /* If the current transmitted packet is the first */
-  auto transmit_packet = [&]() {
-    /* Checks if it is the first packet, if so just transmit, else we will
-      * increment the chain id and set the chain flag */
-    if (!first_packet) {
-      DEBUG_ONLY(Serial.printf("Writing chained packet, "
-        "with payload size of: %d\r\n", packet.body.size));
-    
-      /* Sets chained to true, and increments the chain ID */ 
-      packet.hdr.flags.chained = 0x1;
-      ++packet.hdr.chain_no;
-    } else {
-      first_packet = false;
-      DEBUG_ONLY(Serial.printf("Writing non-chained packet, "
-        "with payload size of: %d\r\n", packet.body.size));
-    }
+/**
+ * Waits until an transmission fits in the duty cycle budget
+ * 
+ * @param airtime the time on air of the transmission in microseconds
+ */
+static void lora_wait_duty_cycle(uint32_t airtime) {
+  int64_t wait = duty_cycle_wait_time(&g_DutyCycle, esp_timer_get_time(), airtime);
+  if (wait > 0) {
+    BINLOG(TX_DUTY_CYCLE_WAIT, wait / 1000);
+    ++g_DutyCycleWaits;
+    vTaskDelay(pdMS_TO_TICKS(wait / 1000) + 1);
+  }
+}
 
-    /* Transmits the packet over lora, after which we reset
-      * the body size, in order to continue with the next elements */
-    DEBUG_ONLY(cbx_pkt_log(&packet));
-    cbx_pkt_transmit(&packet);
-    packet.body.size = 0;
-  };
-  
-  /* Starts looping over all the measurements, and sending the packets
-   * with the corrent payload */
-  for (uint8_t i = 0; i < g_MeasurementCounter; ++i) {
-    const measurement_t *m = &g_Measurements[i];
-
-    /* Checks if the current measurement fits into the
-     * payload of the packet, if not transmit it first */
-    if ((packet.body.size + sizeof (measurement_t)) > sizeof (payload_buffer))
-      transmit_packet();
-
-    /* Copies the measurement into the payload buffer, after which we append
-     * an new measurement to the total size of the packet */
-    memcpy(&payload_buffer[packet.body.size], m, sizeof (measurement_t));
-    packet.body.size += sizeof (measurement_t);
+/**
+ * Transmits an packet once it fits in the duty cycle budget, every packet
+ *  after the first one of an transmission is chained to the previous one
+ * 
+ * @param packet the packet to be transmitted
+ * @param first if it's the first packet of the transmission
+ */
+static void lora_send_packet(cbx_pkt_t *packet, bool first) {
+  /* Checks if it is the first packet, if so just transmit, else we will
+    * increment the chain id and set the chain flag */
+  if (!first) {
+    /* Sets chained to true, and increments the chain ID */ 
+    packet->hdr.flags.chained = 0x1;
+    ++packet->hdr.chain_no;
   }
 
-  /* Checks if there is any data left to be transmitted, if so
-   * transmit it */
-  if (packet.body.size > 0)
-    transmit_packet();
+  BINLOG(TX_PACKET, packet->hdr.chain_no, packet->hdr.flags.chained, packet->body.size);
+
+  uint32_t airtime = LoRa.timeOnAir(CBX_PKT_HEADER_SIZE + packet->body.size);
+  lora_wait_duty_cycle(airtime);
 
-  /* Resets the transmission time */
-  g_LastTransmissionTime = esp_timer_get_time();
-  g_MeasurementCounter = 0;
-  transmitting = false;
+  /* Transmits the packet over lora, after which we reset
+    * the body size, in order to continue with the next elements */
+  cbx_pkt_log(packet);
+  duty_cycle_record(&g_DutyCycle, esp_timer_get_time(), airtime);
+  g_AirtimeUsed += airtime;
+  cbx_pkt_transmit(packet);
+  packet->body.size = 0;
 }
 
 /**
- * The callback for incomming promiscous packets
+ * Transmits the measurements of an batch, the batch will be sorted
  * 
- * @param buffer the buffer which contains the data of the packet
- * @param type the type of packet
+ * @param batch the batch to be transmitted
  */
-void promisc_packet_cb(void *buffer, wifi_promiscuous_pkt_type_t type)  {
-  if (transmitting) return;
+void lora_transmit_measurements(measurement_batch_t *batch) {
+  /* Defines the paykoad buffer, and the packet with the default
+   * packet values .. */
+  uint8_t payload_buffer[GLOBAL_LORA_PAYLOAD_SIZE];
+  cbx_pkt_t packet = lora_make_packet(payload_buffer);
+  packet.hdr.flags.presence = 0x1;
   
-  /* Gets the required information for the current measurement */
-  measurement_t m;
-  wifi_promiscuous_pkt_t *promisc_pkt = (wifi_promiscuous_pkt_t *) buffer;
-  switch (type) {
-    case WIFI_CF_MGMT: {
-      ieee80211_management_packet_t *pkt = (ieee80211_management_packet_t *) promisc_pkt->payload;
-      memcpy(m.mac, pkt->hdr.transmitter, 6);
-      break;
+  /* Sorts the records, so the MACs sharing an vendor prefix are
+   * next to each other, which is what the compression relies on */
+  presence_sort(&batch->records);
+
+  /* Starts looping over all the records, and sending the packets with as
+   * many as fit. The budget of an full packet is awaited before encoding,
+   * since the payload holds the age of the batch at the moment it is sent */
+  for (size_t i = 0; i < batch->records.count;) {
+    lora_wait_duty_cycle(g_FullPacketAirtime.load(std::memory_order_relaxed));
+
+    STATS_ONLY(uint32_t started = stats_now());
+    size_t consumed;
+    packet.body.size = presence_encode(payload_buffer, sizeof (payload_buffer), &batch->records,
+      i, esp_timer_get_time(), &consumed);
+    STATS_ONLY(stats_end(STATS_ENCODE, started));
+
+    g_PresenceBytes += packet.body.size;
+    g_PresenceRecords += consumed;
+    lora_send_packet(&packet, i == 0);
+    i += consumed;
+  }
+
+  /* The refreshes follow in the same chain, as an plain compressed payload,
+   * so the gateway takes them as seen when they arrive */
+  packet.hdr.flags.presence = 0x0;
+  packet.hdr.flags.compressed = 0x1;
+  mac_codec_sort(batch->refreshed, batch->refreshed_count);
+  g_MacsRefreshed += batch->refreshed_count;
+
+  for (size_t i = 0; i < batch->refreshed_count;) {
+    size_t consumed;
+    packet.body.size = mac_codec_encode(payload_buffer, sizeof (payload_buffer), &batch->refreshed[i],
+      batch->refreshed_count - i, &consumed);
+    lora_send_packet(&packet, i == 0 && batch->records.count == 0);
+    i += consumed;
+  }
+}
+
+/**
+ * Removes the records and refreshes from an batch, and starts an new one
+ * 
+ * @param batch the batch to be cleared
+ * @param now the current time in microseconds
+ */
+static void lora_clear_batch(measurement_batch_t *batch, int64_t now) {
+  presence_clear(&batch->records, now);
+  batch->refreshed_count = 0;
+}
+
+/**
+ * Transmits an sketch, as an chain of one packet per part
+ * 
+ * @param sketch the sketch to be transmitted
+ */
+void lora_transmit_sketch(const sketch_t *sketch) {
+  uint8_t payload_buffer[GLOBAL_LORA_PAYLOAD_SIZE];
+  cbx_pkt_t packet = lora_make_packet(payload_buffer);
+  packet.hdr.flags.sketch = 0x1;
+
+  for (uint8_t part = 0; part < SKETCH_PART_COUNT; ++part) {
+    packet.body.size = sketch_encode_part(sketch, part, GLOBAL_SKETCH_WINDOW / 1000,
+      payload_buffer, sizeof (payload_buffer));
+    lora_send_packet(&packet, part == 0);
+  }
+}
+
+/**
+ * Publishes the airtime which is still available for the collector
+ */
+static void lora_publish_airtime() {
+  int64_t available = duty_cycle_available(&g_DutyCycle, esp_timer_get_time());
+  g_AirtimeAvailable.store(available > UINT32_MAX ? UINT32_MAX 
+    : static_cast<uint32_t>(available), std::memory_order_relaxed);
+}
+
+#ifndef GLOBAL_SKETCH_MODE
+/**
+ * Checks if the batch should be flushed before it is full, only done once an
+ *  full packet worth of records is there, and the budget has room for an
+ *  whole batch, otherwise we keep collecting so more unique MACs end up in
+ *  the same airtime. The size of an whole batch is estimated from the size
+ *  of the records collected so far
+ * 
+ * @param batch the batch being filled
+ */
+static bool lora_should_flush(const measurement_batch_t *batch) {
+  const size_t packet_size = GLOBAL_LORA_PAYLOAD_SIZE - PRESENCE_PACKET_OVERHEAD;
+  if (batch->records.count >= GLOBAL_MEASUREMENT_BUFFER_SIZE) return true;
+
+  size_t size = presence_size_bound(&batch->records);
+  if (size < packet_size) return false;
+
+  size_t batch_size = size * GLOBAL_MEASUREMENT_BUFFER_SIZE / batch->records.count;
+  uint64_t batch_airtime = static_cast<uint64_t>(g_FullPacketAirtime.load(std::memory_order_relaxed))
+    * ((batch_size + packet_size - 1) / packet_size);
+  return g_AirtimeAvailable.load(std::memory_order_relaxed) >= batch_airtime;
+}
+
+/**
+ * Hands the batch currently being filled over to the transmission task, and
+ *  continues filling the other one
+ * 
+ * @return false if the other batch is still in flight
+ */
+static bool lora_swap_batches() {
+  if (g_BatchInFlight.load(std::memory_order_acquire)) return false;
+
+  uint8_t fill = g_FillIndex.load(std::memory_order_relaxed);
+  g_Batches[fill].swapped_at = esp_timer_get_time();
+  lora_clear_batch(&g_Batches[fill ^ 1], g_Batches[fill].swapped_at);
+
+  /* Flips the fill index before raising the flag, so the transmission
+   * task always sees the batch it is supposed to drain */
+  g_FillIndex.store(fill ^ 1, std::memory_order_release);
+  g_BatchInFlight.store(true, std::memory_order_release);
+  xTaskNotifyGive(g_TxTask);
+
+  /* The deduplication only covers a single batch */
+  mac_set_clear(&g_MeasurementSet);
+  g_LastSwapTime = g_Batches[fill].swapped_at;
+  return true;
+}
+#else
+/**
+ * Hands the sketch of the window which just ended over to the transmission
+ *  task, and starts an new one
+ * 
+ * @return false if the other sketch is still in flight
+ */
+static bool lora_swap_sketches() {
+  if (g_BatchInFlight.load(std::memory_order_acquire)) return false;
+
+  uint8_t fill = g_FillIndex.load(std::memory_order_relaxed);
+  g_Batches[fill].swapped_at = esp_timer_get_time();
+  sketch_clear(&g_Sketches[fill ^ 1]);
+
+  g_FillIndex.store(fill ^ 1, std::memory_order_release);
+  g_BatchInFlight.store(true, std::memory_order_release);
+  xTaskNotifyGive(g_TxTask);
+
+  g_LastSwapTime = g_Batches[fill].swapped_at;
+  return true;
+}
+#endif
+
+/**
+ * Replaces the randomized MAC of an fingerprinted sighting with the MAC its
+ *  device is reported as
+ * 
+ * @param m the sighting
+ */
+static inline void lora_collapse_mac(sighting_t *m) {
+  memcpy(m->mac, fingerprint_cluster(&g_Fingerprints, m->mac, m->fingerprint, m->seq,
+    esp_timer_get_time()), 6);
+  g_FpClusters.store(g_Fingerprints.created, std::memory_order_relaxed);
+  g_FpCollapsed.store(g_Fingerprints.collapsed, std::memory_order_relaxed);
+}
+
+#ifndef GLOBAL_SKETCH_MODE
+/**
+ * Publishes the false positive rate of the reported filters, when their
+ *  bits changed since it was published last
+ */
+static void lora_publish_fp_rate() {
+  static uint32_t published_bits = UINT32_MAX;
+  uint32_t bits = g_Reported.filters[0].set_bits + g_Reported.filters[1].set_bits;
+  if (bits == published_bits) return;
+
+  published_bits = bits;
+  g_ReportedFpRate.store(bloom_pair_fp_rate(&g_Reported), std::memory_order_relaxed);
+}
+#endif
+
+/**
+ * Adds an sighting to the batch being filled, unless its MAC is in it
+ *  already or was reported recently, the set maps the MACs in the batch to
+ *  their record, and remembers the suppressed MACs while it has room beyond
+ *  what the batch may still need, an suppressed MAC which was not refreshed
+ *  recently is added to the refreshes of the batch
+ * 
+ * @param batch the batch being filled, which is not full
+ * @param set the MACs of the batch
+ * @param reported the MACs reported recently
+ * @param refreshed the MACs reported or refreshed recently
+ * @param m the sighting
+ * @param now the current time in microseconds
+ */
+lora_collect_t lora_collect(measurement_batch_t *batch, mac_set_t *set, bloom_pair_t *reported,
+  bloom_pair_t *refreshed, const sighting_t *m, int64_t now) {
+  /* Most frames come from an MAC which was seen before, so their next
+   * frames are skipped with a single lookup */
+  uint16_t *index = mac_set_find(set, m->mac);
+  if (index != nullptr) {
+    if (*index != LORA_SUPPRESSED) presence_update(&batch->records, *index, m, now);
+    return LORA_COLLECT_DUPLICATE;
+  }
+
+  /* Checked before the filters, which would otherwise suppress the MAC
+   * when it is collected again once there is room */
+  if (set->size >= GLOBAL_MAC_SET_CAPACITY / 2) return LORA_COLLECT_FULL;
+
+  /* The suppressed MACs never take the room of an MAC which is to be
+   * reported, once the spare room is used up their frames are checked
+   * against the filters every time */
+  bool inserted;
+  if (!bloom_pair_insert(reported, m->mac)) {
+    /* The MAC is still sent once per refresh interval, without its record,
+     * so the backend knows it is still around. When the refreshes of the
+     * batch are full it is left for the next batch */
+    if (batch->refreshed_count < GLOBAL_REFRESH_BUFFER_SIZE && bloom_pair_insert(refreshed, m->mac))
+      memcpy(batch->refreshed[batch->refreshed_count++].mac, m->mac, 6);
+
+    if (set->size - batch->records.count >= GLOBAL_MAC_SET_CAPACITY / 2 - GLOBAL_MEASUREMENT_BUFFER_SIZE)
+      return LORA_COLLECT_UNTRACKED;
+
+    *mac_set_emplace(set, m->mac, &inserted) = LORA_SUPPRESSED;
+    return LORA_COLLECT_SUPPRESSED;
+  }
+
+  /* An reported MAC needs no refresh until the interval is over */
+  bloom_pair_insert(refreshed, m->mac);
+
+  /* The set is below its load limit, so the MAC always gets an slot */
+  index = mac_set_emplace(set, m->mac, &inserted);
+  BINLOG(TX_UNIQUE_MAC, BINLOG_MAC(m->mac));
+  *index = batch->records.count;
+  presence_add(&batch->records, m, now);
+  return LORA_COLLECT_NEW;
+}
+
+/**
+ * The task which drains the ring, deduplicates the MACs and fills the
+ *  current batch
+ * 
+ * @param arg unused
+ */
+void lora_collect_task(void *arg) {
+  sighting_t m;
+
+  for (;;) {
+#ifdef GLOBAL_SKETCH_MODE
+    /* Every sniffed MAC goes into the sketch, duplicates included since
+     * the Count-Min sketch counts the frames, once the window is over the
+     * sketch is handed over, or retried the next time if still in flight */
+    sketch_t *sketch = &g_Sketches[g_FillIndex.load(std::memory_order_relaxed)];
+    while (ring_pop(&g_MeasurementRing, &m)) {
+      if (m.fingerprint != FINGERPRINT_NONE) lora_collapse_mac(&m);
+      sketch_add(sketch, m.mac);
     }
-    case WIFI_CF_CONTROL: {
-      ieee80211_control_mac_header_t *hdr = (ieee80211_control_mac_header_t *) promisc_pkt->payload;
-      memcpy(m.mac, hdr->transmitter, 6);
-      break;
+
+    if (esp_timer_get_time() > g_LastSwapTime + GLOBAL_SKETCH_WINDOW * 1000LL) {
+      if (sketch_empty(sketch)) g_LastSwapTime = esp_timer_get_time();
+      else lora_swap_sketches();
     }
-    case WIFI_CF_DATA: {
-      ieee80211_data_packet_t *pkt = (ieee80211_data_packet_t *) promisc_pkt->payload;
-      memcpy(m.mac, pkt->hdr.address2, 6);
-      break;
+#else
+    measurement_batch_t *batch = &g_Batches[g_FillIndex.load(std::memory_order_relaxed)];
+
+    /* Retries the swap of an batch which became ready while the other one was
+     * still in flight */
+    if (lora_should_flush(batch) && lora_swap_batches())
+      batch = &g_Batches[g_FillIndex.load(std::memory_order_relaxed)];
+
+    bloom_pair_rotate(&g_Reported, esp_timer_get_time());
+    bloom_pair_rotate(&g_Refreshed, esp_timer_get_time());
+
+    /* Drains the ring, and stores each unique mac in the current batch, once
+     * ready we try to swap, if the other batch is still in flight the remaining
+     * macs just stay in the ring until it has been transmitted */
+    int64_t now = esp_timer_get_time();
+    while (batch->records.count < GLOBAL_MEASUREMENT_BUFFER_SIZE && ring_pop(&g_MeasurementRing, &m)) {
+      STATS_ONLY(uint32_t started = stats_now());
+      if (m.fingerprint != FINGERPRINT_NONE) lora_collapse_mac(&m);
+      lora_collect_t collected = lora_collect(batch, &g_MeasurementSet, &g_Reported, &g_Refreshed, &m, now);
+
+      /* The room kept for the batch should prevent this, but if the set
+       * fills up anyway the batch is flushed, so the MAC gets an slot in an
+       * empty set, it is only lost when the other batch is still in flight */
+      if (collected == LORA_COLLECT_FULL) {
+        BINLOG(TX_SET_FULL, g_SetOverflows.fetch_add(1, std::memory_order_relaxed) + 1);
+        if (lora_swap_batches()) {
+          batch = &g_Batches[g_FillIndex.load(std::memory_order_relaxed)];
+          collected = lora_collect(batch, &g_MeasurementSet, &g_Reported, &g_Refreshed, &m, now);
+        }
+      }
+      STATS_ONLY(stats_end(STATS_DEDUP, started));
+
+      if (collected == LORA_COLLECT_DUPLICATE) {
+        g_FramesDuplicate.fetch_add(1, std::memory_order_relaxed);
+        continue;
+      } else if (collected == LORA_COLLECT_SUPPRESSED) {
+        g_MacsSuppressed.fetch_add(1, std::memory_order_relaxed);
+        continue;
+      } else if (collected == LORA_COLLECT_UNTRACKED) {
+        g_FramesUntracked.fetch_add(1, std::memory_order_relaxed);
+        continue;
+      } else if (collected == LORA_COLLECT_FULL) continue;
+
+      if (lora_should_flush(batch) && lora_swap_batches())
+        batch = &g_Batches[g_FillIndex.load(std::memory_order_relaxed)];
     }
-    case WIFI_CF_EXT: return;
-    default: break;
+
+    /* The stats read the rate published here, not the filters */
+    lora_publish_fp_rate();
+
+    /* Checks if the oldest measurement waited too long, if so flush it now */
+    if (esp_timer_get_time() > g_LastSwapTime + GLOBAL_TRANSMISSION_INTERVAL) {
+      if (batch->records.count > 0 || batch->refreshed_count > 0) lora_swap_batches();
+      else {
+        g_LastSwapTime = esp_timer_get_time();
+        lora_clear_batch(batch, g_LastSwapTime);
+      }
+    }
+#endif
+
+    /* Waits until the callback or the transmission task wakes us up, or
+     * the poll delay expires */
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(GLOBAL_TX_TASK_POLL_DELAY));
   }
+}
+
+/**
+ * The task which transmits the batches handed over by the collection task
+ * 
+ * @param arg unused
+ */
+void lora_tx_task(void *arg) {
+  g_FullPacketAirtime.store(LoRa.timeOnAir(CBX_PKT_HEADER_SIZE + GLOBAL_LORA_PAYLOAD_SIZE),
+    std::memory_order_relaxed);
+
+  for (;;) {
+    /* The available airtime grows while older transmissions leave the window,
+     * so it is refreshed every second even without any batch */
+    lora_publish_airtime();
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000));
+
+    /* Prints the stats frame once in a while, from here since this task
+     * is idle most of the time */
+    STATS_ONLY({
+      if (esp_timer_get_time() - g_LastStatsTime >= GLOBAL_STATS_INTERVAL * 1000LL) {
+        g_LastStatsTime = esp_timer_get_time();
+        stats_print();
+      }
+    });
 
-  /* Stores the measurement in the list of measurements, if full we will
-   * start the transmission */
-  for (uint16_t i = 0; i < g_MeasurementCounter; ++i) {
-    measurement_t *mi = &g_Measurements[i];
-    if (mi->mac[0] != m.mac[0]) continue;
-    else if (mi->mac[1] != m.mac[1]) continue;
-    else if (mi->mac[2] != m.mac[2]) continue;
-    else if (mi->mac[3] != m.mac[3]) continue;
-    else if (mi->mac[4] != m.mac[4]) continue;
-    else if (mi->mac[5] != m.mac[5]) continue;
-    else return;
+    if (!g_BatchInFlight.load(std::memory_order_acquire)) continue;
+
+    /* Transmits the batch which is not being filled */
+    uint8_t drain = g_FillIndex.load(std::memory_order_acquire) ^ 1;
+    measurement_batch_t *batch = &g_Batches[drain];
+#ifdef GLOBAL_SKETCH_MODE
+    lora_transmit_sketch(&g_Sketches[drain]);
+#else
+    lora_transmit_measurements(batch);
+#endif
+
+    /* Keeps track of how long the batch has been away from the collector */
+    g_LastInFlightTime = esp_timer_get_time() - batch->swapped_at;
+    if (g_LastInFlightTime > g_MaxInFlightTime) g_MaxInFlightTime = g_LastInFlightTime;
+    ++g_BatchesTransmitted;
+
+    /* Returns the batch to the collector, and wakes it up since it might
+     * be waiting for us with a full batch */
+    lora_publish_airtime();
+    g_BatchInFlight.store(false, std::memory_order_release);
+    xTaskNotifyGive(g_CollectTask);
+
+    /* Logs the stats of all three records from the same snapshot */
+    if (BINLOG_ENABLED_TX_STATS || BINLOG_ENABLED_TX_REPORTED || BINLOG_ENABLED_TX_FINGERPRINTS) {
+      lora_tx_stats_t stats;
+      lora_get_stats(&stats);
+      BINLOG(TX_STATS, stats.received, stats.dropped, stats.duplicates, stats.batches,
+        stats.last_in_flight_us, stats.max_in_flight_us, stats.airtime_us / 1000,
+        stats.duty_cycle_waits);
+      BINLOG(TX_REPORTED, stats.suppressed, stats.reported_fp_ppm, stats.airtime_saved_us / 1000);
+      BINLOG(TX_FINGERPRINTS, stats.fp_clusters, stats.fp_collapsed);
+    }
   }
+}
 
-  DEBUG_ONLY({
-    char mac[] = {"00:00:00:00:00:00\0"};
-    ieee80211_mac_to_string(mac, m.mac);
-    Serial.printf("Unique mac: %s\r\n", mac);
-  });
-  
-  g_Measurements[g_MeasurementCounter++] = m;
-  if (g_MeasurementCounter >= GLOBAL_MEASUREMENT_BUFFER_SIZE) {
-    lora_transmit_measurements();
+/**
+ * Gets a snapshot of the transmission statistics
+ * 
+ * @param stats the output statistics
+ */
+void lora_get_stats(lora_tx_stats_t *stats) {
+  stats->received = g_FramesReceived.load(std::memory_order_relaxed);
+  stats->dropped = g_MeasurementRing.dropped.load(std::memory_order_relaxed);
+  stats->duplicates = g_FramesDuplicate.load(std::memory_order_relaxed);
+  stats->overflows = g_SetOverflows.load(std::memory_order_relaxed);
+  stats->suppressed = g_MacsSuppressed.load(std::memory_order_relaxed);
+  stats->untracked = g_FramesUntracked.load(std::memory_order_relaxed);
+  stats->refreshed = g_MacsRefreshed;
+  stats->fp_clusters = g_FpClusters.load(std::memory_order_relaxed);
+  stats->fp_collapsed = g_FpCollapsed.load(std::memory_order_relaxed);
+  stats->reported_fp_ppm = g_ReportedFpRate.load(std::memory_order_relaxed);
+
+  /* Each suppressed MAC would have taken its share of an full packet, as
+   * large as the records sent so far were on average, before the first batch
+   * the largest an record can be is taken */
+  uint64_t bytes = g_PresenceBytes, records = g_PresenceRecords;
+  if (records == 0) {
+    bytes = PRESENCE_PACKET_OVERHEAD + 6 + PRESENCE_RECORD_MAX_SIZE;
+    records = 1;
   }
+
+  uint64_t record_airtime = g_FullPacketAirtime.load(std::memory_order_relaxed) * bytes / records;
+  stats->airtime_saved_us = stats->suppressed * record_airtime / GLOBAL_LORA_PAYLOAD_SIZE;
+  stats->batches = g_BatchesTransmitted;
+  stats->last_in_flight_us = g_LastInFlightTime;
+  stats->max_in_flight_us = g_MaxInFlightTime;
+  stats->airtime_us = g_AirtimeUsed;
+  stats->duty_cycle_waits = g_DutyCycleWaits;
+}
+
+/**
+ * Gets the capture statistics of an channel
+ * 
+ * @param channel the channel, starting at 1
+ * @param stats the output statistics
+ */
+void channel_get_stats(uint8_t channel, hopper_channel_stats_t *stats) {
+  hopper_get_stats(&g_Hopper, channel, stats);
+}
+
+/**
+ * The callback for incomming promiscous packets
+ * 
+ * @param buffer the buffer which contains the data of the packet
+ * @param type the type of packet
+ */
+void promisc_packet_cb(void *buffer, wifi_promiscuous_pkt_type_t type)  {
+  STATS_ONLY(uint32_t started = stats_now());
+
+  /* Gets the transmitter of the frame, the frames without one, or which
+   * are truncated, are ignored */
+  sighting_t m;
+  ieee80211_frame_info_t info;
+  wifi_promiscuous_pkt_t *promisc_pkt = (wifi_promiscuous_pkt_t *) buffer;
+  size_t size = promisc_pkt->rx_ctrl.sig_len > IEEE80211_FCS_SIZE
+    ? promisc_pkt->rx_ctrl.sig_len - IEEE80211_FCS_SIZE : 0;
+  if (ieee80211_classify(promisc_pkt->payload, size, &info) != 0 || info.transmitter == nullptr)
+    return;
+  memcpy(m.mac, info.transmitter, 6);
+  m.rssi = promisc_pkt->rx_ctrl.rssi;
+  m.channel = promisc_pkt->rx_ctrl.channel;
+
+  /* The probe requests of an locally administered MAC are fingerprinted,
+   * so the collector can tell which randomized MACs belong together */
+  m.fingerprint = FINGERPRINT_NONE;
+  if (info.type == WIFI_CF_MGMT && info.subtype == WIFI_PROBE_REQ && (m.mac[0] & 0x02) != 0) {
+    const ieee80211_management_mac_header_t *hdr
+      = reinterpret_cast<const ieee80211_management_mac_header_t *>(promisc_pkt->payload);
+    m.seq = hdr->seq_ctl >> 4;
+    m.fingerprint = fingerprint_probe(&promisc_pkt->payload[info.elements_offset],
+      size - info.elements_offset);
+  }
+  hopper_observe(&g_Hopper, promisc_pkt->rx_ctrl.channel, info.transmitter);
+
+  /* Hands the sighting over to the transmission task, waking it up
+   * once the ring is half full so bursts do not wait for the poll delay */
+  g_FramesReceived.fetch_add(1, std::memory_order_relaxed);
+  if (ring_push(&g_MeasurementRing, &m) && g_CollectTask != nullptr
+    && ring_size(&g_MeasurementRing) == GLOBAL_RING_SIZE / 2)
+    xTaskNotifyGive(g_CollectTask);
+
+  STATS_ONLY(stats_end(STATS_PROMISC_CB, started));
 }
 
 /**
@@ -176,8 +659,19 @@ void promisc_packet_cb(void *buffer, wifi_promiscuous_pkt_type_t type)  {
 void setup() {
   wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
   
-  /* Inits serial */
+  /* Inits serial, and the log which is drained to it */
   Serial.begin(GLOBAL_USART_BAUD);
+  binlog_begin();
+
+  /* Inits the deduplication set, the reported filters, the ring, the duty cycle budget and
+   * the channel hopping scheduler */
+  mac_set_init(&g_MeasurementSet);
+  bloom_pair_init(&g_Reported, GLOBAL_BLOOM_ROTATE_INTERVAL, esp_timer_get_time());
+  bloom_pair_init(&g_Refreshed, GLOBAL_REFRESH_INTERVAL, esp_timer_get_time());
+  fingerprint_init(&g_Fingerprints);
+  ring_init(&g_MeasurementRing);
+  duty_cycle_init(&g_DutyCycle);
+  hopper_init(&g_Hopper, esp_timer_get_time());
 
   /* Inits NVS */
   esp_err_t err = nvs_flash_init();
@@ -207,23 +701,46 @@ void setup() {
   }
 
   Serial.println("LoRa.begin() succeeded");
+
+  /* Starts the collection and transmission tasks on the other core than the WiFi
+   * driver, frames sniffed before this moment are simply waiting in the ring */
+  g_LastSwapTime = esp_timer_get_time();
+  lora_clear_batch(&g_Batches[0], g_LastSwapTime);
+  xTaskCreatePinnedToCore(&lora_tx_task, "lora_tx", GLOBAL_TX_TASK_STACK_SIZE,
+    nullptr, GLOBAL_TX_TASK_PRIORITY, &g_TxTask, GLOBAL_TX_TASK_CORE);
+  xTaskCreatePinnedToCore(&lora_collect_task, "lora_collect", GLOBAL_TX_TASK_STACK_SIZE,
+    nullptr, GLOBAL_TX_TASK_PRIORITY, &g_CollectTask, GLOBAL_TX_TASK_CORE);
 }
 
 /**
- * Switches the channels
+ * Switches the channels, the dwell time on each channel is adapted to
+ *  the number of new transmitters it yields
  */
 void loop() {
-  /* Checks if the transmission time was to long ago, if so do it now*/
-  if (esp_timer_get_time() > g_LastTransmissionTime + 60000000) {
-    lora_transmit_measurements();
-    return;
+  /* Performs the channel switching */
+  uint32_t dwell;
+  uint8_t channel = hopper_next(&g_Hopper, esp_timer_get_time(), &dwell);
+  esp_err_t err = esp_wifi_set_channel(channel, WIFI_SECOND_CHAN_NONE);
+  if (err != ESP_OK) {
+    /* The radio stayed on the previous channel, so only the minimum dwell
+     * is spent before moving on to the next one */
+    BINLOG(HOP_FAILED, channel, err, ++g_HopFailures);
+    dwell = GLOBAL_HOP_MIN_DWELL;
   }
 
-  /* Performs the channel switching */
-  if (channel > 11) channel = 1;
-  else ++channel;
-  esp_wifi_set_channel(channel, WIFI_SECOND_CHAN_NONE);
-  delay(GLOBAL_CHANNEL_SWITCH_DELAY);
+  /* Logs the capture statistics of every channel once in a while */
+  if (BINLOG_ENABLED_HOP_CHANNEL
+    && esp_timer_get_time() - g_LastHopStatsTime >= GLOBAL_STATS_INTERVAL * 1000LL) {
+    g_LastHopStatsTime = esp_timer_get_time();
+    for (uint8_t i = 1; i <= GLOBAL_HOP_CHANNEL_COUNT; ++i) {
+      hopper_channel_stats_t stats;
+      hopper_get_stats(&g_Hopper, i, &stats);
+      BINLOG(HOP_CHANNEL, i, stats.frames, stats.new_macs, stats.score >> HOPPER_SCORE_SHIFT,
+        stats.dwell, stats.dwell_total);
+    }
+  }
+
+  delay(dwell);
 }
 
 #endif
\ No newline at end of file
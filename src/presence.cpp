@@ -0,0 +1,290 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#include "presence.h"
+#include "maccodec.h"
+
+#include <algorithm>
+
+/**
+ * Gets the number of seconds between the start of the batch and now, the
+ *  batches are flushed long before this saturates
+ *
+ * @param table the table
+ * @param now the current time in microseconds
+ */
+static inline uint16_t presence_seconds(const presence_table_t *table, int64_t now) {
+  int64_t seconds = (now - table->started_at) / 1000000;
+  return seconds < 0 ? 0 : seconds > UINT16_MAX ? UINT16_MAX : static_cast<uint16_t>(seconds);
+}
+
+/**
+ * Gets the size of an unsigned LEB128 varint
+ *
+ * @param value the value
+ */
+static inline size_t presence_varint_size(uint32_t value) {
+  size_t n = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    ++n;
+  }
+
+  return n;
+}
+
+/**
+ * Writes an unsigned LEB128 varint
+ *
+ * @param out the output buffer
+ * @param value the value
+ * @return the number of bytes written
+ */
+static size_t presence_put_varint(uint8_t *out, uint32_t value) {
+  size_t n = 0;
+  while (value >= 0x80) {
+    out[n++] = (value & 0x7F) | 0x80;
+    value >>= 7;
+  }
+
+  out[n++] = value;
+  return n;
+}
+
+/**
+ * Reads an unsigned LEB128 varint of at most 32 bits
+ *
+ * @param in the input, advanced past the varint
+ * @param end the end of the input
+ * @param value the output value
+ * @return false if the varint is truncated or too long
+ */
+static bool presence_get_varint(const uint8_t **in, const uint8_t *end, uint32_t *value) {
+  *value = 0;
+  for (uint8_t shift = 0; shift < 35; shift += 7) {
+    if (*in >= end) return false;
+
+    uint8_t b = *(*in)++;
+    *value |= static_cast<uint32_t>(b & 0x7F) << shift;
+    if ((b & 0x80) == 0) return true;
+  }
+
+  return false;
+}
+
+/**
+ * Gets the channel an record was seen on, or 0 when there were multiple
+ *
+ * @param channels the channel bitmap
+ */
+static inline uint8_t presence_single_channel(uint16_t channels) {
+  return channels != 0 && (channels & (channels - 1)) == 0 ? __builtin_ctz(channels) + 1 : 0;
+}
+
+/**
+ * Gets the encoded size of an record
+ *
+ * @param table the table
+ * @param i the index of the record
+ */
+static size_t presence_record_size(const presence_table_t *table, size_t i) {
+  size_t n = presence_varint_size(table->first_seen[i])
+    + presence_varint_size(table->last_seen[i] - table->first_seen[i])
+    + presence_varint_size(table->frames[i] - 1) + 2;
+  if (presence_single_channel(table->channels[i]) == 0) n += presence_varint_size(table->channels[i]);
+  return n;
+}
+
+/**
+ * Swaps two records of an table
+ *
+ * @param table the table
+ * @param a the index of the first record
+ * @param b the index of the second record
+ */
+static void presence_swap(presence_table_t *table, size_t a, size_t b) {
+  std::swap(table->macs[a], table->macs[b]);
+  std::swap(table->first_seen[a], table->first_seen[b]);
+  std::swap(table->last_seen[a], table->last_seen[b]);
+  std::swap(table->frames[a], table->frames[b]);
+  std::swap(table->rssi_sum[a], table->rssi_sum[b]);
+  std::swap(table->rssi_max[a], table->rssi_max[b]);
+  std::swap(table->channels[a], table->channels[b]);
+}
+
+/**
+ * Removes all the records from an table, and starts an new batch
+ *
+ * @param table the table to be cleared
+ * @param now the current time in microseconds
+ */
+void presence_clear(presence_table_t *table, int64_t now) {
+  table->count = 0;
+  table->started_at = now;
+}
+
+/**
+ * Adds an new record to an table, for an MAC which is not in it yet
+ *
+ * @param table the table
+ * @param sighting the sighting of the MAC
+ * @param now the current time in microseconds
+ * @return the index of the record, or -1 if the table is full
+ */
+int32_t presence_add(presence_table_t *table, const sighting_t *sighting, int64_t now) {
+  if (table->count >= GLOBAL_MEASUREMENT_BUFFER_SIZE) return -1;
+
+  size_t i = table->count++;
+  memcpy(table->macs[i].mac, sighting->mac, 6);
+  table->first_seen[i] = table->last_seen[i] = presence_seconds(table, now);
+  table->frames[i] = 1;
+  table->rssi_sum[i] = table->rssi_max[i] = sighting->rssi;
+  table->channels[i] = 0;
+  if (sighting->channel >= 1 && sighting->channel <= PRESENCE_CHANNEL_MAX)
+    table->channels[i] = 1 << (sighting->channel - 1);
+  return static_cast<int32_t>(i);
+}
+
+/**
+ * Updates the record of an MAC with another sighting
+ *
+ * @param table the table
+ * @param index the index of the record
+ * @param sighting the sighting of the MAC
+ * @param now the current time in microseconds
+ */
+void presence_update(presence_table_t *table, size_t index, const sighting_t *sighting, int64_t now) {
+  table->last_seen[index] = presence_seconds(table, now);
+  ++table->frames[index];
+  table->rssi_sum[index] += sighting->rssi;
+  if (sighting->rssi > table->rssi_max[index]) table->rssi_max[index] = sighting->rssi;
+  if (sighting->channel >= 1 && sighting->channel <= PRESENCE_CHANNEL_MAX)
+    table->channels[index] |= 1 << (sighting->channel - 1);
+}
+
+/**
+ * Sorts the records of an table by MAC, so the shared prefixes are adjacent
+ *
+ * @param table the table to be sorted
+ */
+void presence_sort(presence_table_t *table) {
+  /* The batch is small, and only sorted once by the transmission task, so an
+   * insertion sort which swaps the whole rows is enough */
+  for (size_t i = 1; i < table->count; ++i) {
+    for (size_t j = i; j > 0 && memcmp(table->macs[j - 1].mac, table->macs[j].mac, 6) > 0; --j)
+      presence_swap(table, j - 1, j);
+  }
+}
+
+/**
+ * Gets an upper bound of the encoded size of all records of an table, the
+ *  MACs are counted whole since their shared prefixes are only known once
+ *  the table is sorted, the overhead of each packet is left out
+ *
+ * @param table the table
+ * @return the size in bytes
+ */
+size_t presence_size_bound(const presence_table_t *table) {
+  /* The MAC headers are nibbles, two to an byte */
+  size_t size = (table->count + 1) / 2;
+  for (size_t i = 0; i < table->count; ++i) size += 6 + presence_record_size(table, i);
+  return size;
+}
+
+/**
+ * Encodes as many sorted records as fit into the output buffer
+ *
+ * @param out the output buffer
+ * @param out_size the size of the output buffer
+ * @param table the sorted table
+ * @param start the index of the first record to encode
+ * @param now the current time in microseconds
+ * @param consumed the number of records which were encoded
+ * @return the number of bytes written
+ */
+size_t presence_encode(uint8_t *out, size_t out_size, const presence_table_t *table,
+  size_t start, int64_t now, size_t *consumed) {
+  *consumed = 0;
+  if (out_size < PRESENCE_AGE_SIZE + 1) return 0;
+
+  /* Finds out how many records fit, the MACs and the records both grow
+   * with every record, so they are counted together */
+  size_t count = table->count - start, n = 0, mac_size = 1, record_size = 0;
+  if (count > MAC_CODEC_MAX_COUNT) count = MAC_CODEC_MAX_COUNT;
+  for (; n < count; ++n) {
+    const measurement_t *macs = &table->macs[start];
+    uint8_t header = mac_codec_header(n == 0 ? nullptr : macs[n - 1].mac, macs[n].mac);
+    size_t next_mac_size = mac_size + mac_codec_suffix_size(header) + ((n & 1) ? 0 : 1);
+    size_t next_record_size = record_size + presence_record_size(table, start + n);
+    if (PRESENCE_AGE_SIZE + next_mac_size + next_record_size > out_size) break;
+    mac_size = next_mac_size;
+    record_size = next_record_size;
+  }
+
+  /* Writes the age, the MACs and the records */
+  uint16_t age = presence_seconds(table, now);
+  out[0] = age & 0xFF;
+  out[1] = age >> 8;
+
+  size_t size = PRESENCE_AGE_SIZE + mac_codec_encode(&out[PRESENCE_AGE_SIZE], mac_size,
+    &table->macs[start], n, consumed);
+  for (size_t i = start; i < start + *consumed; ++i) {
+    uint8_t channel = presence_single_channel(table->channels[i]);
+    int32_t spread = table->rssi_max[i] - table->rssi_sum[i] / static_cast<int32_t>(table->frames[i]);
+    if (spread > PRESENCE_SPREAD_MAX) spread = PRESENCE_SPREAD_MAX;
+
+    size += presence_put_varint(&out[size], table->first_seen[i]);
+    size += presence_put_varint(&out[size], table->last_seen[i] - table->first_seen[i]);
+    size += presence_put_varint(&out[size], table->frames[i] - 1);
+    out[size++] = static_cast<uint8_t>(table->rssi_max[i]);
+    out[size++] = (spread << 4) | channel;
+    if (channel == 0) size += presence_put_varint(&out[size], table->channels[i]);
+  }
+
+  return size;
+}
+
+/**
+ * Decodes an presence payload
+ *
+ * @param in the payload
+ * @param in_size the size of the payload
+ * @param age the output age of the batch in seconds
+ * @param macs the output measurements
+ * @param records the output records
+ * @param max_count the max number of output records
+ * @return the number of decoded records, or -1 if malformed
+ */
+int32_t presence_decode(const uint8_t *in, size_t in_size, uint16_t *age,
+  measurement_t *macs, presence_record_t *records, size_t max_count) {
+  if (in_size < PRESENCE_AGE_SIZE) return -1;
+  *age = in[0] | (in[1] << 8);
+
+  size_t mac_size;
+  int32_t n = mac_codec_decode(&in[PRESENCE_AGE_SIZE], in_size - PRESENCE_AGE_SIZE,
+    macs, max_count, &mac_size);
+  if (n < 0) return -1;
+
+  const uint8_t *p = &in[PRESENCE_AGE_SIZE + mac_size], *end = &in[in_size];
+  for (int32_t i = 0; i < n; ++i) {
+    presence_record_t *r = &records[i];
+    uint32_t dwell, channels;
+    if (!presence_get_varint(&p, end, &r->first_seen) || !presence_get_varint(&p, end, &dwell)
+      || !presence_get_varint(&p, end, &r->frames) || end - p < 2) return -1;
+
+    r->last_seen = r->first_seen + dwell;
+    ++r->frames;
+    r->rssi_max = static_cast<int8_t>(p[0]);
+    int32_t rssi_avg = r->rssi_max - (p[1] >> 4);
+    r->rssi_avg = static_cast<int8_t>(rssi_avg < INT8_MIN ? INT8_MIN : rssi_avg);
+    uint8_t channel = p[1] & 0x0F;
+    p += 2;
+
+    if (channel != 0) r->channels = 1 << (channel - 1);
+    else if (!presence_get_varint(&p, end, &channels) || channels > UINT16_MAX) return -1;
+    else r->channels = channels;
+  }
+
+  return p == end ? n : -1;
+}
@@ -0,0 +1,69 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#include "ring.h"
+
+static_assert((GLOBAL_RING_SIZE & (GLOBAL_RING_SIZE - 1)) == 0,
+  "GLOBAL_RING_SIZE must be a power of two");
+
+/**
+ * Initializes an measurement ring
+ * 
+ * @param ring the ring to be initialized
+ */
+void ring_init(measurement_ring_t *ring) {
+  ring->head.store(0, std::memory_order_relaxed);
+  ring->tail.store(0, std::memory_order_relaxed);
+  ring->dropped.store(0, std::memory_order_relaxed);
+}
+
+/**
+ * Pushes an sighting into the ring, may only be called by the producer
+ * 
+ * @param ring the ring to push into
+ * @param m the sighting to be pushed
+ * @return false if the ring was full and the sighting has been dropped
+ */
+bool IRAM_ATTR ring_push(measurement_ring_t *ring, const sighting_t *m) {
+  uint32_t head = ring->head.load(std::memory_order_relaxed);
+  uint32_t tail = ring->tail.load(std::memory_order_acquire);
+
+  /* The indices run freely, and are only masked on access, so the
+   * difference is always the number of used slots */
+  if (head - tail >= GLOBAL_RING_SIZE) {
+    ring->dropped.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  ring->items[head & (GLOBAL_RING_SIZE - 1)] = *m;
+  ring->head.store(head + 1, std::memory_order_release);
+  return true;
+}
+
+/**
+ * Pops an sighting from the ring, may only be called by the consumer
+ * 
+ * @param ring the ring to pop from
+ * @param m the output sighting
+ * @return false if the ring was empty
+ */
+bool ring_pop(measurement_ring_t *ring, sighting_t *m) {
+  uint32_t tail = ring->tail.load(std::memory_order_relaxed);
+  uint32_t head = ring->head.load(std::memory_order_acquire);
+  if (head == tail) return false;
+
+  *m = ring->items[tail & (GLOBAL_RING_SIZE - 1)];
+  ring->tail.store(tail + 1, std::memory_order_release);
+  return true;
+}
+
+/**
+ * Gets the number of sightings currently in the ring
+ * 
+ * @param ring the ring
+ */
+uint32_t ring_size(const measurement_ring_t *ring) {
+  return ring->head.load(std::memory_order_acquire)
+    - ring->tail.load(std::memory_order_acquire);
+}
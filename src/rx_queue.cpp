@@ -0,0 +1,69 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#include "rx_queue.h"
+
+static_assert((GLOBAL_RX_QUEUE_SIZE & (GLOBAL_RX_QUEUE_SIZE - 1)) == 0,
+  "GLOBAL_RX_QUEUE_SIZE must be a power of two");
+
+/**
+ * Initializes an receive queue
+ * 
+ * @param queue the queue to be initialized
+ */
+void rx_queue_init(rx_queue_t *queue) {
+  queue->head.store(0, std::memory_order_relaxed);
+  queue->tail.store(0, std::memory_order_relaxed);
+  queue->dropped.store(0, std::memory_order_relaxed);
+}
+
+/**
+ * Reserves the next free frame, may only be called by the producer
+ * 
+ * @param queue the queue
+ * @return the frame to be filled, or nullptr if the queue is full
+ */
+rx_frame_t *rx_queue_reserve(rx_queue_t *queue) {
+  uint32_t head = queue->head.load(std::memory_order_relaxed);
+  uint32_t tail = queue->tail.load(std::memory_order_acquire);
+
+  if (head - tail >= GLOBAL_RX_QUEUE_SIZE) {
+    queue->dropped.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+  }
+
+  return &queue->frames[head & (GLOBAL_RX_QUEUE_SIZE - 1)];
+}
+
+/**
+ * Publishes the frame returned by rx_queue_reserve to the consumer
+ * 
+ * @param queue the queue
+ */
+void rx_queue_commit(rx_queue_t *queue) {
+  queue->head.fetch_add(1, std::memory_order_release);
+}
+
+/**
+ * Gets the oldest published frame, may only be called by the consumer
+ * 
+ * @param queue the queue
+ * @return the frame, or nullptr if the queue is empty
+ */
+rx_frame_t *rx_queue_front(rx_queue_t *queue) {
+  uint32_t tail = queue->tail.load(std::memory_order_relaxed);
+  uint32_t head = queue->head.load(std::memory_order_acquire);
+  if (head == tail) return nullptr;
+
+  return &queue->frames[tail & (GLOBAL_RX_QUEUE_SIZE - 1)];
+}
+
+/**
+ * Returns the frame returned by rx_queue_front to the producer
+ * 
+ * @param queue the queue
+ */
+void rx_queue_release(rx_queue_t *queue) {
+  queue->tail.fetch_add(1, std::memory_order_release);
+}
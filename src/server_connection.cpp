@@ -1,41 +1,257 @@
 #include "server_connection.h"
 
-ServerConnection::ServerConnection(const char *addr, uint32_t port):
-  m_Address(addr), m_Port(port)
+#include <fcntl.h>
+#include <errno.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+ServerConnection::ServerConnection(const char *addr, uint32_t port, server_framing_t framing):
+  m_Address(addr), m_Port(port), m_Framing(framing), m_FD(-1), m_Wanted(false),
+  m_State(SERVER_STATE_DISCONNECTED), m_RetryAt(0), m_Backoff(GLOBAL_SERVER_RECONNECT_MIN),
+  m_Reconnects(0), m_Dropped(0), m_Head(0), m_Tail(0), m_Size(0), m_Sent(0), m_OldestAt(0)
 {}
 
-int32_t ServerConnection::writePacket(const uint8_t *buffer, int32_t size) {
-  char writeBuff[8];
-  for (int32_t i = 0; i < size; ++i) {
-    uint8_t len = sprintf(writeBuff, "%02x", buffer[i]);
-    if (write(this->m_FD, writeBuff, len) < 0) return -1;
+int32_t ServerConnection::writePacket(const uint8_t *buffer, int32_t size, int16_t rssi,
+  float snr, uint64_t received_at) {
+  static const char hex[] = "0123456789abcdef";
+  uint8_t encoded[64];
+  size_t record_size;
+
+  /* Computes the size of the record, the hex lines are twice the size of
+   * the packet plus the newline */
+  if (this->m_Framing == SERVER_FRAMING_BINARY) record_size = SERVER_RECORD_HEADER_SIZE + size;
+  else record_size = static_cast<size_t>(size) * 2 + 1;
+
+  /* Makes room by forgetting the records kept for replay, and refuses the
+   * packet if the ring is still full, the ring is drained in order so the
+   * oldest packets are the ones which are kept */
+  if (record_size <= GLOBAL_SERVER_BUFFER_SIZE) this->release(GLOBAL_SERVER_BUFFER_SIZE - record_size);
+  if (this->m_Size + record_size > GLOBAL_SERVER_BUFFER_SIZE) {
+    ++this->m_Dropped;
+    return -1;
+  }
+
+  if (this->m_Size == this->m_Sent) this->m_OldestAt = esp_timer_get_time();
+
+  /* Writes the record, the binary packets are copied straight into the
+   * ring after their header, the hex lines are encoded in small pieces so
+   * large packets don't need an large buffer on the stack */
+  if (this->m_Framing == SERVER_FRAMING_BINARY) {
+    uint16_t length = SERVER_RECORD_HEADER_SIZE - 2 + size;
+    int8_t snr_q = static_cast<int8_t>(snr * 4);
+    encoded[0] = length & 0xFF; encoded[1] = length >> 8;
+    for (uint8_t i = 0; i < 8; ++i) encoded[2 + i] = (received_at >> (8 * i)) & 0xFF;
+    encoded[10] = rssi & 0xFF; encoded[11] = (rssi >> 8) & 0xFF;
+    encoded[12] = static_cast<uint8_t>(snr_q);
+    this->append(encoded, SERVER_RECORD_HEADER_SIZE);
+    this->append(buffer, size);
+  } else {
+    for (int32_t i = 0; i < size; i += sizeof (encoded) / 2) {
+      int32_t chunk = size - i < static_cast<int32_t>(sizeof (encoded) / 2)
+        ? size - i : static_cast<int32_t>(sizeof (encoded) / 2);
+      for (int32_t j = 0; j < chunk; ++j) {
+        encoded[j * 2] = hex[buffer[i + j] >> 4];
+        encoded[j * 2 + 1] = hex[buffer[i + j] & 0x0F];
+      }
+      this->append(encoded, chunk * 2);
+    }
+    this->append(reinterpret_cast<const uint8_t *>("\n"), 1);
+  }
+
+  /* Flushes once an segment worth of data is there */
+  if (this->m_State == SERVER_STATE_CONNECTED && this->m_Size - this->m_Sent >= GLOBAL_SERVER_FLUSH_SIZE)
+    this->flush();
+  return 0;
+}
+
+int32_t ServerConnection::poll() {
+  int64_t now = esp_timer_get_time();
+
+  /* Closes the connection if it is no longer wanted, the next connection
+   * may then be made right away */
+  if (!this->m_Wanted.load()) {
+    if (this->m_State != SERVER_STATE_DISCONNECTED) this->disconnect();
+    this->m_RetryAt = 0;
+    this->m_Backoff = GLOBAL_SERVER_RECONNECT_MIN;
+    return 0;
+  }
+
+  switch (this->m_State) {
+    case SERVER_STATE_DISCONNECTED:
+      if (now >= this->m_RetryAt) return this->startConnect();
+      return 0;
+    case SERVER_STATE_CONNECTING:
+      return this->finishConnect();
+    case SERVER_STATE_CONNECTED: {
+      /* Checks if the server closed the connection, anything it sends
+       * is ignored */
+      uint8_t discard[32];
+      ssize_t rc = recv(this->m_FD, discard, sizeof (discard), MSG_DONTWAIT);
+      if (rc == 0 || (rc < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+        this->disconnect();
+        return -1;
+      }
+
+      /* Flushes if the oldest buffered packet waited long enough */
+      if (this->m_Size > this->m_Sent && (this->m_Size - this->m_Sent >= GLOBAL_SERVER_FLUSH_SIZE 
+        || now - this->m_OldestAt >= GLOBAL_SERVER_FLUSH_LATENCY * 1000LL)) return this->flush();
+      return 0;
+    }
+    default: return 0;
+  }
+}
+
+int32_t ServerConnection::flush() {
+  if (this->m_State != SERVER_STATE_CONNECTED) return -1;
+  STATS_ONLY(uint32_t started = stats_now());
+
+  /* Sends the unsent part of the ring, which takes two send calls when it
+   * wraps around, an full socket buffer just means we try again later */
+  while (this->m_Sent < this->m_Size) {
+    size_t start = (this->m_Tail + this->m_Sent) % GLOBAL_SERVER_BUFFER_SIZE;
+    size_t length = this->m_Size - this->m_Sent;
+    if (start + length > GLOBAL_SERVER_BUFFER_SIZE) length = GLOBAL_SERVER_BUFFER_SIZE - start;
+
+    ssize_t rc = send(this->m_FD, &this->m_Buffer[start], length, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+    else if (rc < 0) {
+      this->disconnect();
+      STATS_ONLY(stats_end(STATS_SERVER_FLUSH, started));
+      return -1;
+    }
+
+    this->m_Sent += rc;
   }
-  
-  if (write(this->m_FD, "\n", 1) < 0) return -1;
+
+  /* Removes the records which have been sent, except for the last ones
+   * which might still be in the socket buffers */
+  this->release(GLOBAL_SERVER_BUFFER_SIZE);
+
+  if (this->m_Size > this->m_Sent) this->m_OldestAt = esp_timer_get_time();
+  STATS_ONLY(stats_end(STATS_SERVER_FLUSH, started));
   return 0;
 }
 
 int32_t ServerConnection::initConn() {
-  int32_t rc;
+  this->m_Wanted.store(true);
+  return 0;
+}
+
+void ServerConnection::closeConn() {
+  this->m_Wanted.store(false);
+}
+
+int32_t ServerConnection::startConnect() {
+  int32_t rc, one = 1;
 
   /* Configures the socket structure, we also convert the IP to binary */
   memset(reinterpret_cast<void *>(&this->m_SocketAddr), 0x0, sizeof (struct sockaddr_in));
   this->m_SocketAddr.sin_family = AF_INET;
-  this->m_SocketAddr.sin_addr.s_addr = inet_addr(GLOBAL_SERVER_IP);
-  this->m_SocketAddr.sin_port = htons(GLOBAL_SERVER_PORT);
+  this->m_SocketAddr.sin_addr.s_addr = inet_addr(this->m_Address);
+  this->m_SocketAddr.sin_port = htons(this->m_Port);
 
-  /* Gets the socket file descriptor, and prints serial error if this fails */
+  /* Gets the socket file descriptor, and makes it non-blocking */
   this->m_FD = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-  if (this->m_FD < 0) return -1;
+  if (this->m_FD < 0) {
+    this->disconnect();
+    return -1;
+  }
+
+  fcntl(this->m_FD, F_SETFL, fcntl(this->m_FD, F_GETFL, 0) | O_NONBLOCK);
 
-  /* Connects the socket to the server, and checks for further errors */
+  /* Disables Nagle, the packets are already coalesced in our own buffer so
+   * the flushes should go out right away */
+  setsockopt(this->m_FD, IPPROTO_TCP, TCP_NODELAY, &one, sizeof (one));
+
+  /* Starts connecting, which will be finished by an later poll */
   rc = connect(this->m_FD, reinterpret_cast<struct sockaddr *>(
     &this->m_SocketAddr), sizeof (struct sockaddr_in));
-  if (rc != 0) return -1;
+  if (rc != 0 && errno != EINPROGRESS) {
+    this->disconnect();
+    return -1;
+  }
 
-  return 0;
+  this->m_State = SERVER_STATE_CONNECTING;
+  this->m_RetryAt = esp_timer_get_time() + GLOBAL_SERVER_CONNECT_TIMEOUT * 1000LL;
+  return rc == 0 ? this->finishConnect() : 0;
 }
 
-void ServerConnection::closeConn() {
-  shutdown(this->m_FD, SHUT_RDWR);
-}
\ No newline at end of file
+int32_t ServerConnection::finishConnect() {
+  fd_set write_fds;
+  struct timeval timeout = { 0, 0 };
+
+  /* Checks if the socket became writable, which means the connect finished */
+  FD_ZERO(&write_fds);
+  FD_SET(this->m_FD, &write_fds);
+  if (select(this->m_FD + 1, nullptr, &write_fds, nullptr, &timeout) <= 0) {
+    if (esp_timer_get_time() < this->m_RetryAt) return 0;
+    this->disconnect();
+    return -1;
+  }
+
+  int32_t err = 0;
+  socklen_t len = sizeof (err);
+  if (getsockopt(this->m_FD, SOL_SOCKET, SO_ERROR, &err, &len) != 0 || err != 0) {
+    this->disconnect();
+    return -1;
+  }
+
+  BINLOG(SERVER_CONNECTED, this->m_Size);
+  this->m_State = SERVER_STATE_CONNECTED;
+  this->m_Backoff = GLOBAL_SERVER_RECONNECT_MIN;
+  ++this->m_Reconnects;
+  return this->m_Size > 0 ? this->flush() : 0;
+}
+
+void ServerConnection::disconnect() {
+  if (this->m_FD >= 0) close(this->m_FD);
+  this->m_FD = -1;
+  this->m_State = SERVER_STATE_DISCONNECTED;
+
+  /* Data accepted by the socket might never have reached the server, so
+   * the records kept for replay, and the one which was partially sent,
+   * will be sent again */
+  this->m_Sent = 0;
+
+  /* Schedules the next attempt, with exponential backoff */
+  this->m_RetryAt = esp_timer_get_time() + this->m_Backoff * 1000LL;
+  this->m_Backoff = this->m_Backoff * 2 > GLOBAL_SERVER_RECONNECT_MAX 
+    ? GLOBAL_SERVER_RECONNECT_MAX : this->m_Backoff * 2;
+  BINLOG(SERVER_DISCONNECTED, this->m_Backoff / 2);
+}
+
+void ServerConnection::release(size_t max_size) {
+  /* Sent records are kept while they fit in the replay window, or until
+   * the ring has to shrink to max_size */
+  while (this->m_Size > 0) {
+    size_t size = this->recordSize(this->m_Tail);
+    if (size > this->m_Sent) break;
+    else if (this->m_Sent - size < GLOBAL_SERVER_REPLAY_SIZE && this->m_Size <= max_size) break;
+
+    this->m_Tail = (this->m_Tail + size) % GLOBAL_SERVER_BUFFER_SIZE;
+    this->m_Size -= size;
+    this->m_Sent -= size;
+  }
+}
+
+void ServerConnection::append(const uint8_t *data, size_t size) {
+  size_t first = GLOBAL_SERVER_BUFFER_SIZE - this->m_Head;
+  if (first > size) first = size;
+
+  memcpy(&this->m_Buffer[this->m_Head], data, first);
+  memcpy(this->m_Buffer, data + first, size - first);
+  this->m_Head = (this->m_Head + size) % GLOBAL_SERVER_BUFFER_SIZE;
+  this->m_Size += size;
+}
+
+size_t ServerConnection::recordSize(size_t pos) const {
+  if (this->m_Framing == SERVER_FRAMING_BINARY)
+    return 2 + (this->at(pos) | (static_cast<size_t>(this->at(pos + 1)) << 8));
+
+  /* The hex records end with an newline */
+  size_t size = 1;
+  while (this->at(pos + size - 1) != '\n') ++size;
+  return size;
+}
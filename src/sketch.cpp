@@ -0,0 +1,238 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#include "sketch.h"
+#include "macset.h"
+
+#include <math.h>
+
+static_assert(SKETCH_HLL_REGISTERS * 6 / 8 <= SKETCH_CMS_WIDTH * 2,
+  "the HyperLogLog part must not be larger than an Count-Min part");
+
+/**
+ * Mixes an 64 bit key, the finalizer of splitmix64, so every bit of the
+ *  MAC affects every bit of the hash
+ *
+ * @param key the key
+ */
+static inline uint64_t sketch_hash(uint64_t key) {
+  key ^= key >> 30;
+  key *= 0xBF58476D1CE4E5B9ULL;
+  key ^= key >> 27;
+  key *= 0x94D049BB133111EBULL;
+  key ^= key >> 31;
+  return key;
+}
+
+/**
+ * Gets the column of an key in an Count-Min row, the rows use independent
+ *  columns derived from two halves of the hash
+ *
+ * @param hash the hash of the key
+ * @param row the row
+ */
+static inline size_t sketch_cms_column(uint64_t hash, size_t row) {
+  uint32_t h1 = static_cast<uint32_t>(hash), h2 = static_cast<uint32_t>(hash >> 32);
+  return (h1 + row * h2) % SKETCH_CMS_WIDTH;
+}
+
+static inline void sketch_put_u16(uint8_t *out, uint16_t v) {
+  out[0] = v & 0xFF;
+  out[1] = v >> 8;
+}
+
+static inline uint16_t sketch_get_u16(const uint8_t *in) {
+  return in[0] | (in[1] << 8);
+}
+
+/**
+ * Clears an sketch
+ *
+ * @param sketch the sketch to be cleared
+ */
+void sketch_clear(sketch_t *sketch) {
+  memset(sketch, 0, sizeof (sketch_t));
+}
+
+/**
+ * Adds an sighting of an MAC to the sketch
+ *
+ * @param sketch the sketch
+ * @param mac the mac address (6 bytes)
+ */
+void sketch_add(sketch_t *sketch, const uint8_t *mac) {
+  /* The HyperLogLog register is picked by the top bits of the hash, and
+   * keeps the longest run of leading zeros seen in the other bits */
+  uint64_t hash = sketch_hash(mac_set_key(mac));
+  uint64_t rest = (hash << SKETCH_HLL_BITS) | (1ULL << (SKETCH_HLL_BITS - 1));
+  uint8_t rank = __builtin_clzll(rest) + 1;
+  uint8_t *reg = &sketch->hll[hash >> (64 - SKETCH_HLL_BITS)];
+  if (rank > *reg) *reg = rank;
+
+  /* The counters saturate, so an busy OUI never wraps around */
+  uint32_t oui = (mac[0] & 0x02) ? SKETCH_OUI_RANDOMIZED
+    : (static_cast<uint32_t>(mac[0]) << 16) | (mac[1] << 8) | mac[2];
+  uint64_t oui_hash = sketch_hash(oui);
+  for (size_t row = 0; row < SKETCH_CMS_DEPTH; ++row) {
+    uint16_t *counter = &sketch->cms[row][sketch_cms_column(oui_hash, row)];
+    if (*counter != 0xFFFF) ++*counter;
+  }
+}
+
+/**
+ * Checks if nothing was added to the sketch
+ *
+ * @param sketch the sketch
+ */
+bool sketch_empty(const sketch_t *sketch) {
+  for (size_t i = 0; i < SKETCH_HLL_REGISTERS; ++i)
+    if (sketch->hll[i] != 0) return false;
+  return true;
+}
+
+/**
+ * Estimates the number of distinct MACs in the sketch
+ *
+ * @param sketch the sketch
+ */
+uint32_t sketch_estimate(const sketch_t *sketch) {
+  const double m = SKETCH_HLL_REGISTERS;
+  const double alpha = 0.7213 / (1.0 + 1.079 / m);
+
+  double sum = 0.0;
+  size_t zeros = 0;
+  for (size_t i = 0; i < SKETCH_HLL_REGISTERS; ++i) {
+    sum += ldexp(1.0, -sketch->hll[i]);
+    if (sketch->hll[i] == 0) ++zeros;
+  }
+
+  /* Small cardinalities are estimated by linear counting of the empty
+   * registers, which is more accurate there */
+  double estimate = alpha * m * m / sum;
+  if (estimate <= 2.5 * m && zeros > 0) estimate = m * log(m / zeros);
+  return static_cast<uint32_t>(estimate + 0.5);
+}
+
+/**
+ * Estimates the number of frames sent by MACs with an OUI
+ *
+ * @param sketch the sketch
+ * @param oui the OUI (first three bytes, big endian) or SKETCH_OUI_RANDOMIZED
+ */
+uint32_t sketch_oui_count(const sketch_t *sketch, uint32_t oui) {
+  uint64_t oui_hash = sketch_hash(oui);
+  uint32_t count = 0xFFFF;
+  for (size_t row = 0; row < SKETCH_CMS_DEPTH; ++row) {
+    uint16_t counter = sketch->cms[row][sketch_cms_column(oui_hash, row)];
+    if (counter < count) count = counter;
+  }
+
+  return count;
+}
+
+/**
+ * Encodes an part of the sketch
+ *
+ * @param sketch the sketch
+ * @param part the part, 0 for the HyperLogLog, 1 and up for the Count-Min rows
+ * @param window the window the sketch covers in seconds
+ * @param out the output buffer
+ * @param out_size the size of the output buffer
+ * @return the number of bytes written, or 0 if the buffer is too small
+ */
+size_t sketch_encode_part(const sketch_t *sketch, uint8_t part, uint16_t window,
+  uint8_t *out, size_t out_size) {
+  if (part >= SKETCH_PART_COUNT || out_size < SKETCH_PART_MAX_SIZE) return 0;
+
+  out[0] = part == 0 ? SKETCH_PART_HLL : SKETCH_PART_CMS;
+  out[1] = part == 0 ? 0 : part - 1;
+  sketch_put_u16(&out[2], window);
+  size_t n = SKETCH_PART_HEADER_SIZE;
+
+  if (part == 0) {
+    /* Packs four registers of 6 bits into three bytes */
+    for (size_t i = 0; i < SKETCH_HLL_REGISTERS; i += 4) {
+      uint32_t v = sketch->hll[i] | (sketch->hll[i + 1] << 6)
+        | (sketch->hll[i + 2] << 12) | (sketch->hll[i + 3] << 18);
+      out[n++] = v & 0xFF;
+      out[n++] = (v >> 8) & 0xFF;
+      out[n++] = (v >> 16) & 0xFF;
+    }
+  } else {
+    for (size_t i = 0; i < SKETCH_CMS_WIDTH; ++i, n += 2)
+      sketch_put_u16(&out[n], sketch->cms[part - 1][i]);
+  }
+
+  return n;
+}
+
+/**
+ * Merges an received part into an sketch, the registers are merged by
+ *  their maximum and the counters are added, so the result is the sketch
+ *  of everything the transmitters saw together
+ *
+ * @param sketch the sketch to merge into
+ * @param in the encoded part
+ * @param in_size the size of the encoded part
+ * @return 0 on success, -1 if the part is malformed
+ */
+int32_t sketch_merge_part(sketch_t *sketch, const uint8_t *in, size_t in_size) {
+  if (in_size < SKETCH_PART_HEADER_SIZE) return -1;
+
+  uint8_t kind = in[0], index = in[1];
+  uint16_t window = sketch_get_u16(&in[2]);
+  in += SKETCH_PART_HEADER_SIZE;
+  in_size -= SKETCH_PART_HEADER_SIZE;
+
+  if (kind == SKETCH_PART_HLL) {
+    if (index != 0 || in_size != SKETCH_HLL_REGISTERS * 6 / 8) return -1;
+
+    for (size_t i = 0; i < SKETCH_HLL_REGISTERS; i += 4, in += 3) {
+      uint32_t v = in[0] | (in[1] << 8) | (static_cast<uint32_t>(in[2]) << 16);
+      for (size_t j = 0; j < 4; ++j) {
+        uint8_t reg = (v >> (j * 6)) & 0x3F;
+        if (reg > sketch->hll[i + j]) sketch->hll[i + j] = reg;
+      }
+    }
+  } else if (kind == SKETCH_PART_CMS) {
+    if (index >= SKETCH_CMS_DEPTH || in_size != SKETCH_CMS_WIDTH * 2) return -1;
+
+    for (size_t i = 0; i < SKETCH_CMS_WIDTH; ++i) {
+      uint32_t sum = sketch->cms[index][i] + sketch_get_u16(&in[i * 2]);
+      sketch->cms[index][i] = sum > 0xFFFF ? 0xFFFF : sum;
+    }
+  } else {
+    return -1;
+  }
+
+  if (window > sketch->window) sketch->window = window;
+  return 0;
+}
+
+/**
+ * Serializes an sketch into the frame sent to the server
+ *
+ * @param sketch the sketch
+ * @param out the output buffer
+ * @param out_size the size of the output buffer
+ * @return the number of bytes written, or 0 if the buffer is too small
+ */
+size_t sketch_serialize(const sketch_t *sketch, uint8_t *out, size_t out_size) {
+  if (out_size < SKETCH_FRAME_SIZE) return 0;
+
+  out[0] = 'C'; out[1] = 'B'; out[2] = 'X'; out[3] = 'K';
+  out[4] = SKETCH_FRAME_VERSION;
+  out[5] = SKETCH_HLL_BITS;
+  out[6] = SKETCH_CMS_DEPTH;
+  out[7] = SKETCH_CMS_WIDTH;
+  sketch_put_u16(&out[8], sketch->window);
+
+  size_t n = 10;
+  memcpy(&out[n], sketch->hll, SKETCH_HLL_REGISTERS);
+  n += SKETCH_HLL_REGISTERS;
+  for (size_t row = 0; row < SKETCH_CMS_DEPTH; ++row)
+    for (size_t i = 0; i < SKETCH_CMS_WIDTH; ++i, n += 2) sketch_put_u16(&out[n], sketch->cms[row][i]);
+
+  return n;
+}
@@ -0,0 +1,140 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#include "stats.h"
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "stats_record must not take a lock");
+
+static stats_counters_t g_Counters[portNUM_PROCESSORS][STATS_COUNT];
+
+/**
+ * Records an sample of an stage on the current core
+ * 
+ * @param stage the stage
+ * @param ticks the duration in ticks
+ */
+void IRAM_ATTR stats_record(stats_stage_t stage, uint32_t ticks) {
+  stats_counters_t *c = &g_Counters[xPortGetCoreID()][stage];
+
+  /* The bucket is the number of significant bits */
+  uint32_t bucket = ticks == 0 ? 0 : 32 - __builtin_clz(ticks);
+  if (bucket >= STATS_BUCKET_COUNT) bucket = STATS_BUCKET_COUNT - 1;
+
+  c->count.fetch_add(1, std::memory_order_relaxed);
+  uint32_t low = c->sum_low.fetch_add(ticks, std::memory_order_relaxed);
+  if (low + ticks < low) c->sum_high.fetch_add(1, std::memory_order_relaxed);
+  c->buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+  if (ticks > c->max.load(std::memory_order_relaxed)) c->max.store(ticks, std::memory_order_relaxed);
+}
+
+/**
+ * Gets the counters of an stage, summed over the cores
+ * 
+ * @param stage the stage
+ * @param out the output snapshot
+ */
+void stats_snapshot(stats_stage_t stage, stats_stage_snapshot_t *out) {
+  memset(out, 0, sizeof (stats_stage_snapshot_t));
+
+  for (size_t core = 0; core < portNUM_PROCESSORS; ++core) {
+    const stats_counters_t *c = &g_Counters[core][stage];
+    out->count += c->count.load(std::memory_order_relaxed);
+
+    /* Reads the halves until the high one did not change in between, an
+     * sample which wrapped the low half is 2^32 ticks short until it carries */
+    uint32_t high, low;
+    do {
+      high = c->sum_high.load(std::memory_order_relaxed);
+      low = c->sum_low.load(std::memory_order_relaxed);
+    } while (high != c->sum_high.load(std::memory_order_relaxed));
+    out->sum += (static_cast<uint64_t>(high) << 32) | low;
+
+    uint32_t max = c->max.load(std::memory_order_relaxed);
+    if (max > out->max) out->max = max;
+
+    for (size_t i = 0; i < STATS_BUCKET_COUNT; ++i)
+      out->buckets[i] += c->buckets[i].load(std::memory_order_relaxed);
+  }
+}
+
+/**
+ * Gets the number of ticks per second
+ */
+uint32_t stats_tick_hz() {
+  return getCpuFrequencyMhz() * 1000000;
+}
+
+/**
+ * Writes an unsigned LEB128 varint
+ * 
+ * @param out the output buffer
+ * @param value the value
+ * @return the number of bytes written
+ */
+static size_t stats_put_varint(uint8_t *out, uint64_t value) {
+  size_t n = 0;
+  do {
+    uint8_t b = value & 0x7f;
+    value >>= 7;
+    out[n++] = b | (value != 0 ? 0x80 : 0x00);
+  } while (value != 0);
+
+  return n;
+}
+
+/**
+ * Serializes the counters of all stages into an stats frame
+ * 
+ * @param out the output buffer
+ * @param out_size the size of the output buffer
+ * @return the number of bytes written, or 0 if the buffer is too small
+ */
+size_t stats_serialize(uint8_t *out, size_t out_size) {
+  if (out_size < STATS_FRAME_MAX_SIZE) return 0;
+
+  uint32_t tick_hz = stats_tick_hz();
+  uint32_t uptime = static_cast<uint32_t>(esp_timer_get_time() / 1000);
+
+  out[0] = 'C'; out[1] = 'B'; out[2] = 'X'; out[3] = 'S';
+  out[4] = STATS_FRAME_VERSION;
+  for (size_t i = 0; i < 4; ++i) out[5 + i] = (tick_hz >> (i * 8)) & 0xff;
+  for (size_t i = 0; i < 4; ++i) out[9 + i] = (uptime >> (i * 8)) & 0xff;
+  out[13] = STATS_COUNT;
+  out[14] = STATS_BUCKET_COUNT;
+
+  size_t n = 15;
+  for (size_t stage = 0; stage < STATS_COUNT; ++stage) {
+    stats_stage_snapshot_t s;
+    stats_snapshot(static_cast<stats_stage_t>(stage), &s);
+
+    n += stats_put_varint(&out[n], s.count);
+    n += stats_put_varint(&out[n], s.sum);
+    n += stats_put_varint(&out[n], s.max);
+    for (size_t i = 0; i < STATS_BUCKET_COUNT; ++i) n += stats_put_varint(&out[n], s.buckets[i]);
+  }
+
+  return n;
+}
+
+/**
+ * Writes an stats frame to the serial console, as an single line of hex
+ *  prefixed with '#S' so it can be picked out of the other output
+ */
+void stats_print() {
+  static uint8_t frame[STATS_FRAME_MAX_SIZE];
+  static char line[2 * STATS_FRAME_MAX_SIZE + 5];
+  static const char digits[] = "0123456789abcdef";
+
+  size_t size = stats_serialize(frame, sizeof (frame)), n = 0;
+  line[n++] = '#';
+  line[n++] = 'S';
+  for (size_t i = 0; i < size; ++i) {
+    line[n++] = digits[frame[i] >> 4];
+    line[n++] = digits[frame[i] & 0xf];
+  }
+
+  line[n++] = '\r';
+  line[n++] = '\n';
+  Serial.write(reinterpret_cast<const uint8_t *>(line), n);
+}
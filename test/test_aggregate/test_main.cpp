@@ -0,0 +1,169 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#include <unity.h>
+
+#include "aggregate.h"
+
+static aggregate_t g_Aggregate;
+
+/**
+ * Registers an frame of an numbered transmitter
+ *
+ * @param n the number of the transmitter
+ * @param now the current time in microseconds
+ * @return the result of aggregate_frame
+ */
+static int32_t frame(uint8_t n, int64_t now) {
+  cbx_pkt_t pkt;
+  memset(&pkt, 0, sizeof (cbx_pkt_t));
+  const uint8_t sender[6] = { 0x24, 0x0A, 0xC4, 0x00, 0x00, n };
+  memcpy(pkt.hdr.sender, sender, 6);
+  pkt.body.api_key = "key";
+  return aggregate_frame(&g_Aggregate, &pkt, now);
+}
+
+/**
+ * Merges an sighting of an numbered MAC into the table
+ *
+ * @param node the node index
+ * @param n the number of the MAC
+ * @param seen when the MAC was seen, in unix seconds
+ * @return the result of aggregate_insert
+ */
+static bool insert(int32_t node, uint32_t n, uint32_t seen) {
+  const uint8_t mac[6] = { 0x24, 0x0A, 0xC4, static_cast<uint8_t>(n >> 16),
+    static_cast<uint8_t>(n >> 8), static_cast<uint8_t>(n) };
+  presence_record_t record = { };
+  record.first_seen = record.last_seen = seen;
+  record.frames = 1;
+  record.rssi_max = record.rssi_avg = -60;
+  record.channels = 1;
+  return aggregate_insert(&g_Aggregate, node, mac, &record);
+}
+
+/**
+ * Finds the slot of an numbered MAC
+ *
+ * @param n the number of the MAC
+ * @return the slot, or -1 if there is none
+ */
+static int32_t find(uint32_t n) {
+  const uint8_t mac[6] = { 0x24, 0x0A, 0xC4, static_cast<uint8_t>(n >> 16),
+    static_cast<uint8_t>(n >> 8), static_cast<uint8_t>(n) };
+  uint64_t key = mac_set_key(mac);
+  for (size_t slot = 0; slot < GLOBAL_AGGREGATE_CAPACITY; ++slot) {
+    if (aggregate_used(&g_Aggregate, slot) && g_Aggregate.keys[slot] == key)
+      return static_cast<int32_t>(slot);
+  }
+
+  return -1;
+}
+
+void setUp() {
+  aggregate_init(&g_Aggregate);
+}
+
+void tearDown() {}
+
+static void test_nodes_are_found_again() {
+  TEST_ASSERT_EQUAL(0, frame(1, 0));
+  TEST_ASSERT_EQUAL(1, frame(2, 0));
+  TEST_ASSERT_EQUAL(0, frame(1, 0));
+  TEST_ASSERT_EQUAL(2, g_Aggregate.node_count);
+}
+
+static void test_too_many_nodes() {
+  for (uint8_t n = 0; n < GLOBAL_AGGREGATE_MAX_NODES; ++n) TEST_ASSERT_EQUAL(n, frame(n, 0));
+  TEST_ASSERT_EQUAL(-1, frame(GLOBAL_AGGREGATE_MAX_NODES, 0));
+}
+
+/* The transmitters which went quiet are forgotten once the table is
+ * cleared, so the new ones get their slot, the others keep theirs in order */
+static void test_quiet_nodes_are_forgotten() {
+  const int64_t timeout = GLOBAL_AGGREGATE_NODE_TIMEOUT * 1000LL;
+  for (uint8_t n = 0; n < GLOBAL_AGGREGATE_MAX_NODES; ++n) frame(n, 0);
+  frame(3, timeout);
+  frame(7, timeout);
+
+  aggregate_clear(&g_Aggregate, timeout - 1);
+  TEST_ASSERT_EQUAL(GLOBAL_AGGREGATE_MAX_NODES, g_Aggregate.node_count);
+
+  aggregate_clear(&g_Aggregate, timeout);
+  TEST_ASSERT_EQUAL(2, g_Aggregate.node_count);
+  TEST_ASSERT_EQUAL(0, frame(3, timeout));
+  TEST_ASSERT_EQUAL(1, frame(7, timeout));
+  TEST_ASSERT_EQUAL(2, frame(GLOBAL_AGGREGATE_MAX_NODES, timeout));
+}
+
+/* Only the transmitters whose upload failed keep their measurements, the
+ * others start over with their next sighting */
+static void test_release_keeps_failed_uploads() {
+  frame(1, 0);
+  frame(2, 0);
+  insert(0, 1, 100);
+  insert(1, 1, 110);
+  insert(0, 2, 100);
+  insert(1, 3, 100);
+
+  aggregate_release(&g_Aggregate, 1 << 0, 0);
+  TEST_ASSERT_EQUAL(-1, find(2));
+  TEST_ASSERT_NOT_EQUAL(-1, find(1));
+  TEST_ASSERT_NOT_EQUAL(-1, find(3));
+  TEST_ASSERT_EQUAL(2, g_Aggregate.seen_by[find(1)]);
+
+  /* The uploaded MAC is counted anew, the kept one merges on */
+  insert(0, 2, 200);
+  TEST_ASSERT_EQUAL(1, g_Aggregate.seen_by[find(2)]);
+  TEST_ASSERT_EQUAL(200, g_Aggregate.first_seen[find(2)]);
+  TEST_ASSERT_EQUAL(1, g_Aggregate.frames[find(2)]);
+
+  insert(1, 3, 200);
+  TEST_ASSERT_EQUAL(100, g_Aggregate.first_seen[find(3)]);
+  TEST_ASSERT_EQUAL(2, g_Aggregate.frames[find(3)]);
+
+  /* Once everything is uploaded the table is cleared */
+  aggregate_release(&g_Aggregate, 1 << 0 | 1 << 1, 0);
+  TEST_ASSERT_EQUAL(0, g_Aggregate.size);
+  TEST_ASSERT_EQUAL(-1, find(1));
+}
+
+/* The uploaded MACs make room for new ones, and the MACs which are kept are
+ * still found, wherever their probe sequence had taken them */
+static void test_release_makes_room() {
+  frame(1, 0);
+  frame(2, 0);
+  for (uint32_t n = 0; n < GLOBAL_AGGREGATE_CAPACITY / 2; ++n)
+    TEST_ASSERT_TRUE(insert(n % 3 == 0 ? 0 : 1, n, 100));
+  TEST_ASSERT_FALSE(insert(1, GLOBAL_AGGREGATE_CAPACITY, 100));
+
+  aggregate_release(&g_Aggregate, 1 << 1, 0);
+  const uint32_t kept = (GLOBAL_AGGREGATE_CAPACITY / 2 + 2) / 3;
+  TEST_ASSERT_EQUAL(kept, g_Aggregate.size);
+
+  for (uint32_t n = 0; n < GLOBAL_AGGREGATE_CAPACITY / 2; ++n) {
+    if (n % 3 != 0) {
+      TEST_ASSERT_EQUAL(-1, find(n));
+      continue;
+    }
+
+    TEST_ASSERT_TRUE(insert(0, n, 300));
+    TEST_ASSERT_EQUAL(2, g_Aggregate.frames[find(n)]);
+  }
+
+  TEST_ASSERT_EQUAL(kept, g_Aggregate.size);
+  for (uint32_t n = 0; n < GLOBAL_AGGREGATE_CAPACITY / 2 - kept; ++n)
+    TEST_ASSERT_TRUE(insert(1, GLOBAL_AGGREGATE_CAPACITY + n, 300));
+  TEST_ASSERT_EQUAL(GLOBAL_AGGREGATE_CAPACITY / 2, g_Aggregate.size);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_nodes_are_found_again);
+  RUN_TEST(test_too_many_nodes);
+  RUN_TEST(test_quiet_nodes_are_forgotten);
+  RUN_TEST(test_release_keeps_failed_uploads);
+  RUN_TEST(test_release_makes_room);
+  return UNITY_END();
+}
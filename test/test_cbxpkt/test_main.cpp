@@ -0,0 +1,172 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#include <unity.h>
+
+#include "cbxpkt.h"
+
+static const uint8_t g_Payload[] = { 0xDE, 0xAD, 0xBE, 0xEF };
+
+/* An chained packet with an compressed presence payload, key 1 */
+static const uint8_t g_Golden[] = {
+  'C', 'B', 'X', 0x02,                  /* Magic and version */
+  0x24, 0x0A, 0xC4, 0x01, 0x02, 0x03,   /* Sender */
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,   /* Receiver */
+  0x02,                                 /* Chain number */
+  0x2C,                                 /* Flags: chained, compressed, presence */
+  0x78, 0x56, 0x34, 0x12,               /* Unique ID */
+  0x01, 0x00,                           /* Key ID */
+  0x04,                                 /* Size */
+  0xDE, 0xAD, 0xBE, 0xEF
+};
+
+/* The same packet in the format the server understands */
+static const uint8_t g_GoldenLegacy[] = {
+  'C', 'B', 'X', 'L',
+  0x24, 0x0A, 0xC4, 0x01, 0x02, 0x03,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0x02,
+  0x2C,
+  0x78, 0x56, 0x34, 0x12,
+  '8', 'a', '3', 'd', '6', 'b', '-', 'e', 'f', 'c', 'd', 'c', '1', '-', '6', 'd', 'e', '\0',
+  0x04,
+  0xDE, 0xAD, 0xBE, 0xEF
+};
+
+/**
+ * Makes the packet of the golden vectors
+ * 
+ * @param pkt the output packet
+ */
+static void make_packet(cbx_pkt_t *pkt) {
+  memset(pkt, 0, sizeof (cbx_pkt_t));
+  const uint8_t sender[6] = { 0x24, 0x0A, 0xC4, 0x01, 0x02, 0x03 };
+  memcpy(pkt->hdr.sender, sender, 6);
+  memset(pkt->hdr.receiver, 0xFF, 6);
+  pkt->hdr.chain_no = 2;
+  pkt->hdr.flags.chained = 1;
+  pkt->hdr.flags.compressed = 1;
+  pkt->hdr.flags.presence = 1;
+  pkt->body.unique_id = 0x12345678;
+  pkt->body.key_id = 1;
+  pkt->body.api_key = "8a3d6b-efcdc1-6de";
+  pkt->body.size = sizeof (g_Payload);
+  pkt->body.payload = g_Payload;
+}
+
+/**
+ * Checks an parsed packet against the one of the golden vectors
+ * 
+ * @param pkt the parsed packet
+ * @param version the expected version
+ */
+static void check_packet(const cbx_pkt_t *pkt, uint8_t version) {
+  cbx_pkt_t expected;
+  make_packet(&expected);
+
+  TEST_ASSERT_EQUAL(version, pkt->hdr.version);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected.hdr.sender, pkt->hdr.sender, 6);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected.hdr.receiver, pkt->hdr.receiver, 6);
+  TEST_ASSERT_EQUAL(2, pkt->hdr.chain_no);
+  TEST_ASSERT_EQUAL(0, pkt->hdr.flags.encrypted);
+  TEST_ASSERT_EQUAL(0, pkt->hdr.flags.relayed);
+  TEST_ASSERT_EQUAL(1, pkt->hdr.flags.chained);
+  TEST_ASSERT_EQUAL(1, pkt->hdr.flags.compressed);
+  TEST_ASSERT_EQUAL(0, pkt->hdr.flags.sketch);
+  TEST_ASSERT_EQUAL(1, pkt->hdr.flags.presence);
+  TEST_ASSERT_EQUAL(0, pkt->hdr.flags.reserved);
+  TEST_ASSERT_EQUAL_HEX32(0x12345678, pkt->body.unique_id);
+  TEST_ASSERT_EQUAL_STRING(expected.body.api_key, pkt->body.api_key);
+  TEST_ASSERT_EQUAL(sizeof (g_Payload), pkt->body.size);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(g_Payload, pkt->body.payload, sizeof (g_Payload));
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+static void test_serialize() {
+  cbx_pkt_t pkt;
+  uint8_t out[CBX_PKT_MAX_SIZE];
+  make_packet(&pkt);
+
+  TEST_ASSERT_EQUAL(sizeof (g_Golden), cbx_pkt_serialize(&pkt, out, sizeof (out)));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(g_Golden, out, sizeof (g_Golden));
+  TEST_ASSERT_EQUAL(0, cbx_pkt_serialize(&pkt, out, sizeof (g_Golden) - 1));
+}
+
+static void test_serialize_legacy() {
+  cbx_pkt_t pkt;
+  uint8_t out[CBX_PKT_MAX_SIZE];
+  make_packet(&pkt);
+
+  TEST_ASSERT_EQUAL(sizeof (g_GoldenLegacy), cbx_pkt_serialize_legacy(&pkt, out, sizeof (out)));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(g_GoldenLegacy, out, sizeof (g_GoldenLegacy));
+  TEST_ASSERT_EQUAL(0, cbx_pkt_serialize_legacy(&pkt, out, sizeof (g_GoldenLegacy) - 1));
+}
+
+static void test_parse() {
+  cbx_pkt_t pkt;
+  TEST_ASSERT_EQUAL(0, cbx_pkt_parse(g_Golden, sizeof (g_Golden), &pkt));
+  check_packet(&pkt, CBX_PKT_VERSION);
+  TEST_ASSERT_EQUAL(1, pkt.body.key_id);
+}
+
+static void test_parse_legacy() {
+  cbx_pkt_t pkt;
+  TEST_ASSERT_EQUAL(0, cbx_pkt_parse(g_GoldenLegacy, sizeof (g_GoldenLegacy), &pkt));
+  check_packet(&pkt, CBX_PKT_VERSION_LEGACY);
+  TEST_ASSERT_EQUAL(0, pkt.body.key_id);
+}
+
+/* The gateway forwards the packets it receives in the legacy format */
+static void test_forward_as_legacy() {
+  cbx_pkt_t pkt;
+  uint8_t out[CBX_PKT_MAX_SIZE];
+  TEST_ASSERT_EQUAL(0, cbx_pkt_parse(g_Golden, sizeof (g_Golden), &pkt));
+  TEST_ASSERT_EQUAL(sizeof (g_GoldenLegacy), cbx_pkt_serialize_legacy(&pkt, out, sizeof (out)));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(g_GoldenLegacy, out, sizeof (g_GoldenLegacy));
+}
+
+static void test_parse_rejects() {
+  cbx_pkt_t pkt;
+  uint8_t in[sizeof (g_GoldenLegacy)];
+
+  /* Every truncation of both formats */
+  for (size_t size = 0; size < sizeof (g_Golden); ++size)
+    TEST_ASSERT_EQUAL(-1, cbx_pkt_parse(g_Golden, size, &pkt));
+  for (size_t size = 0; size < sizeof (g_GoldenLegacy); ++size)
+    TEST_ASSERT_EQUAL(-1, cbx_pkt_parse(g_GoldenLegacy, size, &pkt));
+
+  /* An other magic */
+  memcpy(in, g_Golden, sizeof (g_Golden));
+  in[2] = 'Y';
+  TEST_ASSERT_EQUAL(-1, cbx_pkt_parse(in, sizeof (g_Golden), &pkt));
+
+  /* An unknown version */
+  memcpy(in, g_Golden, sizeof (g_Golden));
+  in[3] = 3;
+  TEST_ASSERT_EQUAL(-1, cbx_pkt_parse(in, sizeof (g_Golden), &pkt));
+
+  /* An unknown key */
+  memcpy(in, g_Golden, sizeof (g_Golden));
+  in[22] = 0x02;
+  TEST_ASSERT_EQUAL(-1, cbx_pkt_parse(in, sizeof (g_Golden), &pkt));
+
+  /* An legacy key which is not terminated inside its field */
+  memcpy(in, g_GoldenLegacy, sizeof (g_GoldenLegacy));
+  in[39] = 'x';
+  TEST_ASSERT_EQUAL(-1, cbx_pkt_parse(in, sizeof (g_GoldenLegacy), &pkt));
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_serialize);
+  RUN_TEST(test_serialize_legacy);
+  RUN_TEST(test_parse);
+  RUN_TEST(test_parse_legacy);
+  RUN_TEST(test_forward_as_legacy);
+  RUN_TEST(test_parse_rejects);
+  return UNITY_END();
+}
@@ -0,0 +1,195 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#include <unity.h>
+
+#include "ieee80211.h"
+
+#include <random>
+#include <vector>
+
+typedef struct {
+  const char *name;
+  uint8_t fc0;                  /* Protocol, type and subtype */
+  uint8_t fc1;                  /* The flags: DS bits, protected, order */
+  size_t size;
+  int32_t rc;
+  uint16_t payload_offset;
+  uint8_t receiver;             /* The offsets of the addresses, 0 if absent */
+  uint8_t transmitter;
+  uint8_t bssid;
+  uint16_t elements_offset;
+} classify_case_t;
+
+static const classify_case_t g_Cases[] = {
+  { "probe request", 0x40, 0x00, 24, 0, 24, 4, 10, 16, 24 },
+  { "probe request, elements", 0x40, 0x00, 40, 0, 24, 4, 10, 16, 24 },
+  { "beacon", 0x80, 0x00, 50, 0, 24, 4, 10, 16, 36 },
+  { "beacon, fixed fields cut", 0x80, 0x00, 30, 0, 24, 4, 10, 16, 0 },
+  { "beacon, HT control", 0x80, 0x80, 50, 0, 28, 4, 10, 16, 40 },
+  { "beacon, HT control cut", 0x80, 0x80, 27, -1, 0, 0, 0, 0, 0 },
+  { "association request", 0x00, 0x00, 40, 0, 24, 4, 10, 16, 28 },
+  { "reassociation request", 0x20, 0x00, 40, 0, 24, 4, 10, 16, 34 },
+  { "action", 0xD0, 0x00, 40, 0, 24, 4, 10, 16, 0 },
+  { "deauthentication", 0xC0, 0x00, 26, 0, 24, 4, 10, 16, 0 },
+  { "management, DS bits", 0x40, 0x01, 24, -1, 0, 0, 0, 0, 0 },
+  { "management, reserved", 0x70, 0x00, 24, -1, 0, 0, 0, 0, 0 },
+  { "management, cut", 0x40, 0x00, 23, -1, 0, 0, 0, 0, 0 },
+  { "ACK", 0xD4, 0x00, 10, 0, 10, 4, 0, 0, 0 },
+  { "CTS", 0xC4, 0x00, 10, 0, 10, 4, 0, 0, 0 },
+  { "ACK, too short", 0xD4, 0x00, 9, -1, 0, 0, 0, 0, 0 },
+  { "RTS", 0xB4, 0x00, 16, 0, 16, 4, 10, 0, 0 },
+  { "RTS, cut", 0xB4, 0x00, 15, -1, 0, 0, 0, 0, 0 },
+  { "PS-Poll", 0xA4, 0x00, 16, 0, 16, 4, 10, 4, 0 },
+  { "CF-End", 0xE4, 0x00, 16, 0, 16, 4, 10, 10, 0 },
+  { "block ACK", 0x94, 0x00, 20, 0, 16, 4, 10, 0, 0 },
+  { "control wrapper", 0x74, 0x00, 16, 0, 16, 4, 0, 0, 0 },
+  { "control, reserved", 0x04, 0x00, 16, -1, 0, 0, 0, 0, 0 },
+  { "data", 0x08, 0x00, 24, 0, 24, 4, 10, 16, 0 },
+  { "data, to DS", 0x08, 0x01, 24, 0, 24, 4, 10, 4, 0 },
+  { "data, from DS", 0x08, 0x02, 24, 0, 24, 4, 10, 10, 0 },
+  { "data, WDS", 0x08, 0x03, 30, 0, 30, 4, 10, 0, 0 },
+  { "data, WDS cut", 0x08, 0x03, 29, -1, 0, 0, 0, 0, 0 },
+  { "QoS data", 0x88, 0x00, 26, 0, 26, 4, 10, 16, 0 },
+  { "QoS data, HT control", 0x88, 0x80, 30, 0, 30, 4, 10, 16, 0 },
+  { "QoS data, HT control cut", 0x88, 0x80, 29, -1, 0, 0, 0, 0, 0 },
+  { "QoS data, WDS, HT control", 0x88, 0x83, 36, 0, 36, 4, 10, 0, 0 },
+  { "data, order bit without QoS", 0x08, 0x80, 24, 0, 24, 4, 10, 16, 0 },
+  { "data, reserved", 0xD8, 0x00, 24, -1, 0, 0, 0, 0, 0 },
+  { "extension", 0x0C, 0x00, 24, -1, 0, 0, 0, 0, 0 },
+  { "protocol version 1", 0x41, 0x00, 24, -1, 0, 0, 0, 0, 0 },
+  { "empty", 0x00, 0x00, 0, -1, 0, 0, 0, 0, 0 }
+};
+
+/**
+ * Checks that everything an classified frame points at is within the frame
+ * 
+ * @param frame the frame
+ * @param size the size of the frame
+ * @param info the info of the frame
+ */
+static void check_bounds(const uint8_t *frame, size_t size, const ieee80211_frame_info_t *info) {
+  const uint8_t *addresses[] = { info->receiver, info->transmitter, info->bssid };
+  for (const uint8_t *address : addresses) {
+    if (address == nullptr) continue;
+    TEST_ASSERT_TRUE(address >= frame && address + 6 <= frame + size);
+  }
+
+  TEST_ASSERT_NOT_NULL(info->receiver);
+  TEST_ASSERT_TRUE(info->payload_offset <= size);
+  TEST_ASSERT_TRUE(info->elements_offset <= size);
+  TEST_ASSERT_TRUE(info->elements_offset == 0 || info->elements_offset >= info->payload_offset);
+}
+
+/**
+ * Classifies an frame which is copied into an buffer of exactly its size,
+ *  so an read beyond it is caught by the address sanitizer
+ * 
+ * @param frame the frame
+ * @param size the size of the frame
+ * @param info the output info
+ * @return the result of ieee80211_classify
+ */
+static int32_t classify_exact(const uint8_t *frame, size_t size, ieee80211_frame_info_t *info) {
+  std::vector<uint8_t> copy(frame, frame + size);
+  int32_t rc = ieee80211_classify(copy.data(), copy.size(), info);
+  if (rc == 0) check_bounds(copy.data(), copy.size(), info);
+
+  /* The info points into the copy, so it's made relative to the frame */
+  if (rc == 0) {
+    info->receiver = frame + (info->receiver - copy.data());
+    if (info->transmitter != nullptr) info->transmitter = frame + (info->transmitter - copy.data());
+    if (info->bssid != nullptr) info->bssid = frame + (info->bssid - copy.data());
+  }
+
+  return rc;
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+static void test_table() {
+  uint8_t frame[64];
+  for (size_t i = 0; i < sizeof (frame); ++i) frame[i] = static_cast<uint8_t>(i);
+
+  for (const classify_case_t &c : g_Cases) {
+    frame[0] = c.fc0;
+    frame[1] = c.fc1;
+
+    ieee80211_frame_info_t info;
+    TEST_ASSERT_EQUAL_MESSAGE(c.rc, classify_exact(frame, c.size, &info), c.name);
+    if (c.rc != 0) continue;
+
+    TEST_ASSERT_EQUAL_MESSAGE((c.fc0 >> 2) & 0x3, info.type, c.name);
+    TEST_ASSERT_EQUAL_MESSAGE(c.fc0 >> 4, info.subtype, c.name);
+    TEST_ASSERT_EQUAL_MESSAGE((c.fc1 & 0x40) != 0, info.protected_frame, c.name);
+    TEST_ASSERT_EQUAL_MESSAGE(c.payload_offset, info.payload_offset, c.name);
+    TEST_ASSERT_EQUAL_MESSAGE(c.elements_offset, info.elements_offset, c.name);
+    TEST_ASSERT_TRUE_MESSAGE(info.receiver == &frame[c.receiver], c.name);
+    TEST_ASSERT_TRUE_MESSAGE(info.transmitter == (c.transmitter != 0 ? &frame[c.transmitter] : nullptr), c.name);
+    TEST_ASSERT_TRUE_MESSAGE(info.bssid == (c.bssid != 0 ? &frame[c.bssid] : nullptr), c.name);
+  }
+}
+
+static void test_protected() {
+  uint8_t frame[24] = { 0x08, 0x41 };
+  ieee80211_frame_info_t info;
+  TEST_ASSERT_EQUAL(0, classify_exact(frame, sizeof (frame), &info));
+  TEST_ASSERT_TRUE(info.protected_frame);
+}
+
+/* Every frame control, cut at every size up to the largest header with
+ * fixed fields: an frame is either rejected, or everything it points at is
+ * within the frame, and cutting it never makes it valid where the longer
+ * one was not */
+static void test_every_truncation() {
+  uint8_t frame[64];
+  for (size_t i = 0; i < sizeof (frame); ++i) frame[i] = static_cast<uint8_t>(0xA0 + i);
+
+  for (uint32_t fc = 0; fc < 0x10000; ++fc) {
+    frame[0] = static_cast<uint8_t>(fc);
+    frame[1] = static_cast<uint8_t>(fc >> 8);
+
+    ieee80211_frame_info_t info;
+    bool valid = false;
+    for (size_t size = 0; size <= 48; ++size) {
+      bool now = classify_exact(frame, size, &info) == 0;
+      TEST_ASSERT_TRUE(now || !valid);
+      valid = now;
+    }
+  }
+}
+
+/* Random frames of random sizes, most of them garbage */
+static void test_fuzz() {
+  std::mt19937 rng(80211);
+  uint8_t frame[64];
+  uint32_t accepted = 0;
+
+  for (uint32_t i = 0; i < 200000; ++i) {
+    size_t size = rng() % (sizeof (frame) + 1);
+    for (size_t j = 0; j < size; ++j) frame[j] = rng();
+
+    ieee80211_frame_info_t info, again;
+    int32_t rc = classify_exact(frame, size, &info);
+    TEST_ASSERT_EQUAL(rc, classify_exact(frame, size, &again));
+    if (rc != 0) continue;
+
+    ++accepted;
+    TEST_ASSERT_TRUE(info.receiver == again.receiver && info.transmitter == again.transmitter
+      && info.bssid == again.bssid && info.payload_offset == again.payload_offset);
+  }
+
+  TEST_ASSERT_GREATER_THAN(0, accepted);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_table);
+  RUN_TEST(test_protected);
+  RUN_TEST(test_every_truncation);
+  RUN_TEST(test_fuzz);
+  return UNITY_END();
+}
@@ -0,0 +1,229 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#include <unity.h>
+
+#include "ieee80211.h"
+
+#include <random>
+#include <vector>
+
+typedef struct {
+  const char *name;
+  uint8_t elements[40];
+  size_t size;
+  size_t count;                 /* The elements the walk returns */
+  uint8_t kind;                 /* The kind of the last one returned */
+  bool complete;                /* If the walk ends at the end of the elements */
+} ie_case_t;
+
+static const ie_case_t g_Cases[] = {
+  { "empty", { }, 0, 0, 0, true },
+  { "ID only", { IEEE80211_IE_SSID }, 1, 0, 0, false },
+  { "empty SSID", { IEEE80211_IE_SSID, 0 }, 2, 1, IEEE80211_IE_KIND_SSID, true },
+  { "SSID", { IEEE80211_IE_SSID, 4, 'c', 'y', 'b', 'x' }, 6, 1, IEEE80211_IE_KIND_SSID, true },
+  { "SSID, 32 bytes", { IEEE80211_IE_SSID, 32 }, 34, 1, IEEE80211_IE_KIND_SSID, true },
+  { "SSID, 33 bytes", { IEEE80211_IE_SSID, 33 }, 35, 1, IEEE80211_IE_KIND_MALFORMED, true },
+  { "SSID, body cut", { IEEE80211_IE_SSID, 4, 'c', 'y', 'b' }, 5, 0, 0, false },
+  { "DS params", { IEEE80211_IE_DS_PARAMS, 1, 6 }, 3, 1, IEEE80211_IE_KIND_CHANNEL, true },
+  { "DS params, empty", { IEEE80211_IE_DS_PARAMS, 0 }, 2, 1, IEEE80211_IE_KIND_MALFORMED, true },
+  { "DS params, 2 bytes", { IEEE80211_IE_DS_PARAMS, 2, 6, 0 }, 4, 1, IEEE80211_IE_KIND_MALFORMED, true },
+  { "RSN, version only", { IEEE80211_IE_RSN, 2, 1, 0 }, 4, 1, IEEE80211_IE_KIND_RSN, true },
+  { "RSN, 1 byte", { IEEE80211_IE_RSN, 1, 1 }, 3, 1, IEEE80211_IE_KIND_MALFORMED, true },
+  { "HT capabilities", { IEEE80211_IE_HT_CAPABILITIES, 26 }, 28, 1, IEEE80211_IE_KIND_HT_CAPABILITIES, true },
+  { "HT capabilities, 25 bytes", { IEEE80211_IE_HT_CAPABILITIES, 25 }, 27, 1, IEEE80211_IE_KIND_MALFORMED, true },
+  { "HT capabilities, 27 bytes", { IEEE80211_IE_HT_CAPABILITIES, 27 }, 29, 1, IEEE80211_IE_KIND_MALFORMED, true },
+  { "VHT capabilities", { IEEE80211_IE_VHT_CAPABILITIES, 12 }, 14, 1, IEEE80211_IE_KIND_VHT_CAPABILITIES, true },
+  { "VHT capabilities, 13 bytes", { IEEE80211_IE_VHT_CAPABILITIES, 13 }, 15, 1, IEEE80211_IE_KIND_MALFORMED, true },
+  { "vendor", { IEEE80211_IE_VENDOR, 4, 0x00, 0x50, 0xF2, 0x04 }, 6, 1, IEEE80211_IE_KIND_VENDOR, true },
+  { "vendor, OUI cut", { IEEE80211_IE_VENDOR, 2, 0x00, 0x50 }, 4, 1, IEEE80211_IE_KIND_MALFORMED, true },
+  { "rates", { IEEE80211_IE_RATES, 4, 0x82, 0x84, 0x8B, 0x96 }, 6, 1, IEEE80211_IE_KIND_OTHER, true },
+  { "unknown, empty", { 200, 0 }, 2, 1, IEEE80211_IE_KIND_OTHER, true },
+  { "length 255, cut", { 200, 255, 1, 2 }, 4, 0, 0, false },
+  { "length one past the end", { IEEE80211_IE_RATES, 3, 0x82, 0x84 }, 4, 0, 0, false },
+  { "second header cut", { IEEE80211_IE_SSID, 0, IEEE80211_IE_DS_PARAMS }, 3, 1, IEEE80211_IE_KIND_SSID, false },
+  { "second body cut", { IEEE80211_IE_SSID, 0, IEEE80211_IE_DS_PARAMS, 1 }, 4, 1, IEEE80211_IE_KIND_SSID, false },
+  { "malformed, then SSID", { IEEE80211_IE_DS_PARAMS, 0, IEEE80211_IE_SSID, 1, 'x' }, 5, 2, IEEE80211_IE_KIND_SSID, true },
+  { "empty elements", { 7, 0, 8, 0, 9, 0 }, 6, 3, IEEE80211_IE_KIND_OTHER, true }
+};
+
+/**
+ * Gets the kind an element should have, by the lengths in the standard
+ *
+ * @param id the element ID
+ * @param length the element length
+ */
+static uint8_t expected_kind(uint8_t id, uint8_t length) {
+  bool valid;
+  uint8_t kind;
+  switch (id) {
+    case IEEE80211_IE_SSID: kind = IEEE80211_IE_KIND_SSID; valid = length <= 32; break;
+    case IEEE80211_IE_DS_PARAMS: kind = IEEE80211_IE_KIND_CHANNEL; valid = length == 1; break;
+    case IEEE80211_IE_RSN: kind = IEEE80211_IE_KIND_RSN; valid = length >= 2; break;
+    case IEEE80211_IE_HT_CAPABILITIES: kind = IEEE80211_IE_KIND_HT_CAPABILITIES; valid = length == 26; break;
+    case IEEE80211_IE_VHT_CAPABILITIES: kind = IEEE80211_IE_KIND_VHT_CAPABILITIES; valid = length == 12; break;
+    case IEEE80211_IE_VENDOR: kind = IEEE80211_IE_KIND_VENDOR; valid = length >= 3; break;
+    default: return IEEE80211_IE_KIND_OTHER;
+  }
+
+  return valid ? kind : static_cast<uint8_t>(IEEE80211_IE_KIND_MALFORMED);
+}
+
+/**
+ * Walks the elements of an buffer which is copied into an buffer of exactly
+ *  its size, so an read beyond it is caught by the address sanitizer, and
+ *  checks that every element is within the buffer
+ *
+ * @param elements the elements
+ * @param size the size of the elements
+ * @param last the output last element, untouched if none
+ * @param complete the output, true if the walk ended at the end
+ * @return the number of elements returned
+ */
+static size_t walk_exact(const uint8_t *elements, size_t size, ieee80211_ie_t *last, bool *complete) {
+  std::vector<uint8_t> copy(elements, elements + size);
+  const uint8_t *begin = copy.data(), *end = copy.data() + copy.size();
+
+  ieee80211_ie_iter_t iter;
+  ieee80211_ie_t ie;
+  ieee80211_ie_init(&iter, begin, copy.size());
+
+  size_t count = 0;
+  const uint8_t *next = begin;
+  while (ieee80211_ie_next(&iter, &ie)) {
+    TEST_ASSERT_TRUE(ie.data == next + 2);
+    TEST_ASSERT_TRUE(ie.data + ie.length <= end);
+    TEST_ASSERT_EQUAL(next[0], ie.id);
+    TEST_ASSERT_EQUAL(next[1], ie.length);
+    TEST_ASSERT_EQUAL(expected_kind(ie.id, ie.length), ie.kind);
+    TEST_ASSERT_TRUE(iter.pos == ie.data + ie.length);
+    TEST_ASSERT_LESS_OR_EQUAL(size / 2, count);
+
+    next = iter.pos;
+    *last = ie;
+    ++count;
+  }
+
+  /* An walk only stops early at an element which does not fit */
+  size_t left = end - iter.pos;
+  TEST_ASSERT_TRUE(iter.pos == next);
+  TEST_ASSERT_TRUE(left == 0 || left < 2 || iter.pos[1] > left - 2);
+
+  *complete = ieee80211_ie_complete(&iter);
+  TEST_ASSERT_EQUAL(left == 0, *complete);
+
+  /* The element points into the copy, so it's made relative to the buffer */
+  if (count > 0) last->data = elements + (last->data - begin);
+  return count;
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+static void test_table() {
+  for (const ie_case_t &c : g_Cases) {
+    ieee80211_ie_t last;
+    bool complete;
+    TEST_ASSERT_EQUAL_MESSAGE(c.count, walk_exact(c.elements, c.size, &last, &complete), c.name);
+    TEST_ASSERT_EQUAL_MESSAGE(c.complete, complete, c.name);
+    if (c.count > 0) TEST_ASSERT_EQUAL_MESSAGE(c.kind, last.kind, c.name);
+  }
+}
+
+static void test_vendor_oui() {
+  const uint8_t elements[] = { IEEE80211_IE_VENDOR, 4, 0x00, 0x50, 0xF2, 0x04 };
+  ieee80211_ie_t ie;
+  bool complete;
+  TEST_ASSERT_EQUAL(1, walk_exact(elements, sizeof (elements), &ie, &complete));
+  TEST_ASSERT_EQUAL(IEEE80211_IE_KIND_VENDOR, ie.kind);
+  TEST_ASSERT_EQUAL_HEX32(0x0050F2, ieee80211_ie_vendor_oui(&ie));
+}
+
+/* Every ID with every length, alone in an buffer of exactly its size */
+static void test_every_id_and_length() {
+  uint8_t elements[2 + 255];
+  for (size_t i = 0; i < sizeof (elements); ++i) elements[i] = static_cast<uint8_t>(i);
+
+  for (uint32_t id = 0; id < 256; ++id) {
+    for (uint32_t length = 0; length < 256; ++length) {
+      elements[0] = id;
+      elements[1] = length;
+
+      ieee80211_ie_t ie;
+      bool complete;
+      TEST_ASSERT_EQUAL(1, walk_exact(elements, 2 + length, &ie, &complete));
+      TEST_ASSERT_TRUE(complete);
+
+      /* One byte less and the element is dropped */
+      TEST_ASSERT_EQUAL(0, walk_exact(elements, 1 + length, &ie, &complete));
+      TEST_ASSERT_FALSE(complete);
+    }
+  }
+}
+
+/* An probe request body cut at every size: the elements which fit are all
+ * returned, and the walk is only complete at an element boundary */
+static void test_every_truncation() {
+  std::vector<uint8_t> elements;
+  std::vector<size_t> boundaries = { 0 };
+  const uint8_t lengths[][2] = {
+    { IEEE80211_IE_SSID, 5 }, { IEEE80211_IE_RATES, 8 }, { IEEE80211_IE_DS_PARAMS, 1 },
+    { IEEE80211_IE_HT_CAPABILITIES, 26 }, { IEEE80211_IE_EXT_RATES, 0 }, { IEEE80211_IE_RSN, 20 },
+    { IEEE80211_IE_VHT_CAPABILITIES, 12 }, { IEEE80211_IE_VENDOR, 7 }, { IEEE80211_IE_EXTENSION, 3 }
+  };
+
+  for (const uint8_t *e : lengths) {
+    elements.push_back(e[0]);
+    elements.push_back(e[1]);
+    for (uint8_t i = 0; i < e[1]; ++i) elements.push_back(0xC0 + i);
+    boundaries.push_back(elements.size());
+  }
+
+  for (size_t size = 0; size <= elements.size(); ++size) {
+    size_t fit = 0;
+    while (fit + 1 < boundaries.size() && boundaries[fit + 1] <= size) ++fit;
+
+    ieee80211_ie_t last;
+    bool complete;
+    TEST_ASSERT_EQUAL(fit, walk_exact(elements.data(), size, &last, &complete));
+    TEST_ASSERT_EQUAL(boundaries[fit] == size, complete);
+  }
+}
+
+/* Random elements of random sizes, most of them cut somewhere, and random
+ * lengths where the elements are meant to fit */
+static void test_fuzz() {
+  std::mt19937 rng(80211);
+  uint8_t elements[300];
+  uint32_t complete_walks = 0, elements_seen = 0;
+
+  for (uint32_t i = 0; i < 200000; ++i) {
+    size_t size = rng() % (sizeof (elements) + 1);
+    for (size_t j = 0; j < size; ++j) elements[j] = rng();
+
+    /* Half of the buffers get plausible lengths, so the walk gets further */
+    if (i & 1) {
+      for (size_t j = 0; j + 1 < size; j += 2 + elements[j + 1]) elements[j + 1] %= 40;
+    }
+
+    ieee80211_ie_t last;
+    bool complete;
+    elements_seen += walk_exact(elements, size, &last, &complete);
+    complete_walks += complete;
+  }
+
+  TEST_ASSERT_GREATER_THAN(0, complete_walks);
+  TEST_ASSERT_GREATER_THAN(200000, elements_seen);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_table);
+  RUN_TEST(test_vendor_oui);
+  RUN_TEST(test_every_id_and_length);
+  RUN_TEST(test_every_truncation);
+  RUN_TEST(test_fuzz);
+  return UNITY_END();
+}
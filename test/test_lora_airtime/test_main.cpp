@@ -0,0 +1,109 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#include <unity.h>
+
+#include "default.h"
+
+#include <math.h>
+
+typedef struct {
+  int sf;
+  long bw;
+  int cr;                       /* The denominator of the coding rate */
+  long preamble;
+  bool crc;
+  bool implicit_header;
+  size_t size;
+  uint32_t expected;            /* The time on air in microseconds */
+} airtime_case_t;
+
+/* Worked out by hand with the formula of the SX1276 datasheet, section
+ * 4.1.1.7, these match the Semtech LoRa calculator */
+static const airtime_case_t g_Cases[] = {
+  { 7, 125000, 5, 8, true, false, 10, 41216 },
+  { 9, 125000, 5, 8, true, false, 20, 185344 },
+  { 10, 250000, 8, 8, true, false, 255, 1786880 },
+  { 11, 125000, 5, 8, true, false, 51, 1314816 },   /* 16.4ms symbols, low data rate */
+  { 12, 125000, 5, 8, true, false, 51, 2465792 },   /* Low data rate */
+  { 6, 500000, 5, 6, false, true, 16, 5536 },
+  { 12, 125000, 5, 8, false, true, 0, 401408 + 8 * 32768 }
+};
+
+/**
+ * Configures the radio like an case
+ * 
+ * @param c the case
+ */
+static void configure(const airtime_case_t *c) {
+  LoRa.setSpreadingFactor(c->sf);
+  LoRa.setSignalBandwidth(c->bw);
+  LoRa.setCodingRate4(c->cr);
+  LoRa.setPreambleLength(c->preamble);
+  if (c->crc) LoRa.enableCrc();
+  else LoRa.disableCrc();
+  if (c->implicit_header) LoRa.beginPacket(true);
+  else LoRa.beginPacket(false);
+}
+
+/**
+ * The time on air by the Semtech formula, in double precision
+ * 
+ * @param c the case
+ * @return the time on air in microseconds
+ */
+static double semtech_airtime(const airtime_case_t *c) {
+  double symbol = static_cast<double>(1L << c->sf) * 1E6 / c->bw;
+  bool ldro = symbol > 16000.0;
+
+  double payload = ceil((8.0 * c->size - 4.0 * c->sf + 28 + (c->crc ? 16 : 0) - (c->implicit_header ? 20 : 0))
+    / (4.0 * (c->sf - (ldro ? 2 : 0))));
+  double symbols = 8 + (payload > 0 ? payload : 0) * c->cr;
+  return (c->preamble + 4.25) * symbol + symbols * symbol;
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+static void test_table() {
+  for (const airtime_case_t &c : g_Cases) {
+    configure(&c);
+    TEST_ASSERT_UINT32_WITHIN(1, c.expected, LoRa.timeOnAir(c.size));
+    TEST_ASSERT_UINT32_WITHIN(1, c.expected, static_cast<uint32_t>(semtech_airtime(&c)));
+  }
+}
+
+static void test_sweep() {
+  const long bandwidths[] = { 62500, 125000, 250000, 500000 };
+  for (int sf = 7; sf <= 12; ++sf) {
+    for (long bw : bandwidths) {
+      for (int cr = 5; cr <= 8; ++cr) {
+        for (int flags = 0; flags < 4; ++flags) {
+          for (size_t size = 0; size <= 255; size += 5) {
+            airtime_case_t c = { sf, bw, cr, 8, (flags & 1) != 0, (flags & 2) != 0, size, 0 };
+            configure(&c);
+
+            /* The library works in single precision */
+            double expected = semtech_airtime(&c);
+            TEST_ASSERT_UINT32_WITHIN(static_cast<uint32_t>(expected * 1E-6) + 1,
+              static_cast<uint32_t>(expected), LoRa.timeOnAir(size));
+          }
+        }
+      }
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+
+  SPI.begin(SCK, MISO, MOSI, SS);
+  LoRa.setPins(SS, RST, DI0);
+  if (!LoRa.begin(BAND)) return 1;
+
+  RUN_TEST(test_table);
+  RUN_TEST(test_sweep);
+  return UNITY_END();
+}
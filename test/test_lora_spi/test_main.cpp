@@ -0,0 +1,145 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#include <unity.h>
+
+#include "cbxpkt.h"
+#include "sim.h"
+
+#include <stdio.h>
+
+/* The frames the simulated radio transmits are appended to this file */
+#define TEST_CHANNEL "test_lora_spi.bin"
+
+static FILE *g_Channel = nullptr;
+
+void setUp() {}
+
+void tearDown() {}
+
+/**
+ * Gets the SPI transactions and bytes since the last call
+ * 
+ * @param transactions the output transactions
+ * @param bytes the output bytes
+ */
+static void spi_delta(uint32_t *transactions, uint32_t *bytes) {
+  static uint32_t last_transactions = 0, last_bytes = 0;
+  uint32_t t, b;
+  sim_spi_counters(&t, &b);
+  *transactions = t - last_transactions;
+  *bytes = b - last_bytes;
+  last_transactions = t;
+  last_bytes = b;
+}
+
+/**
+ * Reads the next frame the radio transmitted
+ * 
+ * @param frame the output frame (255 bytes)
+ * @return the size of the frame, or -1 if there is none
+ */
+static int read_frame(uint8_t *frame) {
+  int size = fgetc(g_Channel);
+  if (size == EOF || fread(frame, 1, size, g_Channel) != static_cast<size_t>(size)) return -1;
+  return size;
+}
+
+static void test_fifo_write_is_one_burst() {
+  uint8_t payload[200], frame[255];
+  for (size_t i = 0; i < sizeof (payload); ++i) payload[i] = static_cast<uint8_t>(i * 7);
+
+  uint32_t transactions, bytes;
+  LoRa.beginPacket();
+  spi_delta(&transactions, &bytes);
+  LoRa.write(payload, sizeof (payload));
+  spi_delta(&transactions, &bytes);
+
+  /* Reading the length, the burst and writing the length, whatever the size */
+  TEST_ASSERT_EQUAL_UINT32(3, transactions);
+  TEST_ASSERT_EQUAL_UINT32(2 + 1 + sizeof (payload) + 2, bytes);
+
+  LoRa.endPacket();
+  TEST_ASSERT_EQUAL(sizeof (payload), read_frame(frame));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(payload, frame, sizeof (payload));
+}
+
+static void test_burst_against_register_writes() {
+  uint8_t payload[200];
+  for (size_t i = 0; i < sizeof (payload); ++i) payload[i] = static_cast<uint8_t>(i);
+
+  /* The old path, one register write transaction per byte */
+  uint32_t register_transactions, register_bytes, burst_transactions, burst_bytes;
+  spi_delta(&register_transactions, &register_bytes);
+  for (size_t i = 0; i < sizeof (payload); ++i) {
+    SPI.beginTransaction(SPISettings());
+    SPI.transfer(0x80);
+    SPI.transfer(payload[i]);
+    SPI.endTransaction();
+  }
+  spi_delta(&register_transactions, &register_bytes);
+
+  LoRa.beginPacket();
+  spi_delta(&burst_transactions, &burst_bytes);
+  LoRa.write(payload, sizeof (payload));
+  spi_delta(&burst_transactions, &burst_bytes);
+  LoRa.endPacket();
+
+  uint8_t frame[255];
+  TEST_ASSERT_EQUAL(sizeof (payload), read_frame(frame));
+
+  char message[128];
+  snprintf(message, sizeof (message), "200 bytes: %u transactions / %u bytes per register, "
+    "%u / %u in an burst", register_transactions, register_bytes, burst_transactions, burst_bytes);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_LESS_THAN(register_transactions / 50, burst_transactions);
+}
+
+static void test_packet_is_one_burst() {
+  uint8_t payload[100], expected[CBX_PKT_MAX_SIZE], frame[255];
+  for (size_t i = 0; i < sizeof (payload); ++i) payload[i] = static_cast<uint8_t>(0xA0 + i);
+
+  cbx_pkt_t pkt = {};
+  pkt.hdr.version = CBX_PKT_VERSION;
+  pkt.body.key_id = GLOBAL_KEY_ID;
+  pkt.body.size = sizeof (payload);
+  pkt.body.payload = payload;
+  size_t size = cbx_pkt_serialize(&pkt, expected, sizeof (expected));
+
+  uint32_t transactions, bytes;
+  spi_delta(&transactions, &bytes);
+  cbx_pkt_transmit(&pkt);
+  spi_delta(&transactions, &bytes);
+
+  /* The register setup and the polling of the TX done flag do not grow
+   * with the size of the packet, the payload is one burst */
+  char message[96];
+  snprintf(message, sizeof (message), "cbx_pkt_transmit of %zu bytes: %u transactions, %u bytes",
+    size, transactions, bytes);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_LESS_OR_EQUAL(16, transactions);
+
+  TEST_ASSERT_EQUAL(size, read_frame(frame));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, frame, size);
+}
+
+int main(int argc, char **argv) {
+  remove(TEST_CHANNEL);
+  sim_lora_open_output(TEST_CHANNEL);
+  g_Channel = fopen(TEST_CHANNEL, "rb");
+
+  SPI.begin(SCK, MISO, MOSI, SS);
+  LoRa.setPins(SS, RST, DI0);
+  if (!LoRa.begin(BAND) || g_Channel == nullptr) return 1;
+
+  UNITY_BEGIN();
+  RUN_TEST(test_fifo_write_is_one_burst);
+  RUN_TEST(test_burst_against_register_writes);
+  RUN_TEST(test_packet_is_one_burst);
+  int failures = UNITY_END();
+
+  fclose(g_Channel);
+  remove(TEST_CHANNEL);
+  return failures;
+}
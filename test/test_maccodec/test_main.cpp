@@ -0,0 +1,214 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#include <unity.h>
+
+#include "maccodec.h"
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+/* Five sorted MACs which use every kind of header: the first one, an shared
+ * prefix which is as short as the difference, an difference of one byte, an
+ * new OUI, and an difference of two bytes */
+static const measurement_t g_Macs[] = {
+  { { 0x00, 0x11, 0x22, 0x33, 0x44, 0x55 } },
+  { { 0x00, 0x11, 0x22, 0x33, 0x44, 0x60 } },
+  { { 0x00, 0x11, 0x22, 0x33, 0x45, 0x02 } },
+  { { 0x00, 0x11, 0x23, 0x00, 0x00, 0x01 } },
+  { { 0x00, 0x11, 0x23, 0x01, 0x00, 0x00 } }
+};
+
+static const uint8_t g_Encoded[] = {
+  0x05,                                 /* Count */
+  0x05, 0x62, 0x70,                     /* Headers: 0, 5, 6, 2, 7 */
+  0x00, 0x11, 0x22, 0x33, 0x44, 0x55,   /* Whole MAC */
+  0x60,                                 /* Suffix after 5 shared bytes */
+  0xA2,                                 /* Difference 0x334502 - 0x334460 */
+  0x23, 0x00, 0x00, 0x01,               /* Suffix after 2 shared bytes */
+  0xFF, 0xFF                            /* Difference 0x010000 - 0x000001 */
+};
+
+/* The same first three MACs encoded without differences, like the
+ * transmitters which predate them do */
+static const uint8_t g_EncodedPrefixOnly[] = {
+  0x03, 0x05, 0x40,
+  0x00, 0x11, 0x22, 0x33, 0x44, 0x55,
+  0x60,
+  0x45, 0x02
+};
+
+void setUp() {}
+
+void tearDown() {}
+
+static void test_golden_encode() {
+  uint8_t out[64];
+  size_t consumed;
+  size_t size = mac_codec_encode(out, sizeof (out), g_Macs, 5, &consumed);
+
+  TEST_ASSERT_EQUAL(5, consumed);
+  TEST_ASSERT_EQUAL(sizeof (g_Encoded), size);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(g_Encoded, out, size);
+}
+
+static void test_golden_decode() {
+  measurement_t macs[8];
+  size_t used;
+  TEST_ASSERT_EQUAL(5, mac_codec_decode(g_Encoded, sizeof (g_Encoded), macs, 8, &used));
+  TEST_ASSERT_EQUAL(sizeof (g_Encoded), used);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(g_Macs, macs, sizeof (g_Macs));
+}
+
+static void test_decodes_prefix_only() {
+  measurement_t macs[8];
+  size_t used;
+  TEST_ASSERT_EQUAL(3, mac_codec_decode(g_EncodedPrefixOnly, sizeof (g_EncodedPrefixOnly), macs, 8, &used));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(g_Macs, macs, 3 * sizeof (measurement_t));
+}
+
+static void test_rejects_malformed() {
+  measurement_t macs[8];
+  size_t used;
+  uint8_t in[sizeof (g_Encoded)];
+
+  /* Every truncation */
+  for (size_t size = 0; size < sizeof (g_Encoded); ++size)
+    TEST_ASSERT_EQUAL(-1, mac_codec_decode(g_Encoded, size, macs, 8, &used));
+
+  /* An difference for the first MAC, which has nothing to add it to */
+  memcpy(in, g_Encoded, sizeof (in));
+  in[1] = 0x65;
+  TEST_ASSERT_EQUAL(-1, mac_codec_decode(in, sizeof (in), macs, 8, &used));
+
+  /* An header above 8 */
+  memcpy(in, g_Encoded, sizeof (in));
+  in[2] = 0x92;
+  TEST_ASSERT_EQUAL(-1, mac_codec_decode(in, sizeof (in), macs, 8, &used));
+
+  /* More MACs than the output holds */
+  TEST_ASSERT_EQUAL(-1, mac_codec_decode(g_Encoded, sizeof (g_Encoded), macs, 4, &used));
+}
+
+static void test_stops_when_full() {
+  uint8_t out[12];
+  size_t consumed;
+  size_t size = mac_codec_encode(out, sizeof (out), g_Macs, 5, &consumed);
+
+  /* The count, two header bytes, the whole MAC, the suffix and the difference */
+  TEST_ASSERT_EQUAL(3, consumed);
+  TEST_ASSERT_EQUAL(11, size);
+
+  measurement_t macs[8];
+  size_t used;
+  TEST_ASSERT_EQUAL(3, mac_codec_decode(out, size, macs, 8, &used));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(g_Macs, macs, 3 * sizeof (measurement_t));
+}
+
+/**
+ * Makes an corpus of MACs, from a number of vendors with their NIC parts
+ *  spread over a range, or randomized
+ * 
+ * @param macs the output corpus
+ * @param count the number of MACs
+ * @param vendors the number of vendors, 0 for randomized MACs
+ * @param spread the range of the NIC parts of an vendor
+ * @param rng the random generator
+ */
+static void make_corpus(std::vector<measurement_t> &macs, size_t count, uint32_t vendors,
+  uint32_t spread, std::mt19937 &rng) {
+  macs.resize(count);
+  for (measurement_t &m : macs) {
+    if (vendors == 0) {
+      for (uint8_t &b : m.mac) b = rng();
+      m.mac[0] = (m.mac[0] & 0xFC) | 0x02;
+      continue;
+    }
+
+    uint32_t vendor = rng() % vendors, nic = rng() % spread;
+    m.mac[0] = 0x00;
+    m.mac[1] = vendor * 37;
+    m.mac[2] = vendor * 11;
+    m.mac[3] = nic >> 16;
+    m.mac[4] = nic >> 8;
+    m.mac[5] = nic;
+  }
+}
+
+/**
+ * Encodes an corpus in batches like the transmitter, checks the round trip
+ *  and reports the bytes per MAC against the raw and the prefix only sizes
+ * 
+ * @param name the name of the corpus
+ * @param vendors the number of vendors, 0 for randomized MACs
+ * @param spread the range of the NIC parts of an vendor
+ */
+static void bench_corpus(const char *name, uint32_t vendors, uint32_t spread) {
+  const size_t batch_count = 200, batch_size = 128;
+  std::mt19937 rng(vendors * 7919 + spread);
+  size_t encoded_size = 0, prefix_size = 0, mac_count = 0;
+  int64_t elapsed = 0;
+
+  std::vector<measurement_t> macs, decoded(batch_size);
+  uint8_t out[1 + batch_size / 2 + batch_size * 6];
+  for (size_t batch = 0; batch < batch_count; ++batch) {
+    make_corpus(macs, batch_size, vendors, spread, rng);
+    mac_codec_sort(macs.data(), macs.size());
+
+    auto started = std::chrono::steady_clock::now();
+    size_t consumed, used;
+    size_t size = mac_codec_encode(out, sizeof (out), macs.data(), macs.size(), &consumed);
+    int32_t n = mac_codec_decode(out, size, decoded.data(), decoded.size(), &used);
+    elapsed += std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - started).count();
+
+    TEST_ASSERT_EQUAL(batch_size, consumed);
+    TEST_ASSERT_EQUAL(batch_size, n);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(macs.data(), decoded.data(), batch_size * sizeof (measurement_t));
+
+    /* The size the headers up to 5 alone would take */
+    prefix_size += 1 + (batch_size + 1) / 2 + 6;
+    for (size_t i = 1; i < batch_size; ++i) prefix_size += 6 - mac_codec_shared(macs[i - 1].mac, macs[i].mac);
+    encoded_size += size;
+    mac_count += batch_size;
+  }
+
+  char message[160];
+  snprintf(message, sizeof (message), "mac_codec %s: raw 6.00, prefix only %.2f, encoded %.2f "
+    "bytes/MAC, %.1f ns/MAC encode+decode", name, static_cast<double>(prefix_size) / mac_count,
+    static_cast<double>(encoded_size) / mac_count, static_cast<double>(elapsed) / mac_count);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_LESS_OR_EQUAL(prefix_size, encoded_size);
+}
+
+static void test_bench_few_vendors() {
+  bench_corpus("4 vendors", 4, 0x10000);
+}
+
+static void test_bench_production_runs() {
+  bench_corpus("4 production runs", 4, 0x800);
+}
+
+static void test_bench_many_vendors() {
+  bench_corpus("64 vendors", 64, 0x1000000);
+}
+
+static void test_bench_randomized() {
+  bench_corpus("randomized", 0, 0);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_golden_encode);
+  RUN_TEST(test_golden_decode);
+  RUN_TEST(test_decodes_prefix_only);
+  RUN_TEST(test_rejects_malformed);
+  RUN_TEST(test_stops_when_full);
+  RUN_TEST(test_bench_few_vendors);
+  RUN_TEST(test_bench_production_runs);
+  RUN_TEST(test_bench_many_vendors);
+  RUN_TEST(test_bench_randomized);
+  return UNITY_END();
+}
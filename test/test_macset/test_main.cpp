@@ -0,0 +1,152 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#include <unity.h>
+
+#include "macset.h"
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+static mac_set_t g_Set;
+
+void setUp() {
+  mac_set_init(&g_Set);
+}
+
+void tearDown() {}
+
+/**
+ * Makes an MAC out of an number, the vendor prefix is shared like in an
+ *  busy venue, where most MACs come from a few vendors
+ * 
+ * @param mac the output mac (6 bytes)
+ * @param n the number
+ */
+static void make_mac(uint8_t *mac, uint32_t n) {
+  mac[0] = 0x3C;
+  mac[1] = 0x22;
+  mac[2] = static_cast<uint8_t>(0xF0 | (n & 0x3));
+  mac[3] = static_cast<uint8_t>(n >> 16);
+  mac[4] = static_cast<uint8_t>(n >> 8);
+  mac[5] = static_cast<uint8_t>(n);
+}
+
+static void test_emplace_finds_inserted() {
+  uint8_t mac[6];
+  bool inserted;
+  make_mac(mac, 1);
+
+  uint16_t *value = mac_set_emplace(&g_Set, mac, &inserted);
+  TEST_ASSERT_NOT_NULL(value);
+  TEST_ASSERT_TRUE(inserted);
+  *value = 42;
+
+  value = mac_set_emplace(&g_Set, mac, &inserted);
+  TEST_ASSERT_NOT_NULL(value);
+  TEST_ASSERT_FALSE(inserted);
+  TEST_ASSERT_EQUAL_UINT16(42, *value);
+  TEST_ASSERT_EQUAL(1, g_Set.size);
+}
+
+static void test_full_at_half_capacity() {
+  uint8_t mac[6];
+  bool inserted;
+  for (uint32_t i = 0; i < GLOBAL_MAC_SET_CAPACITY / 2; ++i) {
+    make_mac(mac, i);
+    TEST_ASSERT_NOT_NULL(mac_set_emplace(&g_Set, mac, &inserted));
+    TEST_ASSERT_TRUE(inserted);
+  }
+
+  /* New MACs are refused, the present ones are still found */
+  make_mac(mac, GLOBAL_MAC_SET_CAPACITY);
+  TEST_ASSERT_NULL(mac_set_emplace(&g_Set, mac, &inserted));
+  make_mac(mac, 0);
+  TEST_ASSERT_NOT_NULL(mac_set_emplace(&g_Set, mac, &inserted));
+  TEST_ASSERT_FALSE(inserted);
+}
+
+static void test_clear_forgets_everything() {
+  uint8_t mac[6];
+  bool inserted;
+  make_mac(mac, 7);
+  mac_set_emplace(&g_Set, mac, &inserted);
+  mac_set_clear(&g_Set);
+
+  TEST_ASSERT_EQUAL(0, g_Set.size);
+  mac_set_emplace(&g_Set, mac, &inserted);
+  TEST_ASSERT_TRUE(inserted);
+}
+
+static void test_clear_survives_epoch_wrap() {
+  uint8_t mac[6];
+  bool inserted;
+  make_mac(mac, 9);
+
+  /* Every clear bumps the epoch, the stale slots must never come back */
+  for (uint32_t i = 0; i < 70000; ++i) {
+    mac_set_emplace(&g_Set, mac, &inserted);
+    TEST_ASSERT_TRUE(inserted);
+    mac_set_clear(&g_Set);
+  }
+}
+
+/**
+ * Feeds an stream of frames from a number of unique MACs through the set,
+ *  cleared whenever an batch would be full, like the collector does, and
+ *  reports the time per frame
+ * 
+ * @param unique the number of unique MACs in the stream
+ */
+static void bench_stream(uint32_t unique) {
+  const size_t frame_count = 1000000;
+  std::mt19937 rng(unique);
+  std::vector<uint8_t> macs(frame_count * 6);
+  for (size_t i = 0; i < frame_count; ++i) make_mac(&macs[i * 6], rng() % unique);
+
+  size_t batch = 0, duplicates = 0;
+  auto started = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < frame_count; ++i) {
+    bool inserted;
+    uint16_t *value = mac_set_emplace(&g_Set, &macs[i * 6], &inserted);
+    if (!inserted) {
+      ++duplicates;
+      continue;
+    }
+
+    *value = static_cast<uint16_t>(batch);
+    if (++batch == GLOBAL_MEASUREMENT_BUFFER_SIZE) {
+      mac_set_clear(&g_Set);
+      batch = 0;
+    }
+  }
+  auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now() - started).count();
+
+  char message[128];
+  snprintf(message, sizeof (message), "mac_set %u unique MACs: %.1f ns/frame, %zu duplicates",
+    unique, static_cast<double>(elapsed) / frame_count, duplicates);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_TRUE(g_Set.size <= GLOBAL_MEASUREMENT_BUFFER_SIZE);
+}
+
+static void test_bench_10k_unique() {
+  bench_stream(10000);
+}
+
+static void test_bench_100k_unique() {
+  bench_stream(100000);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_emplace_finds_inserted);
+  RUN_TEST(test_full_at_half_capacity);
+  RUN_TEST(test_clear_forgets_everything);
+  RUN_TEST(test_clear_survives_epoch_wrap);
+  RUN_TEST(test_bench_10k_unique);
+  RUN_TEST(test_bench_100k_unique);
+  return UNITY_END();
+}
@@ -0,0 +1,212 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#include <unity.h>
+
+#include "presence.h"
+
+/* Three sorted MACs: one seen twice on channel 6, one seen three times on
+ * channels 1 and 11 with an dwell of two varint bytes and an spread which is
+ * clamped, and one seen once on channel 14 at an first_seen of two bytes */
+static const measurement_t g_Macs[] = {
+  { { 0x00, 0x11, 0x22, 0x33, 0x44, 0x55 } },
+  { { 0x00, 0x11, 0x22, 0x33, 0x44, 0x60 } },
+  { { 0x00, 0x11, 0x23, 0x00, 0x00, 0x01 } }
+};
+
+static const uint8_t g_Encoded[] = {
+  0x2E, 0x01,                           /* Age 302 */
+  0x03,                                 /* Count */
+  0x05, 0x20,                           /* Headers: 0, 5, 2 */
+  0x00, 0x11, 0x22, 0x33, 0x44, 0x55,   /* Whole MAC */
+  0x60,                                 /* Suffix after 5 shared bytes */
+  0x23, 0x00, 0x00, 0x01,               /* Suffix after 2 shared bytes */
+  0x01, 0x02, 0x01, 0xC4, 0x56,         /* 1 s, 2 s dwell, 2 frames, -60 dBm, spread 5, channel 6 */
+  0x02, 0xC8, 0x01, 0x02, 0xD8, 0xF0,   /* 2 s, 200 s dwell, 3 frames, -40 dBm, spread 15, multiple */
+  0x81, 0x08,                           /* Channels 1 and 11 */
+  0xAC, 0x02, 0x00, 0x00, 0xA6, 0x0E    /* 300 s, no dwell, 1 frame, -90 dBm, spread 0, channel 14 */
+};
+
+static const presence_record_t g_Records[] = {
+  { 1, 3, 2, -60, -65, 1 << 5 },
+  { 2, 202, 3, -40, -55, 1 << 0 | 1 << 10 },
+  { 300, 300, 1, -90, -90, 1 << 13 }
+};
+
+static presence_table_t g_Table;
+
+/**
+ * Registers an sighting of one of the golden MACs
+ *
+ * @param i the index of the MAC
+ * @param rssi the signal strength
+ * @param channel the channel
+ * @param seconds the seconds since the start of the batch
+ */
+static void sight(size_t i, int8_t rssi, uint8_t channel, int64_t seconds) {
+  sighting_t sighting = { };
+  memcpy(sighting.mac, g_Macs[i].mac, 6);
+  sighting.rssi = rssi;
+  sighting.channel = channel;
+
+  for (size_t j = 0; j < g_Table.count; ++j) {
+    if (memcmp(g_Table.macs[j].mac, sighting.mac, 6) == 0) {
+      presence_update(&g_Table, j, &sighting, seconds * 1000000);
+      return;
+    }
+  }
+
+  TEST_ASSERT_NOT_EQUAL(-1, presence_add(&g_Table, &sighting, seconds * 1000000));
+}
+
+void setUp() {
+  presence_clear(&g_Table, 0);
+  sight(2, -90, 14, 300);
+  sight(0, -60, 6, 1);
+  sight(1, -80, 1, 2);
+  sight(0, -70, 6, 3);
+  sight(1, -80, 11, 130);
+  sight(1, -40, 11, 202);
+  presence_sort(&g_Table);
+}
+
+void tearDown() {}
+
+static void test_golden_encode() {
+  uint8_t out[64];
+  size_t consumed;
+  size_t size = presence_encode(out, sizeof (out), &g_Table, 0, 302 * 1000000LL, &consumed);
+
+  TEST_ASSERT_EQUAL(3, consumed);
+  TEST_ASSERT_EQUAL(sizeof (g_Encoded), size);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(g_Encoded, out, size);
+  TEST_ASSERT_LESS_OR_EQUAL(presence_size_bound(&g_Table) + PRESENCE_PACKET_OVERHEAD, size);
+}
+
+static void test_golden_decode() {
+  measurement_t macs[8];
+  presence_record_t records[8];
+  uint16_t age;
+  TEST_ASSERT_EQUAL(3, presence_decode(g_Encoded, sizeof (g_Encoded), &age, macs, records, 8));
+  TEST_ASSERT_EQUAL(302, age);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(g_Macs, macs, sizeof (g_Macs));
+
+  for (size_t i = 0; i < 3; ++i) {
+    TEST_ASSERT_EQUAL(g_Records[i].first_seen, records[i].first_seen);
+    TEST_ASSERT_EQUAL(g_Records[i].last_seen, records[i].last_seen);
+    TEST_ASSERT_EQUAL(g_Records[i].frames, records[i].frames);
+    TEST_ASSERT_EQUAL(g_Records[i].rssi_max, records[i].rssi_max);
+    TEST_ASSERT_EQUAL(g_Records[i].rssi_avg, records[i].rssi_avg);
+    TEST_ASSERT_EQUAL(g_Records[i].channels, records[i].channels);
+  }
+}
+
+/* An MAC seen on every channel which fits the bitmap, and on one beyond it,
+ * which is left out */
+static void test_multi_channel_bitmap() {
+  presence_clear(&g_Table, 0);
+  for (uint8_t channel = 1; channel <= PRESENCE_CHANNEL_MAX + 1; ++channel) sight(0, -50, channel, 0);
+
+  uint8_t out[32];
+  size_t consumed;
+  size_t size = presence_encode(out, sizeof (out), &g_Table, 0, 0, &consumed);
+  TEST_ASSERT_EQUAL(1, consumed);
+
+  /* The nibble is 0, followed by the bitmap of 15 bits */
+  TEST_ASSERT_EQUAL(0x00, out[size - 4] & 0x0F);
+  TEST_ASSERT_EQUAL(0xFF, out[size - 3]);
+  TEST_ASSERT_EQUAL(0xFF, out[size - 2]);
+  TEST_ASSERT_EQUAL(0x01, out[size - 1]);
+
+  measurement_t macs[1];
+  presence_record_t records[1];
+  uint16_t age;
+  TEST_ASSERT_EQUAL(1, presence_decode(out, size, &age, macs, records, 1));
+  TEST_ASSERT_EQUAL(0x7FFF, records[0].channels);
+  TEST_ASSERT_EQUAL(16, records[0].frames);
+}
+
+/* The age is the time from the start of the batch to the transmission, it
+ * never goes below 0 and saturates at the 16 bits */
+static void test_age() {
+  uint8_t out[64];
+  size_t consumed;
+  measurement_t macs[8];
+  presence_record_t records[8];
+  uint16_t age;
+
+  const int64_t nows[] = { 302 * 1000000LL, 302 * 1000000LL + 999999, 0, -1000000, 70000 * 1000000LL };
+  const uint16_t ages[] = { 302, 302, 0, 0, UINT16_MAX };
+  for (size_t i = 0; i < sizeof (ages) / sizeof (ages[0]); ++i) {
+    size_t size = presence_encode(out, sizeof (out), &g_Table, 0, nows[i], &consumed);
+    TEST_ASSERT_EQUAL(3, presence_decode(out, size, &age, macs, records, 8));
+    TEST_ASSERT_EQUAL(ages[i], age);
+  }
+}
+
+static void test_rejects_malformed() {
+  measurement_t macs[8];
+  presence_record_t records[8];
+  uint16_t age;
+  uint8_t in[sizeof (g_Encoded) + 1];
+
+  /* Every truncation */
+  for (size_t size = 0; size < sizeof (g_Encoded); ++size)
+    TEST_ASSERT_EQUAL(-1, presence_decode(g_Encoded, size, &age, macs, records, 8));
+
+  /* An trailing byte */
+  memcpy(in, g_Encoded, sizeof (g_Encoded));
+  in[sizeof (g_Encoded)] = 0x00;
+  TEST_ASSERT_EQUAL(-1, presence_decode(in, sizeof (in), &age, macs, records, 8));
+
+  /* An channel bitmap beyond 16 bits */
+  const uint8_t wide[] = {
+    0x00, 0x00, 0x01, 0x00,
+    0x00, 0x11, 0x22, 0x33, 0x44, 0x55,
+    0x00, 0x00, 0x00, 0xC4, 0x00, 0x80, 0x80, 0x04
+  };
+  TEST_ASSERT_EQUAL(-1, presence_decode(wide, sizeof (wide), &age, macs, records, 8));
+
+  /* An varint of more than 32 bits */
+  const uint8_t long_varint[] = {
+    0x00, 0x00, 0x01, 0x00,
+    0x00, 0x11, 0x22, 0x33, 0x44, 0x55,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x00, 0x00, 0x00, 0xC4, 0x06
+  };
+  TEST_ASSERT_EQUAL(-1, presence_decode(long_varint, sizeof (long_varint), &age, macs, records, 8));
+
+  /* More records than the output holds */
+  TEST_ASSERT_EQUAL(-1, presence_decode(g_Encoded, sizeof (g_Encoded), &age, macs, records, 2));
+}
+
+static void test_stops_when_full() {
+  uint8_t out[sizeof (g_Encoded) - 1];
+  size_t consumed;
+  size_t size = presence_encode(out, sizeof (out), &g_Table, 0, 302 * 1000000LL, &consumed);
+  TEST_ASSERT_EQUAL(2, consumed);
+
+  measurement_t macs[8];
+  presence_record_t records[8];
+  uint16_t age;
+  TEST_ASSERT_EQUAL(2, presence_decode(out, size, &age, macs, records, 8));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(g_Macs, macs, 2 * sizeof (measurement_t));
+
+  /* The rest goes into the next packet */
+  size = presence_encode(out, sizeof (out), &g_Table, 2, 302 * 1000000LL, &consumed);
+  TEST_ASSERT_EQUAL(1, consumed);
+  TEST_ASSERT_EQUAL(1, presence_decode(out, size, &age, macs, records, 8));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(g_Macs[2].mac, macs[0].mac, 6);
+  TEST_ASSERT_EQUAL(300, records[0].first_seen);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_golden_encode);
+  RUN_TEST(test_golden_decode);
+  RUN_TEST(test_multi_channel_bitmap);
+  RUN_TEST(test_age);
+  RUN_TEST(test_rejects_malformed);
+  RUN_TEST(test_stops_when_full);
+  return UNITY_END();
+}
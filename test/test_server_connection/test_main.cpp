@@ -0,0 +1,455 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#include <unity.h>
+
+#include "server_connection.h"
+#include "sim.h"
+
+#include <fcntl.h>
+#include <errno.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#define TEST_PACKET_SIZE 60     /* About an forwarded presence frame */
+#define TEST_RECORD_SIZE (SERVER_RECORD_HEADER_SIZE + TEST_PACKET_SIZE)
+
+/* An loopback server which reads everything it is sent, it is pumped from
+ * the test itself so the tests decide when it reads, accepts or drops */
+typedef struct {
+  int32_t listen_fd;
+  int32_t fd;
+  uint16_t port;
+  std::vector<uint8_t> data;
+  uint32_t reads;               /* The recv calls which returned data */
+  uint32_t connections;
+} sink_t;
+
+/**
+ * Opens an sink on an free loopback port
+ * 
+ * @param sink the sink
+ */
+static void sink_open(sink_t *sink) {
+  struct sockaddr_in addr;
+  socklen_t len = sizeof (addr);
+  int32_t one = 1;
+
+  memset(&addr, 0, sizeof (addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(sink->port);
+
+  sink->listen_fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  setsockopt(sink->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof (one));
+  TEST_ASSERT_EQUAL(0, bind(sink->listen_fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof (addr)));
+  TEST_ASSERT_EQUAL(0, listen(sink->listen_fd, 4));
+  fcntl(sink->listen_fd, F_SETFL, fcntl(sink->listen_fd, F_GETFL, 0) | O_NONBLOCK);
+
+  getsockname(sink->listen_fd, reinterpret_cast<struct sockaddr *>(&addr), &len);
+  sink->port = ntohs(addr.sin_port);
+  sink->fd = -1;
+}
+
+/**
+ * Accepts an connection if there is none, and reads what is there
+ * 
+ * @param sink the sink
+ */
+static void sink_pump(sink_t *sink) {
+  if (sink->fd < 0) {
+    sink->fd = accept(sink->listen_fd, nullptr, nullptr);
+    if (sink->fd < 0) return;
+
+    fcntl(sink->fd, F_SETFL, fcntl(sink->fd, F_GETFL, 0) | O_NONBLOCK);
+    ++sink->connections;
+  }
+
+  uint8_t buffer[65536];
+  for (;;) {
+    ssize_t rc = recv(sink->fd, buffer, sizeof (buffer), 0);
+    if (rc > 0) {
+      sink->data.insert(sink->data.end(), buffer, buffer + rc);
+      ++sink->reads;
+    } else {
+      if (rc == 0) {
+        close(sink->fd);
+        sink->fd = -1;
+      }
+
+      return;
+    }
+  }
+}
+
+/**
+ * Closes the sink and its connection
+ * 
+ * @param sink the sink
+ */
+static void sink_close(sink_t *sink) {
+  if (sink->fd >= 0) close(sink->fd);
+  if (sink->listen_fd >= 0) close(sink->listen_fd);
+  sink->fd = -1;
+  sink->listen_fd = -1;
+}
+
+/**
+ * Drops the connection like an server which went away
+ * 
+ * @param sink the sink
+ */
+static void sink_drop(sink_t *sink) {
+  if (sink->fd >= 0) close(sink->fd);
+  sink->fd = -1;
+}
+
+/**
+ * Makes an packet which starts with its sequence number
+ * 
+ * @param packet the output packet (TEST_PACKET_SIZE bytes)
+ * @param seq the sequence number
+ */
+static void make_packet(uint8_t *packet, uint32_t seq) {
+  memcpy(packet, &seq, sizeof (seq));
+  for (size_t i = sizeof (seq); i < TEST_PACKET_SIZE; ++i) packet[i] = static_cast<uint8_t>(seq + i);
+}
+
+/**
+ * Parses the binary records the sink received into their sequence numbers
+ *  and checks the records themselves
+ * 
+ * @param data the received bytes
+ * @param seqs the output sequence numbers
+ */
+static void parse_records(const std::vector<uint8_t> &data, std::vector<uint32_t> &seqs) {
+  uint8_t expected[TEST_PACKET_SIZE];
+  size_t pos = 0;
+  while (pos < data.size()) {
+    TEST_ASSERT_TRUE(pos + SERVER_RECORD_HEADER_SIZE <= data.size());
+    size_t length = data[pos] | (data[pos + 1] << 8);
+    TEST_ASSERT_EQUAL(SERVER_RECORD_HEADER_SIZE - 2 + TEST_PACKET_SIZE, length);
+    TEST_ASSERT_TRUE(pos + 2 + length <= data.size());
+
+    uint32_t seq;
+    memcpy(&seq, &data[pos + SERVER_RECORD_HEADER_SIZE], sizeof (seq));
+    make_packet(expected, seq);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, &data[pos + SERVER_RECORD_HEADER_SIZE], TEST_PACKET_SIZE);
+    TEST_ASSERT_EQUAL(-70, static_cast<int16_t>(data[pos + 10] | (data[pos + 11] << 8)));
+
+    seqs.push_back(seq);
+    pos += 2 + length;
+  }
+}
+
+/**
+ * Polls the connection and pumps the sink until the connection is made
+ * 
+ * @param conn the connection
+ * @param sink the sink
+ */
+static void wait_connected(ServerConnection *conn, sink_t *sink) {
+  for (int32_t i = 0; i < 1000 && conn->getState() != SERVER_STATE_CONNECTED; ++i) {
+    conn->poll();
+    sink_pump(sink);
+  }
+
+  TEST_ASSERT_EQUAL(SERVER_STATE_CONNECTED, conn->getState());
+}
+
+/**
+ * Polls the connection and pumps the sink until the sink has an number
+ *  of bytes
+ * 
+ * @param conn the connection
+ * @param sink the sink
+ * @param size the number of bytes
+ */
+static void drain(ServerConnection *conn, sink_t *sink, size_t size) {
+  auto started = std::chrono::steady_clock::now();
+  while (sink->data.size() < size && std::chrono::steady_clock::now() - started < std::chrono::seconds(5)) {
+    conn->flush();
+    conn->poll();
+    sink_pump(sink);
+  }
+}
+
+/**
+ * Polls the connection until an connection attempt is made and finished
+ * 
+ * @param conn the connection
+ * @return true if an attempt was made and failed
+ */
+static bool attempt_failed(ServerConnection *conn) {
+  int32_t rc = conn->poll();
+  for (int32_t i = 0; i < 1000 && conn->getState() == SERVER_STATE_CONNECTING; ++i) rc = conn->poll();
+  return rc < 0 && conn->getState() == SERVER_STATE_DISCONNECTED;
+}
+
+/**
+ * Writes packets with consecutive sequence numbers, the connection is polled
+ *  after each like the receiver task does
+ * 
+ * @param conn the connection
+ * @param sink the sink
+ * @param first the first sequence number
+ * @param count the number of packets
+ * @return the number of packets the connection refused
+ */
+static uint32_t write_packets(ServerConnection *conn, sink_t *sink, uint32_t first, uint32_t count) {
+  uint8_t packet[TEST_PACKET_SIZE];
+  uint32_t refused = 0;
+  for (uint32_t seq = first; seq < first + count; ++seq) {
+    make_packet(packet, seq);
+    if (conn->writePacket(packet, sizeof (packet), -70, 9.5f, seq) != 0) ++refused;
+    conn->poll();
+    sink_pump(sink);
+  }
+
+  return refused;
+}
+
+/**
+ * Polls the connection and pumps the sink until the record of an sequence
+ *  number was the last one received
+ * 
+ * @param conn the connection
+ * @param sink the sink
+ * @param seq the sequence number
+ */
+static void drain_until(ServerConnection *conn, sink_t *sink, uint32_t seq) {
+  auto started = std::chrono::steady_clock::now();
+  while (std::chrono::steady_clock::now() - started < std::chrono::seconds(5)) {
+    conn->flush();
+    conn->poll();
+    sink_pump(sink);
+
+    uint32_t last;
+    size_t size = sink->data.size();
+    if (size == 0 || size % TEST_RECORD_SIZE != 0) continue;
+    memcpy(&last, &sink->data[size - TEST_PACKET_SIZE], sizeof (last));
+    if (last == seq) return;
+  }
+}
+
+static ServerConnection *g_Conn = nullptr;
+static sink_t g_Sink;
+
+void setUp() {
+  g_Sink = sink_t();
+  sink_open(&g_Sink);
+  g_Conn = new ServerConnection("127.0.0.1", g_Sink.port, SERVER_FRAMING_BINARY);
+  g_Conn->initConn();
+}
+
+void tearDown() {
+  g_Conn->closeConn();
+  g_Conn->poll();
+  delete g_Conn;
+  sink_close(&g_Sink);
+}
+
+static void test_delivers_in_order() {
+  uint8_t packet[TEST_PACKET_SIZE];
+  wait_connected(g_Conn, &g_Sink);
+
+  for (uint32_t seq = 0; seq < 1000; ++seq) {
+    make_packet(packet, seq);
+    TEST_ASSERT_EQUAL(0, g_Conn->writePacket(packet, sizeof (packet), -70, 9.5f, seq));
+    g_Conn->poll();
+    sink_pump(&g_Sink);
+  }
+
+  drain(g_Conn, &g_Sink, 1000 * TEST_RECORD_SIZE);
+
+  std::vector<uint32_t> seqs;
+  parse_records(g_Sink.data, seqs);
+  TEST_ASSERT_EQUAL(1000, seqs.size());
+  for (uint32_t seq = 0; seq < 1000; ++seq) TEST_ASSERT_EQUAL(seq, seqs[seq]);
+  TEST_ASSERT_EQUAL(0, g_Conn->getDropped());
+}
+
+/* The line format the server has always understood */
+static void test_hex_framing() {
+  const uint8_t packet[] = { 0x43, 0x42, 0x58, 0x02, 0x00, 0xFF };
+  ServerConnection conn("127.0.0.1", g_Sink.port, SERVER_FRAMING_HEX);
+  conn.initConn();
+  wait_connected(&conn, &g_Sink);
+
+  conn.writePacket(packet, sizeof (packet));
+  conn.writePacket(packet, 2);
+  drain(&conn, &g_Sink, 18);
+
+  std::string lines(g_Sink.data.begin(), g_Sink.data.end());
+  TEST_ASSERT_EQUAL_STRING("4342580200ff\n4342\n", lines.c_str());
+  conn.closeConn();
+  conn.poll();
+}
+
+/* Without an server the attempts back off from the minimum to the maximum,
+ * and once connected the backoff starts over */
+static void test_backoff() {
+  sink_close(&g_Sink);
+  TEST_ASSERT_TRUE(attempt_failed(g_Conn));
+
+  uint32_t backoff = GLOBAL_SERVER_RECONNECT_MIN;
+  for (int32_t i = 0; i < 10; ++i) {
+    sim_advance_time((backoff - 50) * 1000LL);
+    TEST_ASSERT_FALSE(attempt_failed(g_Conn));
+    sim_advance_time(100 * 1000LL);
+    TEST_ASSERT_TRUE(attempt_failed(g_Conn));
+    backoff = backoff * 2 > GLOBAL_SERVER_RECONNECT_MAX ? GLOBAL_SERVER_RECONNECT_MAX : backoff * 2;
+  }
+
+  TEST_ASSERT_EQUAL(GLOBAL_SERVER_RECONNECT_MAX, backoff);
+  TEST_ASSERT_EQUAL(0, g_Conn->getReconnects());
+
+  /* The server comes back */
+  sink_open(&g_Sink);
+  sim_advance_time(backoff * 1000LL);
+  wait_connected(g_Conn, &g_Sink);
+  TEST_ASSERT_EQUAL(1, g_Conn->getReconnects());
+
+  /* And goes away again, the next attempt is made after the minimum */
+  sink_close(&g_Sink);
+  for (int32_t i = 0; i < 1000 && g_Conn->getState() == SERVER_STATE_CONNECTED; ++i) g_Conn->poll();
+  TEST_ASSERT_EQUAL(SERVER_STATE_DISCONNECTED, g_Conn->getState());
+  sim_advance_time((GLOBAL_SERVER_RECONNECT_MIN - 50) * 1000LL);
+  TEST_ASSERT_FALSE(attempt_failed(g_Conn));
+  sim_advance_time(100 * 1000LL);
+  TEST_ASSERT_TRUE(attempt_failed(g_Conn));
+}
+
+/* The server drops the connection, the packets written in the meantime and
+ * the last ones sent before the drop are delivered after the reconnect */
+static void test_replay_after_drop() {
+  wait_connected(g_Conn, &g_Sink);
+  TEST_ASSERT_EQUAL(0, write_packets(g_Conn, &g_Sink, 0, 100));
+  drain_until(g_Conn, &g_Sink, 99);
+
+  sink_drop(&g_Sink);
+  for (int32_t i = 0; i < 1000 && g_Conn->getState() == SERVER_STATE_CONNECTED; ++i) g_Conn->poll();
+  TEST_ASSERT_EQUAL(SERVER_STATE_DISCONNECTED, g_Conn->getState());
+  TEST_ASSERT_EQUAL(0, write_packets(g_Conn, &g_Sink, 100, 30));
+  TEST_ASSERT_EQUAL(1, g_Sink.connections);
+
+  sim_advance_time(GLOBAL_SERVER_RECONNECT_MIN * 1000LL);
+  wait_connected(g_Conn, &g_Sink);
+  drain_until(g_Conn, &g_Sink, 129);
+  TEST_ASSERT_EQUAL(2, g_Sink.connections);
+
+  /* Every packet arrived, in order, the second connection starts with
+   * an replay of at most the replay window */
+  std::vector<uint32_t> seqs;
+  parse_records(g_Sink.data, seqs);
+  size_t restart = 0;
+  for (size_t i = 1; i < seqs.size(); ++i) {
+    if (seqs[i] == seqs[i - 1] + 1) continue;
+    TEST_ASSERT_EQUAL(0, restart);
+    TEST_ASSERT_LESS_THAN(seqs[i - 1] + 1, seqs[i]);
+    restart = i;
+  }
+
+  TEST_ASSERT_EQUAL(100, restart);
+  TEST_ASSERT_EQUAL(0, seqs.front());
+  TEST_ASSERT_EQUAL(129, seqs.back());
+  TEST_ASSERT_LESS_OR_EQUAL(GLOBAL_SERVER_REPLAY_SIZE / TEST_RECORD_SIZE + 1, seqs.size() - 130);
+  TEST_ASSERT_EQUAL(0, g_Conn->getDropped());
+}
+
+/* While the server is down the ring fills up, the oldest packets are kept
+ * and delivered once it is back */
+static void test_spill_while_down() {
+  const uint32_t fit = GLOBAL_SERVER_BUFFER_SIZE / TEST_RECORD_SIZE;
+  sink_close(&g_Sink);
+
+  TEST_ASSERT_EQUAL(50, write_packets(g_Conn, &g_Sink, 0, fit + 50));
+  TEST_ASSERT_EQUAL(50, g_Conn->getDropped());
+  TEST_ASSERT_EQUAL(fit * TEST_RECORD_SIZE, g_Conn->getBuffered());
+
+  sink_open(&g_Sink);
+  sim_advance_time(GLOBAL_SERVER_RECONNECT_MAX * 1000LL);
+  wait_connected(g_Conn, &g_Sink);
+  drain_until(g_Conn, &g_Sink, fit - 1);
+
+  std::vector<uint32_t> seqs;
+  parse_records(g_Sink.data, seqs);
+  TEST_ASSERT_EQUAL(fit, seqs.size());
+  for (uint32_t seq = 0; seq < fit; ++seq) TEST_ASSERT_EQUAL(seq, seqs[seq]);
+}
+
+/**
+ * Benchmarks sending every packet on its own against writing them through
+ *  the connection, which coalesces them into segments
+ */
+static void test_bench_coalescing() {
+  const uint32_t count = 20000;
+  const size_t record_size = TEST_RECORD_SIZE;
+  uint8_t record[record_size];
+  memset(record, 0, SERVER_RECORD_HEADER_SIZE);
+  make_packet(&record[SERVER_RECORD_HEADER_SIZE], 0);
+
+  /* An socket like the old connection had, with one send per packet */
+  int32_t fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP), one = 1;
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof (addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(g_Sink.port);
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof (one));
+  TEST_ASSERT_EQUAL(0, connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof (addr)));
+
+  auto started = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < count; ++i) {
+    TEST_ASSERT_EQUAL(record_size, send(fd, record, record_size, MSG_NOSIGNAL));
+    sink_pump(&g_Sink);
+  }
+
+  while (g_Sink.data.size() < count * record_size) sink_pump(&g_Sink);
+  double single_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - started).count();
+  uint32_t single_reads = g_Sink.reads;
+  close(fd);
+  while (g_Sink.fd >= 0) sink_pump(&g_Sink);
+
+  /* The same packets through the connection */
+  g_Sink.data.clear();
+  g_Sink.reads = 0;
+  wait_connected(g_Conn, &g_Sink);
+  stats_stage_snapshot_t before, after;
+  stats_snapshot(STATS_SERVER_FLUSH, &before);
+
+  started = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < count; ++i) {
+    TEST_ASSERT_EQUAL(0, g_Conn->writePacket(&record[SERVER_RECORD_HEADER_SIZE], TEST_PACKET_SIZE));
+    g_Conn->poll();
+    sink_pump(&g_Sink);
+  }
+
+  drain(g_Conn, &g_Sink, count * record_size);
+  double coalesced_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - started).count();
+  stats_snapshot(STATS_SERVER_FLUSH, &after);
+  TEST_ASSERT_EQUAL(count * record_size, g_Sink.data.size());
+
+  char message[200];
+  snprintf(message, sizeof (message), "server uplink, %u packets of %u bytes: one send each %.2f us/packet, "
+    "%u reads; coalesced %.2f us/packet, %u sends, %u reads", count, TEST_PACKET_SIZE, single_us / count,
+    single_reads, coalesced_us / count, after.count - before.count, g_Sink.reads);
+  TEST_MESSAGE(message);
+
+  /* An send per segment or less */
+  TEST_ASSERT_LESS_OR_EQUAL(count * record_size / GLOBAL_SERVER_FLUSH_SIZE + 1, after.count - before.count);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_delivers_in_order);
+  RUN_TEST(test_hex_framing);
+  RUN_TEST(test_backoff);
+  RUN_TEST(test_replay_after_drop);
+  RUN_TEST(test_spill_while_down);
+  RUN_TEST(test_bench_coalescing);
+  return UNITY_END();
+}
@@ -0,0 +1,168 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#include <unity.h>
+
+#include "sketch.h"
+
+static sketch_t g_Source, g_Merged;
+
+/**
+ * Adds an range of numbered MACs to an sketch, every fourth one randomized
+ *
+ * @param sketch the sketch
+ * @param first the number of the first MAC
+ * @param count the number of MACs
+ */
+static void add_macs(sketch_t *sketch, uint32_t first, uint32_t count) {
+  for (uint32_t n = first; n < first + count; ++n) {
+    const uint8_t mac[6] = { static_cast<uint8_t>(n % 4 == 0 ? 0x02 : 0x00), 0x11,
+      static_cast<uint8_t>(n % 3), static_cast<uint8_t>(n >> 16),
+      static_cast<uint8_t>(n >> 8), static_cast<uint8_t>(n) };
+    sketch_add(sketch, mac);
+  }
+}
+
+/**
+ * Encodes every part of an sketch and merges it into another
+ *
+ * @param to the sketch to merge into
+ * @param from the sketch to be encoded
+ * @param window the window in seconds
+ */
+static void merge_all(sketch_t *to, const sketch_t *from, uint16_t window) {
+  uint8_t part[SKETCH_PART_MAX_SIZE];
+  for (uint8_t i = 0; i < SKETCH_PART_COUNT; ++i) {
+    size_t size = sketch_encode_part(from, i, window, part, sizeof (part));
+    TEST_ASSERT_NOT_EQUAL(0, size);
+    TEST_ASSERT_EQUAL(0, sketch_merge_part(to, part, size));
+  }
+}
+
+void setUp() {
+  sketch_clear(&g_Source);
+  sketch_clear(&g_Merged);
+  add_macs(&g_Source, 0, 1000);
+}
+
+void tearDown() {}
+
+/* Every part merged into an empty sketch gives the source back */
+static void test_parts_round_trip() {
+  merge_all(&g_Merged, &g_Source, 60);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(g_Source.hll, g_Merged.hll, sizeof (g_Source.hll));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(g_Source.cms, g_Merged.cms, sizeof (g_Source.cms));
+  TEST_ASSERT_EQUAL(60, g_Merged.window);
+}
+
+/* Every register value which fits the 6 bits survives the packing */
+static void test_registers_round_trip() {
+  for (size_t i = 0; i < SKETCH_HLL_REGISTERS; ++i) g_Source.hll[i] = (i * 7) % 64;
+
+  uint8_t part[SKETCH_PART_MAX_SIZE];
+  size_t size = sketch_encode_part(&g_Source, 0, 60, part, sizeof (part));
+  TEST_ASSERT_EQUAL(SKETCH_PART_HEADER_SIZE + SKETCH_HLL_REGISTERS * 6 / 8, size);
+  TEST_ASSERT_EQUAL(SKETCH_PART_HLL, part[0]);
+  TEST_ASSERT_EQUAL(0, part[1]);
+  TEST_ASSERT_EQUAL(0, sketch_merge_part(&g_Merged, part, size));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(g_Source.hll, g_Merged.hll, sizeof (g_Source.hll));
+}
+
+static void test_encode_rejects() {
+  uint8_t part[SKETCH_PART_MAX_SIZE];
+  TEST_ASSERT_EQUAL(0, sketch_encode_part(&g_Source, SKETCH_PART_COUNT, 60, part, sizeof (part)));
+  TEST_ASSERT_EQUAL(0, sketch_encode_part(&g_Source, 1, 60, part, sizeof (part) - 1));
+}
+
+static void test_merge_rejects() {
+  uint8_t hll[SKETCH_PART_MAX_SIZE], cms[SKETCH_PART_MAX_SIZE], in[SKETCH_PART_MAX_SIZE + 1];
+  size_t hll_size = sketch_encode_part(&g_Source, 0, 60, hll, sizeof (hll));
+  size_t cms_size = sketch_encode_part(&g_Source, SKETCH_CMS_DEPTH, 60, cms, sizeof (cms));
+
+  /* An wrong kind */
+  const uint8_t kinds[] = { 0, SKETCH_PART_CMS + 1, 0xFF };
+  for (uint8_t kind : kinds) {
+    memcpy(in, cms, cms_size);
+    in[0] = kind;
+    TEST_ASSERT_EQUAL(-1, sketch_merge_part(&g_Merged, in, cms_size));
+  }
+
+  /* An wrong index */
+  memcpy(in, hll, hll_size);
+  in[1] = 1;
+  TEST_ASSERT_EQUAL(-1, sketch_merge_part(&g_Merged, in, hll_size));
+  memcpy(in, cms, cms_size);
+  in[1] = SKETCH_CMS_DEPTH;
+  TEST_ASSERT_EQUAL(-1, sketch_merge_part(&g_Merged, in, cms_size));
+
+  /* An wrong size, shorter, longer or without an header */
+  TEST_ASSERT_EQUAL(-1, sketch_merge_part(&g_Merged, hll, hll_size - 1));
+  TEST_ASSERT_EQUAL(-1, sketch_merge_part(&g_Merged, cms, cms_size - 1));
+  memcpy(in, hll, hll_size);
+  TEST_ASSERT_EQUAL(-1, sketch_merge_part(&g_Merged, in, hll_size + 1));
+  memcpy(in, cms, cms_size);
+  TEST_ASSERT_EQUAL(-1, sketch_merge_part(&g_Merged, in, cms_size + 1));
+  for (size_t size = 0; size < SKETCH_PART_HEADER_SIZE; ++size)
+    TEST_ASSERT_EQUAL(-1, sketch_merge_part(&g_Merged, cms, size));
+
+  /* Nothing was merged */
+  TEST_ASSERT_TRUE(sketch_empty(&g_Merged));
+  TEST_ASSERT_EQUAL(0, g_Merged.window);
+}
+
+/* Two nodes merge into the register maximum and the counter sum, the sum
+ * saturates and the longest window is kept */
+static void test_merge_two_nodes() {
+  sketch_t other;
+  sketch_clear(&other);
+  add_macs(&other, 500, 1000);
+  other.cms[0][0] = 0xFFF0;
+  g_Source.cms[0][0] = 0x20;
+
+  merge_all(&g_Merged, &g_Source, 60);
+  merge_all(&g_Merged, &other, 120);
+
+  for (size_t i = 0; i < SKETCH_HLL_REGISTERS; ++i)
+    TEST_ASSERT_EQUAL(g_Source.hll[i] > other.hll[i] ? g_Source.hll[i] : other.hll[i], g_Merged.hll[i]);
+
+  TEST_ASSERT_EQUAL(0xFFFF, g_Merged.cms[0][0]);
+  for (size_t row = 0; row < SKETCH_CMS_DEPTH; ++row) {
+    for (size_t i = row == 0 ? 1 : 0; i < SKETCH_CMS_WIDTH; ++i)
+      TEST_ASSERT_EQUAL(g_Source.cms[row][i] + other.cms[row][i], g_Merged.cms[row][i]);
+  }
+
+  TEST_ASSERT_EQUAL(120, g_Merged.window);
+
+  /* The union of the 1500 distinct MACs, within the error of the registers */
+  TEST_ASSERT_UINT32_WITHIN(1500 * 3 / 10, 1500, sketch_estimate(&g_Merged));
+}
+
+static void test_serialize() {
+  g_Source.window = 0x1234;
+  uint8_t out[SKETCH_FRAME_SIZE];
+  TEST_ASSERT_EQUAL(0, sketch_serialize(&g_Source, out, sizeof (out) - 1));
+  TEST_ASSERT_EQUAL(SKETCH_FRAME_SIZE, sketch_serialize(&g_Source, out, sizeof (out)));
+
+  const uint8_t header[] = { 'C', 'B', 'X', 'K', SKETCH_FRAME_VERSION, SKETCH_HLL_BITS,
+    SKETCH_CMS_DEPTH, SKETCH_CMS_WIDTH, 0x34, 0x12 };
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(header, out, sizeof (header));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(g_Source.hll, &out[sizeof (header)], SKETCH_HLL_REGISTERS);
+
+  const uint8_t *counters = &out[sizeof (header) + SKETCH_HLL_REGISTERS];
+  for (size_t row = 0; row < SKETCH_CMS_DEPTH; ++row) {
+    for (size_t i = 0; i < SKETCH_CMS_WIDTH; ++i, counters += 2)
+      TEST_ASSERT_EQUAL(g_Source.cms[row][i], counters[0] | (counters[1] << 8));
+  }
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_parts_round_trip);
+  RUN_TEST(test_registers_round_trip);
+  RUN_TEST(test_encode_rejects);
+  RUN_TEST(test_merge_rejects);
+  RUN_TEST(test_merge_two_nodes);
+  RUN_TEST(test_serialize);
+  return UNITY_END();
+}
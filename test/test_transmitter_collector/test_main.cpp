@@ -0,0 +1,234 @@
+/*
+  Copyright Cybox 2020 - Written by Luke A.C.A. Rieff
+*/
+
+#include <unity.h>
+
+#include "main_transmitter.h"
+
+static measurement_batch_t g_Batch;
+static mac_set_t g_Set;
+static bloom_pair_t g_Reported;
+static bloom_pair_t g_Refreshed;
+
+/**
+ * Makes an sighting of an numbered MAC
+ * 
+ * @param m the output sighting
+ * @param n the number of the MAC
+ */
+static void make_sighting(sighting_t *m, uint32_t n) {
+  memset(m, 0, sizeof (sighting_t));
+  m->mac[0] = 0x24;
+  m->mac[1] = 0x0A;
+  m->mac[2] = 0xC4;
+  m->mac[3] = n >> 16;
+  m->mac[4] = n >> 8;
+  m->mac[5] = n;
+  m->rssi = -60;
+  m->channel = 6;
+  m->fingerprint = FINGERPRINT_NONE;
+}
+
+/**
+ * Collects an sighting of an numbered MAC
+ * 
+ * @param n the number of the MAC
+ */
+static lora_collect_t collect(uint32_t n) {
+  sighting_t m;
+  make_sighting(&m, n);
+  return lora_collect(&g_Batch, &g_Set, &g_Reported, &g_Refreshed, &m, 0);
+}
+
+/**
+ * Reports the MACs of an range in an earlier batch, within the refresh
+ *  interval
+ * 
+ * @param first the first MAC
+ * @param count the number of MACs
+ */
+static void report(uint32_t first, uint32_t count) {
+  sighting_t m;
+  for (uint32_t n = first; n < first + count; ++n) {
+    make_sighting(&m, n);
+    bloom_pair_insert(&g_Reported, m.mac);
+    bloom_pair_insert(&g_Refreshed, m.mac);
+  }
+}
+
+/**
+ * Lets the refresh interval of the reported MACs pass, by rotating both
+ *  filters of the refreshed MACs
+ */
+static void refresh_interval_over() {
+  bloom_pair_rotate(&g_Refreshed, GLOBAL_REFRESH_INTERVAL * 1000LL);
+  bloom_pair_rotate(&g_Refreshed, 2 * GLOBAL_REFRESH_INTERVAL * 1000LL);
+}
+
+/**
+ * Starts the next batch, like the collector does after an swap
+ */
+static void next_batch() {
+  mac_set_clear(&g_Set);
+  presence_clear(&g_Batch.records, 0);
+  g_Batch.refreshed_count = 0;
+}
+
+void setUp() {
+  mac_set_init(&g_Set);
+  bloom_pair_init(&g_Reported, GLOBAL_BLOOM_ROTATE_INTERVAL, 0);
+  bloom_pair_init(&g_Refreshed, GLOBAL_REFRESH_INTERVAL, 0);
+  presence_clear(&g_Batch.records, 0);
+  g_Batch.refreshed_count = 0;
+}
+
+void tearDown() {}
+
+static void test_new_and_duplicate() {
+  TEST_ASSERT_EQUAL(LORA_COLLECT_NEW, collect(1));
+  TEST_ASSERT_EQUAL(LORA_COLLECT_DUPLICATE, collect(1));
+  TEST_ASSERT_EQUAL(LORA_COLLECT_NEW, collect(2));
+  TEST_ASSERT_EQUAL(2, g_Batch.records.count);
+}
+
+static void test_suppressed() {
+  report(1, 1);
+  TEST_ASSERT_EQUAL(LORA_COLLECT_SUPPRESSED, collect(1));
+  TEST_ASSERT_EQUAL(LORA_COLLECT_DUPLICATE, collect(1));
+  TEST_ASSERT_EQUAL(0, g_Batch.records.count);
+}
+
+/* An suppressed MAC is sent as MAC only once its refresh interval is over,
+ * and not again until the next one is */
+static void test_refreshed() {
+  report(1, 1);
+  refresh_interval_over();
+  TEST_ASSERT_EQUAL(LORA_COLLECT_SUPPRESSED, collect(1));
+  TEST_ASSERT_EQUAL(LORA_COLLECT_DUPLICATE, collect(1));
+  TEST_ASSERT_EQUAL(0, g_Batch.records.count);
+  TEST_ASSERT_EQUAL(1, g_Batch.refreshed_count);
+
+  sighting_t m;
+  make_sighting(&m, 1);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(m.mac, g_Batch.refreshed[0].mac, 6);
+
+  next_batch();
+  TEST_ASSERT_EQUAL(LORA_COLLECT_SUPPRESSED, collect(1));
+  TEST_ASSERT_EQUAL(0, g_Batch.refreshed_count);
+}
+
+/* The MACs which do not fit in the refreshes of the batch are refreshed with
+ * the next one */
+static void test_refreshes_full() {
+  report(0, GLOBAL_REFRESH_BUFFER_SIZE + 1);
+  refresh_interval_over();
+  for (uint32_t n = 0; n <= GLOBAL_REFRESH_BUFFER_SIZE; ++n) TEST_ASSERT_NOT_EQUAL(LORA_COLLECT_NEW, collect(n));
+  TEST_ASSERT_EQUAL(GLOBAL_REFRESH_BUFFER_SIZE, g_Batch.refreshed_count);
+
+  next_batch();
+  collect(GLOBAL_REFRESH_BUFFER_SIZE);
+  collect(0);
+  TEST_ASSERT_EQUAL(1, g_Batch.refreshed_count);
+}
+
+/* More MACs which were reported already than the batch holds arrive before
+ * an new one, the new one still gets its record */
+static void test_suppressed_do_not_fill_the_set() {
+  const uint32_t reported = 3 * GLOBAL_MEASUREMENT_BUFFER_SIZE;
+  report(0, reported);
+
+  const uint32_t spare = GLOBAL_MAC_SET_CAPACITY / 2 - GLOBAL_MEASUREMENT_BUFFER_SIZE;
+  for (uint32_t n = 0; n < reported; ++n)
+    TEST_ASSERT_EQUAL(n < spare ? LORA_COLLECT_SUPPRESSED : LORA_COLLECT_UNTRACKED, collect(n));
+  TEST_ASSERT_EQUAL(LORA_COLLECT_NEW, collect(reported));
+  TEST_ASSERT_EQUAL(1, g_Batch.records.count);
+
+  /* The ones the set remembers are skipped with an single lookup, the rest
+   * are checked against the filters again */
+  TEST_ASSERT_EQUAL(LORA_COLLECT_DUPLICATE, collect(0));
+  TEST_ASSERT_EQUAL(LORA_COLLECT_UNTRACKED, collect(reported - 1));
+
+  /* And the batch can still be filled completely, with the suppressed MACs
+   * coming in between */
+  for (uint32_t n = 1; n < GLOBAL_MEASUREMENT_BUFFER_SIZE; ++n) {
+    TEST_ASSERT_EQUAL(LORA_COLLECT_NEW, collect(reported + n));
+    TEST_ASSERT_NOT_EQUAL(LORA_COLLECT_NEW, collect(n));
+  }
+
+  TEST_ASSERT_EQUAL(GLOBAL_MEASUREMENT_BUFFER_SIZE, g_Batch.records.count);
+}
+
+/* The records stay attached to their MACs while the suppressed MACs come in
+ * between */
+static void test_records_follow_their_macs() {
+  report(1000, 50);
+  for (uint32_t n = 0; n < 50; ++n) {
+    TEST_ASSERT_EQUAL(LORA_COLLECT_NEW, collect(n));
+    TEST_ASSERT_EQUAL(LORA_COLLECT_SUPPRESSED, collect(1000 + n));
+  }
+
+  for (uint32_t n = 0; n < 50; ++n) {
+    sighting_t m;
+    make_sighting(&m, n);
+    uint16_t *index = mac_set_find(&g_Set, m.mac);
+    TEST_ASSERT_NOT_NULL(index);
+    TEST_ASSERT_EQUAL(n, *index);
+  }
+}
+
+/* An full set refuses the MAC without marking it as reported, so it is
+ * collected as new once the batch has been flushed */
+static void test_full_set() {
+  sighting_t m;
+  bool inserted;
+  for (uint32_t n = 0; n < GLOBAL_MAC_SET_CAPACITY / 2; ++n) {
+    make_sighting(&m, 5000 + n);
+    mac_set_emplace(&g_Set, m.mac, &inserted);
+  }
+
+  TEST_ASSERT_EQUAL(LORA_COLLECT_FULL, collect(1));
+  TEST_ASSERT_EQUAL(0, g_Batch.records.count);
+
+  mac_set_clear(&g_Set);
+  TEST_ASSERT_EQUAL(LORA_COLLECT_NEW, collect(1));
+}
+
+/* The size the flush decision is taken on never falls short of what the
+ * records take once encoded, whatever packets they end up in */
+static void test_size_bound() {
+  sighting_t m;
+  for (uint32_t n = 0; n < GLOBAL_MEASUREMENT_BUFFER_SIZE; ++n) {
+    make_sighting(&m, n * 7919);
+    m.mac[2] = n % 3;
+    lora_collect(&g_Batch, &g_Set, &g_Reported, &g_Refreshed, &m, n * 1000000LL);
+    m.channel = 1 + n % 11;
+    lora_collect(&g_Batch, &g_Set, &g_Reported, &g_Refreshed, &m, n * 2000000LL);
+  }
+
+  size_t bound = presence_size_bound(&g_Batch.records), encoded = 0;
+  presence_sort(&g_Batch.records);
+
+  uint8_t out[GLOBAL_LORA_PAYLOAD_SIZE];
+  for (size_t i = 0, consumed; i < g_Batch.records.count; i += consumed) {
+    size_t size = presence_encode(out, sizeof (out), &g_Batch.records, i,
+      GLOBAL_MEASUREMENT_BUFFER_SIZE * 2000000LL, &consumed);
+    TEST_ASSERT_GREATER_THAN(0, consumed);
+    encoded += size - PRESENCE_PACKET_OVERHEAD;
+  }
+
+  TEST_ASSERT_LESS_OR_EQUAL(bound, encoded);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_new_and_duplicate);
+  RUN_TEST(test_suppressed);
+  RUN_TEST(test_refreshed);
+  RUN_TEST(test_refreshes_full);
+  RUN_TEST(test_suppressed_do_not_fill_the_set);
+  RUN_TEST(test_records_follow_their_macs);
+  RUN_TEST(test_full_set);
+  RUN_TEST(test_size_bound);
+  return UNITY_END();
+}